@@ -47,6 +47,7 @@ REM apidump
 py -3 %VT_SCRIPTS%/lvl_genvk.py -registry %REGISTRY% api_dump.cpp
 py -3 %VT_SCRIPTS%/lvl_genvk.py -registry %REGISTRY% api_dump_text.h
 py -3 %VT_SCRIPTS%/lvl_genvk.py -registry %REGISTRY% api_dump_html.h
+py -3 %VT_SCRIPTS%/lvl_genvk.py -registry %REGISTRY% api_dump_binary.h
 
 REM vktrace
 py -3 %VT_SCRIPTS%/lvl_genvk.py -registry %REGISTRY% vktrace_vk_vk.h
@@ -18,7 +18,165 @@
 #include "command_buffer_tree.h"
 #include "command_viz.h"
 
-void CommandBufferTree::AddCommandBuffer(const VkVizCommandBuffer& command_buffer) {
-    CommandBufferViz viz(command_buffer.Handle(), command_buffer.Commands());
-    buffer_tree_->addTopLevelItem(viz.ToWidget());
+#include <algorithm>
+
+namespace {
+
+// Rows are added under an expanded row this many at a time.
+const int kFetchBatchSize = 1000;
+
+enum NodeType { ROOT_NODE, COMMAND_BUFFER_NODE, COMMAND_NODE, STAGE_NODE, MEMORY_ACCESS_NODE };
+
+typedef std::pair<VkShaderStageFlagBits, std::vector<MemoryAccess>> StageAccesses;
+
+}  // namespace
+
+struct CommandBufferTree::Node {
+    NodeType type;
+    Node* parent;
+    int row;
+
+    // The VkVizCommandBuffer, CommandWrapper, StageAccesses or MemoryAccess shown in this row.
+    const void* item;
+
+    // The children fetched so far.
+    std::vector<std::unique_ptr<Node>> children;
+
+    Node(NodeType type, Node* parent, int row, const void* item) : type(type), parent(parent), row(row), item(item) {}
+
+    const CommandWrapper& Command() const { return *static_cast<const CommandWrapper*>(item); }
+
+    // Returns the number of children this row has once they are all fetched.
+    int ChildCount() const {
+        switch (type) {
+            case COMMAND_BUFFER_NODE:
+                return static_cast<const VkVizCommandBuffer*>(item)->Commands().size();
+            case COMMAND_NODE:
+                if (Command().VkVizType() == VkVizCommandType::ACCESS) {
+                    return dynamic_cast<const Access*>(Command().Unwrap().get())->accesses.size();
+                }
+                if (Command().VkVizType() == VkVizCommandType::DRAW) {
+                    return dynamic_cast<const DrawCommand*>(Command().Unwrap().get())->stage_accesses.size();
+                }
+                return 0;
+            case STAGE_NODE:
+                return static_cast<const StageAccesses*>(item)->second.size();
+            default:
+                return children.size();
+        }
+    }
+
+    // Creates the node for the given child row.
+    std::unique_ptr<Node> MakeChild(int child_row) {
+        switch (type) {
+            case COMMAND_BUFFER_NODE: {
+                const auto& commands = static_cast<const VkVizCommandBuffer*>(item)->Commands();
+                return std::unique_ptr<Node>(new Node(COMMAND_NODE, this, child_row, &commands[child_row]));
+            }
+            case COMMAND_NODE:
+                if (Command().VkVizType() == VkVizCommandType::ACCESS) {
+                    const auto& accesses = dynamic_cast<const Access*>(Command().Unwrap().get())->accesses;
+                    return std::unique_ptr<Node>(new Node(MEMORY_ACCESS_NODE, this, child_row, &accesses[child_row]));
+                } else {
+                    const auto& stages = dynamic_cast<const DrawCommand*>(Command().Unwrap().get())->stage_accesses;
+                    return std::unique_ptr<Node>(new Node(STAGE_NODE, this, child_row, &stages[child_row]));
+                }
+            default: {
+                const auto& accesses = static_cast<const StageAccesses*>(item)->second;
+                return std::unique_ptr<Node>(new Node(MEMORY_ACCESS_NODE, this, child_row, &accesses[child_row]));
+            }
+        }
+    }
+
+    QString Text() const {
+        switch (type) {
+            case COMMAND_BUFFER_NODE:
+                return PointerToQString(static_cast<const VkVizCommandBuffer*>(item)->Handle());
+            case COMMAND_NODE:
+                return CmdToQString(Command().Unwrap()->type);
+            case STAGE_NODE:
+                return StageName(static_cast<const StageAccesses*>(item)->first);
+            case MEMORY_ACCESS_NODE:
+                return MemoryAccessToQString(*static_cast<const MemoryAccess*>(item));
+            default:
+                return QString();
+        }
+    }
+};
+
+CommandBufferTree::CommandBufferTree(QObject* parent)
+    : QAbstractItemModel(parent), root_(new Node(ROOT_NODE, nullptr, 0, nullptr)) {}
+
+CommandBufferTree::~CommandBufferTree() = default;
+
+CommandBufferTree::Node* CommandBufferTree::NodeFromIndex(const QModelIndex& index) const {
+    return index.isValid() ? static_cast<Node*>(index.internalPointer()) : root_.get();
+}
+
+void CommandBufferTree::AddCommandBuffer(VkVizCommandBuffer command_buffer) {
+    const int row = command_buffers_.size();
+    beginInsertRows(QModelIndex(), row, row);
+    command_buffers_.push_back(std::move(command_buffer));
+    root_->children.emplace_back(new Node(COMMAND_BUFFER_NODE, root_.get(), row, &command_buffers_.back()));
+    endInsertRows();
+}
+
+void CommandBufferTree::Clear() {
+    beginResetModel();
+    root_->children.clear();
+    command_buffers_.clear();
+    endResetModel();
+}
+
+QModelIndex CommandBufferTree::index(int row, int column, const QModelIndex& parent) const {
+    if (!hasIndex(row, column, parent)) return QModelIndex();
+    return createIndex(row, column, NodeFromIndex(parent)->children[row].get());
+}
+
+QModelIndex CommandBufferTree::parent(const QModelIndex& index) const {
+    if (!index.isValid()) return QModelIndex();
+    Node* parent = NodeFromIndex(index)->parent;
+    if (parent == root_.get()) return QModelIndex();
+    return createIndex(parent->row, 0, parent);
+}
+
+int CommandBufferTree::rowCount(const QModelIndex& parent) const {
+    if (parent.column() > 0) return 0;
+    return NodeFromIndex(parent)->children.size();
+}
+
+int CommandBufferTree::columnCount(const QModelIndex& parent) const { return 1; }
+
+bool CommandBufferTree::hasChildren(const QModelIndex& parent) const {
+    if (parent.column() > 0) return false;
+    return NodeFromIndex(parent)->ChildCount() > 0;
+}
+
+bool CommandBufferTree::canFetchMore(const QModelIndex& parent) const {
+    if (parent.column() > 0) return false;
+    const Node* node = NodeFromIndex(parent);
+    return static_cast<int>(node->children.size()) < node->ChildCount();
+}
+
+void CommandBufferTree::fetchMore(const QModelIndex& parent) {
+    if (!canFetchMore(parent)) return;
+    Node* node = NodeFromIndex(parent);
+    const int first = node->children.size();
+    const int last = std::min(node->ChildCount(), first + kFetchBatchSize) - 1;
+
+    beginInsertRows(parent, first, last);
+    for (int row = first; row <= last; ++row) {
+        node->children.push_back(node->MakeChild(row));
+    }
+    endInsertRows();
+}
+
+QVariant CommandBufferTree::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || role != Qt::DisplayRole) return QVariant();
+    return NodeFromIndex(index)->Text();
+}
+
+QVariant CommandBufferTree::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole || section != 0) return QVariant();
+    return QString("Submitted Buffers");
 }
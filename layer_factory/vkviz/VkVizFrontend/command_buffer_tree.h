@@ -18,28 +18,43 @@
 #ifndef COMMAND_BUFFER_TREE_H
 #define COMMAND_BUFFER_TREE_H
 
-#include <QLabel>
-#include <QTreeWidget>
+#include <QAbstractItemModel>
+
+#include <deque>
+#include <memory>
 
 #include "command_buffer.h"
 
-class CommandBufferTree {
-    QTreeWidget* buffer_tree_;
+// A tree model of submitted command buffers, their commands, and the memory those commands access. Rows are only created when a
+// view asks for them: a command buffer's commands are added in batches as its rows are scrolled into view, so expanding a buffer
+// with hundreds of thousands of commands stays fast.
+class CommandBufferTree : public QAbstractItemModel {
+    struct Node;
 
-    // Checks whether this view has any Command Buffers in it.
-    bool IsEmpty() { return buffer_tree_->columnCount() == 0; }
+    std::deque<VkVizCommandBuffer> command_buffers_;
+    std::unique_ptr<Node> root_;
 
-    // Adds a new command to the bottom of the last added command buffer.
-    void AddCommand(const CommandWrapper& command);
+    Node* NodeFromIndex(const QModelIndex& index) const;
 
    public:
-    CommandBufferTree(QTreeWidget* buffer_tree) : buffer_tree_(buffer_tree) {}
-
-    // Adds the given command buffer to this view.
-    void AddCommandBuffer(const VkVizCommandBuffer& command_buffer);
-
-    // Clears all the command buffers from this view.
-    void Clear() { buffer_tree_->clear(); }
+    explicit CommandBufferTree(QObject* parent = nullptr);
+    ~CommandBufferTree();
+
+    // Adds the given command buffer to this model.
+    void AddCommandBuffer(VkVizCommandBuffer command_buffer);
+
+    // Clears all the command buffers from this model.
+    void Clear();
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& index) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 };
 
 #endif  // COMMAND_BUFFER_TREE_H
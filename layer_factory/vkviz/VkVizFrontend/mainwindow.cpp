@@ -21,44 +21,65 @@
 #include "command_enums.h"
 #include "command_buffer.h"
 
+#include <QElapsedTimer>
+#include <QScrollBar>
 
-#include <fstream>
-#include <string>
-#include "third_party/json.hpp"
-#include <cassert>
+namespace {
 
-using json = nlohmann::json;
-std::vector<VkVizCommandBuffer> LoadFromFile(std::string filename) {
-    std::vector<VkVizCommandBuffer> buffers;
-    json j;
+// How long each step of loading a frame may block the event loop.
+const qint64 kLoadStepMilliseconds = 10;
 
-    std::ifstream file(filename);
-    file >> std::ws;
-    while(file.peek() == '{') {
-        file >> j;
-        buffers.emplace_back(j.get<VkVizCommandBuffer>());
-        file >> std::ws;
-    }
-    return buffers;
-}
+}  // namespace
 
-MainWindow::MainWindow(QWidget* parent)
-    : QMainWindow(parent),
-      ui(new Ui::MainWindow),
-      command_buffer_tree_(nullptr)  // Can't initialize until ui->setupUi is called.
-{
+MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), ui(new Ui::MainWindow) {
     ui->setupUi(this);
-
-    // Clear any example Command Buffers
-    command_buffer_tree_ = CommandBufferTree(ui->CmdBufferTree);
-    // command_buffer_view_.Clear();
+    ui->CmdBufferTree->setModel(&command_buffer_tree_);
 
     // Set the splits to be the same size
     ui->Splitter->setSizes({INT_MAX, INT_MAX});
 
-    std::vector<VkVizCommandBuffer> buffers = LoadFromFile("vkviz_frame_start");
-    for(const auto& buffer : buffers) {
-        command_buffer_tree_.AddCommandBuffer(buffer);
+    connect(&load_timer_, &QTimer::timeout, this, &MainWindow::LoadSomeCommandBuffers);
+    connect(ui->CmdBufferTree->verticalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::FetchVisibleRows);
+    connect(ui->CmdBufferTree, &QTreeView::expanded, this, &MainWindow::FetchVisibleRows);
+    connect(ui->FrameSelector, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &MainWindow::LoadFrame);
+
+    if (capture_.Open(kCaptureFileName) && capture_.FrameCount() > 0) {
+        ui->FrameSelector->setMaximum(capture_.FrameCount() - 1);
+        LoadFrame(0);
+    } else {
+        ui->FrameSelector->setEnabled(false);
+    }
+}
+
+void MainWindow::LoadFrame(int frame) {
+    command_buffer_tree_.Clear();
+    if (capture_.SeekFrame(frame)) {
+        load_timer_.start(0);
+    }
+}
+
+void MainWindow::LoadSomeCommandBuffers() {
+    QElapsedTimer elapsed;
+    elapsed.start();
+    VkVizCommandBuffer command_buffer;
+    while (elapsed.elapsed() < kLoadStepMilliseconds) {
+        if (!capture_.ReadCommandBuffer(&command_buffer)) {
+            load_timer_.stop();
+            return;
+        }
+        command_buffer_tree_.AddCommandBuffer(std::move(command_buffer));
+    }
+}
+
+void MainWindow::FetchVisibleRows() {
+    QTreeView* view = ui->CmdBufferTree;
+    const int bottom = view->viewport()->height();
+    for (QModelIndex index = view->indexAt(QPoint(0, 0)); index.isValid(); index = view->indexBelow(index)) {
+        if (view->visualRect(index).top() >= bottom) break;
+        const QModelIndex parent = index.parent();
+        if (index.row() == command_buffer_tree_.rowCount(parent) - 1 && command_buffer_tree_.canFetchMore(parent)) {
+            command_buffer_tree_.fetchMore(parent);
+        }
     }
 }
 
@@ -19,8 +19,10 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QTimer>
 #include <string>
 
+#include "capture_file.h"
 #include "command_buffer_tree.h"
 
 namespace Ui {
@@ -36,8 +38,19 @@ public:
     ~MainWindow();
 
 private:
+    // Starts loading the given frame of the capture into the tree, replacing the frame shown before.
+    void LoadFrame(int frame);
+
+    // Reads the frame's command buffers for a few milliseconds, so the window stays responsive while a large frame loads.
+    void LoadSomeCommandBuffers();
+
+    // Adds more rows under any expanded command buffer whose last loaded row is in view.
+    void FetchVisibleRows();
+
     Ui::MainWindow *ui;
+    CaptureReader capture_;
     CommandBufferTree command_buffer_tree_;
+    QTimer load_timer_;
 };
 
 #endif // MAINWINDOW_H
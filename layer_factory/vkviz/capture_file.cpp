@@ -0,0 +1,197 @@
+/* Copyright (C) 2018 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "capture_file.h"
+#include "serialize.h"
+
+#include <cstring>
+
+namespace {
+
+const char kHeaderMagic[8] = {'V', 'K', 'V', 'I', 'Z', 'C', 'A', 'P'};
+const char kFooterMagic[8] = {'V', 'K', 'V', 'I', 'Z', 'I', 'D', 'X'};
+const uint32_t kCaptureVersion = 1;
+
+const size_t kHeaderSize = 12;
+const size_t kRecordHeaderSize = 8;
+const size_t kFooterSize = 20;
+
+// Records are written out once this much is buffered, or at the end of a frame.
+const size_t kFlushSize = 1 << 20;
+
+void Append32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void Append64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void Store32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint32_t Load32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(in[i]) << (8 * i);
+    return value;
+}
+
+uint64_t Load64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    return value;
+}
+
+}  // namespace
+
+CaptureWriter::CaptureWriter(const std::string& filename) : file_(filename, std::ios::binary | std::ios::trunc) {
+    buffer_.insert(buffer_.end(), kHeaderMagic, kHeaderMagic + sizeof(kHeaderMagic));
+    Append32(buffer_, kCaptureVersion);
+    offset_ = buffer_.size();
+    frame_offsets_.push_back(offset_);
+}
+
+void CaptureWriter::WriteCommandBuffer(const VkVizCommandBuffer& command_buffer) {
+    if (!file_.is_open()) return;
+
+    // The size is filled in once the command buffer is encoded straight into the buffer.
+    const size_t record = buffer_.size();
+    Append32(buffer_, frame_);
+    Append32(buffer_, 0);
+    json::to_msgpack(json(command_buffer), nlohmann::detail::output_adapter<uint8_t>(buffer_));
+    Store32(&buffer_[record + 4], static_cast<uint32_t>(buffer_.size() - record - kRecordHeaderSize));
+
+    offset_ += buffer_.size() - record;
+    if (buffer_.size() >= kFlushSize) Flush();
+}
+
+void CaptureWriter::EndFrame() {
+    if (!file_.is_open()) return;
+    ++frame_;
+    frame_offsets_.push_back(offset_);
+    Flush();
+    file_.flush();
+}
+
+void CaptureWriter::Close() {
+    if (!file_.is_open()) return;
+    const uint64_t index_offset = offset_;
+    for (uint64_t frame_offset : frame_offsets_) Append64(buffer_, frame_offset);
+    Append64(buffer_, index_offset);
+    Append32(buffer_, static_cast<uint32_t>(frame_offsets_.size()));
+    buffer_.insert(buffer_.end(), kFooterMagic, kFooterMagic + sizeof(kFooterMagic));
+    Flush();
+    file_.close();
+}
+
+void CaptureWriter::Flush() {
+    file_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+    buffer_.clear();
+}
+
+bool CaptureReader::Open(const std::string& filename) {
+    frame_offsets_.clear();
+    records_end_ = 0;
+    file_.close();
+    file_.open(filename, std::ios::binary);
+
+    uint8_t header[kHeaderSize];
+    if (!file_.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        memcmp(header, kHeaderMagic, sizeof(kHeaderMagic)) != 0 || Load32(header + 8) != kCaptureVersion) {
+        file_.close();
+        return false;
+    }
+
+    file_.seekg(0, std::ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(file_.tellg());
+    if (!ReadIndex(file_size)) ScanRecords(file_size);
+    return true;
+}
+
+bool CaptureReader::ReadIndex(uint64_t file_size) {
+    if (file_size < kHeaderSize + kFooterSize) return false;
+
+    uint8_t footer[kFooterSize];
+    file_.clear();
+    file_.seekg(file_size - kFooterSize);
+    if (!file_.read(reinterpret_cast<char*>(footer), sizeof(footer)) ||
+        memcmp(footer + 12, kFooterMagic, sizeof(kFooterMagic)) != 0) {
+        return false;
+    }
+    const uint64_t index_offset = Load64(footer);
+    const uint32_t frame_count = Load32(footer + 8);
+    if (index_offset < kHeaderSize || index_offset + uint64_t(frame_count) * 8 != file_size - kFooterSize) return false;
+
+    std::vector<uint8_t> index(frame_count * 8);
+    file_.seekg(index_offset);
+    if (!file_.read(reinterpret_cast<char*>(index.data()), index.size())) return false;
+    for (uint32_t frame = 0; frame < frame_count; ++frame) frame_offsets_.push_back(Load64(&index[frame * 8]));
+    records_end_ = index_offset;
+    return true;
+}
+
+void CaptureReader::ScanRecords(uint64_t file_size) {
+    uint64_t offset = kHeaderSize;
+    uint8_t record[kRecordHeaderSize];
+    file_.clear();
+    while (offset + kRecordHeaderSize <= file_size) {
+        file_.seekg(offset);
+        if (!file_.read(reinterpret_cast<char*>(record), sizeof(record))) break;
+        const uint32_t frame = Load32(record);
+        const uint64_t end = offset + kRecordHeaderSize + Load32(record + 4);
+        if (end > file_size) break;  // The application exited while writing this record.
+        while (frame_offsets_.size() <= frame) frame_offsets_.push_back(offset);
+        offset = end;
+    }
+    records_end_ = offset;
+}
+
+std::vector<VkVizCommandBuffer> CaptureReader::ReadFrame(uint32_t frame) {
+    std::vector<VkVizCommandBuffer> buffers;
+    if (!SeekFrame(frame)) return buffers;
+
+    VkVizCommandBuffer command_buffer;
+    while (ReadCommandBuffer(&command_buffer)) buffers.emplace_back(std::move(command_buffer));
+    return buffers;
+}
+
+bool CaptureReader::SeekFrame(uint32_t frame) {
+    if (frame >= FrameCount()) {
+        next_record_ = records_end_;
+        return false;
+    }
+    frame_ = frame;
+    next_record_ = frame_offsets_[frame];
+    return true;
+}
+
+bool CaptureReader::ReadCommandBuffer(VkVizCommandBuffer* command_buffer) {
+    if (next_record_ + kRecordHeaderSize > records_end_) return false;
+
+    uint8_t record[kRecordHeaderSize];
+    file_.clear();
+    file_.seekg(next_record_);
+    if (!file_.read(reinterpret_cast<char*>(record), sizeof(record)) || Load32(record) != frame_) return false;
+    data_.resize(Load32(record + 4));
+    if (!file_.read(reinterpret_cast<char*>(data_.data()), data_.size())) return false;
+    try {
+        *command_buffer = json::from_msgpack(data_).get<VkVizCommandBuffer>();
+    } catch (const json::exception&) {
+        return false;
+    }
+    next_record_ += kRecordHeaderSize + data_.size();
+    return true;
+}
@@ -0,0 +1,88 @@
+/* Copyright (C) 2018 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include "command_buffer.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// The layer streams every submitted command buffer to a single capture file, which the frontend reads back.
+//
+//   header:  "VKVIZCAP", uint32 version
+//   records: uint32 frame, uint32 size, then size bytes of MessagePack holding the command buffer's JSON serialization
+//   index:   uint64 file offset of the first record of each frame
+//   footer:  uint64 index offset, uint32 frame count, "VKVIZIDX"
+//
+// Integers are little endian. The index and footer are written when the capture is closed; if the application exits without
+// closing it, CaptureReader rebuilds the index by skipping from record to record.
+
+const char kCaptureFileName[] = "vkviz_capture";
+
+class CaptureWriter {
+   public:
+    explicit CaptureWriter(const std::string& filename);
+    ~CaptureWriter() { Close(); }
+
+    void WriteCommandBuffer(const VkVizCommandBuffer& command_buffer);
+
+    // Starts the next frame. Buffered records are written out, so a crash loses at most the current frame.
+    void EndFrame();
+
+    // Writes the frame index. No records can be written afterwards.
+    void Close();
+
+   private:
+    void Flush();
+
+    std::ofstream file_;
+    std::vector<uint8_t> buffer_;
+    uint64_t offset_ = 0;  // File offset of the end of buffer_.
+    uint32_t frame_ = 0;
+    std::vector<uint64_t> frame_offsets_;
+};
+
+class CaptureReader {
+   public:
+    // Returns false if the file is missing or is not a capture file.
+    bool Open(const std::string& filename);
+
+    uint32_t FrameCount() const { return static_cast<uint32_t>(frame_offsets_.size()); }
+    std::vector<VkVizCommandBuffer> ReadFrame(uint32_t frame);
+
+    // Positions the reader at the first command buffer of the given frame, so it can be read one command buffer at a time.
+    bool SeekFrame(uint32_t frame);
+
+    // Reads the next command buffer of the frame last sought to. Returns false at the end of the frame.
+    bool ReadCommandBuffer(VkVizCommandBuffer* command_buffer);
+
+   private:
+    bool ReadIndex(uint64_t file_size);
+    void ScanRecords(uint64_t file_size);
+
+    std::ifstream file_;
+    std::vector<uint64_t> frame_offsets_;
+    uint64_t records_end_ = 0;
+
+    uint32_t frame_ = 0;
+    uint64_t next_record_ = 0;
+    std::vector<uint8_t> data_;
+};
+
+#endif  // CAPTURE_FILE_H
@@ -25,6 +25,7 @@
 
 #include <vulkan_core.h>
 #include "layer_factory.h"
+#include "capture_file.h"
 #include "command_buffer.h"
 
 class VkVizDevice;
@@ -35,8 +36,7 @@ class VkViz : public layer_factory {
     std::unordered_map<VkCommandBuffer, VkVizCommandBuffer> command_buffer_map_;
     std::unordered_map<VkDevice, VkVizDevice> device_map_;
 
-    std::ofstream out_file_;
-    int current_frame_ = 0;
+    CaptureWriter capture_;
 
     void AddCommandBuffers(const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers,
                            VkVizDevice* device) {
@@ -56,7 +56,7 @@ class VkViz : public layer_factory {
 
    public:
     // Constructor for interceptor
-    VkViz() : layer_factory(this), out_file_("vkviz_frame_start") {};
+    VkViz() : layer_factory(this), capture_(kCaptureFileName){};
 
     // These functions are all implemented in vkviz.cpp.
     VkResult PostCallBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo);
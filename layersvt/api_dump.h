@@ -31,6 +31,10 @@
 #include "vk_layer_utils.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -40,6 +44,9 @@
 #include <string>
 #include <type_traits>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include <unordered_set>
@@ -50,27 +57,232 @@
 enum class ApiDumpFormat {
     Text,
     Html,
+    Binary,
+};
+
+// Binary logs start with this header, followed by one record per call. The
+// parameters are stored with the layout of the machine that captured them, so
+// they can only be rendered by a formatter built for the same pointer size and
+// Vulkan headers.
+struct ApiDumpBinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_version;
+    uint32_t pointer_size;
+};
+
+// Each record holds the raw parameter data of a single call
+struct ApiDumpBinaryRecord {
+    uint32_t command;
+    uint32_t thread;
+    uint64_t sequence;
+    uint64_t frame;
+    uint64_t size;
+};
+
+static const char API_DUMP_BINARY_MAGIC[8] = {'V', 'K', 'A', 'P', 'I', 'D', 'M', 'P'};
+static const uint32_t API_DUMP_BINARY_VERSION = 1;
+
+// Identifies a command in a binary log by hashing its name (FNV-1a), so that
+// the IDs don't change when commands are added to the registry
+constexpr uint32_t dump_binary_command_id(const char *name, uint32_t hash = 2166136261u) {
+    return *name == '\0' ? hash : dump_binary_command_id(name + 1, (hash ^ (uint8_t)*name) * 16777619u);
+}
+
+// Writes the output of calls that were formatted into per-thread buffers.
+// Each call is tagged with a global sequence number when it starts (starting
+// from zero), and the writer thread puts the calls back in that order before
+// writing them. The output is written once enough of it has accumulated, or
+// when the flush interval has passed.
+class ApiDumpAsyncWriter {
+   public:
+    ApiDumpAsyncWriter(std::ostream &stream, size_t flush_bytes, std::chrono::milliseconds flush_interval)
+        : output(stream),
+          flush_bytes(flush_bytes),
+          flush_interval(flush_interval),
+          next_ready(0),
+          ready_bytes(0),
+          exiting(false) {
+        writer_thread = std::thread(&ApiDumpAsyncWriter::run, this);
+    }
+
+    ~ApiDumpAsyncWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            exiting = true;
+        }
+        ready.notify_one();
+        writer_thread.join();
+    }
+
+    void submit(uint64_t sequence, std::string &&text) {
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending[sequence] = std::move(text);
+
+            // Output is ready to be written once every call before it has completed
+            for (auto iter = pending.find(next_ready); iter != pending.end() && iter->first == next_ready; ++iter) {
+                ready_bytes += iter->second.size();
+                ++next_ready;
+            }
+            notify = ready_bytes >= flush_bytes;
+        }
+        if (notify) ready.notify_one();
+    }
+
+   private:
+    void run() {
+        std::string text;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait_for(lock, flush_interval, [this] { return exiting || ready_bytes >= flush_bytes; });
+
+            // On exit, also write the calls that are still waiting on a call that never completed
+            uint64_t end = exiting ? UINT64_MAX : next_ready;
+            while (!pending.empty() && pending.begin()->first < end) {
+                text += pending.begin()->second;
+                pending.erase(pending.begin());
+            }
+            ready_bytes = 0;
+            bool done = exiting;
+
+            if (!text.empty()) {
+                lock.unlock();
+                output.write(text.data(), text.size());
+                output.flush();
+                text.clear();
+                lock.lock();
+            }
+
+            if (done) break;
+        }
+    }
+
+    std::ostream &output;
+    const size_t flush_bytes;
+    const std::chrono::milliseconds flush_interval;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::map<uint64_t, std::string> pending;
+    uint64_t next_ready;
+    size_t ready_bytes;
+    bool exiting;
+
+    std::thread writer_thread;
 };
 
 class ApiDumpSettings {
    public:
     ApiDumpSettings() {
-        // Get the output file settings and create a stream for it
+        ApiDumpFormat format = readFormatOption("lunarg_api_dump.output_format", ApiDumpFormat::Text);
+
+        // Get the output file settings. Binary output is always written to a file.
+        const char *filename = NULL;
         const char *file_option = getLayerOption("lunarg_api_dump.file");
-        if (file_option != NULL && strcmp(file_option, "TRUE") == 0) {
-            use_cout = false;
+        if ((file_option != NULL && strcmp(file_option, "TRUE") == 0) || format == ApiDumpFormat::Binary) {
             const char *filename_option = getLayerOption("lunarg_api_dump.log_filename");
             if (filename_option != NULL && strcmp(filename_option, "") != 0)
-                output_stream.open(filename_option, std::ofstream::out | std::ostream::trunc);
+                filename = filename_option;
+            else if (format == ApiDumpFormat::Binary)
+                filename = "vk_apidump.bin";
             else
-                output_stream.open("vk_apidump.txt", std::ofstream::out | std::ostream::trunc);
+                filename = "vk_apidump.txt";
+        }
+
+        initialize(format, filename);
+    }
+
+    // Used by the binary log formatter, which picks the format and output file
+    // itself. The output goes to stdout if filename is NULL.
+    ApiDumpSettings(ApiDumpFormat format, const char *filename) { initialize(format, filename); }
+
+    ~ApiDumpSettings() {
+        // Write out everything that is still buffered before closing the output
+        if (async_writer != NULL) delete async_writer;
+
+        if (output_format == ApiDumpFormat::Html) {
+            // Close off html
+            output() << "</div></body></html>";
+        }
+        if (!use_cout)
+            output_stream.close();
+    }
+
+    inline ApiDumpFormat format() const { return output_format; }
+
+    std::ostream &formatNameType(std::ostream &stream, int indents, const char *name, const char *type) const {
+        stream << indentation(indents) << name << ": ";
+
+        if (use_spaces)
+            stream << spaces(name_size - (int)strlen(name) - 2);
+        else
+            stream << tabs((name_size - (int)strlen(name) - 3 + indent_size) / indent_size);
+
+        if (show_type && use_spaces)
+            stream << type << spaces(type_size - (int)strlen(type));
+        else if (show_type && !use_spaces)
+            stream << type << tabs((type_size - (int)strlen(type) - 1 + indent_size) / indent_size);
+
+        return stream << " = ";
+    }
+
+    inline const char *indentation(int indents) const {
+        if (use_spaces)
+            return spaces(indents * indent_size);
+        else
+            return tabs(indents);
+    }
+
+    inline bool shouldFlush() const { return should_flush; }
+
+    inline bool showAddress() const { return show_address; }
+
+    inline bool showParams() const { return show_params; }
+
+    inline bool showShader() const { return show_shader; }
+
+    inline bool showType() const { return show_type; }
+
+    inline bool useAsync() const { return use_async; }
+
+    // With async output, each thread formats its calls into a buffer of its own
+    inline std::ostream &stream() const { return use_async ? threadBuffer() : output(); }
+
+    // Starts dumping a call on this thread
+    inline void beginCall() const { threadSequence() = next_sequence.fetch_add(1); }
+
+    // Finishes dumping the call started on this thread, handing it to the writer thread
+    inline void endCall() const {
+        if (use_async) {
+            std::ostringstream &buffer = threadBuffer();
+            async_writer->submit(threadSequence(), buffer.str());
+            buffer.str(std::string());
+            buffer.clear();
+        }
+    }
+
+    // Sequence number of the call being dumped on this thread
+    inline uint64_t sequence() const { return threadSequence(); }
+
+   private:
+    void initialize(ApiDumpFormat format, const char *filename) {
+        output_format = format;
+        next_sequence = 0;
+
+        // Create a stream for the output file
+        if (filename != NULL) {
+            use_cout = false;
+            if (output_format == ApiDumpFormat::Binary)
+                output_stream.open(filename, std::ofstream::out | std::ostream::trunc | std::ostream::binary);
+            else
+                output_stream.open(filename, std::ofstream::out | std::ostream::trunc);
         } else {
             use_cout = true;
         }
 
         // Get the remaining settings
-        output_format = readFormatOption("lunarg_api_dump.output_format", ApiDumpFormat::Text);
-
         show_params = readBoolOption("lunarg_api_dump.detailed", true);
         show_address = !readBoolOption("lunarg_api_dump.no_addr", false);
         should_flush = readBoolOption("lunarg_api_dump.flush", true);
@@ -80,6 +292,9 @@ class ApiDumpSettings {
         type_size = std::max(readIntOption("lunarg_api_dump.type_size", 0), 0);
         use_spaces = readBoolOption("lunarg_api_dump.use_spaces", true);
         show_shader = readBoolOption("lunarg_api_dump.show_shader", false);
+        use_async = readBoolOption("lunarg_api_dump.async", false);
+        async_flush_bytes = std::max(readIntOption("lunarg_api_dump.async_flush_bytes", 1024 * 1024), 0);
+        async_flush_ms = std::max(readIntOption("lunarg_api_dump.async_flush_ms", 100), 1);
 
         // Generate HTML heading if specified
         if (output_format == ApiDumpFormat::Html) {
@@ -105,7 +320,8 @@ class ApiDumpSettings {
                 layer_path = "";
             }
 #elif __GNUC__
-            layer_path = getenv("VK_LAYER_PATH");
+            const char *layer_path_env = getenv("VK_LAYER_PATH");
+            layer_path = layer_path_env != NULL ? layer_path_env : "";
             if (layer_path.length() > 0) {
                 layer_path = layer_path.substr(0, layer_path.rfind("/"));
             } else {
@@ -115,7 +331,7 @@ class ApiDumpSettings {
 
             // clang-format off
             // Insert html heading
-            stream() <<
+            output() <<
                 "<!doctype html>"
                 "<html>"
                     "<head>"
@@ -212,55 +428,23 @@ class ApiDumpSettings {
                         "<div id='wrapper'>";
             // clang-format on
         }
-    }
 
-    ~ApiDumpSettings() {
-        if (output_format == ApiDumpFormat::Html) {
-            // Close off html
-            stream() << "</div></body></html>";
+        if (output_format == ApiDumpFormat::Binary) {
+            ApiDumpBinaryHeader header;
+            memcpy(header.magic, API_DUMP_BINARY_MAGIC, sizeof(header.magic));
+            header.version = API_DUMP_BINARY_VERSION;
+            header.header_version = VK_HEADER_VERSION;
+            header.pointer_size = sizeof(void *);
+            output().write((const char *)&header, sizeof(header));
         }
-        if (!use_cout)
-            output_stream.close();
-    }
-
-    inline ApiDumpFormat format() const { return output_format; }
-
-    std::ostream &formatNameType(std::ostream &stream, int indents, const char *name, const char *type) const {
-        stream << indentation(indents) << name << ": ";
-
-        if (use_spaces)
-            stream << spaces(name_size - (int)strlen(name) - 2);
-        else
-            stream << tabs((name_size - (int)strlen(name) - 3 + indent_size) / indent_size);
 
-        if (show_type && use_spaces)
-            stream << type << spaces(type_size - (int)strlen(type));
-        else if (show_type && !use_spaces)
-            stream << type << tabs((type_size - (int)strlen(type) - 1 + indent_size) / indent_size);
-
-        return stream << " = ";
-    }
-
-    inline const char *indentation(int indents) const {
-        if (use_spaces)
-            return spaces(indents * indent_size);
-        else
-            return tabs(indents);
+        if (use_async) {
+            async_writer = new ApiDumpAsyncWriter(output(), async_flush_bytes, std::chrono::milliseconds(async_flush_ms));
+        } else {
+            async_writer = NULL;
+        }
     }
 
-    inline bool shouldFlush() const { return should_flush; }
-
-    inline bool showAddress() const { return show_address; }
-
-    inline bool showParams() const { return show_params; }
-
-    inline bool showShader() const { return show_shader; }
-
-    inline bool showType() const { return show_type; }
-
-    inline std::ostream &stream() const { return use_cout ? std::cout : *(std::ofstream *)&output_stream; }
-
-   private:
     inline static bool readBoolOption(const char *option, bool default_value) {
         const char *string_option = getLayerOption(option);
         if (string_option != NULL && strcmp(string_option, "TRUE") == 0)
@@ -271,10 +455,22 @@ class ApiDumpSettings {
             return default_value;
     }
 
+    inline std::ostream &output() const { return use_cout ? std::cout : *(std::ofstream *)&output_stream; }
+
+    inline static std::ostringstream &threadBuffer() {
+        static thread_local std::ostringstream buffer;
+        return buffer;
+    }
+
+    inline static uint64_t &threadSequence() {
+        static thread_local uint64_t sequence = 0;
+        return sequence;
+    }
+
     inline static int readIntOption(const char *option, int default_value) {
         const char *string_option = getLayerOption(option);
         int value;
-        if (sscanf(string_option, "%d", &value) != 1) {
+        if (string_option == NULL || sscanf(string_option, "%d", &value) != 1) {
             return default_value;
         } else {
             return value;
@@ -283,10 +479,14 @@ class ApiDumpSettings {
 
     inline static ApiDumpFormat readFormatOption(const char *option, ApiDumpFormat default_value) {
         const char *string_option = getLayerOption(option);
-        if (strcmp(string_option, "Text") == 0)
+        if (string_option == NULL)
+            return default_value;
+        else if (strcmp(string_option, "Text") == 0)
             return ApiDumpFormat::Text;
         else if (strcmp(string_option, "Html") == 0)
             return ApiDumpFormat::Html;
+        else if (strcmp(string_option, "Binary") == 0)
+            return ApiDumpFormat::Binary;
         else
             return default_value;
     }
@@ -309,6 +509,12 @@ class ApiDumpSettings {
     bool use_spaces;
     bool show_shader;
 
+    bool use_async;
+    int async_flush_bytes;
+    int async_flush_ms;
+    ApiDumpAsyncWriter *async_writer;
+    mutable std::atomic<uint64_t> next_sequence;
+
     static const char *const SPACES;
     static const int MAX_SPACES = 72;
     static const char *const TABS;
@@ -320,8 +526,10 @@ const char *const ApiDumpSettings::TABS = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t"
 
 class ApiDumpInstance {
    public:
-    inline ApiDumpInstance() : dump_settings(NULL), frame_count(0), thread_count(0) {
+    inline ApiDumpInstance()
+        : dump_settings(NULL), frame_count(0), thread_count(0), object_name_count(0), use_recorded_call(false) {
         loader_platform_thread_create_mutex(&output_mutex);
+        loader_platform_thread_create_mutex(&object_name_mutex);
         loader_platform_thread_create_mutex(&frame_mutex);
         loader_platform_thread_create_mutex(&thread_mutex);
         loader_platform_thread_create_mutex(&cmd_buffer_state_mutex);
@@ -333,10 +541,13 @@ class ApiDumpInstance {
         loader_platform_thread_delete_mutex(&thread_mutex);
         loader_platform_thread_delete_mutex(&frame_mutex);
         loader_platform_thread_delete_mutex(&output_mutex);
+        loader_platform_thread_delete_mutex(&object_name_mutex);
         loader_platform_thread_delete_mutex(&cmd_buffer_state_mutex);
     }
 
     inline uint64_t frameCount() {
+        if (use_recorded_call) return recorded_frame;
+
         loader_platform_thread_lock_mutex(&frame_mutex);
         uint64_t count = frame_count;
         loader_platform_thread_unlock_mutex(&frame_mutex);
@@ -349,15 +560,68 @@ class ApiDumpInstance {
         loader_platform_thread_unlock_mutex(&frame_mutex);
     }
 
-    inline loader_platform_thread_mutex *outputMutex() { return &output_mutex; }
+    // Calls are dumped one at a time, unless async output lets each thread
+    // format its calls on its own.
+    inline void beginCall() {
+        if (!settings().useAsync()) loader_platform_thread_lock_mutex(&output_mutex);
+        settings().beginCall();
+    }
+
+    inline void endCall() {
+        settings().endCall();
+        if (!settings().useAsync()) loader_platform_thread_unlock_mutex(&output_mutex);
+    }
 
     inline const ApiDumpSettings &settings() {
-        if (dump_settings == NULL) dump_settings = new ApiDumpSettings();
+        std::call_once(settings_once, [this] { dump_settings = new ApiDumpSettings(); });
 
         return *dump_settings;
     }
 
+    // Replaces the settings read from the layer options. Takes ownership of the
+    // settings, and has no effect once settings() has been called.
+    inline void setSettings(ApiDumpSettings *settings) {
+        bool used = false;
+        std::call_once(settings_once, [this, settings, &used] {
+            dump_settings = settings;
+            used = true;
+        });
+        if (!used) delete settings;
+    }
+
+    // When rendering a binary log, calls report the thread and frame they were recorded on
+    inline void setRecordedCall(uint32_t thread, uint64_t frame) {
+        use_recorded_call = true;
+        recorded_thread = thread;
+        recorded_frame = frame;
+    }
+
+    inline void setObjectName(uint64_t object, const char *name) {
+        loader_platform_thread_lock_mutex(&object_name_mutex);
+        if (name != NULL) {
+            object_name_map.insert(std::make_pair(object, std::string(name)));
+        } else {
+            object_name_map.erase(object);
+        }
+        object_name_count.store(object_name_map.size());
+        loader_platform_thread_unlock_mutex(&object_name_mutex);
+    }
+
+    inline bool getObjectName(uint64_t object, std::string &name) {
+        // Most applications never name anything, so don't take the lock for every handle
+        if (object_name_count.load() == 0) return false;
+
+        loader_platform_thread_lock_mutex(&object_name_mutex);
+        const auto iter = object_name_map.find(object);
+        bool found = (iter != object_name_map.end());
+        if (found) name = iter->second;
+        loader_platform_thread_unlock_mutex(&object_name_mutex);
+        return found;
+    }
+
     uint32_t threadID() {
+        if (use_recorded_call) return recorded_thread;
+
         loader_platform_thread_id id = loader_platform_get_thread_id();
         loader_platform_thread_lock_mutex(&thread_mutex);
         for (uint32_t i = 0; i < thread_count; ++i) {
@@ -438,11 +702,10 @@ class ApiDumpInstance {
 
     static inline ApiDumpInstance &current() { return current_instance; }
 
-    std::unordered_map<uint64_t, std::string> object_name_map;
-
    private:
     static ApiDumpInstance current_instance;
 
+    std::once_flag settings_once;
     ApiDumpSettings *dump_settings;
     loader_platform_thread_mutex output_mutex;
     loader_platform_thread_mutex frame_mutex;
@@ -456,6 +719,14 @@ class ApiDumpInstance {
     loader_platform_thread_mutex cmd_buffer_state_mutex;
     std::map<std::pair<VkDevice, VkCommandPool>, std::unordered_set<VkCommandBuffer> > cmd_buffer_pools;
     std::unordered_map<VkCommandBuffer, VkCommandBufferLevel> cmd_buffer_level;
+
+    loader_platform_thread_mutex object_name_mutex;
+    std::unordered_map<uint64_t, std::string> object_name_map;
+    std::atomic<size_t> object_name_count;
+
+    bool use_recorded_call;
+    uint32_t recorded_thread;
+    uint64_t recorded_frame;
 };
 
 ApiDumpInstance ApiDumpInstance::current_instance;
@@ -739,3 +1010,201 @@ inline std::ostream &dump_html_int(int object, const ApiDumpSettings &settings,
     settings.stream() << object;
     return settings.stream() << "</div>";
 }
+
+//=================================== Binary Backend Helpers =====================================//
+
+// Calls are recorded without formatting anything: every parameter is written
+// as its raw bytes, followed by the data its pointers refer to. A pointer is
+// written as a flag saying whether it was NULL, the number of elements, the raw
+// elements and then the data referenced by each element in turn.
+
+inline void dump_binary_bytes(std::string &buffer, const void *data, size_t size) {
+    buffer.append((const char *)data, size);
+}
+
+template <typename T>
+inline void dump_binary_raw(std::string &buffer, const T &object) {
+    dump_binary_bytes(buffer, &object, sizeof(T));
+}
+
+// Only structs refer to other data; their overloads are generated in api_dump_binary.h
+template <typename T, typename... Args>
+inline void dump_binary_pointees(std::string &buffer, const T &object, Args... args) {}
+
+inline void dump_binary_cstring(std::string &buffer, const char *string) {
+    dump_binary_raw(buffer, (uint8_t)(string != NULL));
+    if (string != NULL) {
+        uint64_t length = strlen(string);
+        dump_binary_raw(buffer, length);
+        dump_binary_bytes(buffer, string, (size_t)length);
+    }
+}
+
+template <typename T, typename... Args>
+inline void dump_binary_array(std::string &buffer, const T *array, size_t len, Args... args) {
+    dump_binary_raw(buffer, (uint8_t)(array != NULL));
+    if (array != NULL) {
+        dump_binary_raw(buffer, (uint64_t)len);
+        dump_binary_bytes(buffer, array, len * sizeof(T));
+        for (size_t i = 0; i < len; ++i) dump_binary_pointees(buffer, array[i], args...);
+    }
+}
+
+inline void dump_binary_array(std::string &buffer, const char *const *array, size_t len) {
+    dump_binary_raw(buffer, (uint8_t)(array != NULL));
+    if (array != NULL) {
+        dump_binary_raw(buffer, (uint64_t)len);
+        for (size_t i = 0; i < len; ++i) dump_binary_cstring(buffer, array[i]);
+    }
+}
+
+// Starts a record for a call, in a buffer that is reused by every call on this thread
+inline std::string &dump_binary_begin(ApiDumpInstance &dump_inst, uint32_t command) {
+    static thread_local std::string buffer;
+
+    ApiDumpBinaryRecord record;
+    record.command = command;
+    record.thread = dump_inst.threadID();
+    record.sequence = dump_inst.settings().sequence();
+    record.frame = dump_inst.frameCount();
+    record.size = 0;
+
+    buffer.clear();
+    dump_binary_raw(buffer, record);
+    return buffer;
+}
+
+inline void dump_binary_end(ApiDumpInstance &dump_inst, std::string &buffer) {
+    uint64_t size = buffer.size() - sizeof(ApiDumpBinaryRecord);
+    memcpy(&buffer[offsetof(ApiDumpBinaryRecord, size)], &size, sizeof(size));
+
+    const ApiDumpSettings &settings(dump_inst.settings());
+    settings.stream().write(buffer.data(), buffer.size());
+    if (settings.shouldFlush()) settings.stream().flush();
+}
+
+#if defined(API_DUMP_BINARY_READER)
+
+// Reads the parameters of a call back out of a binary log. The objects that
+// the parameters point to are rebuilt in storage owned by the reader, which
+// lives as long as the call is being rendered.
+class ApiDumpBinaryReader {
+   public:
+    ApiDumpBinaryReader(const char *data, size_t size) : next(data), end(data + size), read_failed(false) {}
+
+    bool read(void *data, size_t size) {
+        if (read_failed || size > remaining()) {
+            read_failed = true;
+            memset(data, 0, size);
+            return false;
+        }
+        memcpy(data, next, size);
+        next += size;
+        return true;
+    }
+
+    void *allocate(size_t size) {
+        storage.emplace_back(new uint64_t[(size + sizeof(uint64_t) - 1) / sizeof(uint64_t)]);
+        return storage.back().get();
+    }
+
+    // Checks that count elements of the given size could still be in the record,
+    // so that a corrupt count can't cause a huge allocation
+    bool check(uint64_t count, size_t size) {
+        if (read_failed || (size > 0 && count > remaining() / size)) read_failed = true;
+        return !read_failed;
+    }
+
+    inline size_t remaining() const { return (size_t)(end - next); }
+
+    inline void fail() { read_failed = true; }
+
+    inline bool failed() const { return read_failed; }
+
+   private:
+    const char *next;
+    const char *end;
+    bool read_failed;
+    std::vector<std::unique_ptr<uint64_t[]>> storage;
+};
+
+template <typename T>
+inline void read_binary_raw(ApiDumpBinaryReader &reader, T &object) {
+    reader.read(&object, sizeof(T));
+}
+
+template <typename T>
+inline void read_binary_pointees(ApiDumpBinaryReader &reader, T &object) {}
+
+inline void read_binary_cstring(ApiDumpBinaryReader &reader, const char *&string) {
+    uint8_t present = 0;
+    uint64_t length = 0;
+    string = NULL;
+    read_binary_raw(reader, present);
+    if (present == 0) return;
+    read_binary_raw(reader, length);
+    if (!reader.check(length, 1)) return;
+
+    char *data = (char *)reader.allocate((size_t)length + 1);
+    reader.read(data, (size_t)length);
+    data[length] = '\0';
+    string = data;
+}
+
+// The length of an array must match the length that the dump functions will
+// read from the other parameters or members
+template <typename T>
+inline void read_binary_array(ApiDumpBinaryReader &reader, T *&array, uint64_t expected_len) {
+    typedef typename std::remove_const<T>::type Element;
+
+    uint8_t present = 0;
+    uint64_t len = 0;
+    array = NULL;
+    read_binary_raw(reader, present);
+    if (present == 0) return;
+    read_binary_raw(reader, len);
+    if (len != expected_len) reader.fail();
+    if (!reader.check(len, sizeof(Element))) return;
+
+    Element *elements = (Element *)reader.allocate((size_t)len * sizeof(Element));
+    reader.read(elements, (size_t)len * sizeof(Element));
+    for (uint64_t i = 0; i < len; ++i) read_binary_pointees(reader, elements[i]);
+    array = elements;
+}
+
+inline void read_binary_array(ApiDumpBinaryReader &reader, const char *const *&array, uint64_t expected_len) {
+    uint8_t present = 0;
+    uint64_t len = 0;
+    array = NULL;
+    read_binary_raw(reader, present);
+    if (present == 0) return;
+    read_binary_raw(reader, len);
+    if (len != expected_len) reader.fail();
+    if (!reader.check(len, 1)) return;
+
+    const char **strings = (const char **)reader.allocate((size_t)len * sizeof(const char *));
+    for (uint64_t i = 0; i < len; ++i) read_binary_cstring(reader, strings[i]);
+    array = strings;
+}
+
+template <typename T>
+inline const T *read_binary_struct(ApiDumpBinaryReader &reader) {
+    T *object = (T *)reader.allocate(sizeof(T));
+    read_binary_raw(reader, *object);
+    read_binary_pointees(reader, *object);
+    return object;
+}
+
+// Structures that the layer didn't know are only recorded by their type
+inline const void *read_binary_unknown_struct(ApiDumpBinaryReader &reader, VkStructureType type) {
+    struct UnknownStruct {
+        VkStructureType sType;
+        const void *pNext;
+    };
+    UnknownStruct *object = (UnknownStruct *)reader.allocate(sizeof(UnknownStruct));
+    object->sType = type;
+    object->pNext = NULL;
+    return object;
+}
+
+#endif  // API_DUMP_BINARY_READER
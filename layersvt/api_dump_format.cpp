@@ -0,0 +1,112 @@
+/* Copyright (c) 2015-2018 Valve Corporation
+ * Copyright (c) 2015-2018 LunarG, Inc.
+ * Copyright (c) 2015-2018 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Renders a binary log recorded by the api_dump layer as the text or HTML
+// output the layer would have written. The remaining output settings (no_addr,
+// show_types, indent_size, ...) are read from vk_layer_settings.txt as usual.
+
+#define API_DUMP_BINARY_READER
+
+#include "api_dump_text.h"
+#include "api_dump_html.h"
+#include "api_dump_binary.h"
+
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--text | --html] [-o <output file>] <binary log>\n"
+              << "Writes the calls recorded in the binary log to the output file, or to stdout.\n";
+}
+
+int main(int argc, char **argv) {
+    ApiDumpFormat format = ApiDumpFormat::Text;
+    const char *input_name = NULL;
+    const char *output_name = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--text") == 0) {
+            format = ApiDumpFormat::Text;
+        } else if (strcmp(argv[i], "--html") == 0) {
+            format = ApiDumpFormat::Html;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_name = argv[++i];
+        } else if (argv[i][0] != '-' && input_name == NULL) {
+            input_name = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (input_name == NULL) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream input(input_name, std::ifstream::in | std::ifstream::binary);
+    if (!input.is_open()) {
+        std::cerr << "Could not open " << input_name << "\n";
+        return 1;
+    }
+    input.seekg(0, std::ifstream::end);
+    uint64_t input_size = (uint64_t)input.tellg();
+    input.seekg(0, std::ifstream::beg);
+
+    ApiDumpBinaryHeader header;
+    if (!input.read((char *)&header, sizeof(header)) || memcmp(header.magic, API_DUMP_BINARY_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << input_name << " is not an api_dump binary log\n";
+        return 1;
+    }
+    if (header.version != API_DUMP_BINARY_VERSION || header.pointer_size != sizeof(void *)) {
+        std::cerr << input_name << " was recorded with version " << header.version << " of the log format and "
+                  << header.pointer_size * 8 << "-bit pointers, but this formatter reads version " << API_DUMP_BINARY_VERSION
+                  << " with " << sizeof(void *) * 8 << "-bit pointers\n";
+        return 1;
+    }
+    if (header.header_version != VK_HEADER_VERSION) {
+        std::cerr << "Warning: " << input_name << " was recorded with Vulkan header version " << header.header_version
+                  << ", but this formatter was built with version " << VK_HEADER_VERSION << "\n";
+    }
+
+    ApiDumpInstance &dump_inst = ApiDumpInstance::current();
+    dump_inst.setSettings(new ApiDumpSettings(format, output_name));
+
+    ApiDumpBinaryRecord record;
+    std::vector<char> data;
+    uint64_t skipped = 0;
+    bool truncated = false;
+    while (input.read((char *)&record, sizeof(record))) {
+        if (record.size > input_size - (uint64_t)input.tellg()) {
+            truncated = true;
+            break;
+        }
+        data.resize((size_t)record.size);
+        input.read(data.data(), data.size());
+
+        ApiDumpBinaryReader reader(data.data(), data.size());
+        dump_inst.setRecordedCall(record.thread, record.frame);
+        if (!read_binary_call(dump_inst, record.command, reader)) ++skipped;
+    }
+
+    // A partly read record header also means the log was cut off
+    if (input.gcount() != 0) truncated = true;
+
+    if (skipped > 0) {
+        std::cerr << "Skipped " << skipped << " calls that are unknown to this formatter or could not be read\n";
+    }
+    if (truncated) {
+        std::cerr << input_name << " ends in the middle of a call, the calls before it were written\n";
+        return 1;
+    }
+    return 0;
+}
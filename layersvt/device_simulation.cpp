@@ -42,12 +42,18 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
 
 #include <functional>
 #include <unordered_map>
 #include <vector>
 #include <fstream>
+#include <iterator>
 #include <mutex>
+#include <string>
 
 #include <json/json.h>  // https://github.com/open-source-parsers/jsoncpp
 
@@ -62,8 +68,8 @@ namespace {
 // For any changes, at least increment the patch level.
 // When making ANY changes to the version, be sure to also update layersvt/{linux|windows}/VkLayer_device_simulation.json
 const uint32_t kVersionDevsimMajor = 1;
-const uint32_t kVersionDevsimMinor = 2;
-const uint32_t kVersionDevsimPatch = 3;
+const uint32_t kVersionDevsimMinor = 3;
+const uint32_t kVersionDevsimPatch = 0;
 const uint32_t kVersionDevsimImplementation = VK_MAKE_VERSION(kVersionDevsimMajor, kVersionDevsimMinor, kVersionDevsimPatch);
 
 const VkLayerProperties kLayerProperties[] = {{
@@ -272,10 +278,12 @@ const VkFormat StandardVkFormatEnumList[] = {
 const char *const kEnvarDevsimFilename = "debug.vulkan.devsim.filepath";        // path of the configuration file(s) to load.
 const char *const kEnvarDevsimDebugEnable = "debug.vulkan.devsim.debugenable";  // a non-zero integer will enable debugging output.
 const char *const kEnvarDevsimExitOnError = "debug.vulkan.devsim.exitonerror";  // a non-zero integer will enable exit-on-error.
+const char *const kEnvarDevsimCacheDir = "debug.vulkan.devsim.cachedir";        // directory of the binary configuration cache.
 #else
 const char *const kEnvarDevsimFilename = "VK_DEVSIM_FILENAME";          // path of the configuration file(s) to load.
 const char *const kEnvarDevsimDebugEnable = "VK_DEVSIM_DEBUG_ENABLE";   // a non-zero integer will enable debugging output.
 const char *const kEnvarDevsimExitOnError = "VK_DEVSIM_EXIT_ON_ERROR";  // a non-zero integer will enable exit-on-error.
+const char *const kEnvarDevsimCacheDir = "VK_DEVSIM_CACHE_DIR";         // directory of the binary configuration cache.
 #endif
 
 // Various small utility functions ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -491,6 +499,25 @@ class PhysicalDeviceData {
 
 PhysicalDeviceData::Map PhysicalDeviceData::map_;
 
+// Split a delimited list of configuration file names, skipping empty names.
+std::vector<std::string> SplitFilenameList(const char *filename_list) {
+#if defined(_WIN32)
+    const char delimiter = ';';
+#else
+    const char delimiter = ':';
+#endif
+    std::stringstream ss_list(filename_list);
+    std::string filename;
+    std::vector<std::string> filenames;
+
+    while (std::getline(ss_list, filename, delimiter)) {
+        if (!filename.empty()) {
+            filenames.push_back(filename);
+        }
+    }
+    return filenames;
+}
+
 // Loader for DevSim JSON configuration files ////////////////////////////////////////////////////////////////////////////////////
 
 class JsonLoader {
@@ -717,19 +744,9 @@ class JsonLoader {
 };
 
 bool JsonLoader::LoadFiles(const char *filename_list) {
-#if defined(_WIN32)
-    const char delimiter = ';';
-#else
-    const char delimiter = ':';
-#endif
-    std::stringstream ss_list(filename_list);
-    std::string filename;
-
-    while (std::getline(ss_list, filename, delimiter)) {
-        if (!filename.empty()) {
-            if (!LoadFile(filename.c_str())) {
-                return false;
-            }
+    for (const auto &filename : SplitFilenameList(filename_list)) {
+        if (!LoadFile(filename.c_str())) {
+            return false;
         }
     }
     return true;
@@ -1081,6 +1098,205 @@ void JsonLoader::GetValue(const Json::Value &parent, int index, DevsimFormatProp
 #undef GET_VALUE
 #undef GET_ARRAY
 
+// Binary cache of loaded configurations /////////////////////////////////////////////////////////////////////////////////////////
+
+// Parsing the JSON configuration files is a noticeable part of the startup time of short-lived applications, so the PDD members
+// can be stored in a binary file after loading them.  The cache file is named by a hash of the layer version, the actual
+// device's values and the path, modification time, size and contents of each configuration file.  An edited configuration file
+// or a different device therefore uses another cache file, and cache files never need to be invalidated.
+
+class BinaryCache {
+   public:
+    BinaryCache(PhysicalDeviceData &pdd) : pdd_(pdd) {}
+    BinaryCache() = delete;
+    BinaryCache(const BinaryCache &) = delete;
+    BinaryCache &operator=(const BinaryCache &) = delete;
+
+    // Choose the cache file for the configuration files and the PDD's current values.
+    // Returns false if caching is disabled or a configuration file cannot be read.
+    bool Init(const char *cache_dir, const char *filename_list);
+    // Replace the PDD members with the contents of the cache file, if it exists and was written by the same build.
+    bool Load();
+    // Write the PDD members to the cache file.
+    void Store();
+
+   private:
+    struct Header {
+        char magic[8];
+        uint64_t key;
+        uint32_t struct_sizes[4];  // Detects a cache file written by a build with different Vulkan headers.
+        uint32_t queue_family_count;
+        uint32_t format_count;
+    };
+
+    struct FormatRecord {
+        uint32_t format;
+        VkFormatProperties properties;
+    };
+
+    static uint64_t Hash(uint64_t hash, const void *data, size_t size);
+    void FillHeader(Header *header) const;
+
+    PhysicalDeviceData &pdd_;
+    uint64_t key_ = 0;
+    std::string cache_filename_;
+};
+
+const char kBinaryCacheMagic[8] = {'D', 'E', 'V', 'S', 'I', 'M', 'C', '1'};
+
+// 64-bit FNV-1a.
+uint64_t BinaryCache::Hash(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+void BinaryCache::FillHeader(Header *header) const {
+    memcpy(header->magic, kBinaryCacheMagic, sizeof(header->magic));
+    header->key = key_;
+    header->struct_sizes[0] = sizeof(VkPhysicalDeviceProperties);
+    header->struct_sizes[1] = sizeof(VkPhysicalDeviceFeatures);
+    header->struct_sizes[2] = sizeof(VkPhysicalDeviceMemoryProperties);
+    header->struct_sizes[3] = sizeof(VkQueueFamilyProperties);
+}
+
+bool BinaryCache::Init(const char *cache_dir, const char *filename_list) {
+    const std::vector<std::string> filenames = SplitFilenameList(filename_list);
+    if (!cache_dir || !cache_dir[0] || filenames.empty()) {
+        return false;
+    }
+
+    uint64_t key = 0xcbf29ce484222325ull;
+    key = Hash(key, &kVersionDevsimImplementation, sizeof(kVersionDevsimImplementation));
+    key = Hash(key, &pdd_.physical_device_properties_, sizeof(pdd_.physical_device_properties_));
+    key = Hash(key, &pdd_.physical_device_features_, sizeof(pdd_.physical_device_features_));
+    key = Hash(key, &pdd_.physical_device_memory_properties_, sizeof(pdd_.physical_device_memory_properties_));
+    for (const auto &filename : filenames) {
+        struct stat file_stat;
+        std::ifstream file(filename, std::ios::binary);
+        if (stat(filename.c_str(), &file_stat) != 0 || !file) {
+            return false;
+        }
+        const int64_t mtime = file_stat.st_mtime;
+        const int64_t size = file_stat.st_size;
+        const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        key = Hash(key, filename.c_str(), filename.size() + 1);
+        key = Hash(key, &mtime, sizeof(mtime));
+        key = Hash(key, &size, sizeof(size));
+        key = Hash(key, contents.data(), contents.size());
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "devsim_%016" PRIx64 ".bin", key);
+    key_ = key;
+    cache_filename_ = std::string(cache_dir) + "/" + name;
+    DebugPrintf("\tBinaryCache file \"%s\"\n", cache_filename_.c_str());
+    return true;
+}
+
+bool BinaryCache::Load() {
+    if (cache_filename_.empty()) {
+        return false;
+    }
+    std::ifstream file(cache_filename_, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Header header;
+    Header expected = {};
+    FillHeader(&expected);
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    const size_t expected_size = sizeof(header) + sizeof(pdd_.physical_device_properties_) + sizeof(pdd_.physical_device_features_) +
+                                 sizeof(pdd_.physical_device_memory_properties_) +
+                                 header.queue_family_count * sizeof(VkQueueFamilyProperties) +
+                                 header.format_count * sizeof(FormatRecord);
+    if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.key != expected.key ||
+        memcmp(header.struct_sizes, expected.struct_sizes, sizeof(header.struct_sizes)) != 0 || data.size() != expected_size) {
+        DebugPrintf("\tBinaryCache ignoring invalid file \"%s\"\n", cache_filename_.c_str());
+        return false;
+    }
+
+    const char *src = data.data() + sizeof(header);
+    memcpy(&pdd_.physical_device_properties_, src, sizeof(pdd_.physical_device_properties_));
+    src += sizeof(pdd_.physical_device_properties_);
+    memcpy(&pdd_.physical_device_features_, src, sizeof(pdd_.physical_device_features_));
+    src += sizeof(pdd_.physical_device_features_);
+    memcpy(&pdd_.physical_device_memory_properties_, src, sizeof(pdd_.physical_device_memory_properties_));
+    src += sizeof(pdd_.physical_device_memory_properties_);
+
+    pdd_.arrayof_queue_family_properties_.resize(header.queue_family_count);
+    if (header.queue_family_count > 0) {
+        memcpy(pdd_.arrayof_queue_family_properties_.data(), src, header.queue_family_count * sizeof(VkQueueFamilyProperties));
+    }
+    src += header.queue_family_count * sizeof(VkQueueFamilyProperties);
+
+    pdd_.arrayof_format_properties_.clear();
+    for (uint32_t i = 0; i < header.format_count; ++i) {
+        FormatRecord record;
+        memcpy(&record, src, sizeof(record));
+        src += sizeof(record);
+        pdd_.arrayof_format_properties_[record.format] = record.properties;
+    }
+
+    DebugPrintf("\tBinaryCache loaded \"%s\"\n", cache_filename_.c_str());
+    return true;
+}
+
+void BinaryCache::Store() {
+    if (cache_filename_.empty()) {
+        return;
+    }
+
+    Header header = {};
+    FillHeader(&header);
+    header.queue_family_count = static_cast<uint32_t>(pdd_.arrayof_queue_family_properties_.size());
+    header.format_count = static_cast<uint32_t>(pdd_.arrayof_format_properties_.size());
+
+    std::string data(reinterpret_cast<const char *>(&header), sizeof(header));
+    data.append(reinterpret_cast<const char *>(&pdd_.physical_device_properties_), sizeof(pdd_.physical_device_properties_));
+    data.append(reinterpret_cast<const char *>(&pdd_.physical_device_features_), sizeof(pdd_.physical_device_features_));
+    data.append(reinterpret_cast<const char *>(&pdd_.physical_device_memory_properties_),
+                sizeof(pdd_.physical_device_memory_properties_));
+    data.append(reinterpret_cast<const char *>(pdd_.arrayof_queue_family_properties_.data()),
+                pdd_.arrayof_queue_family_properties_.size() * sizeof(VkQueueFamilyProperties));
+    for (const auto &format : pdd_.arrayof_format_properties_) {
+        FormatRecord record = {};
+        record.format = format.first;
+        record.properties = format.second;
+        data.append(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
+
+    // Write a file of our own and rename it, so concurrent processes never read a partially written cache file.
+#if defined(_WIN32)
+    const unsigned long process_id = GetCurrentProcessId();
+#else
+    const unsigned long process_id = static_cast<unsigned long>(getpid());
+#endif
+    const std::string temp_filename = cache_filename_ + "." + std::to_string(process_id);
+    {
+        std::ofstream file(temp_filename, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(data.data(), data.size())) {
+            ErrorPrintf("BinaryCache failed to write file \"%s\"\n", temp_filename.c_str());
+            file.close();
+            remove(temp_filename.c_str());
+            return;
+        }
+    }
+    if (rename(temp_filename.c_str(), cache_filename_.c_str()) != 0) {
+        // Another process stored the same cache file first.
+        remove(temp_filename.c_str());
+        return;
+    }
+    DebugPrintf("\tBinaryCache stored \"%s\"\n", cache_filename_.c_str());
+}
+
 // Layer-specific wrappers for Vulkan functions, accessed via vkGet*ProcAddr() ///////////////////////////////////////////////////
 
 // Generic layer dispatch table setup, see [LALI].
@@ -1130,6 +1346,8 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo *pCreat
     if (filename.empty()) {
         ErrorPrintf("envar %s is unset\n", kEnvarDevsimFilename);
     }
+    const std::string cache_dir = GetEnvarValue(kEnvarDevsimCacheDir);
+    DebugPrintf("envar %s = \"%s\"\n", kEnvarDevsimCacheDir, cache_dir.c_str());
 
     const auto dt = instance_dispatch_table(*pInstance);
 
@@ -1151,9 +1369,14 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo *pCreat
         dt->GetPhysicalDeviceFeatures(physical_device, &pdd.physical_device_features_);
         dt->GetPhysicalDeviceMemoryProperties(physical_device, &pdd.physical_device_memory_properties_);
 
-        // Override PDD members with values from configuration file(s).
-        JsonLoader json_loader(pdd);
-        json_loader.LoadFiles(filename.c_str());
+        // Override PDD members with values from configuration file(s), or from the binary cache of an earlier run.
+        BinaryCache binary_cache(pdd);
+        if (!binary_cache.Init(cache_dir.c_str(), filename.c_str()) || !binary_cache.Load()) {
+            JsonLoader json_loader(pdd);
+            if (json_loader.LoadFiles(filename.c_str())) {
+                binary_cache.Store();
+            }
+        }
     }
 
     DebugPrintf("CreateInstance END instance %p }\n", *pInstance);
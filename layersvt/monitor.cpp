@@ -24,10 +24,15 @@
 #include "vk_layer_extension_utils.h"
 #include "vk_layer_table.h"
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 #include <vk_dispatch_table_helper.h>
 #include <vk_loader_platform.h>
 #include <vulkan/vk_layer.h>
@@ -38,7 +43,30 @@
 #endif
 
 #define TITLE_LENGTH 1000
-#define FPS_LENGTH 24
+#define FPS_LENGTH 64
+
+// Number of frame times kept for the sliding window statistics.
+#define FRAME_TIME_RING_SIZE 8192
+// The histogram covering the whole run has 0.1 ms buckets up to 250 ms, the
+// last bucket collects all longer frames.
+#define HISTOGRAM_BUCKETS 2500
+#define HISTOGRAM_BUCKET_MS 0.1
+// A frame is a hitch when it takes more than this many times the median.
+#define HITCH_FACTOR 2.0
+
+typedef std::chrono::steady_clock monitor_clock;
+
+struct frame_stats {
+    uint32_t frames;
+    double min_ms;
+    double avg_ms;
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+    double max_ms;
+    uint32_t hitches;
+};
+
 struct layer_data {
     VkLayerDispatchTable *device_dispatch_table;
     VkLayerInstanceDispatchTable *instance_dispatch_table;
@@ -58,15 +86,190 @@ struct layer_data {
 
     PFN_vkSetDeviceLoaderData pfn_dev_init;
     int lastFrame;
-    time_t lastTime;
+    monitor_clock::time_point lastTime;
     float fps;
     int frame;
+
+    // Frame times in ms, measured between consecutive presents.
+    monitor_clock::time_point create_time;
+    monitor_clock::time_point last_present;
+    std::vector<float> frame_times;
+    std::vector<monitor_clock::time_point> frame_ends;
+    uint32_t frame_count;
+    std::vector<uint32_t> histogram;
+    double total_ms;
+    double min_ms;
+    double max_ms;
+    monitor_clock::time_point last_stats_time;
+    uint32_t stats_device;
+};
+
+// Where and how often frame time statistics are written, read from the
+// environment when the first device is created.
+struct stats_output {
+    std::mutex lock;
+    bool initialized = false;
+    FILE *file = nullptr;
+    bool json = false;
+    bool empty = true;
+    double interval = 1.0;
+    double window = 1.0;
+    uint32_t device_count = 0;
+
+    ~stats_output() {
+        if (file) {
+            if (json) fprintf(file, "%s]\n", empty ? "" : "\n");
+            fclose(file);
+        }
+    }
 };
 
+static stats_output stats;
+
 static std::unordered_map<void *, layer_data *> layer_data_map;
 
 template layer_data *GetLayerDataPtr<layer_data>(void *data_key, std::unordered_map<void *, layer_data *> &data_map);
 
+static std::string GetEnvarValue(const char *name) {
+    std::string value = "";
+#if defined(_WIN32)
+    DWORD size = GetEnvironmentVariable(name, nullptr, 0);
+    if (size > 0) {
+        std::vector<char> buffer(size);
+        GetEnvironmentVariable(name, buffer.data(), size);
+        value = buffer.data();
+    }
+#else
+    const char *v = getenv(name);
+    if (v) value = v;
+#endif
+    return value;
+}
+
+// Open the statistics file named by VK_MONITOR_STATS_FILE, as JSON if the name
+// ends in .json and as CSV otherwise.  Must be called with stats.lock held.
+static void init_stats_output() {
+    if (stats.initialized) return;
+    stats.initialized = true;
+
+    std::string interval = GetEnvarValue("VK_MONITOR_STATS_INTERVAL");
+    if (!interval.empty() && atof(interval.c_str()) > 0.0) stats.interval = atof(interval.c_str());
+    std::string window = GetEnvarValue("VK_MONITOR_STATS_WINDOW");
+    if (!window.empty() && atof(window.c_str()) > 0.0) stats.window = atof(window.c_str());
+
+    std::string filename = GetEnvarValue("VK_MONITOR_STATS_FILE");
+    if (filename.empty()) return;
+    stats.file = fopen(filename.c_str(), "w");
+    if (!stats.file) {
+        fprintf(stderr, "Monitor layer could not open statistics file %s\n", filename.c_str());
+        return;
+    }
+    stats.json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    if (stats.json) {
+        fprintf(stats.file, "[");
+    } else {
+        fprintf(stats.file, "device,window,time_s,frames,fps,min_ms,avg_ms,p50_ms,p95_ms,p99_ms,max_ms,hitches\n");
+    }
+}
+
+// Statistics of the frames that ended within the last window seconds.
+static frame_stats compute_window_stats(const layer_data *my_data, monitor_clock::time_point now, double window) {
+    frame_stats result = {};
+    uint32_t count = std::min<uint32_t>(my_data->frame_count, FRAME_TIME_RING_SIZE);
+    std::vector<float> times;
+    times.reserve(count);
+    double total = 0.0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t slot = (my_data->frame_count - 1 - i) % FRAME_TIME_RING_SIZE;
+        if (std::chrono::duration<double>(now - my_data->frame_ends[slot]).count() > window) break;
+        times.push_back(my_data->frame_times[slot]);
+        total += my_data->frame_times[slot];
+    }
+    if (times.empty()) return result;
+
+    std::sort(times.begin(), times.end());
+    size_t n = times.size();
+    result.frames = (uint32_t)n;
+    result.min_ms = times.front();
+    result.max_ms = times.back();
+    result.avg_ms = total / n;
+    result.p50_ms = times[(n - 1) * 50 / 100];
+    result.p95_ms = times[(n - 1) * 95 / 100];
+    result.p99_ms = times[(n - 1) * 99 / 100];
+    result.hitches = (uint32_t)(times.end() - std::upper_bound(times.begin(), times.end(), result.p50_ms * HITCH_FACTOR));
+    return result;
+}
+
+// Statistics of every frame since the device was created, with percentiles
+// taken from the histogram.
+static frame_stats compute_total_stats(const layer_data *my_data) {
+    frame_stats result = {};
+    if (my_data->frame_count == 0) return result;
+
+    result.frames = my_data->frame_count;
+    result.min_ms = my_data->min_ms;
+    result.max_ms = my_data->max_ms;
+    result.avg_ms = my_data->total_ms / my_data->frame_count;
+
+    const uint32_t ranks[3] = {(result.frames - 1) * 50 / 100, (result.frames - 1) * 95 / 100, (result.frames - 1) * 99 / 100};
+    double *percentiles[3] = {&result.p50_ms, &result.p95_ms, &result.p99_ms};
+    uint32_t seen = 0, next = 0;
+    for (uint32_t bucket = 0; bucket < HISTOGRAM_BUCKETS && next < 3; bucket++) {
+        seen += my_data->histogram[bucket];
+        while (next < 3 && seen > ranks[next]) {
+            // Report the middle of the bucket, clamped to the observed range.
+            *percentiles[next++] = std::min(std::max((bucket + 0.5) * HISTOGRAM_BUCKET_MS, result.min_ms), result.max_ms);
+        }
+    }
+
+    uint32_t first_hitch_bucket = (uint32_t)(result.p50_ms * HITCH_FACTOR / HISTOGRAM_BUCKET_MS) + 1;
+    for (uint32_t bucket = first_hitch_bucket; bucket < HISTOGRAM_BUCKETS; bucket++) result.hitches += my_data->histogram[bucket];
+    return result;
+}
+
+static void write_stats(const layer_data *my_data, const char *window, double time_s, const frame_stats &frame) {
+    std::lock_guard<std::mutex> lock(stats.lock);
+    if (!stats.file || frame.frames == 0) return;
+
+    double fps = frame.avg_ms > 0.0 ? 1000.0 / frame.avg_ms : 0.0;
+    if (stats.json) {
+        fprintf(stats.file,
+                "%s\n  {\"device\": %u, \"window\": \"%s\", \"time_s\": %.3f, \"frames\": %u, \"fps\": %.2f, \"min_ms\": %.3f, "
+                "\"avg_ms\": %.3f, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f, \"hitches\": %u}",
+                stats.empty ? "" : ",", my_data->stats_device, window, time_s, frame.frames, fps, frame.min_ms, frame.avg_ms,
+                frame.p50_ms, frame.p95_ms, frame.p99_ms, frame.max_ms, frame.hitches);
+    } else {
+        fprintf(stats.file, "%u,%s,%.3f,%u,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%u\n", my_data->stats_device, window, time_s,
+                frame.frames, fps, frame.min_ms, frame.avg_ms, frame.p50_ms, frame.p95_ms, frame.p99_ms, frame.max_ms,
+                frame.hitches);
+    }
+    stats.empty = false;
+    fflush(stats.file);
+}
+
+// Record the time since the previous present and write the sliding window
+// statistics every stats.interval seconds.
+static void record_present(layer_data *my_data, monitor_clock::time_point now) {
+    if (my_data->frame > 0) {
+        float ms = std::chrono::duration<float, std::milli>(now - my_data->last_present).count();
+        uint32_t slot = my_data->frame_count % FRAME_TIME_RING_SIZE;
+        my_data->frame_times[slot] = ms;
+        my_data->frame_ends[slot] = now;
+        my_data->frame_count++;
+        my_data->histogram[std::min<uint32_t>((uint32_t)(ms / HISTOGRAM_BUCKET_MS), HISTOGRAM_BUCKETS - 1)]++;
+        my_data->total_ms += ms;
+        my_data->min_ms = my_data->frame_count == 1 ? ms : std::min<double>(my_data->min_ms, ms);
+        my_data->max_ms = std::max<double>(my_data->max_ms, ms);
+    }
+    my_data->last_present = now;
+
+    if (stats.file && std::chrono::duration<double>(now - my_data->last_stats_time).count() >= stats.interval) {
+        my_data->last_stats_time = now;
+        write_stats(my_data, "sliding", std::chrono::duration<double>(now - my_data->create_time).count(),
+                    compute_window_stats(my_data, now, stats.window));
+    }
+}
+
 VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkCreateDevice(VkPhysicalDevice gpu, const VkDeviceCreateInfo *pCreateInfo,
                                                               const VkAllocationCallbacks *pAllocator, VkDevice *pDevice) {
     VkLayerDeviceCreateInfo *chain_info = get_chain_info(pCreateInfo, VK_LAYER_LINK_INFO);
@@ -106,7 +309,23 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkCreateDevice(VkPhysicalDevice g
     my_device_data->frame = 0;
     my_device_data->lastFrame = 0;
     my_device_data->fps = 0.0;
-    time(&my_device_data->lastTime);
+    my_device_data->lastTime = monitor_clock::now();
+
+    my_device_data->create_time = my_device_data->lastTime;
+    my_device_data->last_present = my_device_data->lastTime;
+    my_device_data->last_stats_time = my_device_data->lastTime;
+    my_device_data->frame_times.assign(FRAME_TIME_RING_SIZE, 0.0f);
+    my_device_data->frame_ends.assign(FRAME_TIME_RING_SIZE, my_device_data->lastTime);
+    my_device_data->frame_count = 0;
+    my_device_data->histogram.assign(HISTOGRAM_BUCKETS, 0);
+    my_device_data->total_ms = 0.0;
+    my_device_data->min_ms = 0.0;
+    my_device_data->max_ms = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(stats.lock);
+        init_stats_output();
+        my_device_data->stats_device = stats.device_count++;
+    }
 
     // Get our WSI hooks in
     VkLayerDispatchTable *pTable = my_device_data->device_dispatch_table;
@@ -119,6 +338,10 @@ VK_LAYER_EXPORT VKAPI_ATTR void VKAPI_CALL vkDestroyDevice(VkDevice device, cons
     dispatch_key key = get_dispatch_key(device);
     layer_data *my_data = GetLayerDataPtr(key, layer_data_map);
     VkLayerDispatchTable *pTable = my_data->device_dispatch_table;
+    monitor_clock::time_point now = monitor_clock::now();
+    double time_s = std::chrono::duration<double>(now - my_data->create_time).count();
+    write_stats(my_data, "sliding", time_s, compute_window_stats(my_data, now, stats.window));
+    write_stats(my_data, "total", time_s, compute_total_stats(my_data));
     pTable->DeviceWaitIdle(device);
     pTable->DestroyDevice(device, pAllocator);
     delete pTable;
@@ -161,9 +384,9 @@ VK_LAYER_EXPORT VKAPI_ATTR void VKAPI_CALL vkDestroyInstance(VkInstance instance
 VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo) {
     layer_data *my_data = GetLayerDataPtr(get_dispatch_key(queue), layer_data_map);
 
-    time_t now;
-    time(&now);
-    float seconds = (float)difftime(now, my_data->lastTime);
+    monitor_clock::time_point now = monitor_clock::now();
+    float seconds = std::chrono::duration<float>(now - my_data->lastTime).count();
+    record_present(my_data, now);
 
     if (seconds > 0.5) {
         char str[TITLE_LENGTH + FPS_LENGTH];
@@ -172,7 +395,8 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkQueuePresentKHR(VkQueue queue,
         my_data->fps = (my_data->frame - my_data->lastFrame) / seconds;
         my_data->lastFrame = my_data->frame;
         my_data->lastTime = now;
-        sprintf(fpsstr, "   FPS = %.2f", my_data->fps);
+        frame_stats recent = compute_window_stats(my_data, now, seconds);
+        snprintf(fpsstr, sizeof(fpsstr), "   FPS = %.2f   p99 = %.1f ms", my_data->fps, recent.p99_ms);
         strcpy(str, my_instance_data->base_title);
         strcat(str, fpsstr);
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
@@ -28,9 +28,12 @@
 #include <unordered_map>
 #include <iostream>
 #include <algorithm>
-#include <list>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <vector>
 #include <fstream>
 
@@ -43,6 +46,7 @@ using namespace std;
 #include "vk_layer_utils.h"
 
 #include "screenshot_parsing.h"
+#include "screenshot_encoding.h"
 
 #ifdef ANDROID
 
@@ -56,6 +60,7 @@ const char *env_var_old = env_var;
 const char *env_var_old = "_VK_SCREENSHOT";
 const char *env_var = "VK_SCREENSHOT_FRAMES";
 const char *env_var_format = "VK_SCREENSHOT_FORMAT";
+const char *env_var_file_format = "VK_SCREENSHOT_FILE_FORMAT";
 #endif
 
 #ifdef ANDROID
@@ -140,6 +145,8 @@ typedef enum colorSpaceFormat {
 
 colorSpaceFormat userColorSpaceFormat = UNDEFINED;
 
+ScreenshotFileFormat screenshotFileFormat = FILE_FORMAT_PPM;
+
 // unordered map: associates a swap chain with a device, image extent, format,
 // and list of images
 typedef struct {
@@ -150,21 +157,14 @@ typedef struct {
 } SwapchainMapStruct;
 static unordered_map<VkSwapchainKHR, SwapchainMapStruct *> swapchainMap;
 
-// unordered map: associates an image with a device, image extent, and format
-typedef struct {
-    VkDevice device;
-    VkExtent2D imageExtent;
-    VkFormat format;
-} ImageMapStruct;
-static unordered_map<VkImage, ImageMapStruct *> imageMap;
+// unordered map: associates a queue with its queue family index
+static unordered_map<VkQueue, uint32_t> queueFamilyMap;
 
-// unordered map: associates a device with a queue, commandPool, and physical
-// device also contains per device info including dispatch table
+// unordered map: associates a device with a physical device
+// also contains per device info including dispatch table
 typedef struct {
     VkLayerDispatchTable *device_dispatch_table;
     bool wsi_enabled;
-    VkQueue queue;
-    std::list<VkCommandPool> commandPools;
     VkPhysicalDevice physicalDevice;
     PFN_vkSetDeviceLoaderData pfn_dev_init;
 } DeviceMapStruct;
@@ -256,6 +256,20 @@ void readScreenShotFormatENV(void) {
     }
 }
 
+//Get users request for the image file format screenshots are written in
+void readScreenShotFileFormatENV(void) {
+#ifndef ANDROID
+    const char *vk_screenshot_file_format = local_getenv(env_var_file_format);
+    if (vk_screenshot_file_format && *vk_screenshot_file_format) {
+        if (!parseScreenshotFileFormat(vk_screenshot_file_format, &screenshotFileFormat)) {
+            fprintf(stderr, "Selected file format:%s\nIs NOT in the list:\nPPM, PNG, QOI\n"
+                            "PPM will be used instead\n", vk_screenshot_file_format);
+        }
+    }
+    local_free_getenv(vk_screenshot_file_format);
+#endif
+}
+
 // detect if frameNumber reach or beyond the right edge for screenshot in the range.
 // return:
 //       if frameNumber is already the last screenshot frame of the range(mean no another screenshot frame number >frameNumber and
@@ -347,85 +361,58 @@ static void init_screenshot() {
         globalLockInitialized = 1;
     }
     readScreenShotFormatENV();
+    readScreenShotFileFormatENV();
 }
 
-// Track allocated resources in writePPM()
-// and clean them up when they go out of scope.
-struct WritePPMCleanupData {
+// Number of screenshots that can be in flight for one swapchain.  Presents
+// only wait for the screenshot thread when every slot of the ring is still
+// waiting to be written out.
+static const uint32_t READBACK_RING_SIZE = 3;
+
+// A pre-allocated readback target: the frame is copied into a host-visible
+// buffer at present time and written out once the fence signals.
+struct ReadbackSlot {
+    VkImage blitImage;
+    VkDeviceMemory blitMemory;
+    VkBuffer buffer;
+    VkDeviceMemory bufferMemory;
+    const char *pixels;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    VkSemaphore copyDone;
+    bool pending;
+    string filename;
+};
+
+// Per-swapchain ring of readback slots and the thread writing them out.
+// Slots are used round-robin, so the writer always finishes the oldest one
+// first.
+struct ReadbackRing {
     VkDevice device;
     VkLayerDispatchTable *pTableDevice;
-    VkImage image2;
-    VkImage image3;
-    VkDeviceMemory mem2;
-    VkDeviceMemory mem3;
-    bool mem2mapped;
-    bool mem3mapped;
-    VkCommandBuffer commandBuffer;
+    uint32_t queueFamilyIndex;
     VkCommandPool commandPool;
-    ~WritePPMCleanupData();
+    uint32_t width;
+    uint32_t height;
+    uint32_t numChannels;
+    VkFormat destformat;
+    bool copyOnly;
+    PixelLayout layout;
+    bool hostCoherent;
+    ReadbackSlot slots[READBACK_RING_SIZE];
+    uint32_t nextSlot;
+
+    // Guards the pending flags, writeQueue and quit.
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<ReadbackSlot *> writeQueue;
+    bool quit;
+    std::thread writer;
 };
+static unordered_map<VkSwapchainKHR, ReadbackRing *> readbackRingMap;
 
-WritePPMCleanupData::~WritePPMCleanupData() {
-    if (mem2mapped) pTableDevice->UnmapMemory(device, mem2);
-    if (mem2) pTableDevice->FreeMemory(device, mem2, NULL);
-    if (image2) pTableDevice->DestroyImage(device, image2, NULL);
-
-    if (mem3mapped) pTableDevice->UnmapMemory(device, mem3);
-    if (mem3) pTableDevice->FreeMemory(device, mem3, NULL);
-    if (image3) pTableDevice->DestroyImage(device, image3, NULL);
-
-    if (commandBuffer) pTableDevice->FreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-}
-
-// Save an image to a PPM image file.
-//
-// This function issues commands to copy/convert the swapchain image
-// from whatever compatible format the swapchain image uses
-// to a single format (VK_FORMAT_R8G8B8A8_UNORM) so that the converted
-// result can be easily written to a PPM file.
-//
-// Error handling: If there is a problem, this function should silently
-// fail without affecting the Present operation going on in the caller.
-// The numerous debug asserts are to catch programming errors and are not
-// expected to assert.  Recovery and clean up are implemented for image memory
-// allocation failures.
-// (TODO) It would be nice to pass any failure info to DebugReport or something.
-static void writePPM(const char *filename, VkImage image1) {
-    VkResult err;
-    bool pass;
-
-    // Bail immediately if we can't find the image.
-    if (imageMap.empty() || imageMap.find(image1) == imageMap.end()) return;
-
-    // Collect object info from maps.  This info is generally recorded
-    // by the other functions hooked in this layer.
-    VkDevice device = imageMap[image1]->device;
-    VkPhysicalDevice physicalDevice = deviceMap[device]->physicalDevice;
-    VkInstance instance = physDeviceMap[physicalDevice]->instance;
-    VkQueue queue = deviceMap[device]->queue;
-    DeviceMapStruct *devMap = get_dev_info(device);
-    if (NULL == devMap) {
-        assert(0);
-        return;
-    }
-    VkLayerDispatchTable *pTableDevice = devMap->device_dispatch_table;
-    VkLayerDispatchTable *pTableQueue = get_dev_info(static_cast<VkDevice>(static_cast<void *>(queue)))->device_dispatch_table;
-    VkLayerInstanceDispatchTable *pInstanceTable;
-    pInstanceTable = instance_dispatch_table(instance);
-
-    // Gather incoming image info and check image format for compatibility with
-    // the target format.
-    // This function supports both 24-bit and 32-bit swapchain images.
-    uint32_t const width = imageMap[image1]->imageExtent.width;
-    uint32_t const height = imageMap[image1]->imageExtent.height;
-    VkFormat const format = imageMap[image1]->format;
-    uint32_t const numChannels = FormatChannelCount(format);
-
-    if ((3 != numChannels) && (4 != numChannels)) {
-        assert(0);
-        return;
-    }
-
+// Pick the 8 bit per channel format the swapchain image is converted to.
+static VkFormat getDestFormat(VkFormat format, uint32_t numChannels) {
     // Initial dest format is undefined as we will look for one
     VkFormat destformat = VK_FORMAT_UNDEFINED;
 
@@ -541,76 +528,178 @@ static void writePPM(const char *filename, VkImage image1) {
             destformat = VK_FORMAT_R8G8B8_UNORM;
     }
 
+    return destformat;
+}
+
+// Save a frame read back into a slot to an image file.  The pixels are
+// converted to RGB first, as every file format is written without alpha.
+static void writeScreenshot(const char *filename, const ReadbackRing *ring, const char *ptr, vector<uint8_t> &rgb) {
+    uint32_t const width = ring->width;
+    uint32_t const height = ring->height;
+
+    rgb.resize((size_t)width * height * 3);
+    convertToRGB((const uint8_t *)ptr, (size_t)width * ring->numChannels, ring->layout, width, height, rgb.data());
+
+    if (!writeScreenshotFile(filename, screenshotFileFormat, rgb.data(), width, height)) {
+#ifdef ANDROID
+        __android_log_print(ANDROID_LOG_DEBUG, "screenshot",
+                            "Failed to open output file: %s.  Be sure to grant read and write permissions.", filename);
+#else
+        fprintf(stderr, "Failed to open output file:%s,  Be sure to grant read and write permissions\n", filename);
+#endif
+    }
+}
+
+// Screenshot thread of a ring.  Waits for the copies in submission order and
+// writes them out, so the application never waits for the GPU or the disk.
+static void readbackWriterThread(ReadbackRing *ring) {
+    // Reused between screenshots of the same size.
+    vector<uint8_t> rgb;
+    std::unique_lock<std::mutex> lock(ring->mutex);
+    while (true) {
+        ring->cond.wait(lock, [ring] { return ring->quit || !ring->writeQueue.empty(); });
+        if (ring->writeQueue.empty()) return;
+        ReadbackSlot *slot = ring->writeQueue.front();
+        lock.unlock();
+
+        VkResult err = ring->pTableDevice->WaitForFences(ring->device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+        assert(!err);
+        if (VK_SUCCESS == err) {
+            if (!ring->hostCoherent) {
+                VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, NULL, slot->bufferMemory, 0, VK_WHOLE_SIZE};
+                ring->pTableDevice->InvalidateMappedMemoryRanges(ring->device, 1, &range);
+            }
+            writeScreenshot(slot->filename.c_str(), ring, slot->pixels, rgb);
+        }
+
+        lock.lock();
+        ring->writeQueue.pop_front();
+        slot->pending = false;
+        ring->cond.notify_all();
+    }
+}
+
+// Waits for the screenshots still in flight and frees the ring.  Handles that
+// were never created are VK_NULL_HANDLE, so this also cleans up after a
+// failed createReadbackRing().
+static void destroyReadbackRing(ReadbackRing *ring) {
+    {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        ring->quit = true;
+    }
+    ring->cond.notify_all();
+    if (ring->writer.joinable()) ring->writer.join();
+
+    VkDevice device = ring->device;
+    VkLayerDispatchTable *pTableDevice = ring->pTableDevice;
+    for (uint32_t i = 0; i < READBACK_RING_SIZE; i++) {
+        ReadbackSlot &slot = ring->slots[i];
+        if (slot.pixels) pTableDevice->UnmapMemory(device, slot.bufferMemory);
+        if (slot.buffer) pTableDevice->DestroyBuffer(device, slot.buffer, NULL);
+        if (slot.bufferMemory) pTableDevice->FreeMemory(device, slot.bufferMemory, NULL);
+        if (slot.blitImage) pTableDevice->DestroyImage(device, slot.blitImage, NULL);
+        if (slot.blitMemory) pTableDevice->FreeMemory(device, slot.blitMemory, NULL);
+        if (slot.fence) pTableDevice->DestroyFence(device, slot.fence, NULL);
+        if (slot.copyDone) pTableDevice->DestroySemaphore(device, slot.copyDone, NULL);
+    }
+    // Destroying the pool also frees the command buffers.
+    if (ring->commandPool) pTableDevice->DestroyCommandPool(device, ring->commandPool, NULL);
+    delete ring;
+}
+
+// Allocate the readback ring of a swapchain.
+//
+// Every slot owns a host-visible buffer that stays mapped, and, when a format
+// conversion is needed, an optimally tiled image to blit the swapchain image
+// to.  Blitting to an optimal image and then copying it to a buffer works on
+// devices that cannot blit to linear images, and the buffer is tightly packed
+// so the screenshot thread can read it without querying a subresource layout.
+// If the device cannot blit to the target format at all, just do a copy and
+// possibly have the wrong colors.  This should be quite rare.
+//
+// Error handling: If there is a problem, this function returns NULL and the
+// frame is presented without a screenshot.
+static ReadbackRing *createReadbackRing(SwapchainMapStruct *swapchainMapElem, uint32_t queueFamilyIndex) {
+    VkResult err;
+    VkDevice device = swapchainMapElem->device;
+    DeviceMapStruct *devMap = get_dev_info(device);
+    if (NULL == devMap) {
+        assert(0);
+        return NULL;
+    }
+    VkPhysicalDevice physicalDevice = devMap->physicalDevice;
+    VkLayerInstanceDispatchTable *pInstanceTable = instance_dispatch_table(physDeviceMap[physicalDevice]->instance);
+    VkLayerDispatchTable *pTableDevice = devMap->device_dispatch_table;
+
+    // This function supports both 24-bit and 32-bit swapchain images.
+    uint32_t const width = swapchainMapElem->imageExtent.width;
+    uint32_t const height = swapchainMapElem->imageExtent.height;
+    VkFormat const format = swapchainMapElem->format;
+    uint32_t const numChannels = FormatChannelCount(format);
+    if ((3 != numChannels) && (4 != numChannels)) {
+        assert(0);
+        return NULL;
+    }
+
+    VkFormat const destformat = getDestFormat(format, numChannels);
     if ((FormatCompatibilityClass(destformat) != FormatCompatibilityClass(format))) {
         assert(0);
-        return;
+        return NULL;
     }
 
-    // General Approach
-    //
-    // The idea here is to copy/convert the swapchain image into another image
-    // that can be mapped and read by the CPU to produce a PPM file.
-    // The image must be untiled and converted to a specific format for easy
-    // parsing.  The memory for the final image must be host-visible.
-    // Note that in Vulkan, a BLIT operation must be used to perform a format
-    // conversion.
-    //
-    // Devices vary in their ability to blit to/from linear and optimal tiling.
-    // So we must query the device properties to get this information.
-    //
-    // If the device cannot BLIT to a LINEAR image, then the operation must be
-    // done in two steps:
-    // 1) BLIT the swapchain image (image1) to a temp image (image2) that is
-    // created with TILING_OPTIMAL.
-    // 2) COPY image2 to another temp image (image3) that is created with
-    // TILING_LINEAR.
-    // 3) Map image 3 and write the PPM file.
-    //
-    // If the device can BLIT to a LINEAR image, then:
-    // 1) BLIT the swapchain image (image1) to a temp image (image2) that is
-    // created with TILING_LINEAR.
-    // 2) Map image 2 and write the PPM file.
-    //
-    // There seems to be no way to tell if the swapchain image (image1) is tiled
-    // or not.  We therefore assume that the BLIT operation can always read from
-    // both linear and optimal tiled (swapchain) images.
-    // There is therefore no point in looking at the BLIT_SRC properties.
-    //
-    // There is also the optimization where the incoming and target formats are
-    // the same.  In this case, just do a COPY.
+    // The copy is recorded on the presenting queue, which therefore needs to
+    // support transfers.
+    uint32_t queueFamilyCount = 0;
+    pInstanceTable->GetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+    vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    pInstanceTable->GetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    if (queueFamilyIndex >= queueFamilyCount ||
+        !(queueFamilies[queueFamilyIndex].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT))) {
+        return NULL;
+    }
 
     VkFormatProperties targetFormatProps;
     pInstanceTable->GetPhysicalDeviceFormatProperties(physicalDevice, destformat, &targetFormatProps);
-    bool need2steps = false;
-    bool copyOnly = false;
-    if (destformat == format) {
-        copyOnly = true;
+    bool const copyOnly = (destformat == format) || !(targetFormatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    pInstanceTable->GetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    ReadbackRing *ring = new ReadbackRing();
+    ring->device = device;
+    ring->pTableDevice = pTableDevice;
+    ring->queueFamilyIndex = queueFamilyIndex;
+    ring->width = width;
+    ring->height = height;
+    ring->numChannels = numChannels;
+    ring->destformat = destformat;
+    ring->copyOnly = copyOnly;
+    // A blit converts to the RGB(A) destformat, a plain copy keeps the
+    // swapchain's byte order.
+    bool const bgrSource = copyOnly && (format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB ||
+                                        format == VK_FORMAT_B8G8R8A8_SNORM || format == VK_FORMAT_B8G8R8A8_USCALED ||
+                                        format == VK_FORMAT_B8G8R8A8_SSCALED || format == VK_FORMAT_B8G8R8A8_UINT ||
+                                        format == VK_FORMAT_B8G8R8A8_SINT || format == VK_FORMAT_B8G8R8_UNORM ||
+                                        format == VK_FORMAT_B8G8R8_SRGB || format == VK_FORMAT_B8G8R8_SNORM ||
+                                        format == VK_FORMAT_B8G8R8_USCALED || format == VK_FORMAT_B8G8R8_SSCALED ||
+                                        format == VK_FORMAT_B8G8R8_UINT || format == VK_FORMAT_B8G8R8_SINT);
+    if (numChannels == 4) {
+        ring->layout = bgrSource ? PIXEL_LAYOUT_BGRA : PIXEL_LAYOUT_RGBA;
     } else {
-        bool const bltLinear = targetFormatProps.linearTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT ? true : false;
-        bool const bltOptimal = targetFormatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT ? true : false;
-        if (!bltLinear && !bltOptimal) {
-            // Cannot blit to either target tiling type.  It should be pretty
-            // unlikely to have a device that cannot blit to either type.
-            // But punt by just doing a copy and possibly have the wrong
-            // colors.  This should be quite rare.
-            copyOnly = true;
-        } else if (!bltLinear && bltOptimal) {
-            // Cannot blit to a linear target but can blt to optimal, so copy
-            // after blit is needed.
-            need2steps = true;
-        }
-        // Else bltLinear is available and only 1 step is needed.
+        ring->layout = bgrSource ? PIXEL_LAYOUT_BGR : PIXEL_LAYOUT_RGB;
     }
+    ring->hostCoherent = true;
 
-    // Put resources that need to be cleaned up in a struct with a destructor
-    // so that things get cleaned up when this function is exited.
-    WritePPMCleanupData data = {};
-    data.device = device;
-    data.pTableDevice = pTableDevice;
+    const VkCommandPoolCreateInfo commandPoolCreateInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, NULL,
+                                                           VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, queueFamilyIndex};
+    err = pTableDevice->CreateCommandPool(device, &commandPoolCreateInfo, NULL, &ring->commandPool);
+    assert(!err);
+    if (VK_SUCCESS != err) {
+        destroyReadbackRing(ring);
+        return NULL;
+    }
 
-    // Set up the image creation info for both the blit and copy images, in case
-    // both are needed.
-    VkImageCreateInfo imgCreateInfo2 = {
+    VkImageCreateInfo imgCreateInfo = {
         VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
         NULL,
         0,
@@ -620,298 +709,275 @@ static void writePPM(const char *filename, VkImage image1) {
         1,
         1,
         VK_SAMPLE_COUNT_1_BIT,
-        VK_IMAGE_TILING_LINEAR,
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
         VK_SHARING_MODE_EXCLUSIVE,
         0,
         NULL,
         VK_IMAGE_LAYOUT_UNDEFINED,
     };
-    VkImageCreateInfo imgCreateInfo3 = imgCreateInfo2;
-
-    // If we need both images, set up image2 to be read/write and tiled.
-    if (need2steps) {
-        imgCreateInfo2.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imgCreateInfo2.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-    }
-
+    const VkBufferCreateInfo bufferCreateInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                                 NULL,
+                                                 0,
+                                                 (VkDeviceSize)width * height * numChannels,
+                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                 VK_SHARING_MODE_EXCLUSIVE,
+                                                 0,
+                                                 NULL};
     VkMemoryAllocateInfo memAllocInfo = {
         VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, NULL,
         0,  // allocationSize, queried later
         0   // memoryTypeIndex, queried later
     };
     VkMemoryRequirements memRequirements;
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-
-    // Create image2 and allocate its memory.  It could be the intermediate or
-    // final image.
-    err = pTableDevice->CreateImage(device, &imgCreateInfo2, NULL, &data.image2);
-    assert(!err);
-    if (VK_SUCCESS != err) return;
-    pTableDevice->GetImageMemoryRequirements(device, data.image2, &memRequirements);
-    memAllocInfo.allocationSize = memRequirements.size;
-    pInstanceTable->GetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-    pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits,
-                                       need2steps ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                       &memAllocInfo.memoryTypeIndex);
-    assert(pass);
-    err = pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &data.mem2);
-    assert(!err);
-    if (VK_SUCCESS != err) return;
-    err = pTableQueue->BindImageMemory(device, data.image2, data.mem2, 0);
-    assert(!err);
-    if (VK_SUCCESS != err) return;
+    const VkCommandBufferAllocateInfo allocCommandBufferInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL,
+                                                                ring->commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
+    const VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, NULL, 0};
+    const VkSemaphoreCreateInfo semaphoreCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, NULL, 0};
+
+    for (uint32_t i = 0; i < READBACK_RING_SIZE; i++) {
+        ReadbackSlot &slot = ring->slots[i];
+
+        if (!copyOnly) {
+            err = pTableDevice->CreateImage(device, &imgCreateInfo, NULL, &slot.blitImage);
+            assert(!err);
+            if (VK_SUCCESS == err) {
+                pTableDevice->GetImageMemoryRequirements(device, slot.blitImage, &memRequirements);
+                memAllocInfo.allocationSize = memRequirements.size;
+                bool pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits,
+                                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memAllocInfo.memoryTypeIndex);
+                assert(pass);
+                err = pass ? pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &slot.blitMemory)
+                           : VK_ERROR_OUT_OF_DEVICE_MEMORY;
+            }
+            if (VK_SUCCESS == err) err = pTableDevice->BindImageMemory(device, slot.blitImage, slot.blitMemory, 0);
+            if (VK_SUCCESS != err) {
+                destroyReadbackRing(ring);
+                return NULL;
+            }
+        }
 
-    // Create image3 and allocate its memory, if needed.
-    if (need2steps) {
-        err = pTableDevice->CreateImage(device, &imgCreateInfo3, NULL, &data.image3);
+        // Prefer cached memory, since the screenshot thread reads every byte.
+        err = pTableDevice->CreateBuffer(device, &bufferCreateInfo, NULL, &slot.buffer);
         assert(!err);
-        if (VK_SUCCESS != err) return;
-        pTableDevice->GetImageMemoryRequirements(device, data.image3, &memRequirements);
-        memAllocInfo.allocationSize = memRequirements.size;
-        pInstanceTable->GetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-        pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                           &memAllocInfo.memoryTypeIndex);
-        assert(pass);
-        err = pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &data.mem3);
-        assert(!err);
-        if (VK_SUCCESS != err) return;
-        err = pTableQueue->BindImageMemory(device, data.image3, data.mem3, 0);
+        if (VK_SUCCESS == err) {
+            pTableDevice->GetBufferMemoryRequirements(device, slot.buffer, &memRequirements);
+            memAllocInfo.allocationSize = memRequirements.size;
+            bool pass = memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits,
+                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                                    &memAllocInfo.memoryTypeIndex) ||
+                        memory_type_from_properties(&memoryProperties, memRequirements.memoryTypeBits,
+                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &memAllocInfo.memoryTypeIndex);
+            assert(pass);
+            if (!(memoryProperties.memoryTypes[memAllocInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+                ring->hostCoherent = false;
+            }
+            err = pass ? pTableDevice->AllocateMemory(device, &memAllocInfo, NULL, &slot.bufferMemory)
+                       : VK_ERROR_OUT_OF_DEVICE_MEMORY;
+        }
+        if (VK_SUCCESS == err) err = pTableDevice->BindBufferMemory(device, slot.buffer, slot.bufferMemory, 0);
+        if (VK_SUCCESS == err) err = pTableDevice->MapMemory(device, slot.bufferMemory, 0, VK_WHOLE_SIZE, 0, (void **)&slot.pixels);
+        if (VK_SUCCESS == err) err = pTableDevice->CreateFence(device, &fenceCreateInfo, NULL, &slot.fence);
+        if (VK_SUCCESS == err) err = pTableDevice->CreateSemaphore(device, &semaphoreCreateInfo, NULL, &slot.copyDone);
+        if (VK_SUCCESS == err) err = pTableDevice->AllocateCommandBuffers(device, &allocCommandBufferInfo, &slot.commandBuffer);
         assert(!err);
-        if (VK_SUCCESS != err) return;
-    }
+        if (VK_SUCCESS != err) {
+            destroyReadbackRing(ring);
+            return NULL;
+        }
 
-    // Set up the command buffer.  We get a command buffer from a pool we saved
-    // in a hooked function, which would be the application's pool.
-    if (deviceMap[device]->commandPools.empty()) {
-        assert(!deviceMap[device]->commandPools.empty());
-        return;
+        // We have just created a dispatchable object, but the dispatch table has
+        // not been placed in the object yet.  When a "normal" application creates
+        // a command buffer, the dispatch table is installed by the top-level api
+        // binding (trampoline.c). But here, we have to do it ourselves.
+        if (!devMap->pfn_dev_init) {
+            *((const void **)slot.commandBuffer) = *(void **)device;
+        } else {
+            err = devMap->pfn_dev_init(device, (void *)slot.commandBuffer);
+            assert(!err);
+        }
     }
 
-    VkCommandPool commandPool = deviceMap[device]->commandPools.front();
+    ring->writer = std::thread(readbackWriterThread, ring);
+    return ring;
+}
 
-    const VkCommandBufferAllocateInfo allocCommandBufferInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL,
-        commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
-    data.commandPool = commandPool;
-    err = pTableDevice->AllocateCommandBuffers(device, &allocCommandBufferInfo, &data.commandBuffer);
-    assert(!err);
-    if (VK_SUCCESS != err) return;
-
-    VkDevice cmdBuf = static_cast<VkDevice>(static_cast<void *>(data.commandBuffer));
-    deviceMap.emplace(cmdBuf, devMap);
-    VkLayerDispatchTable *pTableCommandBuffer;
-    pTableCommandBuffer = get_dev_info(cmdBuf)->device_dispatch_table;
-
-    // We have just created a dispatchable object, but the dispatch table has
-    // not been placed in the object yet.  When a "normal" application creates
-    // a command buffer, the dispatch table is installed by the top-level api
-    // binding (trampoline.c). But here, we have to do it ourselves.
-    if (!devMap->pfn_dev_init) {
-        *((const void **)data.commandBuffer) = *(void **)device;
-    } else {
-        err = devMap->pfn_dev_init(device, (void *)data.commandBuffer);
-        assert(!err);
+// Wait until the next slot of the ring has been written out and claim it.
+static ReadbackSlot *acquireReadbackSlot(ReadbackRing *ring) {
+    std::unique_lock<std::mutex> lock(ring->mutex);
+    ReadbackSlot *slot = &ring->slots[ring->nextSlot];
+    ring->cond.wait(lock, [slot] { return !slot->pending; });
+    ring->nextSlot = (ring->nextSlot + 1) % READBACK_RING_SIZE;
+    return slot;
+}
+
+// Record and submit the copy of the first presented image into the swapchain's
+// readback ring, to be written to filename by the screenshot thread.
+//
+// The copy waits on the semaphores of the present and signals *pCopyDone,
+// which the present must wait on instead.  Nothing here waits for the GPU.
+//
+// Error handling: If there is a problem, this function returns false without
+// affecting the Present operation going on in the caller.
+static bool queueScreenshot(VkQueue queue, const VkPresentInfoKHR *pPresentInfo, const string &filename, VkSemaphore *pCopyDone) {
+    VkResult err;
+
+    // We'll dump only one image: the first
+    VkSwapchainKHR swapchain = pPresentInfo->pSwapchains[0];
+    auto swapchainIter = swapchainMap.find(swapchain);
+    auto queueIter = queueFamilyMap.find(queue);
+    if (swapchainIter == swapchainMap.end() || !swapchainIter->second->imageList || queueIter == queueFamilyMap.end()) return false;
+    SwapchainMapStruct *swapchainMapElem = swapchainIter->second;
+    VkImage image = swapchainMapElem->imageList[pPresentInfo->pImageIndices[0]];
+
+    ReadbackRing *ring = NULL;
+    auto ringIter = readbackRingMap.find(swapchain);
+    if (ringIter != readbackRingMap.end()) {
+        ring = ringIter->second;
+        if (ring->queueFamilyIndex != queueIter->second) {
+            destroyReadbackRing(ring);
+            readbackRingMap.erase(ringIter);
+            ring = NULL;
+        }
+    }
+    if (!ring) {
+        ring = createReadbackRing(swapchainMapElem, queueIter->second);
+        if (!ring) return false;
+        readbackRingMap[swapchain] = ring;
     }
 
+    ReadbackSlot *slot = acquireReadbackSlot(ring);
+    VkLayerDispatchTable *pTableDevice = ring->pTableDevice;
+    VkCommandBuffer commandBuffer = slot->commandBuffer;
+    slot->filename = filename;
+
     const VkCommandBufferBeginInfo commandBufferBeginInfo = {
         VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
     };
-    err = pTableCommandBuffer->BeginCommandBuffer(data.commandBuffer, &commandBufferBeginInfo);
+    err = pTableDevice->BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
     assert(!err);
+    if (VK_SUCCESS != err) return false;
 
-    // This barrier is used to transition from/to present Layout
+    // This barrier is used to transition from/to present Layout.  The
+    // application's rendering is made visible by the semaphore wait.
     VkImageMemoryBarrier presentMemoryBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
                                                  NULL,
-                                                 VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                 0,
                                                  VK_ACCESS_TRANSFER_READ_BIT,
                                                  VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
                                                  VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
                                                  VK_QUEUE_FAMILY_IGNORED,
                                                  VK_QUEUE_FAMILY_IGNORED,
-                                                 image1,
-                                                 {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
-
-    // This barrier is used to transition from a newly-created layout to a blt
-    // or copy destination layout.
-    VkImageMemoryBarrier destMemoryBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-                                              NULL,
-                                              0,
-                                              VK_ACCESS_TRANSFER_WRITE_BIT,
-                                              VK_IMAGE_LAYOUT_UNDEFINED,
-                                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                              VK_QUEUE_FAMILY_IGNORED,
-                                              VK_QUEUE_FAMILY_IGNORED,
-                                              data.image2,
-                                              {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
-
-    // This barrier is used to transition a dest layout to general layout.
-    VkImageMemoryBarrier generalMemoryBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-                                                 NULL,
-                                                 VK_ACCESS_TRANSFER_WRITE_BIT,
-                                                 VK_ACCESS_TRANSFER_READ_BIT,
-                                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                                 VK_IMAGE_LAYOUT_GENERAL,
-                                                 VK_QUEUE_FAMILY_IGNORED,
-                                                 VK_QUEUE_FAMILY_IGNORED,
-                                                 data.image2,
+                                                 image,
                                                  {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
+    pTableDevice->CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0,
+                                     NULL, 1, &presentMemoryBarrier);
 
-    VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
-
-    // The source image needs to be transitioned from present to transfer
-    // source.
-    pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
-                                            &presentMemoryBarrier);
-
-    // image2 needs to be transitioned from its undefined state to transfer
-    // destination.
-    pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1, &destMemoryBarrier);
+    const VkBufferImageCopy bufferCopyRegion = {
+        0, 0, 0, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1}, {0, 0, 0}, {ring->width, ring->height, 1}};
 
-    const VkImageCopy imageCopyRegion = {
-        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1}, {0, 0, 0}, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1}, {0, 0, 0}, {width, height, 1}};
-
-    if (copyOnly) {
-        pTableCommandBuffer->CmdCopyImage(data.commandBuffer, image1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, data.image2,
-                                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyRegion);
+    if (ring->copyOnly) {
+        pTableDevice->CmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1,
+                                           &bufferCopyRegion);
     } else {
+        // The blit image is transitioned from its undefined state to a transfer
+        // destination, and then to a transfer source for the copy to the buffer.
+        VkImageMemoryBarrier blitMemoryBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                                  NULL,
+                                                  0,
+                                                  VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                  VK_IMAGE_LAYOUT_UNDEFINED,
+                                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                                  VK_QUEUE_FAMILY_IGNORED,
+                                                  VK_QUEUE_FAMILY_IGNORED,
+                                                  slot->blitImage,
+                                                  {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
+        pTableDevice->CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL,
+                                         0, NULL, 1, &blitMemoryBarrier);
+
         VkImageBlit imageBlitRegion = {};
         imageBlitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         imageBlitRegion.srcSubresource.baseArrayLayer = 0;
         imageBlitRegion.srcSubresource.layerCount = 1;
         imageBlitRegion.srcSubresource.mipLevel = 0;
-        imageBlitRegion.srcOffsets[1].x = width;
-        imageBlitRegion.srcOffsets[1].y = height;
+        imageBlitRegion.srcOffsets[1].x = ring->width;
+        imageBlitRegion.srcOffsets[1].y = ring->height;
         imageBlitRegion.srcOffsets[1].z = 1;
         imageBlitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         imageBlitRegion.dstSubresource.baseArrayLayer = 0;
         imageBlitRegion.dstSubresource.layerCount = 1;
         imageBlitRegion.dstSubresource.mipLevel = 0;
-        imageBlitRegion.dstOffsets[1].x = width;
-        imageBlitRegion.dstOffsets[1].y = height;
+        imageBlitRegion.dstOffsets[1].x = ring->width;
+        imageBlitRegion.dstOffsets[1].y = ring->height;
         imageBlitRegion.dstOffsets[1].z = 1;
-
-        pTableCommandBuffer->CmdBlitImage(data.commandBuffer, image1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, data.image2,
-                                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlitRegion, VK_FILTER_NEAREST);
-        if (need2steps) {
-            // image 3 needs to be transitioned from its undefined state to a
-            // transfer destination.
-            destMemoryBarrier.image = data.image3;
-            pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
-                                                    &destMemoryBarrier);
-
-            // Transition image2 so that it can be read for the upcoming copy to
-            // image 3.
-            destMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            destMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            destMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            destMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            destMemoryBarrier.image = data.image2;
-            pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
-                                                    &destMemoryBarrier);
-
-            // This step essentially untiles the image.
-            pTableCommandBuffer->CmdCopyImage(data.commandBuffer, data.image2, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, data.image3,
-                                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyRegion);
-            generalMemoryBarrier.image = data.image3;
-        }
+        pTableDevice->CmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->blitImage,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlitRegion, VK_FILTER_NEAREST);
+
+        blitMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        blitMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        blitMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        blitMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        pTableDevice->CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL,
+                                         0, NULL, 1, &blitMemoryBarrier);
+
+        pTableDevice->CmdCopyImageToBuffer(commandBuffer, slot->blitImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1,
+                                           &bufferCopyRegion);
     }
 
-    // The destination needs to be transitioned from the optimal copy format to
-    // the format we can read with the CPU.
-    pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
-                                            &generalMemoryBarrier);
-
-    // Restore the swap chain image layout to what it was before.
-    // This may not be strictly needed, but it is generally good to restore
-    // things to original state.
-    presentMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    presentMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // Restore the swap chain image layout for the present.
     presentMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
     presentMemoryBarrier.dstAccessMask = 0;
-    pTableCommandBuffer->CmdPipelineBarrier(data.commandBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL, 1,
-                                            &presentMemoryBarrier);
+    presentMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    presentMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    pTableDevice->CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL,
+                                     0, NULL, 1, &presentMemoryBarrier);
+
+    // Make the copy visible to the screenshot thread once the fence signals.
+    const VkBufferMemoryBarrier hostMemoryBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                                                     NULL,
+                                                     VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                     VK_ACCESS_HOST_READ_BIT,
+                                                     VK_QUEUE_FAMILY_IGNORED,
+                                                     VK_QUEUE_FAMILY_IGNORED,
+                                                     slot->buffer,
+                                                     0,
+                                                     VK_WHOLE_SIZE};
+    pTableDevice->CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1,
+                                     &hostMemoryBarrier, 0, NULL);
+
+    err = pTableDevice->EndCommandBuffer(commandBuffer);
+    assert(!err);
+    if (VK_SUCCESS != err) return false;
 
-    err = pTableCommandBuffer->EndCommandBuffer(data.commandBuffer);
+    err = pTableDevice->ResetFences(ring->device, 1, &slot->fence);
     assert(!err);
+    if (VK_SUCCESS != err) return false;
 
-    VkFence nullFence = {VK_NULL_HANDLE};
+    vector<VkPipelineStageFlags> waitStages(pPresentInfo->waitSemaphoreCount, VK_PIPELINE_STAGE_TRANSFER_BIT);
     VkSubmitInfo submitInfo;
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.pNext = NULL;
-    submitInfo.waitSemaphoreCount = 0;
-    submitInfo.pWaitSemaphores = NULL;
-    submitInfo.pWaitDstStageMask = NULL;
+    submitInfo.waitSemaphoreCount = pPresentInfo->waitSemaphoreCount;
+    submitInfo.pWaitSemaphores = pPresentInfo->pWaitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStages.data();
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &data.commandBuffer;
-    submitInfo.signalSemaphoreCount = 0;
-    submitInfo.pSignalSemaphores = NULL;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &slot->copyDone;
 
-    err = pTableQueue->QueueSubmit(queue, 1, &submitInfo, nullFence);
+    err = pTableDevice->QueueSubmit(queue, 1, &submitInfo, slot->fence);
     assert(!err);
+    if (VK_SUCCESS != err) return false;
 
-    err = pTableQueue->QueueWaitIdle(queue);
-    assert(!err);
-
-    err = pTableDevice->DeviceWaitIdle(device);
-    assert(!err);
-
-    // Map the final image so that the CPU can read it.
-    const VkImageSubresource sr = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0};
-    VkSubresourceLayout srLayout;
-    const char *ptr;
-    if (!need2steps) {
-        pTableDevice->GetImageSubresourceLayout(device, data.image2, &sr, &srLayout);
-        err = pTableDevice->MapMemory(device, data.mem2, 0, VK_WHOLE_SIZE, 0, (void **)&ptr);
-        assert(!err);
-        if (VK_SUCCESS != err) return;
-        data.mem2mapped = true;
-    } else {
-        pTableDevice->GetImageSubresourceLayout(device, data.image3, &sr, &srLayout);
-        err = pTableDevice->MapMemory(device, data.mem3, 0, VK_WHOLE_SIZE, 0, (void **)&ptr);
-        assert(!err);
-        if (VK_SUCCESS != err) return;
-        data.mem3mapped = true;
-    }
-
-    // Write the data to a PPM file.
-    ofstream file(filename, ios::binary);
-    assert(file.is_open());
-
-    if (!file.is_open()) {
-#ifdef ANDROID
-        __android_log_print(ANDROID_LOG_DEBUG, "screenshot",
-                            "Failed to open output file: %s.  Be sure to grant read and write permissions.", filename);
-#else
-        fprintf(stderr, "Failed to open output file:%s,  Be sure to grant read and write permissions\n", filename);
-#endif
-        return;
-    }
-
-    file << "P6\n";
-    file << width << "\n";
-    file << height << "\n";
-    file << 255 << "\n";
-
-    ptr += srLayout.offset;
-    if (3 == numChannels) {
-        for (uint32_t y = 0; y < height; y++) {
-            file.write(ptr, 3 * width);
-            ptr += srLayout.rowPitch;
-        }
-    } else if (4 == numChannels) {
-        for (uint32_t y = 0; y < height; y++) {
-            const unsigned int *row = (const unsigned int *)ptr;
-            for (uint32_t x = 0; x < width; x++) {
-                file.write((char *)row, 3);
-                row++;
-            }
-            ptr += srLayout.rowPitch;
-        }
+    {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        slot->pending = true;
+        ring->writeQueue.push_back(slot);
     }
-    file.close();
+    ring->cond.notify_all();
 
-    // Clean up handled by ~WritePPMCleanupData()
+    *pCopyDone = slot->copyDone;
+    return true;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator,
@@ -947,6 +1013,7 @@ static void createDeviceRegisterExtensions(const VkDeviceCreateInfo *pCreateInfo
     VkLayerDispatchTable *pDisp = devMap->device_dispatch_table;
     PFN_vkGetDeviceProcAddr gpa = pDisp->GetDeviceProcAddr;
     pDisp->CreateSwapchainKHR = (PFN_vkCreateSwapchainKHR)gpa(device, "vkCreateSwapchainKHR");
+    pDisp->DestroySwapchainKHR = (PFN_vkDestroySwapchainKHR)gpa(device, "vkDestroySwapchainKHR");
     pDisp->GetSwapchainImagesKHR = (PFN_vkGetSwapchainImagesKHR)gpa(device, "vkGetSwapchainImagesKHR");
     pDisp->AcquireNextImageKHR = (PFN_vkAcquireNextImageKHR)gpa(device, "vkAcquireNextImageKHR");
     pDisp->QueuePresentKHR = (PFN_vkQueuePresentKHR)gpa(device, "vkQueuePresentKHR");
@@ -1022,6 +1089,19 @@ VKAPI_ATTR void VKAPI_CALL DestroyDevice(VkDevice device, const VkAllocationCall
     DeviceMapStruct *devMap = get_dev_info(device);
     assert(devMap);
     VkLayerDispatchTable *pDisp = devMap->device_dispatch_table;
+
+    // Finish the screenshots still in flight while the device is alive.
+    loader_platform_thread_lock_mutex(&globalLock);
+    for (auto ringIter = readbackRingMap.begin(); ringIter != readbackRingMap.end();) {
+        if (ringIter->second->device == device) {
+            destroyReadbackRing(ringIter->second);
+            ringIter = readbackRingMap.erase(ringIter);
+        } else {
+            ++ringIter;
+        }
+    }
+    loader_platform_thread_unlock_mutex(&globalLock);
+
     pDisp->DestroyDevice(device, pAllocator);
 
     local_free_getenv(vk_screenshot_format);
@@ -1050,53 +1130,12 @@ VKAPI_ATTR void VKAPI_CALL GetDeviceQueue(VkDevice device, uint32_t queueNodeInd
     VkDevice que = static_cast<VkDevice>(static_cast<void *>(*pQueue));
     deviceMap.emplace(que, devMap);
 
-    // Create a mapping from a device to a queue
-    devMap->queue = *pQueue;
-    loader_platform_thread_unlock_mutex(&globalLock);
-}
-
-VKAPI_ATTR VkResult VKAPI_CALL CreateCommandPool(VkDevice device, const VkCommandPoolCreateInfo *pCreateInfo,
-                                                 const VkAllocationCallbacks *pAllocator, VkCommandPool *pCommandPool) {
-    DeviceMapStruct *devMap = get_dev_info(device);
-    assert(devMap);
-    VkLayerDispatchTable *pDisp = devMap->device_dispatch_table;
-    VkResult result = pDisp->CreateCommandPool(device, pCreateInfo, pAllocator, pCommandPool);
-
-    // Save the command pool on a map if we are taking screenshots.
-    loader_platform_thread_lock_mutex(&globalLock);
-    if (screenshotFramesReceived && screenshotFrames.empty() && !screenShotFrameRange.valid) {
-        // No screenshots in the list to take
-        loader_platform_thread_unlock_mutex(&globalLock);
-        return result;
-    }
-
-    // Create a mapping from a device to a commandPool
-    devMap->commandPools.push_front(*pCommandPool);
-    loader_platform_thread_unlock_mutex(&globalLock);
-    return result;
-}
-
-VKAPI_ATTR void VKAPI_CALL DestroyCommandPool(VkDevice device, VkCommandPool commandPool, const VkAllocationCallbacks *pAllocator) {
-    DeviceMapStruct *devMap = get_dev_info(device);
-    assert(devMap);
-    VkLayerDispatchTable *pDisp = devMap->device_dispatch_table;
-    pDisp->DestroyCommandPool(device, commandPool, pAllocator);
-
-    // Remove the command pool from the map if we are taking screenshots.
-    loader_platform_thread_lock_mutex(&globalLock);
-    if (screenshotFramesReceived && screenshotFrames.empty() && !screenShotFrameRange.valid) {
-        // No screenshots in the list to take
-        loader_platform_thread_unlock_mutex(&globalLock);
-        return;
-    }
-
-    // Remove the commandPool from the device mapping
-    devMap->commandPools.remove(commandPool);
+    // Create a mapping from a queue to its queue family, which the readback
+    // command pool is created for.
+    queueFamilyMap[*pQueue] = queueNodeIndex;
     loader_platform_thread_unlock_mutex(&globalLock);
-    return;
 }
 
-
 VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(VkDevice device, const VkSwapchainCreateInfoKHR *pCreateInfo,
                                                   const VkAllocationCallbacks *pAllocator, VkSwapchainKHR *pSwapchain) {
     DeviceMapStruct *devMap = get_dev_info(device);
@@ -1124,6 +1163,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(VkDevice device, const VkSwapc
         swapchainMapElem->device = device;
         swapchainMapElem->imageExtent = pCreateInfo->imageExtent;
         swapchainMapElem->format = pCreateInfo->imageFormat;
+        swapchainMapElem->imageList = NULL;
         swapchainMap.insert(make_pair(*pSwapchain, swapchainMapElem));
 
         // Create a mapping for the swapchain object into the dispatch table
@@ -1151,23 +1191,12 @@ VKAPI_ATTR VkResult VKAPI_CALL GetSwapchainImagesKHR(VkDevice device, VkSwapchai
     }
 
     if (result == VK_SUCCESS && pSwapchainImages && !swapchainMap.empty() && swapchainMap.find(swapchain) != swapchainMap.end()) {
-        unsigned i;
-
-        for (i = 0; i < *pCount; i++) {
-            // Create a mapping for an image to a device, image extent, and
-            // format
-            if (imageMap[pSwapchainImages[i]] == NULL) {
-                ImageMapStruct *imageMapElem = new ImageMapStruct;
-                imageMap[pSwapchainImages[i]] = imageMapElem;
-            }
-            imageMap[pSwapchainImages[i]]->device = swapchainMap[swapchain]->device;
-            imageMap[pSwapchainImages[i]]->imageExtent = swapchainMap[swapchain]->imageExtent;
-            imageMap[pSwapchainImages[i]]->format = swapchainMap[swapchain]->format;
-        }
+        unsigned i = *pCount;
 
         // Add list of images to swapchain to image map
         SwapchainMapStruct *swapchainMapElem = swapchainMap[swapchain];
         if (i >= 1 && swapchainMapElem) {
+            delete[] swapchainMapElem->imageList;
             VkImage *imageList = new VkImage[i];
             swapchainMapElem->imageList = imageList;
             for (unsigned j = 0; j < i; j++) {
@@ -1179,6 +1208,29 @@ VKAPI_ATTR VkResult VKAPI_CALL GetSwapchainImagesKHR(VkDevice device, VkSwapchai
     return result;
 }
 
+VKAPI_ATTR void VKAPI_CALL DestroySwapchainKHR(VkDevice device, VkSwapchainKHR swapchain, const VkAllocationCallbacks *pAllocator) {
+    DeviceMapStruct *devMap = get_dev_info(device);
+    assert(devMap);
+    VkLayerDispatchTable *pDisp = devMap->device_dispatch_table;
+
+    // Finish the swapchain's screenshots still in flight and forget it.
+    loader_platform_thread_lock_mutex(&globalLock);
+    auto ringIter = readbackRingMap.find(swapchain);
+    if (ringIter != readbackRingMap.end()) {
+        destroyReadbackRing(ringIter->second);
+        readbackRingMap.erase(ringIter);
+    }
+    auto swapchainIter = swapchainMap.find(swapchain);
+    if (swapchainIter != swapchainMap.end()) {
+        delete[] swapchainIter->second->imageList;
+        delete swapchainIter->second;
+        swapchainMap.erase(swapchainIter);
+    }
+    loader_platform_thread_unlock_mutex(&globalLock);
+
+    pDisp->DestroySwapchainKHR(device, swapchain, pAllocator);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo) {
     static int frameNumber = 0;
     if (frameNumber == 10) {
@@ -1187,7 +1239,8 @@ VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue queue, const VkPresentInf
     DeviceMapStruct *devMap = get_dev_info((VkDevice)queue);
     assert(devMap);
     VkLayerDispatchTable *pDisp = devMap->device_dispatch_table;
-    VkResult result = pDisp->QueuePresentKHR(queue, pPresentInfo);
+    VkPresentInfoKHR presentInfo = *pPresentInfo;
+    VkSemaphore copyDone = VK_NULL_HANDLE;
     loader_platform_thread_lock_mutex(&globalLock);
 
     if (!screenshotFramesReceived) {
@@ -1207,7 +1260,7 @@ VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue queue, const VkPresentInf
         local_free_getenv(vk_screenshot_frames);
     }
 
-    if (result == VK_SUCCESS && (!screenshotFrames.empty() || screenShotFrameRange.valid)) {
+    if (!screenshotFrames.empty() || screenShotFrameRange.valid) {
         set<int>::iterator it;
         bool inScreenShotFrames = false;
         bool inScreenShotFrameRange = false;
@@ -1222,38 +1275,36 @@ VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue queue, const VkPresentInf
             char buffer[64];
             snprintf(buffer, sizeof(buffer), "/sdcard/Android/%d", frameNumber);
             std::string base(buffer);
-            fileName = base + ".ppm";
+            fileName = base + getScreenshotFileExtension(screenshotFileFormat);
 #else
-            fileName = to_string(frameNumber) + ".ppm";
+            fileName = to_string(frameNumber) + getScreenshotFileExtension(screenshotFileFormat);
             printf("Screen Capture file is: %s \n", fileName.c_str());
 #endif
 
-            VkImage image;
-            VkSwapchainKHR swapchain;
-            // We'll dump only one image: the first
-            swapchain = pPresentInfo->pSwapchains[0];
-            image = swapchainMap[swapchain]->imageList[pPresentInfo->pImageIndices[0]];
-            writePPM(fileName.c_str(), image);
+            // The copy has waited on the application's semaphores, so the
+            // present only needs to wait on the copy.
+            if (queueScreenshot(queue, pPresentInfo, fileName, &copyDone)) {
+                presentInfo.waitSemaphoreCount = 1;
+                presentInfo.pWaitSemaphores = &copyDone;
+            }
             if (inScreenShotFrames) {
                 screenshotFrames.erase(it);
             }
 
             if (screenshotFrames.empty() && isEndOfScreenShotFrameRange(frameNumber, &screenShotFrameRange)) {
-                // Free all our maps since we are done with them.
+                // Free all our maps since we are done with them.  The readback
+                // rings are kept until their swapchain is destroyed, since the
+                // last screenshots are still in flight.
                 for (auto swapchainIter = swapchainMap.begin(); swapchainIter != swapchainMap.end(); swapchainIter++) {
                     SwapchainMapStruct *swapchainMapElem = swapchainIter->second;
+                    delete[] swapchainMapElem->imageList;
                     delete swapchainMapElem;
                 }
-                for (auto imageIter = imageMap.begin(); imageIter != imageMap.end(); imageIter++) {
-                    ImageMapStruct *imageMapElem = imageIter->second;
-                    delete imageMapElem;
-                }
                 for (auto physDeviceIter = physDeviceMap.begin(); physDeviceIter != physDeviceMap.end(); physDeviceIter++) {
                     PhysDeviceMapStruct *physDeviceMapElem = physDeviceIter->second;
                     delete physDeviceMapElem;
                 }
                 swapchainMap.clear();
-                imageMap.clear();
                 physDeviceMap.clear();
                 screenShotFrameRange.valid = false;
             }
@@ -1261,7 +1312,7 @@ VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue queue, const VkPresentInf
     }
     frameNumber++;
     loader_platform_thread_unlock_mutex(&globalLock);
-    return result;
+    return pDisp->QueuePresentKHR(queue, &presentInfo);
 }
 
 // Unused, but this could be provided as an extension or utility to the
@@ -1369,8 +1420,6 @@ static PFN_vkVoidFunction intercept_core_device_command(const char *name) {
     } core_device_commands[] = {
         {"vkGetDeviceProcAddr", reinterpret_cast<PFN_vkVoidFunction>(GetDeviceProcAddr)},
         {"vkGetDeviceQueue", reinterpret_cast<PFN_vkVoidFunction>(GetDeviceQueue)},
-        {"vkCreateCommandPool", reinterpret_cast<PFN_vkVoidFunction>(CreateCommandPool)},
-        {"vkDestroyCommandPool", reinterpret_cast<PFN_vkVoidFunction>(DestroyCommandPool)},
         {"vkDestroyDevice", reinterpret_cast<PFN_vkVoidFunction>(DestroyDevice)},
     };
 
@@ -1388,6 +1437,7 @@ static PFN_vkVoidFunction intercept_khr_swapchain_command(const char *name, VkDe
     } khr_swapchain_commands[] = {
         {"vkCreateSwapchainKHR", reinterpret_cast<PFN_vkVoidFunction>(CreateSwapchainKHR)},
         {"vkGetSwapchainImagesKHR", reinterpret_cast<PFN_vkVoidFunction>(GetSwapchainImagesKHR)},
+        {"vkDestroySwapchainKHR", reinterpret_cast<PFN_vkVoidFunction>(DestroySwapchainKHR)},
         {"vkQueuePresentKHR", reinterpret_cast<PFN_vkVoidFunction>(QueuePresentKHR)},
     };
 
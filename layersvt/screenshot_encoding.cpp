@@ -0,0 +1,566 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "screenshot_encoding.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SCREENSHOT_USE_SSSE3
+#include <tmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SSSE3_TARGET
+#else
+#include <cpuid.h>
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SCREENSHOT_USE_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+namespace screenshot {
+
+// Rows are only split between threads in blocks of at least this many rows.
+static const uint32_t MIN_ROWS_PER_THREAD = 64;
+static const uint32_t MAX_WORKER_THREADS = 8;
+
+// Run func(firstRow, endRow) over [0, rowCount), split into contiguous
+// blocks. The first block runs on the calling thread.
+static void forEachRowBlock(uint32_t rowCount, const function<void(uint32_t, uint32_t)> &func) {
+    uint32_t threadCount = min(max(thread::hardware_concurrency(), 1u), MAX_WORKER_THREADS);
+    threadCount = max(min(threadCount, rowCount / MIN_ROWS_PER_THREAD), 1u);
+    uint32_t const rowsPerThread = (rowCount + threadCount - 1) / threadCount;
+
+    vector<thread> workers;
+    for (uint32_t firstRow = rowsPerThread; firstRow < rowCount; firstRow += rowsPerThread) {
+        workers.emplace_back(func, firstRow, min(firstRow + rowsPerThread, rowCount));
+    }
+    func(0, min(rowsPerThread, rowCount));
+    for (auto &worker : workers) worker.join();
+}
+
+bool parseScreenshotFileFormat(const char *name, ScreenshotFileFormat *pFormat) {
+    if (!strcmp(name, "PPM")) {
+        *pFormat = FILE_FORMAT_PPM;
+    } else if (!strcmp(name, "PNG")) {
+        *pFormat = FILE_FORMAT_PNG;
+    } else if (!strcmp(name, "QOI")) {
+        *pFormat = FILE_FORMAT_QOI;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *getScreenshotFileExtension(ScreenshotFileFormat format) {
+    switch (format) {
+        case FILE_FORMAT_PNG:
+            return ".png";
+        case FILE_FORMAT_QOI:
+            return ".qoi";
+        default:
+            return ".ppm";
+    }
+}
+
+// Pixel conversion
+
+static void convertRowScalar(const uint8_t *src, PixelLayout layout, uint32_t width, uint8_t *dst) {
+    uint32_t const srcChannels = (layout == PIXEL_LAYOUT_RGBA || layout == PIXEL_LAYOUT_BGRA) ? 4 : 3;
+    bool const swapRB = (layout == PIXEL_LAYOUT_BGR || layout == PIXEL_LAYOUT_BGRA);
+    for (uint32_t x = 0; x < width; x++, src += srcChannels, dst += 3) {
+        dst[0] = swapRB ? src[2] : src[0];
+        dst[1] = src[1];
+        dst[2] = swapRB ? src[0] : src[2];
+    }
+}
+
+#if defined(SCREENSHOT_USE_SSSE3)
+static bool hasSSSE3() {
+#if defined(_MSC_VER)
+    int cpuInfo[4];
+    __cpuid(cpuInfo, 1);
+    return (cpuInfo[2] & (1 << 9)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 9)) != 0;
+#endif
+}
+
+// Every iteration stores 16 bytes, of which the last 4 (4 channel sources) or
+// 1 (3 channel sources) are overwritten by the next iteration. The loops stop
+// early enough for these stores to stay inside the row; the scalar loop
+// converts the remaining pixels.
+SSSE3_TARGET static void convertRowSSSE3(const uint8_t *src, PixelLayout layout, uint32_t width, uint8_t *dst) {
+    uint32_t x = 0;
+    if (layout == PIXEL_LAYOUT_RGBA || layout == PIXEL_LAYOUT_BGRA) {
+        __m128i const shuffle = (layout == PIXEL_LAYOUT_RGBA)
+                                    ? _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1)
+                                    : _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        for (; x + 6 <= width; x += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x * 4));
+            _mm_storeu_si128((__m128i *)(dst + x * 3), _mm_shuffle_epi8(pixels, shuffle));
+        }
+        convertRowScalar(src + x * 4, layout, width - x, dst + x * 3);
+    } else {
+        __m128i const shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -1);
+        for (; x + 6 <= width; x += 5) {
+            __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x * 3));
+            _mm_storeu_si128((__m128i *)(dst + x * 3), _mm_shuffle_epi8(pixels, shuffle));
+        }
+        convertRowScalar(src + x * 3, layout, width - x, dst + x * 3);
+    }
+}
+#endif
+
+#if defined(SCREENSHOT_USE_NEON)
+static void convertRowNEON(const uint8_t *src, PixelLayout layout, uint32_t width, uint8_t *dst) {
+    uint32_t x = 0;
+    bool const swapRB = (layout == PIXEL_LAYOUT_BGR || layout == PIXEL_LAYOUT_BGRA);
+    if (layout == PIXEL_LAYOUT_RGBA || layout == PIXEL_LAYOUT_BGRA) {
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x4_t pixels = vld4q_u8(src + x * 4);
+            uint8x16x3_t rgb = {{swapRB ? pixels.val[2] : pixels.val[0], pixels.val[1], swapRB ? pixels.val[0] : pixels.val[2]}};
+            vst3q_u8(dst + x * 3, rgb);
+        }
+        convertRowScalar(src + x * 4, layout, width - x, dst + x * 3);
+    } else {
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x3_t pixels = vld3q_u8(src + x * 3);
+            uint8x16x3_t rgb = {{pixels.val[2], pixels.val[1], pixels.val[0]}};
+            vst3q_u8(dst + x * 3, rgb);
+        }
+        convertRowScalar(src + x * 3, layout, width - x, dst + x * 3);
+    }
+}
+#endif
+
+void convertToRGB(const uint8_t *src, size_t srcRowPitch, PixelLayout layout, uint32_t width, uint32_t height, uint8_t *dst) {
+    void (*convertRow)(const uint8_t *, PixelLayout, uint32_t, uint8_t *) = convertRowScalar;
+#if defined(SCREENSHOT_USE_SSSE3)
+    if (hasSSSE3()) convertRow = convertRowSSSE3;
+#elif defined(SCREENSHOT_USE_NEON)
+    convertRow = convertRowNEON;
+#endif
+
+    size_t const dstRowPitch = (size_t)width * 3;
+    forEachRowBlock(height, [=](uint32_t firstRow, uint32_t endRow) {
+        for (uint32_t y = firstRow; y < endRow; y++) {
+            if (layout == PIXEL_LAYOUT_RGB) {
+                memcpy(dst + y * dstRowPitch, src + y * srcRowPitch, dstRowPitch);
+            } else {
+                convertRow(src + y * srcRowPitch, layout, width, dst + y * dstRowPitch);
+            }
+        }
+    });
+}
+
+// PPM
+
+static bool writePPMFile(ofstream &file, const uint8_t *rgb, uint32_t width, uint32_t height) {
+    file << "P6\n";
+    file << width << "\n";
+    file << height << "\n";
+    file << 255 << "\n";
+    file.write((const char *)rgb, (size_t)width * height * 3);
+    return file.good();
+}
+
+// PNG
+//
+// The filtered rows are split into blocks that are deflated independently on
+// worker threads, each ending on a byte boundary, and concatenated into a
+// single zlib stream (as pigz does). The deflate encoder only uses the fixed
+// Huffman codes, with greedy LZ77 matching over a hash chain.
+
+struct Crc32Table {
+    uint32_t entries[256];
+    Crc32Table() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+static uint32_t updateCrc32(uint32_t crc, const uint8_t *data, size_t size) {
+    static const Crc32Table table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static const uint32_t ADLER_BASE = 65521;
+
+static uint32_t updateAdler32(uint32_t adler, const uint8_t *data, size_t size) {
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (size > 0) {
+        // 5552 is the largest block for which b cannot overflow.
+        size_t const blockSize = min(size, (size_t)5552);
+        for (size_t i = 0; i < blockSize; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+        data += blockSize;
+        size -= blockSize;
+    }
+    return (b << 16) | a;
+}
+
+// Adler-32 of the concatenation of two blocks, the second one size2 bytes long.
+static uint32_t combineAdler32(uint32_t adler1, uint32_t adler2, size_t size2) {
+    uint32_t const rem = (uint32_t)(size2 % ADLER_BASE);
+    uint32_t sum1 = adler1 & 0xffff;
+    uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % ADLER_BASE);
+    sum1 += (adler2 & 0xffff) + ADLER_BASE - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - rem;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum2 >= (ADLER_BASE << 1)) sum2 -= (ADLER_BASE << 1);
+    if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+    return (sum2 << 16) | sum1;
+}
+
+class DeflateWriter {
+   public:
+    DeflateWriter(vector<uint8_t> &out) : out(out), bits(0), bitCount(0) {}
+
+    void writeBits(uint32_t value, uint32_t count) {
+        bits |= (uint64_t)value << bitCount;
+        bitCount += count;
+        while (bitCount >= 8) {
+            out.push_back((uint8_t)bits);
+            bits >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    // Huffman codes are stored starting with their most significant bit.
+    void writeCode(uint32_t code, uint32_t length) {
+        uint32_t reversed = 0;
+        for (uint32_t i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+        writeBits(reversed, length);
+    }
+
+    void writeLiteral(uint32_t value) {
+        if (value < 144) {
+            writeCode(0x30 + value, 8);
+        } else if (value < 256) {
+            writeCode(0x190 + value - 144, 9);
+        } else if (value < 280) {
+            writeCode(value - 256, 7);
+        } else {
+            writeCode(0xc0 + value - 280, 8);
+        }
+    }
+
+    void writeMatch(uint32_t length, uint32_t distance) {
+        static const uint16_t lengthBase[] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                              31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const uint8_t lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t distanceBase[] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                                193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static const uint8_t distanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        uint32_t lengthCode = 28;
+        while (lengthBase[lengthCode] > length) lengthCode--;
+        writeLiteral(257 + lengthCode);
+        writeBits(length - lengthBase[lengthCode], lengthExtra[lengthCode]);
+
+        uint32_t distanceCode = 29;
+        while (distanceBase[distanceCode] > distance) distanceCode--;
+        writeCode(distanceCode, 5);
+        writeBits(distance - distanceBase[distanceCode], distanceExtra[distanceCode]);
+    }
+
+    void alignToByte() {
+        if (bitCount > 0) writeBits(0, 8 - bitCount);
+    }
+
+   private:
+    vector<uint8_t> &out;
+    uint64_t bits;
+    uint32_t bitCount;
+};
+
+// Compress data as one fixed Huffman block. Unless it is the final block, it
+// is followed by an empty stored block so that the output ends on a byte
+// boundary and the next block can be appended to it.
+static void deflateBlock(const uint8_t *data, size_t size, bool final, vector<uint8_t> &out) {
+    static const uint32_t HASH_BITS = 15;
+    static const size_t WINDOW_SIZE = 32768;
+    static const uint32_t MIN_MATCH = 3;
+    static const uint32_t MAX_MATCH = 258;
+    static const uint32_t MAX_CHAIN = 32;
+
+    DeflateWriter writer(out);
+    writer.writeBits(final ? 1 : 0, 1);
+    writer.writeBits(1, 2);
+
+    // head holds the last position + 1 of each hash, prev the previous
+    // position + 1 with the same hash as a position in the window.
+    vector<uint32_t> head(1 << HASH_BITS, 0);
+    vector<uint32_t> prev(WINDOW_SIZE, 0);
+    auto hash = [data](size_t pos) {
+        uint32_t const value = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    };
+    auto insert = [&](size_t pos) {
+        uint32_t const h = hash(pos);
+        prev[pos % WINDOW_SIZE] = head[h];
+        head[h] = (uint32_t)pos + 1;
+    };
+
+    size_t pos = 0;
+    while (pos < size) {
+        uint32_t bestLength = 0, bestDistance = 0;
+        if (pos + MIN_MATCH <= size) {
+            uint32_t const maxLength = (uint32_t)min((size_t)MAX_MATCH, size - pos);
+            uint32_t candidate = head[hash(pos)];
+            for (uint32_t chain = 0; candidate > 0 && chain < MAX_CHAIN; chain++) {
+                size_t const match = candidate - 1;
+                if (pos - match > WINDOW_SIZE) break;
+                uint32_t length = 0;
+                while (length < maxLength && data[match + length] == data[pos + length]) length++;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = (uint32_t)(pos - match);
+                    if (length == maxLength) break;
+                }
+                uint32_t const next = prev[match % WINDOW_SIZE];
+                if (next >= candidate) break;
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= MIN_MATCH) {
+            writer.writeMatch(bestLength, bestDistance);
+            for (size_t end = pos + bestLength; pos < end; pos++) {
+                if (pos + MIN_MATCH <= size) insert(pos);
+            }
+        } else {
+            writer.writeLiteral(data[pos]);
+            if (pos + MIN_MATCH <= size) insert(pos);
+            pos++;
+        }
+    }
+    writer.writeLiteral(256);
+
+    if (!final) {
+        writer.writeBits(0, 3);
+        writer.alignToByte();
+        writer.writeBits(0x0000, 16);
+        writer.writeBits(0xffff, 16);
+    } else {
+        writer.alignToByte();
+    }
+}
+
+static uint8_t paethPredictor(int a, int b, int c) {
+    int const p = a + b - c;
+    int const pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return (uint8_t)a;
+    if (pb <= pc) return (uint8_t)b;
+    return (uint8_t)c;
+}
+
+// Filter a row with the Sub, Up or Paeth filter, whichever gives the smallest
+// sum of absolute differences, and store the filter type before it. scratch
+// holds rowSize * 3 bytes.
+static void filterRow(const uint8_t *row, const uint8_t *prevRow, size_t rowSize, uint8_t *scratch, uint8_t *out) {
+    static const size_t BPP = 3;
+    uint8_t *candidates[3];
+    uint64_t bestSum = UINT64_MAX;
+    uint32_t best = 0;
+    for (uint32_t filter = 0; filter < 3; filter++) {
+        uint8_t *filtered = candidates[filter] = scratch + filter * rowSize;
+        uint64_t sum = 0;
+        for (size_t i = 0; i < rowSize; i++) {
+            int const left = (i >= BPP) ? row[i - BPP] : 0;
+            int const up = prevRow ? prevRow[i] : 0;
+            int const upLeft = (prevRow && i >= BPP) ? prevRow[i - BPP] : 0;
+            uint8_t predicted = (filter == 0) ? (uint8_t)left : (filter == 1) ? (uint8_t)up : paethPredictor(left, up, upLeft);
+            filtered[i] = (uint8_t)(row[i] - predicted);
+            sum += (filtered[i] < 128) ? filtered[i] : 256 - filtered[i];
+        }
+        if (sum < bestSum) {
+            bestSum = sum;
+            best = filter;
+        }
+    }
+    static const uint8_t filterTypes[] = {1, 2, 4};
+    out[0] = filterTypes[best];
+    memcpy(out + 1, candidates[best], rowSize);
+}
+
+static void writePNGChunk(ofstream &file, const char *type, const uint8_t *data, size_t size) {
+    uint8_t header[8] = {(uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size};
+    memcpy(header + 4, type, 4);
+    uint32_t const crc = updateCrc32(updateCrc32(0, header + 4, 4), data, size);
+    uint8_t const trailer[4] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc};
+    file.write((const char *)header, sizeof(header));
+    file.write((const char *)data, size);
+    file.write((const char *)trailer, sizeof(trailer));
+}
+
+static bool writePNGFile(ofstream &file, const uint8_t *rgb, uint32_t width, uint32_t height) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+    // Each block of rows is filtered and compressed on its own thread.
+    size_t const rowSize = (size_t)width * 3;
+    struct CompressedBlock {
+        vector<uint8_t> data;
+        uint32_t adler;
+        size_t filteredSize;
+        bool valid;
+    };
+    vector<CompressedBlock> blocks(height);
+    forEachRowBlock(height, [&](uint32_t firstRow, uint32_t endRow) {
+        vector<uint8_t> filtered((endRow - firstRow) * (rowSize + 1));
+        vector<uint8_t> scratch(rowSize * 3);
+        for (uint32_t y = firstRow; y < endRow; y++) {
+            filterRow(rgb + y * rowSize, y > 0 ? rgb + (y - 1) * rowSize : nullptr, rowSize, scratch.data(),
+                      &filtered[(y - firstRow) * (rowSize + 1)]);
+        }
+        CompressedBlock &block = blocks[firstRow];
+        deflateBlock(filtered.data(), filtered.size(), endRow == height, block.data);
+        block.adler = updateAdler32(1, filtered.data(), filtered.size());
+        block.filteredSize = filtered.size();
+        block.valid = true;
+    });
+
+    vector<uint8_t> idat = {0x78, 0x01};
+    uint32_t adler = 1;
+    for (auto &block : blocks) {
+        if (!block.valid) continue;
+        idat.insert(idat.end(), block.data.begin(), block.data.end());
+        adler = combineAdler32(adler, block.adler, block.filteredSize);
+    }
+    idat.push_back((uint8_t)(adler >> 24));
+    idat.push_back((uint8_t)(adler >> 16));
+    idat.push_back((uint8_t)(adler >> 8));
+    idat.push_back((uint8_t)adler);
+
+    // 8 bit RGB, no interlacing
+    uint8_t const ihdr[13] = {(uint8_t)(width >> 24),  (uint8_t)(width >> 16),  (uint8_t)(width >> 8),  (uint8_t)width,
+                              (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+                              8,                       2,                       0,                      0,
+                              0};
+    file.write((const char *)signature, sizeof(signature));
+    writePNGChunk(file, "IHDR", ihdr, sizeof(ihdr));
+    writePNGChunk(file, "IDAT", idat.data(), idat.size());
+    writePNGChunk(file, "IEND", nullptr, 0);
+    return file.good();
+}
+
+// QOI, see https://qoiformat.org/qoi-specification.pdf
+
+static bool writeQOIFile(ofstream &file, const uint8_t *rgb, uint32_t width, uint32_t height) {
+    static const uint8_t QOI_OP_INDEX = 0x00;
+    static const uint8_t QOI_OP_DIFF = 0x40;
+    static const uint8_t QOI_OP_LUMA = 0x80;
+    static const uint8_t QOI_OP_RUN = 0xc0;
+    static const uint8_t QOI_OP_RGB = 0xfe;
+    static const uint8_t padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+    // 3 channels, sRGB with linear alpha
+    uint8_t const header[14] = {'q', 'o', 'i', 'f', (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8),
+                                (uint8_t)width, (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8),
+                                (uint8_t)height, 3, 0};
+
+    // Worst case is 4 bytes per pixel.
+    size_t const pixelCount = (size_t)width * height;
+    vector<uint8_t> out;
+    out.reserve(sizeof(header) + pixelCount * 4 + sizeof(padding));
+    out.insert(out.end(), header, header + sizeof(header));
+
+    // The index starts out zeroed, including alpha, so it can only match the
+    // opaque pixels seen so far.
+    uint8_t index[64][4] = {};
+    uint8_t prev[3] = {0, 0, 0};
+    uint32_t run = 0;
+    for (size_t i = 0; i < pixelCount; i++) {
+        const uint8_t *px = rgb + i * 3;
+        if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2]) {
+            run++;
+            if (run == 62 || i + 1 == pixelCount) {
+                out.push_back(QOI_OP_RUN | (uint8_t)(run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(QOI_OP_RUN | (uint8_t)(run - 1));
+            run = 0;
+        }
+
+        // Alpha is always 255, so it adds 255 * 11 to the hash.
+        uint32_t const hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+        if (index[hash][0] == px[0] && index[hash][1] == px[1] && index[hash][2] == px[2] && index[hash][3] == 255) {
+            out.push_back(QOI_OP_INDEX | (uint8_t)hash);
+        } else {
+            memcpy(index[hash], px, 3);
+            index[hash][3] = 255;
+            int8_t const vr = (int8_t)(px[0] - prev[0]);
+            int8_t const vg = (int8_t)(px[1] - prev[1]);
+            int8_t const vb = (int8_t)(px[2] - prev[2]);
+            int8_t const vgr = (int8_t)(vr - vg);
+            int8_t const vgb = (int8_t)(vb - vg);
+            if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                out.push_back(QOI_OP_DIFF | (uint8_t)((vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+            } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                out.push_back(QOI_OP_LUMA | (uint8_t)(vg + 32));
+                out.push_back((uint8_t)((vgr + 8) << 4 | (vgb + 8)));
+            } else {
+                out.push_back(QOI_OP_RGB);
+                out.insert(out.end(), px, px + 3);
+            }
+        }
+        memcpy(prev, px, 3);
+    }
+    out.insert(out.end(), padding, padding + sizeof(padding));
+
+    file.write((const char *)out.data(), out.size());
+    return file.good();
+}
+
+bool writeScreenshotFile(const char *filename, ScreenshotFileFormat format, const uint8_t *rgb, uint32_t width, uint32_t height) {
+    ofstream file(filename, ios::binary);
+    if (!file.is_open()) return false;
+
+    switch (format) {
+        case FILE_FORMAT_PNG:
+            return writePNGFile(file, rgb, width, height);
+        case FILE_FORMAT_QOI:
+            return writeQOIFile(file, rgb, width, height);
+        default:
+            return writePPMFile(file, rgb, width, height);
+    }
+}
+}
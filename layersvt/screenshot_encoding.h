@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace screenshot {
+
+// Byte order of the 8 bit per channel pixels read back from a swapchain image.
+typedef enum PixelLayout { PIXEL_LAYOUT_RGB = 0, PIXEL_LAYOUT_BGR = 1, PIXEL_LAYOUT_RGBA = 2, PIXEL_LAYOUT_BGRA = 3 } PixelLayout;
+
+// Image file formats screenshots can be written in.
+typedef enum ScreenshotFileFormat { FILE_FORMAT_PPM = 0, FILE_FORMAT_PNG = 1, FILE_FORMAT_QOI = 2 } ScreenshotFileFormat;
+
+// parse a file format name (PPM, PNG or QOI).
+// return:
+//      false if the name is not a known file format, *pFormat is unchanged then.
+bool parseScreenshotFileFormat(const char *name, ScreenshotFileFormat *pFormat);
+
+// file name extension, including the dot, of a file format.
+const char *getScreenshotFileExtension(ScreenshotFileFormat format);
+
+// convert height rows of width pixels to tightly packed RGB, dropping alpha
+// and swizzling BGR(A) as needed. The rows are split between worker threads
+// and converted with SSSE3 or NEON when available.
+// const uint8_t *src, the first row of the source pixels.
+// size_t srcRowPitch, distance in bytes between the starts of two source rows.
+// uint8_t *dst, receives width * height * 3 bytes.
+void convertToRGB(const uint8_t *src, size_t srcRowPitch, PixelLayout layout, uint32_t width, uint32_t height, uint8_t *dst);
+
+// write tightly packed RGB pixels to an image file of the given format.
+// PNG files are compressed on worker threads.
+// return:
+//      false if the file could not be written.
+bool writeScreenshotFile(const char *filename, ScreenshotFileFormat format, const uint8_t *rgb, uint32_t width, uint32_t height);
+}
@@ -35,6 +35,9 @@
 #   * api_dump.cpp: COMMON_CODEGEN - Provides all entrypoints for functions and dispatches the calls
 #       to the proper back end
 #   * api_dump_text.h: TEXT_CODEGEN - Provides the back end for dumping to a text file
+#   * api_dump_html.h: HTML_CODEGEN - Provides the back end for dumping to an HTML file
+#   * api_dump_binary.h: BINARY_CODEGEN - Provides the back end for recording a binary log, and the
+#       reader used to render the log with the text or HTML back end afterwards
 #
 
 import os,re,sys,string
@@ -71,13 +74,14 @@ COMMON_CODEGEN = """
 
 #include "api_dump_text.h"
 #include "api_dump_html.h"
+#include "api_dump_binary.h"
 
 //============================= Dump Functions ==============================//
 
 @foreach function where('{funcReturn}' != 'void' and not '{funcName}' in ['vkGetDeviceProcAddr', 'vkGetInstanceProcAddr', 'vkDebugMarkerSetObjectNameEXT'])
 inline void dump_{funcName}(ApiDumpInstance& dump_inst, {funcReturn} result, {funcTypedParams})
 {{
-    loader_platform_thread_lock_mutex(dump_inst.outputMutex());
+    dump_inst.beginCall();
     switch(dump_inst.settings().format())
     {{
     case ApiDumpFormat::Text:
@@ -86,24 +90,20 @@ inline void dump_{funcName}(ApiDumpInstance& dump_inst, {funcReturn} result, {fu
     case ApiDumpFormat::Html:
         dump_html_{funcName}(dump_inst, result, {funcNamedParams});
         break;
+    case ApiDumpFormat::Binary:
+        dump_binary_{funcName}(dump_inst, result, {funcNamedParams});
+        break;
     }}
-    loader_platform_thread_unlock_mutex(dump_inst.outputMutex());
+    dump_inst.endCall();
 }}
 @end function
 
 @foreach function where('{funcName}' == 'vkDebugMarkerSetObjectNameEXT' and '{funcReturn}' != 'void')
 inline void dump_{funcName}(ApiDumpInstance& dump_inst, {funcReturn} result, {funcTypedParams})
 {{
-    loader_platform_thread_lock_mutex(dump_inst.outputMutex());
+    dump_inst.setObjectName(pNameInfo->object, pNameInfo->pObjectName);
 
-    if (pNameInfo->pObjectName)
-    {{
-        dump_inst.object_name_map.insert(std::make_pair<uint64_t, std::string>((uint64_t &&)pNameInfo->object, pNameInfo->pObjectName));
-    }}
-    else
-    {{
-        dump_inst.object_name_map.erase(pNameInfo->object);
-    }}
+    dump_inst.beginCall();
 
     switch(dump_inst.settings().format())
     {{
@@ -113,15 +113,18 @@ inline void dump_{funcName}(ApiDumpInstance& dump_inst, {funcReturn} result, {fu
     case ApiDumpFormat::Html:
         dump_html_{funcName}(dump_inst, result, {funcNamedParams});
         break;
+    case ApiDumpFormat::Binary:
+        dump_binary_{funcName}(dump_inst, result, {funcNamedParams});
+        break;
     }}
-    loader_platform_thread_unlock_mutex(dump_inst.outputMutex());
+    dump_inst.endCall();
 }}
 @end function
 
 @foreach function where('{funcReturn}' == 'void')
 inline void dump_{funcName}(ApiDumpInstance& dump_inst, {funcTypedParams})
 {{
-    loader_platform_thread_lock_mutex(dump_inst.outputMutex());
+    dump_inst.beginCall();
     switch(dump_inst.settings().format())
     {{
     case ApiDumpFormat::Text:
@@ -130,8 +133,11 @@ inline void dump_{funcName}(ApiDumpInstance& dump_inst, {funcTypedParams})
     case ApiDumpFormat::Html:
         dump_html_{funcName}(dump_inst, {funcNamedParams});
         break;
+    case ApiDumpFormat::Binary:
+        dump_binary_{funcName}(dump_inst, {funcNamedParams});
+        break;
     }}
-    loader_platform_thread_unlock_mutex(dump_inst.outputMutex());
+    dump_inst.endCall();
 }}
 @end function
 
@@ -418,9 +424,9 @@ inline std::ostream& dump_text_{hdlName}(const {hdlName} object, const ApiDumpSe
     if(settings.showAddress()) {{
         settings.stream() << object;
 
-        std::unordered_map<uint64_t, std::string>::const_iterator it = ApiDumpInstance::current().object_name_map.find((uint64_t) object);
-        if (it != ApiDumpInstance::current().object_name_map.end()) {{
-            settings.stream() << " [" << it->second << "]";
+        std::string name;
+        if (ApiDumpInstance::current().getObjectName((uint64_t) object, name)) {{
+            settings.stream() << " [" << name << "]";
         }}
     }} else {{
         settings.stream() << "address";
@@ -738,9 +744,9 @@ inline std::ostream& dump_html_{hdlName}(const {hdlName} object, const ApiDumpSe
     if(settings.showAddress()) {{
         settings.stream() << object;
 
-        std::unordered_map<uint64_t, std::string>::const_iterator it = ApiDumpInstance::current().object_name_map.find((uint64_t) object);
-        if (it != ApiDumpInstance::current().object_name_map.end()) {{
-            settings.stream() << "</div><div class='val'>[" << it->second << "]";
+        std::string name;
+        if (ApiDumpInstance::current().getObjectName((uint64_t) object, name)) {{
+            settings.stream() << "</div><div class='val'>[" << name << "]";
         }}
     }} else {{
         settings.stream() << "address";
@@ -1007,6 +1013,323 @@ std::ostream& dump_html_{funcName}(ApiDumpInstance& dump_inst, {funcTypedParams}
 @end function
 """
 
+BINARY_CODEGEN = """
+/* Copyright (c) 2015-2017 Valve Corporation
+ * Copyright (c) 2015-2017 LunarG, Inc.
+ * Copyright (c) 2015-2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: Lenny Komow <lenny@lunarg.com>
+ * Author: Shannon McPherson <shannon@lunarg.com>
+ */
+
+/*
+ * This file is generated from the Khronos Vulkan XML API Registry.
+ */
+
+#pragma once
+
+#include "api_dump.h"
+
+@foreach struct
+void dump_binary_pointees(std::string& buffer, const {sctName}& object{sctConditionVars});
+@end struct
+
+//============================== pNext Chains ===============================//
+
+// Writes the next structure of a pNext chain, which continues through its own pNext.
+// Only the type is written for structures that aren't known, which ends the chain.
+inline void dump_binary_next(std::string& buffer, const void* next)
+{{
+    dump_binary_raw(buffer, (uint8_t)(next != NULL));
+    if(next == NULL)
+        return;
+
+    const VkStructureType type = *reinterpret_cast<const VkStructureType*>(next);
+    dump_binary_raw(buffer, type);
+    switch(type)
+    {{
+    @foreach struct where('{sctStructureType}' != 'None' and '{sctConditionVars}' == '')
+    case {sctStructureType}:
+        dump_binary_raw(buffer, *reinterpret_cast<const {sctName}*>(next));
+        dump_binary_pointees(buffer, *reinterpret_cast<const {sctName}*>(next));
+        break;
+    @end struct
+    default:
+        break;
+    }}
+}}
+
+//========================== Struct Implementations =========================//
+
+@foreach struct
+void dump_binary_pointees(std::string& buffer, const {sctName}& object{sctConditionVars})
+{{
+    @foreach member
+    @if('{memName}' == 'pNext')
+    dump_binary_next(buffer, object.pNext);
+    @end if
+    @if({memPtrLevel} == 0 and '{memTypeID}' == 'cstring' and '[' not in '{memType}')
+    dump_binary_cstring(buffer, object.{memName});
+    @end if
+    @if({memPtrLevel} == 0 and {memTypeIsStruct})
+    dump_binary_pointees(buffer, object.{memName}{memInheritedConditions});
+    @end if
+    @if({memPtrLevel} == 1 and '[' not in '{memType}' and '{memCondition}' == 'None' and '{memLength}' == 'None')
+    dump_binary_array(buffer, object.{memName}, 1{memInheritedConditions});
+    @end if
+    @if({memPtrLevel} == 1 and '[' not in '{memType}' and '{memCondition}' == 'None' and '{memLength}' != 'None' and {memLengthIsMember})
+    dump_binary_array(buffer, object.{memName}, object.{memLength}{memInheritedConditions});
+    @end if
+    @if({memPtrLevel} == 1 and '[' not in '{memType}' and '{memCondition}' != 'None' and '{memLength}' == 'None')
+    dump_binary_array(buffer, ({memCondition}) ? object.{memName} : NULL, 1{memInheritedConditions});
+    @end if
+    @if({memPtrLevel} == 1 and '[' not in '{memType}' and '{memCondition}' != 'None' and '{memLength}' != 'None' and {memLengthIsMember})
+    dump_binary_array(buffer, ({memCondition}) ? object.{memName} : NULL, object.{memLength}{memInheritedConditions});
+    @end if
+    @end member
+}}
+@end struct
+
+//========================= Function Implementations ========================//
+
+@foreach function where('{funcReturn}' != 'void' and not '{funcName}' in ['vkGetDeviceProcAddr', 'vkGetInstanceProcAddr'])
+inline void dump_binary_{funcName}(ApiDumpInstance& dump_inst, {funcReturn} result, {funcTypedParams})
+{{
+    constexpr uint32_t command_id = dump_binary_command_id("{funcName}");
+    std::string& record = dump_binary_begin(dump_inst, command_id);
+    dump_binary_raw(record, result);
+    @foreach parameter
+    @if({prmPtrLevel} == 0 and '{prmTypeID}' == 'cstring')
+    dump_binary_cstring(record, {prmName});
+    @end if
+    @if({prmPtrLevel} == 0 and '{prmTypeID}' != 'cstring')
+    dump_binary_raw(record, {prmName});
+    @end if
+    @if({prmPtrLevel} == 1 and '{prmLength}' == 'None')
+    dump_binary_array(record, {prmName}, 1{prmInheritedConditions});
+    @end if
+    @if({prmPtrLevel} == 1 and '{prmLength}' != 'None')
+    dump_binary_array(record, {prmName}, {prmLength}{prmInheritedConditions});
+    @end if
+    @end parameter
+    dump_binary_end(dump_inst, record);
+}}
+@end function
+
+@foreach function where('{funcReturn}' == 'void')
+inline void dump_binary_{funcName}(ApiDumpInstance& dump_inst, {funcTypedParams})
+{{
+    constexpr uint32_t command_id = dump_binary_command_id("{funcName}");
+    std::string& record = dump_binary_begin(dump_inst, command_id);
+    @foreach parameter
+    @if({prmPtrLevel} == 0 and '{prmTypeID}' == 'cstring')
+    dump_binary_cstring(record, {prmName});
+    @end if
+    @if({prmPtrLevel} == 0 and '{prmTypeID}' != 'cstring')
+    dump_binary_raw(record, {prmName});
+    @end if
+    @if({prmPtrLevel} == 1 and '{prmLength}' == 'None')
+    dump_binary_array(record, {prmName}, 1{prmInheritedConditions});
+    @end if
+    @if({prmPtrLevel} == 1 and '{prmLength}' != 'None')
+    dump_binary_array(record, {prmName}, {prmLength}{prmInheritedConditions});
+    @end if
+    @end parameter
+    dump_binary_end(dump_inst, record);
+}}
+@end function
+
+//============================== Binary Reader ==============================//
+
+// Used by the offline formatter to render a binary log with the text and HTML
+// dump functions
+#if defined(API_DUMP_BINARY_READER)
+
+@foreach struct
+void read_binary_pointees(ApiDumpBinaryReader& reader, {sctName}& object);
+@end struct
+
+inline void read_binary_next(ApiDumpBinaryReader& reader, const void*& next)
+{{
+    uint8_t present = 0;
+    VkStructureType type;
+    next = NULL;
+    read_binary_raw(reader, present);
+    if(present == 0)
+        return;
+    read_binary_raw(reader, type);
+    switch(type)
+    {{
+    @foreach struct where('{sctStructureType}' != 'None' and '{sctConditionVars}' == '')
+    case {sctStructureType}:
+        next = read_binary_struct<{sctName}>(reader);
+        break;
+    @end struct
+    default:
+        next = read_binary_unknown_struct(reader, type);
+        break;
+    }}
+}}
+
+inline void read_binary_next(ApiDumpBinaryReader& reader, void*& next)
+{{
+    const void* value = NULL;
+    read_binary_next(reader, value);
+    next = const_cast<void*>(value);
+}}
+
+@foreach struct
+void read_binary_pointees(ApiDumpBinaryReader& reader, {sctName}& object)
+{{
+    @foreach member
+    @if('{memName}' == 'pNext')
+    read_binary_next(reader, object.pNext);
+    @end if
+    @if({memPtrLevel} == 0 and '{memTypeID}' == 'cstring' and '[' not in '{memType}')
+    read_binary_cstring(reader, object.{memName});
+    @end if
+    @if({memPtrLevel} == 0 and {memTypeIsStruct})
+    read_binary_pointees(reader, object.{memName});
+    @end if
+    @if({memPtrLevel} == 1 and '[' not in '{memType}' and '{memLength}' == 'None')
+    read_binary_array(reader, object.{memName}, 1);
+    @end if
+    @if({memPtrLevel} == 1 and '[' not in '{memType}' and '{memLength}' != 'None' and {memLengthIsMember})
+    read_binary_array(reader, object.{memName}, object.{memLength});
+    @end if
+    @end member
+}}
+@end struct
+
+// Array lengths can come from parameters that were read earlier, such as
+// *pPropertyCount. Those are NULL once a truncated record has failed to read,
+// so the arrays after them are only read while the reader hasn't failed.
+@foreach function where('{funcReturn}' != 'void' and not '{funcName}' in ['vkGetDeviceProcAddr', 'vkGetInstanceProcAddr'])
+inline void read_binary_{funcName}(ApiDumpInstance& dump_inst, ApiDumpBinaryReader& reader)
+{{
+    {funcReturn} result;
+    read_binary_raw(reader, result);
+    @foreach parameter
+    @if('[' not in '{prmType}')
+    {prmType} {prmName} = {{}};
+    @end if
+    @if('[' in '{prmType}')
+    {prmChildType}* {prmName} = NULL;
+    @end if
+    @if({prmPtrLevel} == 0 and '{prmTypeID}' == 'cstring')
+    read_binary_cstring(reader, {prmName});
+    @end if
+    @if({prmPtrLevel} == 0 and '{prmTypeID}' != 'cstring')
+    read_binary_raw(reader, {prmName});
+    @end if
+    @if({prmPtrLevel} == 1 and '{prmLength}' == 'None')
+    read_binary_array(reader, {prmName}, 1);
+    @end if
+    @if({prmPtrLevel} == 1 and '{prmLength}' != 'None')
+    if(!reader.failed())
+        read_binary_array(reader, {prmName}, {prmLength});
+    @end if
+    @end parameter
+    if(reader.failed())
+        return;
+
+    {funcStateTrackingCode}
+    @if('{funcName}' == 'vkDebugMarkerSetObjectNameEXT')
+    dump_inst.setObjectName(pNameInfo->object, pNameInfo->pObjectName);
+    @end if
+
+    dump_inst.beginCall();
+    switch(dump_inst.settings().format())
+    {{
+    case ApiDumpFormat::Text:
+        dump_text_{funcName}(dump_inst, result, {funcNamedParams});
+        break;
+    case ApiDumpFormat::Html:
+        dump_html_{funcName}(dump_inst, result, {funcNamedParams});
+        break;
+    case ApiDumpFormat::Binary:
+        break;
+    }}
+    dump_inst.endCall();
+}}
+@end function
+
+@foreach function where('{funcReturn}' == 'void')
+inline void read_binary_{funcName}(ApiDumpInstance& dump_inst, ApiDumpBinaryReader& reader)
+{{
+    @foreach parameter
+    @if('[' not in '{prmType}')
+    {prmType} {prmName} = {{}};
+    @end if
+    @if('[' in '{prmType}')
+    {prmChildType}* {prmName} = NULL;
+    @end if
+    @if({prmPtrLevel} == 0 and '{prmTypeID}' == 'cstring')
+    read_binary_cstring(reader, {prmName});
+    @end if
+    @if({prmPtrLevel} == 0 and '{prmTypeID}' != 'cstring')
+    read_binary_raw(reader, {prmName});
+    @end if
+    @if({prmPtrLevel} == 1 and '{prmLength}' == 'None')
+    read_binary_array(reader, {prmName}, 1);
+    @end if
+    @if({prmPtrLevel} == 1 and '{prmLength}' != 'None')
+    if(!reader.failed())
+        read_binary_array(reader, {prmName}, {prmLength});
+    @end if
+    @end parameter
+    if(reader.failed())
+        return;
+
+    {funcStateTrackingCode}
+
+    dump_inst.beginCall();
+    switch(dump_inst.settings().format())
+    {{
+    case ApiDumpFormat::Text:
+        dump_text_{funcName}(dump_inst, {funcNamedParams});
+        break;
+    case ApiDumpFormat::Html:
+        dump_html_{funcName}(dump_inst, {funcNamedParams});
+        break;
+    case ApiDumpFormat::Binary:
+        break;
+    }}
+    dump_inst.endCall();
+}}
+@end function
+
+// Renders a single call from a binary log. Returns false if the command isn't
+// known or its parameters couldn't be read.
+inline bool read_binary_call(ApiDumpInstance& dump_inst, uint32_t command, ApiDumpBinaryReader& reader)
+{{
+    switch(command)
+    {{
+    @foreach function where(not '{funcName}' in ['vkGetDeviceProcAddr', 'vkGetInstanceProcAddr'])
+    case dump_binary_command_id("{funcName}"):
+        read_binary_{funcName}(dump_inst, reader);
+        return !reader.failed();
+    @end function
+    default:
+        return false;
+    }}
+}}
+
+#endif // API_DUMP_BINARY_READER
+"""
+
 POINTER_TYPES = ['void', 'xcb_connection_t', 'Display', 'SECURITY_ATTRIBUTES', 'ANativeWindow']
 
 TRACKED_STATE = {
@@ -1235,6 +1558,12 @@ class ApiDumpOutputGenerator(OutputGenerator):
                                         if sysType not in self.sysTypes:
                                             self.sysTypes.add(sysType)
 
+        # Mark the members that contain other structs
+        structNames = set([struct.name for struct in self.structs])
+        for struct in self.structs:
+            for member in struct.members:
+                member.typeIsStruct = member.typeID in structNames
+
         # Find every @foreach, @if, and @end
         forIter = re.finditer('(^\\s*\\@foreach\\s+[a-z]+(\\s+where\\(.*\\))?\\s*^)|(\\@foreach [a-z]+(\\s+where\\(.*\\))?\\b)', self.format, flags=re.MULTILINE)
         ifIter = re.finditer('(^\\s*\\@if\\(.*\\)\\s*^)|(\\@if\\(.*\\))', self.format, flags=re.MULTILINE)
@@ -1813,6 +2142,9 @@ class VulkanStruct:
         def __init__(self, rootNode, constants, parentName):
             VulkanVariable.__init__(self, rootNode, constants, parentName)
 
+            # Set once all of the structs are known
+            self.typeIsStruct = False
+
             # Search for a member condition
             self.condition = None
             if rootNode.get('noautovalidity') == 'true' and parentName in VALIDITY_CHECKS and self.name in VALIDITY_CHECKS[parentName]:
@@ -1830,14 +2162,18 @@ class VulkanStruct:
                 'memLengthIsMember': self.lengthMember,
                 'memCondition': self.condition,
                 'memInheritedConditions': self.inheritedConditions,
+                'memTypeIsStruct': self.typeIsStruct,
             }
 
 
     def __init__(self, rootNode, constants):
         self.name = rootNode.get('name')
         self.members = []
+        self.structureType = None
         for node in rootNode.findall('member'):
             self.members.append(VulkanStruct.Member(node, constants, self.name))
+            if self.members[-1].name == 'sType':
+                self.structureType = node.get('values')
         self.conditionVars = ''
         if self.name in INHERITED_STATE:
             for parent, states in INHERITED_STATE[self.name].items():
@@ -1848,6 +2184,7 @@ class VulkanStruct:
         return {
             'sctName': self.name,
             'sctConditionVars': self.conditionVars,
+            'sctStructureType': self.structureType,
         }
 
 class VulkanSystemType:
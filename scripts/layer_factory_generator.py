@@ -152,6 +152,8 @@ class LayerFactoryOutputGenerator(OutputGenerator):
  */
 
 #include <string.h>
+#include <atomic>
+#include <memory>
 #include <mutex>
 
 #include "vk_loader_platform.h"
@@ -167,6 +169,9 @@ debug_report_data *vlf_report_data = VK_NULL_HANDLE;
 
 #include "layer_factory.h"
 
+// For each hook, the interceptors that override it.  Filled in by the interceptors' constructors.
+std::vector<layer_factory *> global_intercept_lists[InterceptIdCount];
+
 struct instance_layer_data {
     VkLayerInstanceDispatchTable dispatch_table;
     VkInstance instance = VK_NULL_HANDLE;
@@ -185,8 +190,73 @@ struct device_layer_data {
     instance_layer_data *instance_data = nullptr;
 };
 
-static std::unordered_map<void *, device_layer_data *> device_layer_data_map;
-static std::unordered_map<void *, instance_layer_data *> instance_layer_data_map;
+// Read-mostly map from a dispatch key to the layer data of an instance or device.  Lookups are lock-free: the map is an
+// immutable table which Create() and Destroy() copy, modify and publish under a mutex, and each thread remembers its last
+// hit.  Replaced tables are only freed with the registry, as other threads may still be reading them; this is cheap because
+// tables are only replaced when instances and devices are created or destroyed.
+template <typename DATA_T>
+class layer_data_registry {
+   public:
+    layer_data_registry() : current_(new table()) { tables_.emplace_back(current_.load()); }
+    layer_data_registry(const layer_data_registry &) = delete;
+    layer_data_registry &operator=(const layer_data_registry &) = delete;
+
+    // Find the data of a dispatch key, or nullptr.
+    DATA_T *Get(void *key) const {
+        const table *current = current_.load(std::memory_order_acquire);
+        static thread_local last_hit cache = {};
+        if (cache.snapshot == current && cache.key == key) return cache.data;
+        const auto item = current->find(key);
+        DATA_T *data = (item != current->end()) ? item->second : nullptr;
+        cache = {current, key, data};
+        return data;
+    }
+
+    // Find the data of a dispatch key, adding it if it does not exist yet.
+    DATA_T *Create(void *key) {
+        std::lock_guard<std::mutex> lock(write_lock_);
+        const table *current = current_.load(std::memory_order_relaxed);
+        const auto item = current->find(key);
+        if (item != current->end()) return item->second;
+        DATA_T *data = new DATA_T;
+        table *next = new table(*current);
+        (*next)[key] = data;
+        Publish(next);
+        return data;
+    }
+
+    void Destroy(void *key) {
+        std::lock_guard<std::mutex> lock(write_lock_);
+        const table *current = current_.load(std::memory_order_relaxed);
+        const auto item = current->find(key);
+        if (item == current->end()) return;
+        DATA_T *data = item->second;
+        table *next = new table(*current);
+        next->erase(key);
+        Publish(next);
+        delete data;
+    }
+
+   private:
+    typedef std::unordered_map<void *, DATA_T *> table;
+    struct last_hit {
+        const table *snapshot;
+        void *key;
+        DATA_T *data;
+    };
+
+    void Publish(table *next) {
+        tables_.emplace_back(next);
+        current_.store(next, std::memory_order_release);
+    }
+
+    std::atomic<const table *> current_;
+    std::vector<std::unique_ptr<const table>> tables_;  // Guarded by write_lock_.
+    std::mutex write_lock_;
+};
+
+static layer_data_registry<device_layer_data> device_layer_data_map;
+static layer_data_registry<instance_layer_data> instance_layer_data_map;
 
 #include "interceptor_objects.h"
 
@@ -213,11 +283,12 @@ extern const std::unordered_map<std::string, void*> name_to_funcptr_map;
 
 VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetDeviceProcAddr(VkDevice device, const char *funcName) {
     assert(device);
-    device_layer_data *device_data = GetLayerDataPtr(get_dispatch_key(device), device_layer_data_map);
+    device_layer_data *device_data = device_layer_data_map.Get(get_dispatch_key(device));
     const auto &item = name_to_funcptr_map.find(funcName);
     if (item != name_to_funcptr_map.end()) {
         return reinterpret_cast<PFN_vkVoidFunction>(item->second);
     }
+    if (!device_data) return nullptr;
     auto &table = device_data->dispatch_table;
     if (!table.GetDeviceProcAddr) return nullptr;
     return table.GetDeviceProcAddr(device, funcName);
@@ -229,14 +300,16 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetInstanceProcAddr(VkInstance instance
     if (item != name_to_funcptr_map.end()) {
         return reinterpret_cast<PFN_vkVoidFunction>(item->second);
     }
-    instance_data = GetLayerDataPtr(get_dispatch_key(instance), instance_layer_data_map);
+    instance_data = instance_layer_data_map.Get(get_dispatch_key(instance));
+    if (!instance_data) return nullptr;
     auto &table = instance_data->dispatch_table;
     if (!table.GetInstanceProcAddr) return nullptr;
     return table.GetInstanceProcAddr(instance, funcName);
 }
 
 VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetPhysicalDeviceProcAddr(VkInstance instance, const char *funcName) {
-    instance_layer_data *instance_data = GetLayerDataPtr(get_dispatch_key(instance), instance_layer_data_map);
+    instance_layer_data *instance_data = instance_layer_data_map.Get(get_dispatch_key(instance));
+    if (!instance_data) return nullptr;
     auto &table = instance_data->dispatch_table;
     if (!table.GetPhysicalDeviceProcAddr) return nullptr;
     return table.GetPhysicalDeviceProcAddr(instance, funcName);
@@ -265,7 +338,7 @@ VKAPI_ATTR VkResult VKAPI_CALL EnumerateDeviceExtensionProperties(VkPhysicalDevi
 
     assert(physicalDevice);
 
-    instance_layer_data *instance_data = GetLayerDataPtr(get_dispatch_key(physicalDevice), instance_layer_data_map);
+    instance_layer_data *instance_data = instance_layer_data_map.Get(get_dispatch_key(physicalDevice));
     return instance_data->dispatch_table.EnumerateDeviceExtensionProperties(physicalDevice, NULL, pCount, pProperties);
 }
 
@@ -286,7 +359,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo *pCreat
 
     VkResult result = fpCreateInstance(pCreateInfo, pAllocator, pInstance);
 
-    instance_layer_data *instance_data = GetLayerDataPtr(get_dispatch_key(*pInstance), instance_layer_data_map);
+    instance_layer_data *instance_data = instance_layer_data_map.Create(get_dispatch_key(*pInstance));
     instance_data->instance = *pInstance;
     layer_init_instance_dispatch_table(*pInstance, &instance_data->dispatch_table, fpGetInstanceProcAddr);
     instance_data->report_data = debug_utils_create_instance(
@@ -305,7 +378,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo *pCreat
 
 VKAPI_ATTR void VKAPI_CALL DestroyInstance(VkInstance instance, const VkAllocationCallbacks *pAllocator) {
     dispatch_key key = get_dispatch_key(instance);
-    instance_layer_data *instance_data = GetLayerDataPtr(key, instance_layer_data_map);
+    instance_layer_data *instance_data = instance_layer_data_map.Get(key);
     for (auto intercept : global_interceptor_list) {
         intercept->PreCallDestroyInstance(instance, pAllocator);
     }
@@ -328,12 +401,12 @@ VKAPI_ATTR void VKAPI_CALL DestroyInstance(VkInstance instance, const VkAllocati
         instance_data->logging_callback.pop_back();
     }
     layer_debug_utils_destroy_instance(instance_data->report_data);
-    FreeLayerDataPtr(key, instance_layer_data_map);
+    instance_layer_data_map.Destroy(key);
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu, const VkDeviceCreateInfo *pCreateInfo,
                                             const VkAllocationCallbacks *pAllocator, VkDevice *pDevice) {
-    instance_layer_data *instance_data = GetLayerDataPtr(get_dispatch_key(gpu), instance_layer_data_map);
+    instance_layer_data *instance_data = instance_layer_data_map.Get(get_dispatch_key(gpu));
 
     unique_lock_t lock(global_lock);
     VkLayerDeviceCreateInfo *chain_info = get_chain_info(pCreateInfo, VK_LAYER_LINK_INFO);
@@ -353,7 +426,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu, const VkDevice
     for (auto intercept : global_interceptor_list) {
         intercept->PostCallCreateDevice(gpu, pCreateInfo, pAllocator, pDevice);
     }
-    device_layer_data *device_data = GetLayerDataPtr(get_dispatch_key(*pDevice), device_layer_data_map);
+    device_layer_data *device_data = device_layer_data_map.Create(get_dispatch_key(*pDevice));
     device_data->instance_data = instance_data;
     layer_init_device_dispatch_table(*pDevice, &device_data->dispatch_table, fpGetDeviceProcAddr);
     device_data->device = *pDevice;
@@ -369,7 +442,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu, const VkDevice
 
 VKAPI_ATTR void VKAPI_CALL DestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocator) {
     dispatch_key key = get_dispatch_key(device);
-    device_layer_data *device_data = GetLayerDataPtr(key, device_layer_data_map);
+    device_layer_data *device_data = device_layer_data_map.Get(key);
 
     unique_lock_t lock(global_lock);
     for (auto intercept : global_interceptor_list) {
@@ -385,14 +458,14 @@ VKAPI_ATTR void VKAPI_CALL DestroyDevice(VkDevice device, const VkAllocationCall
         intercept->PostCallDestroyDevice(device, pAllocator);
     }
 
-    FreeLayerDataPtr(key, device_layer_data_map);
+    device_layer_data_map.Destroy(key);
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL CreateDebugReportCallbackEXT(VkInstance instance,
                                                             const VkDebugReportCallbackCreateInfoEXT *pCreateInfo,
                                                             const VkAllocationCallbacks *pAllocator,
                                                             VkDebugReportCallbackEXT *pCallback) {
-    instance_layer_data *instance_data = GetLayerDataPtr(get_dispatch_key(instance), instance_layer_data_map);
+    instance_layer_data *instance_data = instance_layer_data_map.Get(get_dispatch_key(instance));
     for (auto intercept : global_interceptor_list) {
         intercept->PreCallCreateDebugReportCallbackEXT(instance, pCreateInfo, pAllocator, pCallback);
     }
@@ -406,7 +479,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDebugReportCallbackEXT(VkInstance instance,
 
 VKAPI_ATTR void VKAPI_CALL DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback,
                                                          const VkAllocationCallbacks *pAllocator) {
-    instance_layer_data *instance_data = GetLayerDataPtr(get_dispatch_key(instance), instance_layer_data_map);
+    instance_layer_data *instance_data = instance_layer_data_map.Get(get_dispatch_key(instance));
     for (auto intercept : global_interceptor_list) {
         intercept->PreCallDestroyDebugReportCallbackEXT(instance, callback, pAllocator);
     }
@@ -486,6 +559,8 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVe
         self.sections = dict([(section, []) for section in self.ALL_SECTIONS])
         self.intercepts = []
         self.layer_factory = ''                     # String containing base layer factory class definition
+        self.intercept_ids = ''                     # String containing the InterceptId enumerants
+        self.register_intercepts = ''               # String containing the override checks of RegisterIntercepts()
 
     # Check if the parameter passed in is a pointer to an array
     def paramIsArray(self, param):
@@ -528,6 +603,7 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVe
             if (genOpts.prefixText):
                 for s in genOpts.prefixText:
                     write(s, file=self.outFile)
+            write('#include <type_traits>', file=self.outFile)
             write('#include <unordered_map>', file=self.outFile)
             write('#include <vector>\n', file=self.outFile)
             write('#include "vulkan/vk_layer.h"', file=self.outFile)
@@ -544,8 +620,10 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVe
         self.layer_factory += 'class layer_factory {\n'
         self.layer_factory += '    public:\n'
         self.layer_factory += '        layer_factory(const layer_factory&) = delete;\n'
-        self.layer_factory += '        layer_factory(layer_factory *interceptor) {\n'
+        self.layer_factory += '        template <typename T>\n'
+        self.layer_factory += '        layer_factory(T *interceptor) {\n'
         self.layer_factory += '            global_interceptor_list.emplace_back(this);\n'
+        self.layer_factory += '            RegisterIntercepts<T>();\n'
         self.layer_factory += '        };\n'
         self.layer_factory += '\n'
         self.layer_factory += '        std::string layer_name = "VLF";\n'
@@ -597,7 +675,29 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVe
         write('} // namespace vulkan_layer_factory', file=self.outFile)
         if self.header:
             self.newline()
+            # Output the hook identifiers and the per-hook interceptor lists
+            write('// Identifies a PreCall or PostCall hook of the layer_factory class', file=self.outFile)
+            write('enum InterceptId {', file=self.outFile)
+            write(self.intercept_ids + '    InterceptIdCount', file=self.outFile)
+            write('};\n', file=self.outFile)
+            write('extern std::vector<layer_factory *> global_intercept_lists[InterceptIdCount];\n', file=self.outFile)
             # Output Layer Factory Class Definitions
+            self.layer_factory += '\n'
+            self.layer_factory += '    private:\n'
+            self.layer_factory += '        template <typename U>\n'
+            self.layer_factory += '        static bool Overrides(U layer_factory::*) { return false; }\n'
+            self.layer_factory += '        template <typename U, typename C>\n'
+            self.layer_factory += '        static bool Overrides(U C::*) { return true; }\n'
+            self.layer_factory += '\n'
+            self.layer_factory += '        // Add this interceptor to the list of each hook that T overrides, so that hooks nobody overrides cost\n'
+            self.layer_factory += '        // nothing. Overriding PreCallApiFunction or PostCallApiFunction implies overriding every PreCall or\n'
+            self.layer_factory += '        // PostCall hook.\n'
+            self.layer_factory += '        template <typename T>\n'
+            self.layer_factory += '        void RegisterIntercepts() {\n'
+            self.layer_factory += '            const bool pre_call_all = Overrides(&T::PreCallApiFunction);\n'
+            self.layer_factory += '            const bool post_call_all = Overrides(&T::PostCallApiFunction);\n'
+            self.layer_factory += self.register_intercepts
+            self.layer_factory += '        }\n'
             self.layer_factory += '};\n'
             write(self.layer_factory, file=self.outFile)
         else:
@@ -707,6 +807,19 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVe
                 self.layer_factory += '#ifdef %s\n' % self.featureExtraProtect
             # Update base class with virtual function declarations
             self.layer_factory += self.BaseClassCdecl(cmdinfo.elem, name)
+            # Record the hook identifiers and how to detect overrides
+            if (self.featureExtraProtect != None):
+                self.intercept_ids += '#ifdef %s\n' % self.featureExtraProtect
+                self.register_intercepts += '#ifdef %s\n' % self.featureExtraProtect
+            for hook in ['PreCall', 'PostCall']:
+                hook_name = hook + name[2:]
+                self.intercept_ids += '    InterceptId%s,\n' % hook_name
+                self.register_intercepts += '            if (%s_all || Overrides(&T::%s)) {\n' % ('pre_call' if hook == 'PreCall' else 'post_call', hook_name)
+                self.register_intercepts += '                global_intercept_lists[InterceptId%s].emplace_back(this);\n' % hook_name
+                self.register_intercepts += '            }\n'
+            if (self.featureExtraProtect != None):
+                self.intercept_ids += '#endif\n'
+                self.register_intercepts += '#endif\n'
             # Update function intercepts
             self.intercepts += [ '    {"%s", (void*)%s},' % (name,name[2:]) ]
             if (self.featureExtraProtect != None):
@@ -758,14 +871,14 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVe
         if dispatchable_type in ["VkPhysicalDevice", "VkInstance"] or name == 'vkCreateInstance':
             device_or_instance = 'instance'
             dispatch_table_name = 'VkLayerInstanceDispatchTable'
-        self.appendSection('command', '    %s_layer_data *%s_data = GetLayerDataPtr(get_dispatch_key(%s), %s_layer_data_map);' % (device_or_instance, device_or_instance, dispatchable_name, device_or_instance))
+        self.appendSection('command', '    %s_layer_data *%s_data = %s_layer_data_map.Get(get_dispatch_key(%s));' % (device_or_instance, device_or_instance, device_or_instance, dispatchable_name))
         api_function_name = cmdinfo.elem.attrib.get('name')
         params = cmdinfo.elem.findall('param/name')
         paramstext = ', '.join([str(param.text) for param in params])
         API = api_function_name.replace('vk','%s_data->dispatch_table.' % (device_or_instance),1)
 
-        # Generate pre-call object processing source code
-        self.appendSection('command', '    for (auto intercept : global_interceptor_list) {')
+        # Generate pre-call object processing source code, calling only the interceptors that override the hook
+        self.appendSection('command', '    for (auto intercept : global_intercept_lists[InterceptIdPreCall%s]) {' % api_function_name[2:])
         self.appendSection('command', '        intercept->PreCall%s(%s);' % (api_function_name[2:], paramstext))
         self.appendSection('command', '    }')
 
@@ -781,7 +894,7 @@ VK_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVe
         self.appendSection('command', '    ' + assignresult + API + '(' + paramstext + ');')
 
         # Generate post-call object processing source code
-        self.appendSection('command', '    for (auto intercept : global_interceptor_list) {')
+        self.appendSection('command', '    for (auto intercept : global_intercept_lists[InterceptIdPostCall%s]) {' % api_function_name[2:])
         self.appendSection('command', '        intercept->PostCall%s(%s);' % (api_function_name[2:], paramstext))
         self.appendSection('command', '    }')
 
@@ -23,7 +23,7 @@ from cgenerator import CGeneratorOptions, COutputGenerator
 
 # VulkanTools generator additions
 from tool_helper_file_generator import ToolHelperFileOutputGenerator, ToolHelperFileOutputGeneratorOptions
-from api_dump_generator import ApiDumpGeneratorOptions, ApiDumpOutputGenerator, COMMON_CODEGEN, TEXT_CODEGEN, HTML_CODEGEN
+from api_dump_generator import ApiDumpGeneratorOptions, ApiDumpOutputGenerator, COMMON_CODEGEN, TEXT_CODEGEN, HTML_CODEGEN, BINARY_CODEGEN
 from vktrace_file_generator import VkTraceFileOutputGenerator, VkTraceFileOutputGeneratorOptions
 from mock_icd_generator import MockICDGeneratorOptions, MockICDOutputGenerator
 from layer_factory_generator import LayerFactoryGeneratorOptions, LayerFactoryOutputGenerator
@@ -256,6 +256,33 @@ def makeGenOpts(args):
             expandEnumerants  = False)
     ]
 
+    # API dump generator options for api_dump_binary.h
+    genOpts['api_dump_binary.h'] = [
+        ApiDumpOutputGenerator,
+        ApiDumpGeneratorOptions(
+            input             = BINARY_CODEGEN,
+            filename          = 'api_dump_binary.h',
+            apiname           = 'vulkan',
+            profile           = None,
+            versions          = featuresPat,
+            emitversions      = featuresPat,
+            defaultExtensions = 'vulkan',
+            addExtensions     = addExtensionsPat,
+            removeExtensions  = removeExtensionsPat,
+            emitExtensions    = emitExtensionsPat,
+            prefixText        = prefixStrings + vkPrefixStrings,
+            genFuncPointers   = True,
+            protectFile       = protect,
+            protectFeature    = False,
+            protectProto      = None,
+            protectProtoStr   = 'VK_NO_PROTOTYPES',
+            apicall           = 'VKAPI_ATTR ',
+            apientry          = 'VKAPI_CALL ',
+            apientryp         = 'VKAPI_PTR *',
+            alignFuncParam    = 48,
+            expandEnumerants  = False)
+    ]
+
     # VkTrace file generator options for vkreplay_vk_objmapper.h
     genOpts['vkreplay_vk_objmapper.h'] = [
           VkTraceFileOutputGenerator,
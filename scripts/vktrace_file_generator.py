@@ -495,6 +495,7 @@ class VkTraceFileOutputGenerator(OutputGenerator):
         replay_objmapper_header += '#include <string>\n'
         replay_objmapper_header += '#include "vulkan/vulkan.h"\n'
         replay_objmapper_header += '#include "vktrace_pageguard_memorycopy.h"\n'
+        replay_objmapper_header += '#include "vkreplay_handle_map.h"\n'
         replay_objmapper_header += '\n'
         replay_objmapper_header += '#include "vkreplay_objmapper_class_defs.h"\n\n'
 
@@ -509,6 +510,13 @@ class VkTraceFileOutputGenerator(OutputGenerator):
             replay_objmapper_header += '        %s.clear();\n' % mangled_name
         for item in additional_remap_fifo:
             replay_objmapper_header += '        m_%s.clear();\n' % item
+        replay_objmapper_header += '    }\n\n'
+
+        # Output function to log how often each object map was searched
+        replay_objmapper_header += '    void log_lookup_counts() const {\n'
+        for item in self.object_types:
+            mangled_name = 'm_' + item[2:].lower() + 's'
+            replay_objmapper_header += '        %s.log_lookup_counts("%s");\n' % (mangled_name, item)
         replay_objmapper_header += '    }\n'
 
         remapped_objects = ['VkImage', 'VkBuffer', 'VkDeviceMemory']
@@ -519,7 +527,7 @@ class VkTraceFileOutputGenerator(OutputGenerator):
                 obj_name = item[2:].lower() + 'Obj'
             else:
                 obj_name = item
-            replay_objmapper_header += '    std::map<%s, %s> %s;\n' % (item, obj_name, mangled_name)
+            replay_objmapper_header += '    vkReplayHandleMap<%s, %s> %s;\n' % (item, obj_name, mangled_name)
             replay_objmapper_header += '    void add_to_%s_map(%s pTraceVal, %s pReplayVal) {\n' % (map_name, item, obj_name)
             replay_objmapper_header += '        %s[pTraceVal] = pReplayVal;\n' % mangled_name
             replay_objmapper_header += '    }\n\n'
@@ -531,14 +539,14 @@ class VkTraceFileOutputGenerator(OutputGenerator):
             replay_objmapper_header += '    %s remap_%s(const %s& value) {\n' % (item, map_name, item)
             replay_objmapper_header += '        if (value == 0) { return 0; }\n'
             if item in remapped_objects:
-                replay_objmapper_header += '        std::map<%s, %s>::const_iterator q = %s.find(value);\n' % (item, obj_name, mangled_name)
+                replay_objmapper_header += '        vkReplayHandleMap<%s, %s>::const_iterator q = %s.find(value);\n' % (item, obj_name, mangled_name)
                 if item == 'VkDeviceMemory':
                     replay_objmapper_header += '        if (q == %s.end()) { vktrace_LogError("Failed to remap %s."); return VK_NULL_HANDLE; }\n' % (mangled_name, item)
                 else:
                     replay_objmapper_header += '        if (q == %s.end()) return VK_NULL_HANDLE;\n' % mangled_name
                 replay_objmapper_header += '        return q->second.replay%s;\n' % item[2:]
             else:
-                replay_objmapper_header += '        std::map<%s, %s>::const_iterator q = %s.find(value);\n' % (item, obj_name, mangled_name)
+                replay_objmapper_header += '        vkReplayHandleMap<%s, %s>::const_iterator q = %s.find(value);\n' % (item, obj_name, mangled_name)
                 replay_objmapper_header += '        if (q == %s.end()) { vktrace_LogError("Failed to remap %s."); return VK_NULL_HANDLE; }\n' % (mangled_name, item)
                 replay_objmapper_header += '        return q->second;\n'
             replay_objmapper_header += '    }\n\n'
@@ -1125,8 +1133,7 @@ class VkTraceFileOutputGenerator(OutputGenerator):
         trace_pkt_id_hdr += '    pHeader = vktrace_create_trace_packet(VKTRACE_TID_VULKAN, VKTRACE_TPI_VK_##entrypoint, sizeof(packet_##entrypoint), buffer_bytes_needed);\n\n'
         trace_pkt_id_hdr += '#define FINISH_TRACE_PACKET() \\\n'
         trace_pkt_id_hdr += '    vktrace_finalize_trace_packet(pHeader); \\\n'
-        trace_pkt_id_hdr += '    vktrace_write_trace_packet(pHeader, vktrace_trace_get_trace_file()); \\\n'
-        trace_pkt_id_hdr += '    vktrace_delete_trace_packet(&pHeader);\n'
+        trace_pkt_id_hdr += '    vktrace_write_and_delete_trace_packet(&pHeader, vktrace_trace_get_trace_file());\n'
         trace_pkt_id_hdr += '\n'
         trace_pkt_id_hdr += '// Include trace packet identifier definitions\n'
         trace_pkt_id_hdr += '#include "vktrace_trace_packet_identifiers.h"\n\n'
@@ -2233,6 +2240,7 @@ class VkTraceFileOutputGenerator(OutputGenerator):
         trace_vk_src += '#include "vktrace_vk_vk.h"\n'
         trace_vk_src += '#include "vktrace_interconnect.h"\n'
         trace_vk_src += '#include "vktrace_filelike.h"\n'
+        trace_vk_src += '#include "vktrace_packet_writer.h"\n'
         trace_vk_src += '#include "vk_struct_size_helper.h"\n'
         trace_vk_src += '#ifdef PLATFORM_LINUX\n'
         trace_vk_src += '#include <pthread.h>\n'
@@ -2254,18 +2262,48 @@ class VkTraceFileOutputGenerator(OutputGenerator):
         trace_vk_src += '#elif defined(PLATFORM_LINUX)\n'
         trace_vk_src += 'void InitTracer(void) {\n'
         trace_vk_src += '#endif\n\n'
+        trace_vk_src += '    const char *outputTrace = vktrace_get_global_var(VKTRACE_OUTPUT_TRACE_ENV);\n'
+        trace_vk_src += '    if (outputTrace != NULL && *outputTrace != \'\\0\') {\n'
+        trace_vk_src += '        // No vktrace server, write the trace file from here. Child processes inherit the env var and load\n'
+        trace_vk_src += '        // the layer too, so the pid is appended to the file name to keep them from overwriting each other.\n'
+        trace_vk_src += '        const char *pExtension = strrchr(outputTrace, \'.\');\n'
+        trace_vk_src += '        if (pExtension == NULL || strchr(pExtension, \'/\') != NULL || strchr(pExtension, \'\\\\\') != NULL) {\n'
+        trace_vk_src += '            pExtension = outputTrace + strlen(outputTrace);\n'
+        trace_vk_src += '        }\n'
+        trace_vk_src += '        size_t traceFilenameSize = strlen(outputTrace) + 17;\n'
+        trace_vk_src += '        char *traceFilename = VKTRACE_NEW_ARRAY(char, traceFilenameSize);\n'
+        trace_vk_src += '#if defined(WIN32)\n'
+        trace_vk_src += '        _snprintf_s(traceFilename, traceFilenameSize, _TRUNCATE, "%.*s-%u%s", (int)(pExtension - outputTrace), outputTrace,\n'
+        trace_vk_src += '                    (unsigned int)vktrace_get_pid(), pExtension);\n'
+        trace_vk_src += '#else\n'
+        trace_vk_src += '        snprintf(traceFilename, traceFilenameSize, "%.*s-%u%s", (int)(pExtension - outputTrace), outputTrace,\n'
+        trace_vk_src += '                 (unsigned int)vktrace_get_pid(), pExtension);\n'
+        trace_vk_src += '#endif\n'
+        trace_vk_src += '        FILE *pTraceFile = fopen(traceFilename, "w+b");\n'
+        trace_vk_src += '        FileLike *pFileLike = vktrace_FileLike_create_trace_file_writer(pTraceFile);\n'
+        trace_vk_src += '        if (pFileLike == NULL) {\n'
+        trace_vk_src += '            vktrace_LogError("Unable to create trace file %s.", traceFilename);\n'
+        trace_vk_src += '            if (pTraceFile != NULL) fclose(pTraceFile);\n'
+        trace_vk_src += '        } else {\n'
+        trace_vk_src += '            vktrace_LogAlways("Writing trace file %s.", traceFilename);\n'
+        trace_vk_src += '        }\n'
+        trace_vk_src += '        vktrace_free(traceFilename);\n'
+        trace_vk_src += '        vktrace_trace_set_trace_file(pFileLike);\n'
+        trace_vk_src += '    } else {\n'
         trace_vk_src += '#if defined(ANDROID)\n'
-        trace_vk_src += '    // On Android, we can use an abstract socket to fit permissions model\n'
-        trace_vk_src += '    const char *ipAddr = "localabstract";\n'
-        trace_vk_src += '    const char *ipPort = "vktrace";\n'
-        trace_vk_src += '    gMessageStream = vktrace_MessageStream_create_port_string(FALSE, ipAddr, ipPort);\n'
+        trace_vk_src += '        // On Android, we can use an abstract socket to fit permissions model\n'
+        trace_vk_src += '        const char *ipAddr = "localabstract";\n'
+        trace_vk_src += '        const char *ipPort = "vktrace";\n'
+        trace_vk_src += '        gMessageStream = vktrace_MessageStream_create_port_string(FALSE, ipAddr, ipPort);\n'
         trace_vk_src += '#else\n'
-        trace_vk_src += '    const char *ipAddr = vktrace_get_global_var("VKTRACE_LIB_IPADDR");\n'
-        trace_vk_src += '    if (ipAddr == NULL)\n'
-        trace_vk_src += '        ipAddr = "127.0.0.1";\n'
-        trace_vk_src += '    gMessageStream = vktrace_MessageStream_create(FALSE, ipAddr, VKTRACE_BASE_PORT + VKTRACE_TID_VULKAN);\n'
+        trace_vk_src += '        const char *ipAddr = vktrace_get_global_var("VKTRACE_LIB_IPADDR");\n'
+        trace_vk_src += '        if (ipAddr == NULL)\n'
+        trace_vk_src += '            ipAddr = "127.0.0.1";\n'
+        trace_vk_src += '        gMessageStream = vktrace_MessageStream_create(FALSE, ipAddr, VKTRACE_BASE_PORT + VKTRACE_TID_VULKAN);\n'
         trace_vk_src += '#endif\n'
-        trace_vk_src += '    vktrace_trace_set_trace_file(vktrace_FileLike_create_msg(gMessageStream));\n'
+        trace_vk_src += '        vktrace_trace_set_trace_file(vktrace_FileLike_create_msg(gMessageStream));\n'
+        trace_vk_src += '    }\n'
+        trace_vk_src += '    vktrace_PacketWriter_start(vktrace_trace_get_trace_file(), 0);\n'
         trace_vk_src += '    vktrace_tracelog_set_tracer_id(VKTRACE_TID_VULKAN);\n'
         trace_vk_src += '    trim::initialize();\n'
         trace_vk_src += '    vktrace_initialize_trace_packet_utils();\n'
@@ -38,6 +38,53 @@ then
 fi
 
 rm apidump_file.tmp
+
+# Record vulkaninfo's calls as text and as a binary log, and check that the
+# offline formatter turns the binary log into the same text. Addresses differ
+# between runs, so they are left out of both.
+printf "$GREEN[ RUN      ]$NC $0 binary\n"
+mkdir -p apidump_text_settings apidump_binary_settings
+printf "lunarg_api_dump.file = TRUE\nlunarg_api_dump.log_filename = apidump_text.tmp\nlunarg_api_dump.no_addr = TRUE\n" \
+    > apidump_text_settings/vk_layer_settings.txt
+printf "lunarg_api_dump.output_format = Binary\nlunarg_api_dump.log_filename = apidump_binary.tmp\nlunarg_api_dump.no_addr = TRUE\n" \
+    > apidump_binary_settings/vk_layer_settings.txt
+
+function binary_fail () {
+    printf "$RED[  FAILED  ]$NC $0 binary: $1\n"
+    rm -rf apidump_text_settings apidump_binary_settings apidump_text.tmp apidump_binary.tmp apidump_formatted.tmp apidump_truncated.tmp
+    popd
+    exit 1
+}
+
+VK_ICD_FILENAMES=../icd/VkICD_mock_icd.json VK_LAYER_PATH=../../../layersvt VK_INSTANCE_LAYERS=VK_LAYER_LUNARG_api_dump \
+    VK_LAYER_SETTINGS_PATH=apidump_text_settings ./vulkaninfo > /dev/null
+[ -s apidump_text.tmp ] || binary_fail "vulkaninfo with text output"
+VK_ICD_FILENAMES=../icd/VkICD_mock_icd.json VK_LAYER_PATH=../../../layersvt VK_INSTANCE_LAYERS=VK_LAYER_LUNARG_api_dump \
+    VK_LAYER_SETTINGS_PATH=apidump_binary_settings ./vulkaninfo > /dev/null
+[ -s apidump_binary.tmp ] || binary_fail "vulkaninfo with binary output"
+
+VK_LAYER_SETTINGS_PATH=apidump_binary_settings ../../../layersvt/api_dump_format --text -o apidump_formatted.tmp apidump_binary.tmp
+[ $? -eq 0 ] || binary_fail "api_dump_format"
+diff -q apidump_text.tmp apidump_formatted.tmp > /dev/null
+[ $? -eq 0 ] || binary_fail "formatted binary log differs from the text output"
+
+# A log cut off inside its header or inside a call must be rejected with an
+# error. A cut that happens to fall between two calls leaves a valid log, so
+# the other sizes only have to be handled without crashing the formatter.
+binary_size=$(stat -c %s apidump_binary.tmp)
+for truncated_size in 8 $((binary_size / 4)) $((binary_size / 2)) $((binary_size - 1)); do
+    head -c $truncated_size apidump_binary.tmp > apidump_truncated.tmp
+    VK_LAYER_SETTINGS_PATH=apidump_binary_settings ../../../layersvt/api_dump_format --text apidump_truncated.tmp \
+        > /dev/null 2>&1
+    status=$?
+    [ $status -le 1 ] || binary_fail "log truncated to $truncated_size bytes crashed the formatter"
+    if (( truncated_size == 8 || truncated_size == binary_size - 1 )); then
+        [ $status -eq 1 ] || binary_fail "log truncated to $truncated_size bytes was not rejected"
+    fi
+done
+
+printf "$GREEN[  PASSED  ]$NC $0 binary\n"
+rm -rf apidump_text_settings apidump_binary_settings apidump_text.tmp apidump_binary.tmp apidump_formatted.tmp apidump_truncated.tmp
 popd
 
 exit 0
@@ -70,6 +70,57 @@ jq -S $JSON_SECTIONS $FILENAME_02_TEMP1 > $FILENAME_02_TEMP2
 jq --slurp  --exit-status '.[0] == .[1]' devsim_test2_gold.json $FILENAME_02_TEMP2 > /dev/null
 [ $? -eq 0 ] || fail_msg "test2 jq comparison"
 
+#############################################################################
+# Test 3: Verify devsim results when loaded from the binary cache.
+# The first run fills the cache and the second run loads from it. The third
+# run must notice that an input file was touched and store a new cache file.
+
+FILENAME_03_RESULT="device_simulation_layer_test_1.json"
+FILENAME_03_STDOUT="device_simulation_layer_test_3.txt"
+FILENAME_03_TEMP1="devsim_test3_temp1.json"
+DIRNAME_03_INPUT="devsim_test3_in"
+DIRNAME_03_CACHE="devsim_test3_cache"
+rm -rf $FILENAME_03_STDOUT $FILENAME_03_TEMP1 $DIRNAME_03_INPUT $DIRNAME_03_CACHE
+mkdir $DIRNAME_03_INPUT $DIRNAME_03_CACHE
+cp devsim_test1_in_ArrayOfVkFormatProperties.json devsim_test1_in.json $DIRNAME_03_INPUT
+
+export VK_DEVSIM_FILENAME="$DIRNAME_03_INPUT/devsim_test1_in_ArrayOfVkFormatProperties.json:$DIRNAME_03_INPUT/devsim_test1_in.json"
+export VK_DEVSIM_CACHE_DIR="$DIRNAME_03_CACHE"
+export VK_DEVSIM_DEBUG_ENABLE="1"
+
+# Usage: run_test3 <step name> <expected BinaryCache message>
+function run_test3 () {
+    rm -f $FILENAME_03_RESULT $FILENAME_03_TEMP1
+    "$LVL_BUILD_DIR/libs/vkjson/vkjson_info" > $FILENAME_03_STDOUT
+    [ $? -eq 0 ] || fail_msg "test3 $1 vkjson_info"
+
+    grep -q "BinaryCache $2" $FILENAME_03_STDOUT
+    [ $? -eq 0 ] || fail_msg "test3 $1 cache $2"
+
+    jq -S '{properties,features,memory,queues,formats}' $FILENAME_03_RESULT > $FILENAME_03_TEMP1
+    [ $? -eq 0 ] || fail_msg "test3 $1 jq extraction"
+
+    diff devsim_test1_gold.json $FILENAME_03_TEMP1 >> $FILENAME_03_STDOUT
+    [ $? -eq 0 ] || fail_msg "test3 $1 diff comparison"
+}
+
+run_test3 "fill" "stored"
+CACHE_FILE_COUNT=$(ls $DIRNAME_03_CACHE | wc -l)
+[ $CACHE_FILE_COUNT -gt 0 ] || fail_msg "test3 fill cache file count"
+
+run_test3 "hit" "loaded"
+grep -q "BinaryCache stored" $FILENAME_03_STDOUT && fail_msg "test3 hit cache stored"
+[ $(ls $DIRNAME_03_CACHE | wc -l) -eq $CACHE_FILE_COUNT ] || fail_msg "test3 hit cache file count"
+
+# Cache files are keyed by the modification time of each input file, which has a resolution of one second.
+sleep 1
+touch $DIRNAME_03_INPUT/devsim_test1_in.json
+run_test3 "touched input" "stored"
+[ $(ls $DIRNAME_03_CACHE | wc -l) -eq $((CACHE_FILE_COUNT * 2)) ] || fail_msg "test3 touched input cache file count"
+
+unset VK_DEVSIM_CACHE_DIR VK_DEVSIM_DEBUG_ENABLE
+rm -rf $DIRNAME_03_INPUT $DIRNAME_03_CACHE
+
 #############################################################################
 
 printf "$GREEN[  PASSED  ]$NC $0\n"
@@ -40,11 +40,21 @@ const char APP_VERSION[] = "Version 1.2";
 #else
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <sys/utsname.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #endif
 
 #include <json/json.h>
@@ -2625,74 +2635,461 @@ bool CheckDriver(std::string &folder_loc, std::string &object_name) {
 // Pointer to a function sed to validate if the system object is found
 typedef bool (*PFN_CheckIfValid)(std::string &folder_loc, std::string &object_name);
 
-bool FindLinuxSystemObject(std::string object_name, std::string &location, PFN_CheckIfValid func, bool break_on_first) {
-    bool found_one = false;
-    std::string path_to_check;
-    char *env_value = getenv("LD_LIBRARY_PATH");
+// Split a colon (':') delimited list of paths, such as LD_LIBRARY_PATH.
+// Unlike strtok, this leaves the environment variable itself untouched.
+std::vector<std::string> SplitPathList(const char *path_list) {
+    std::vector<std::string> paths;
+    if (NULL != path_list) {
+        std::stringstream stream(path_list);
+        std::string path;
+        while (std::getline(stream, path, ':')) {
+            if (!path.empty()) {
+                paths.push_back(path);
+            }
+        }
+    }
+    return paths;
+}
 
-    for (uint32_t iii = 0; iii < 5; iii++) {
-        switch (iii) {
-            case 0:
-                path_to_check = "/usr/lib";
-                break;
-            case 1:
-#if __x86_64__ || __ppc64__
-                path_to_check = "/usr/lib/x86_64-linux-gnu";
-#else
-                path_to_check = "/usr/lib/i386-linux-gnu";
-#endif
-                break;
-            case 2:
-#if __x86_64__ || __ppc64__
-                path_to_check = "/usr/lib64";
-#else
-                path_to_check = "/usr/lib32";
-#endif
-                break;
-            case 3:
-                path_to_check = "/usr/local/lib";
-                break;
-            case 4:
+// The standard system library folders, in the order they are searched.
+std::vector<std::string> SystemLibraryPaths() {
+    std::vector<std::string> paths;
+    paths.push_back("/usr/lib");
 #if __x86_64__ || __ppc64__
-                path_to_check = "/usr/local/lib64";
+    paths.push_back("/usr/lib/x86_64-linux-gnu");
+    paths.push_back("/usr/lib64");
+    paths.push_back("/usr/local/lib");
+    paths.push_back("/usr/local/lib64");
 #else
-                path_to_check = "/usr/local/lib32";
+    paths.push_back("/usr/lib/i386-linux-gnu");
+    paths.push_back("/usr/lib32");
+    paths.push_back("/usr/local/lib");
+    paths.push_back("/usr/local/lib32");
 #endif
-                break;
-            default:
-                continue;
+    return paths;
+}
+
+// The standard folders a kind of Vulkan JSON manifest (such as "icd.d" or
+// "implicit_layer.d") is installed in, in the order they are searched.
+std::vector<std::string> VulkanManifestPaths(const std::string &sub_folder) {
+    std::vector<std::string> paths;
+    paths.push_back("/etc/vulkan/" + sub_folder);
+    paths.push_back("/usr/share/vulkan/" + sub_folder);
+    paths.push_back("/usr/local/etc/vulkan/" + sub_folder);
+    paths.push_back("/usr/local/share/vulkan/" + sub_folder);
+
+    char *home_env_value = getenv("HOME");
+    if (NULL == home_env_value) {
+        paths.push_back("~/.local/share/vulkan/" + sub_folder);
+    } else {
+        paths.push_back(std::string(home_env_value) + "/.local/share/vulkan/" + sub_folder);
+    }
+    return paths;
+}
+
+// Reads the folders and JSON manifests looked at by the driver, runtime and
+// layer sections on a pool of worker threads.  Everything is requested up
+// front, so the file system is probed concurrently while the report is still
+// written out in order.  Folder listings and the ldconfig library list are
+// also kept in a cache file between runs, keyed by path and modification
+// time, so repeat runs only re-read what changed.
+class SystemScanner {
+   public:
+    struct Folder {
+        bool exists = false;
+        std::vector<std::string> entries;
+    };
+
+    struct Manifest {
+        bool opened = false;
+        bool parsed = false;
+        Json::Value root = Json::nullValue;
+        std::string errors;
+    };
+
+    SystemScanner();
+    ~SystemScanner();
+
+    // Start listing a folder in the background and, if parse_manifests is
+    // set, reading every JSON manifest in it.
+    void PrefetchFolder(const std::string &path, bool parse_manifests) { FolderFuture(path, parse_manifests); }
+
+    // Start reading a JSON manifest in the background.
+    void PrefetchManifest(const std::string &path) { ManifestFuture(path); }
+
+    // Get the contents of a folder or manifest, waiting for the prefetch to
+    // finish.  Anything that was not prefetched is read now.
+    const Folder &GetFolder(const std::string &path) { return FolderFuture(path, false).get(); }
+    const Manifest &GetManifest(const std::string &path) { return ManifestFuture(path).get(); }
+
+    // Find the location of a library in the ldconfig cache, replacing
+    // "ldconfig -p | grep library_name | awk '{ print $4 }'".
+    bool FindInLdconfigCache(const std::string &library_name, std::string &location);
+
+   private:
+    struct CacheEntry {
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        std::vector<std::string> lines;
+        bool used;
+    };
+
+    void WorkerThread();
+    std::shared_future<Folder> FolderFuture(const std::string &path, bool parse_manifests);
+    std::shared_future<Manifest> ManifestFuture(const std::string &path);
+    Folder ReadFolder(const std::string &path, bool parse_manifests);
+    static Manifest ReadManifest(const std::string &path);
+
+    bool LookupCache(const std::string &key, const struct stat &info, std::vector<std::string> &lines);
+    void StoreCache(const std::string &key, const struct stat &info, const std::vector<std::string> &lines);
+    void LoadCacheFile();
+    void SaveCacheFile();
+
+    std::mutex mutex_;
+    std::condition_variable job_ready_;
+    std::deque<std::function<void()>> jobs_;
+    std::vector<std::thread> workers_;
+    bool stopping_ = false;
+
+    std::map<std::string, std::shared_future<Folder>> folders_;
+    std::map<std::string, std::shared_future<Manifest>> manifests_;
+
+    std::string cache_file_;
+    std::map<std::string, CacheEntry> cache_;
+    bool cache_dirty_ = false;
+
+    bool ldconfig_read_ = false;
+    std::vector<std::string> ldconfig_lines_;
+};
+
+const char kScanCacheHeader[] = "via scan cache 1";
+
+SystemScanner::SystemScanner() {
+    char *cache_env_value = getenv("XDG_CACHE_HOME");
+    char *home_env_value = getenv("HOME");
+    std::string cache_folder;
+    if (NULL != cache_env_value && cache_env_value[0] != '\0') {
+        cache_folder = cache_env_value;
+    } else if (NULL != home_env_value) {
+        cache_folder = home_env_value;
+        cache_folder += "/.cache";
+    }
+    if (!cache_folder.empty()) {
+        mkdir(cache_folder.c_str(), 0755);
+        cache_file_ = cache_folder + "/via_scan_cache";
+        LoadCacheFile();
+    }
+
+    uint32_t num_workers = std::thread::hardware_concurrency();
+    num_workers = std::max(2u, std::min(num_workers, 8u));
+    for (uint32_t i = 0; i < num_workers; i++) {
+        workers_.emplace_back(&SystemScanner::WorkerThread, this);
+    }
+}
+
+SystemScanner::~SystemScanner() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    job_ready_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+    SaveCacheFile();
+}
+
+void SystemScanner::WorkerThread() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        job_ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return;
+        }
+        std::function<void()> job = std::move(jobs_.front());
+        jobs_.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+std::shared_future<SystemScanner::Folder> SystemScanner::FolderFuture(const std::string &path, bool parse_manifests) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto folder = folders_.find(path);
+    if (folder != folders_.end()) {
+        return folder->second;
+    }
+
+    auto task = std::make_shared<std::packaged_task<Folder()>>(std::bind(&SystemScanner::ReadFolder, this, path, parse_manifests));
+    std::shared_future<Folder> future = task->get_future().share();
+    folders_[path] = future;
+    jobs_.push_back([task]() { (*task)(); });
+    job_ready_.notify_one();
+    return future;
+}
+
+std::shared_future<SystemScanner::Manifest> SystemScanner::ManifestFuture(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto manifest = manifests_.find(path);
+    if (manifest != manifests_.end()) {
+        return manifest->second;
+    }
+
+    auto task = std::make_shared<std::packaged_task<Manifest()>>(std::bind(&SystemScanner::ReadManifest, path));
+    std::shared_future<Manifest> future = task->get_future().share();
+    manifests_[path] = future;
+    jobs_.push_back([task]() { (*task)(); });
+    job_ready_.notify_one();
+    return future;
+}
+
+SystemScanner::Folder SystemScanner::ReadFolder(const std::string &path, bool parse_manifests) {
+    Folder folder;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+        return folder;
+    }
+
+    // Adding or removing an entry updates the folder's modification time, so
+    // a cached listing is only used while that is unchanged.
+    std::string cache_key = "folder:" + path;
+    if (!LookupCache(cache_key, info, folder.entries)) {
+        DIR *dir = opendir(path.c_str());
+        if (NULL == dir) {
+            return folder;
+        }
+        dirent *cur_ent;
+        while ((cur_ent = readdir(dir)) != NULL) {
+            folder.entries.push_back(cur_ent->d_name);
+        }
+        closedir(dir);
+        StoreCache(cache_key, info, folder.entries);
+    }
+    folder.exists = true;
+
+    if (parse_manifests) {
+        for (const auto &entry : folder.entries) {
+            if (NULL != strstr(entry.c_str(), ".json")) {
+                ManifestFuture(path + "/" + entry);
+            }
+        }
+    }
+    return folder;
+}
+
+SystemScanner::Manifest SystemScanner::ReadManifest(const std::string &path) {
+    Manifest manifest;
+    std::ifstream stream(path.c_str(), std::ifstream::in);
+    if (stream.fail()) {
+        return manifest;
+    }
+    manifest.opened = true;
+
+    Json::Reader reader;
+    manifest.parsed = reader.parse(stream, manifest.root, false) && !manifest.root.isNull();
+    if (!manifest.parsed) {
+        manifest.errors = reader.getFormattedErrorMessages();
+    }
+    return manifest;
+}
+
+bool SystemScanner::FindInLdconfigCache(const std::string &library_name, std::string &location) {
+    if (!ldconfig_read_) {
+        ldconfig_read_ = true;
+
+        // ldconfig -p prints /etc/ld.so.cache, so its output only changes
+        // along with that file.
+        struct stat info;
+        bool have_info = stat("/etc/ld.so.cache", &info) == 0;
+        if (!have_info || !LookupCache("ldconfig:/etc/ld.so.cache", info, ldconfig_lines_)) {
+            FILE *fp = popen("/sbin/ldconfig -N -p", "r");
+            if (fp != NULL) {
+                char line[MAX_STRING_LENGTH];
+                while (fgets(line, sizeof(line) - 1, fp) != NULL) {
+                    ldconfig_lines_.push_back(line);
+                }
+                if (pclose(fp) == 0 && have_info) {
+                    StoreCache("ldconfig:/etc/ld.so.cache", info, ldconfig_lines_);
+                }
+            }
+        }
+    }
+
+    // Each entry looks like "libname.so.1 (libc6,x86-64) => /path/to/libname.so.1".
+    for (const auto &line : ldconfig_lines_) {
+        if (line.find(library_name) != std::string::npos) {
+            std::stringstream fields(line);
+            std::string field;
+            for (uint32_t i = 0; i < 4; i++) {
+                field.clear();
+                fields >> field;
+            }
+            location = field;
+            return !location.empty();
+        }
+    }
+    return false;
+}
+
+bool SystemScanner::LookupCache(const std::string &key, const struct stat &info, std::vector<std::string> &lines) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = cache_.find(key);
+    if (entry == cache_.end() || entry->second.mtime_sec != info.st_mtim.tv_sec ||
+        entry->second.mtime_nsec != info.st_mtim.tv_nsec) {
+        return false;
+    }
+    entry->second.used = true;
+    lines = entry->second.lines;
+    return true;
+}
+
+void SystemScanner::StoreCache(const std::string &key, const struct stat &info, const std::vector<std::string> &lines) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheEntry &entry = cache_[key];
+    entry.mtime_sec = info.st_mtim.tv_sec;
+    entry.mtime_nsec = info.st_mtim.tv_nsec;
+    entry.lines = lines;
+    entry.used = true;
+    cache_dirty_ = true;
+}
+
+// The cache file is a list of '\0' terminated strings: the header, then for
+// each entry its key, modification time seconds and nanoseconds, line count
+// and lines.
+void SystemScanner::LoadCacheFile() {
+    std::ifstream stream(cache_file_.c_str(), std::ifstream::in | std::ifstream::binary);
+    std::string header;
+    if (!std::getline(stream, header, '\0') || header != kScanCacheHeader) {
+        return;
+    }
+
+    std::string key;
+    while (std::getline(stream, key, '\0')) {
+        std::string mtime_sec, mtime_nsec, count;
+        if (!std::getline(stream, mtime_sec, '\0') || !std::getline(stream, mtime_nsec, '\0') ||
+            !std::getline(stream, count, '\0')) {
+            cache_.clear();
+            return;
+        }
+        CacheEntry entry = {strtoll(mtime_sec.c_str(), NULL, 10), strtoll(mtime_nsec.c_str(), NULL, 10), {}, false};
+        entry.lines.resize(strtoul(count.c_str(), NULL, 10));
+        for (auto &line : entry.lines) {
+            if (!std::getline(stream, line, '\0')) {
+                cache_.clear();
+                return;
+            }
+        }
+        cache_[key] = std::move(entry);
+    }
+}
+
+void SystemScanner::SaveCacheFile() {
+    if (cache_file_.empty()) {
+        return;
+    }
+
+    // Entries that were not needed this run are dropped, so the cache does
+    // not keep growing when folders come and go.
+    bool changed = cache_dirty_;
+    for (auto entry = cache_.begin(); entry != cache_.end();) {
+        if (entry->second.used) {
+            ++entry;
+        } else {
+            entry = cache_.erase(entry);
+            changed = true;
+        }
+    }
+    if (!changed) {
+        return;
+    }
+
+    // Write a temporary file and rename it over the cache, so that another
+    // via running at the same time never sees a partially written cache.
+    std::string temp_file = cache_file_ + "." + std::to_string(getpid());
+    std::ofstream stream(temp_file.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    stream << kScanCacheHeader << '\0';
+    for (const auto &entry : cache_) {
+        stream << entry.first << '\0' << entry.second.mtime_sec << '\0' << entry.second.mtime_nsec << '\0'
+               << entry.second.lines.size() << '\0';
+        for (const auto &line : entry.second.lines) {
+            stream << line << '\0';
+        }
+    }
+    stream.close();
+    if (stream.fail() || rename(temp_file.c_str(), cache_file_.c_str()) != 0) {
+        unlink(temp_file.c_str());
+    }
+}
+
+// The scanner used while the system info section is printed.
+SystemScanner *system_scanner = NULL;
+
+// Start reading every folder and manifest the driver, runtime, SDK and layer
+// sections will look at.
+void PrefetchSystemObjects(SystemScanner &scanner) {
+    for (const auto &path : VulkanManifestPaths("icd.d")) {
+        scanner.PrefetchFolder(path, true);
+    }
+    for (const auto &path : SplitPathList(getenv("VK_DRIVERS_PATH"))) {
+        scanner.PrefetchFolder(path, true);
+    }
+    for (const auto &path : SplitPathList(getenv("VK_ICD_FILENAMES"))) {
+        scanner.PrefetchManifest(path);
+    }
+
+    for (const auto &path : SystemLibraryPaths()) {
+        scanner.PrefetchFolder(path, false);
+    }
+    for (const auto &path : SplitPathList(getenv("LD_LIBRARY_PATH"))) {
+        scanner.PrefetchFolder(path, false);
+    }
+
+    const char *sdk_env_names[] = {"VK_SDK_PATH", "VULKAN_SDK"};
+    for (const char *sdk_env_name : sdk_env_names) {
+        char *env_value = getenv(sdk_env_name);
+        if (NULL != env_value) {
+            scanner.PrefetchFolder(std::string(env_value) + "/etc/explicit_layer.d", true);
         }
+    }
+
+    for (const auto &path : VulkanManifestPaths("implicit_layer.d")) {
+        scanner.PrefetchFolder(path, true);
+    }
+    for (const auto &path : SplitPathList(getenv("VK_LAYER_PATH"))) {
+        scanner.PrefetchFolder(path, true);
+    }
+    for (const auto &path : VulkanManifestPaths("explicit_layer.d")) {
+        scanner.PrefetchFolder(path, true);
+    }
+}
+
+bool FindLinuxSystemObject(std::string object_name, std::string &location, PFN_CheckIfValid func, bool break_on_first) {
+    bool found_one = false;
 
+    for (std::string path_to_check : SystemLibraryPaths()) {
         if (func(path_to_check, object_name)) {
             location = path_to_check + "/" + object_name;
 
             // We found one runtime, clear any failures
             found_one = true;
             if (break_on_first) {
-                goto out;
+                return found_one;
             }
         }
     }
 
     // LD_LIBRARY_PATH may have multiple folders listed in it (colon
     // ':' delimited)
-    if (env_value != NULL) {
-        char *tok = strtok(env_value, ":");
-        while (tok != NULL) {
-            if (strlen(tok) > 0) {
-                path_to_check = tok;
-                if (func(path_to_check, object_name)) {
-                    location = path_to_check + "/" + object_name;
+    for (std::string path_to_check : SplitPathList(getenv("LD_LIBRARY_PATH"))) {
+        if (func(path_to_check, object_name)) {
+            location = path_to_check + "/" + object_name;
 
-                    // We found one runtime, clear any failures
-                    found_one = true;
-                }
-            }
-            tok = strtok(NULL, ":");
+            // We found one runtime, clear any failures
+            found_one = true;
         }
     }
 
-out:
     return found_one;
 }
 
@@ -2712,35 +3109,31 @@ ErrorResults PrintSystemInfo(void) {
     std::string exe_directory;
     std::string desktop_session;
 
+    // Start reading the driver, runtime and layer folders in the background
+    // while the environment and hardware are printed.
+    SystemScanner scanner;
+    system_scanner = &scanner;
+    PrefetchSystemObjects(scanner);
+
     BeginSection("System Info");
 
     // Environment section has information about the OS and the
     // execution environment.
     PrintBeginTable("Environment", 3);
 
-    fp = popen("cat /etc/os-release", "r");
-    if (fp == NULL) {
+    std::ifstream os_release("/etc/os-release", std::ifstream::in);
+    if (os_release.fail()) {
         PrintBeginTableRow();
         PrintTableElement("ERROR");
-        PrintTableElement("Failed to cat /etc/os-release");
+        PrintTableElement("Failed to read /etc/os-release");
         PrintTableElement("");
         PrintEndTableRow();
         res = SYSTEM_CALL_FAILURE;
     } else {
-        // Read the output a line at a time - output it.
-        while (fgets(path, sizeof(path) - 1, fp) != NULL) {
-            if (NULL != strstr(path, "PRETTY_NAME")) {
-                uint32_t index;
-                index = strlen(path) - 1;
-                while (path[index] == ' ' || path[index] == '\t' || path[index] == '\r' || path[index] == '\n' ||
-                       path[index] == '\"') {
-                    path[index] = '\0';
-                    index = strlen(path) - 1;
-                }
-                index = 13;
-                while (path[index] == ' ' || path[index] == '\t' || path[index] == '\"') {
-                    index++;
-                }
+        // Read the file a line at a time, looking for the distro name.
+        std::string line;
+        while (std::getline(os_release, line)) {
+            if (0 == line.compare(0, 12, "PRETTY_NAME=")) {
                 PrintBeginTableRow();
                 PrintTableElement("Linux");
                 PrintTableElement("");
@@ -2749,12 +3142,11 @@ ErrorResults PrintSystemInfo(void) {
                 PrintBeginTableRow();
                 PrintTableElement("");
                 PrintTableElement("Distro");
-                PrintTableElement(&path[index]);
+                PrintTableElement(TrimWhitespace(line.substr(12), " \t\r\n\"\'"));
                 PrintEndTableRow();
                 break;
             }
         }
-        pclose(fp);
     }
 
     errno = 0;
@@ -2981,6 +3373,7 @@ ErrorResults PrintSystemInfo(void) {
     res = PrintLayerSettingsFileInfo();
     EndSection();
 
+    system_scanner = NULL;
     return res;
 }
 
@@ -2998,17 +3391,15 @@ bool VerifyOpen(std::string library_file, std::string &error) {
 
 bool ReadDriverJson(std::string cur_driver_json, bool &found_lib) {
     bool found_json = false;
-    std::ifstream *stream = NULL;
-    Json::Value root = Json::nullValue;
+    const SystemScanner::Manifest &manifest = system_scanner->GetManifest(cur_driver_json);
+    const Json::Value &root = manifest.root;
     Json::Value inst_exts = Json::nullValue;
     Json::Value dev_exts = Json::nullValue;
-    Json::Reader reader;
     char full_driver_path[MAX_STRING_LENGTH];
     char generic_string[MAX_STRING_LENGTH];
     uint32_t j = 0;
 
-    stream = new std::ifstream(cur_driver_json.c_str(), std::ifstream::in);
-    if (nullptr == stream || stream->fail()) {
+    if (!manifest.opened) {
         PrintBeginTableRow();
         PrintTableElement("");
         PrintTableElement("Error reading JSON file");
@@ -3017,11 +3408,11 @@ bool ReadDriverJson(std::string cur_driver_json, bool &found_lib) {
         goto out;
     }
 
-    if (!reader.parse(*stream, root, false) || root.isNull()) {
+    if (!manifest.parsed) {
         PrintBeginTableRow();
         PrintTableElement("");
         PrintTableElement("Error reading JSON file");
-        PrintTableElement(reader.getFormattedErrorMessages());
+        PrintTableElement(manifest.errors);
         PrintEndTableRow();
         goto out;
     }
@@ -3081,10 +3472,7 @@ bool ReadDriverJson(std::string cur_driver_json, bool &found_lib) {
             }
         }
         if (!found_lib) {
-            FILE *fp;
-            sprintf(generic_string, "/sbin/ldconfig -v -N -p | grep %s | awk \'{ print $4 }\'", driver_name.c_str());
-            fp = popen(generic_string, "r");
-            if (fp == NULL) {
+            if (!system_scanner->FindInLdconfigCache(driver_name, location)) {
                 snprintf(generic_string, MAX_STRING_LENGTH - 1,
                          "Failed to find driver %s "
                          "referenced by JSON %s",
@@ -3095,20 +3483,14 @@ bool ReadDriverJson(std::string cur_driver_json, bool &found_lib) {
                 PrintTableElement(generic_string);
                 PrintEndTableRow();
             } else {
-                char query_res[MAX_STRING_LENGTH];
-
-                // Read the output a line at a time - output it.
-                if (fgets(query_res, sizeof(query_res) - 1, fp) != NULL) {
-                    sprintf(generic_string, "Found at %s", query_res);
-                    PrintBeginTableRow();
-                    PrintTableElement("");
-                    PrintTableElement("");
-                    PrintTableElement(generic_string);
-                    PrintEndTableRow();
-                    found_lib = true;
-                    could_load = VerifyOpen(query_res, load_error);
-                }
-                fclose(fp);
+                snprintf(generic_string, MAX_STRING_LENGTH - 1, "Found at %s", location.c_str());
+                PrintBeginTableRow();
+                PrintTableElement("");
+                PrintTableElement("");
+                PrintTableElement(generic_string);
+                PrintEndTableRow();
+                found_lib = true;
+                could_load = VerifyOpen(location, load_error);
             }
         } else if (!could_load) {
             PrintBeginTableRow();
@@ -3177,12 +3559,6 @@ bool ReadDriverJson(std::string cur_driver_json, bool &found_lib) {
 
 out:
 
-    if (nullptr != stream) {
-        stream->close();
-        delete stream;
-        stream = NULL;
-    }
-
     return found_json;
 }
 
@@ -3196,7 +3572,6 @@ ErrorResults PrintDriverInfo(void) {
     uint32_t i = 0;
     char generic_string[MAX_STRING_LENGTH];
     char cur_vulkan_driver_json[MAX_STRING_LENGTH];
-    char *home_env_value = NULL;
     char *drivers_env_value = NULL;
     char *icd_env_value = NULL;
     std::vector<std::string> driver_paths;
@@ -3206,19 +3581,7 @@ ErrorResults PrintDriverInfo(void) {
 
     // There are several folders ICD JSONs could be in.  So,
     // try all of them.
-    driver_paths.push_back("/etc/vulkan/icd.d");
-    driver_paths.push_back("/usr/share/vulkan/icd.d");
-    driver_paths.push_back("/usr/local/etc/vulkan/icd.d");
-    driver_paths.push_back("/usr/local/share/vulkan/icd.d");
-
-    home_env_value = getenv("HOME");
-    if (NULL == home_env_value) {
-        driver_paths.push_back("~/.local/share/vulkan/icd.d");
-    } else {
-        std::string home_icd_dir = home_env_value;
-        home_icd_dir += "/.local/share/vulkan/icd.d";
-        driver_paths.push_back(home_icd_dir);
-    }
+    driver_paths = VulkanManifestPaths("icd.d");
 
     // The user can override the drivers path manually
     drivers_env_value = getenv("VK_DRIVERS_PATH");
@@ -3226,14 +3589,8 @@ ErrorResults PrintDriverInfo(void) {
         drivers_path_index = driver_paths.size();
         // VK_DRIVERS_PATH may have multiple folders listed in it (colon
         // ':' delimited)
-        char *tok = strtok(drivers_env_value, ":");
-        if (tok != NULL) {
-            while (tok != NULL) {
-                driver_paths.push_back(tok);
-                tok = strtok(NULL, ":");
-            }
-        } else {
-            driver_paths.push_back(drivers_env_value);
+        for (const auto &path : SplitPathList(drivers_env_value)) {
+            driver_paths.push_back(path);
         }
     }
 
@@ -3256,8 +3613,8 @@ ErrorResults PrintDriverInfo(void) {
         }
 
         // Make sure the directory exists.
-        DIR *driver_dir = opendir(driver_paths[dir].c_str());
-        if (NULL == driver_dir) {
+        const SystemScanner::Folder &driver_dir = system_scanner->GetFolder(driver_paths[dir]);
+        if (!driver_dir.exists) {
             PrintBeginTableRow();
             PrintTableElement(driver_paths[dir], ALIGN_RIGHT);
             PrintTableElement("No such folder");
@@ -3273,16 +3630,15 @@ ErrorResults PrintDriverInfo(void) {
         PrintTableElement("");
         PrintEndTableRow();
 
-        dirent *cur_ent;
         i = 0;
-        while ((cur_ent = readdir(driver_dir)) != NULL) {
-            if (NULL != strstr(cur_ent->d_name, ".json")) {
+        for (const auto &entry : driver_dir.entries) {
+            if (NULL != strstr(entry.c_str(), ".json")) {
                 snprintf(generic_string, MAX_STRING_LENGTH - 1, "[%d]", i++);
-                snprintf(cur_vulkan_driver_json, MAX_STRING_LENGTH - 1, "%s/%s", driver_paths[dir].c_str(), cur_ent->d_name);
+                snprintf(cur_vulkan_driver_json, MAX_STRING_LENGTH - 1, "%s/%s", driver_paths[dir].c_str(), entry.c_str());
 
                 PrintBeginTableRow();
                 PrintTableElement(generic_string, ALIGN_RIGHT);
-                PrintTableElement(cur_ent->d_name);
+                PrintTableElement(entry);
                 PrintTableElement("");
                 PrintEndTableRow();
 
@@ -3303,44 +3659,22 @@ ErrorResults PrintDriverInfo(void) {
         PrintTableElement("");
         PrintEndTableRow();
 
-        // VK_ICD_FILENAMES may have multiple folders listed in it (colon
+        // VK_ICD_FILENAMES may have multiple files listed in it (colon
         // ':' delimited)
-        char *tok = strtok(icd_env_value, ":");
-        if (tok != NULL) {
-            while (tok != NULL) {
-                if (access(tok, R_OK) != -1) {
-                    PrintBeginTableRow();
-                    PrintTableElement(tok, ALIGN_RIGHT);
-                    PrintTableElement("");
-                    PrintTableElement("");
-                    PrintEndTableRow();
-                    if (ReadDriverJson(tok, found_this_lib)) {
-                        found_json = true;
-                        found_lib |= found_this_lib;
-                    }
-                } else {
-                    PrintBeginTableRow();
-                    PrintTableElement(tok, ALIGN_RIGHT);
-                    PrintTableElement("No such file");
-                    PrintTableElement("");
-                    PrintEndTableRow();
-                }
-                tok = strtok(NULL, ":");
-            }
-        } else {
-            if (access(icd_env_value, R_OK) != -1) {
+        for (const auto &icd_file : SplitPathList(icd_env_value)) {
+            if (access(icd_file.c_str(), R_OK) != -1) {
                 PrintBeginTableRow();
-                PrintTableElement(icd_env_value, ALIGN_RIGHT);
+                PrintTableElement(icd_file, ALIGN_RIGHT);
                 PrintTableElement("");
                 PrintTableElement("");
                 PrintEndTableRow();
-                if (ReadDriverJson(icd_env_value, found_this_lib)) {
+                if (ReadDriverJson(icd_file, found_this_lib)) {
                     found_json = true;
                     found_lib |= found_this_lib;
                 }
             } else {
                 PrintBeginTableRow();
-                PrintTableElement(icd_env_value, ALIGN_RIGHT);
+                PrintTableElement(icd_file, ALIGN_RIGHT);
                 PrintTableElement("No such file");
                 PrintTableElement("");
                 PrintEndTableRow();
@@ -3362,18 +3696,14 @@ ErrorResults PrintDriverInfo(void) {
 // Print out all the runtime files found in a given location.  This way we
 // capture the full state of the system.
 ErrorResults PrintRuntimesInFolder(std::string &folder_loc, std::string &object_name, bool print_header = true) {
-    DIR *runtime_dir;
     ErrorResults res = SUCCESSFUL;
 
-    runtime_dir = opendir(folder_loc.c_str());
-    if (NULL != runtime_dir) {
+    const SystemScanner::Folder &runtime_dir = system_scanner->GetFolder(folder_loc);
+    if (runtime_dir.exists) {
         bool file_found = false;
-        FILE *pfp;
         uint32_t i = 0;
-        dirent *cur_ent;
-        std::string command_str;
-        std::stringstream generic_str;
-        char path[1035];
+        char generic_string[MAX_STRING_LENGTH];
+        char link_target[PATH_MAX];
 
         if (print_header) {
             PrintBeginTableRow();
@@ -3383,53 +3713,39 @@ ErrorResults PrintRuntimesInFolder(std::string &folder_loc, std::string &object_
             PrintEndTableRow();
         }
 
-        while ((cur_ent = readdir(runtime_dir)) != NULL) {
-            if (NULL != strstr(cur_ent->d_name, object_name.c_str()) && strlen(cur_ent->d_name) == 14) {
-                // Get the source of this symbolic link
-                command_str = "stat -c%N \'";
-                command_str += folder_loc;
-                command_str += "/";
-                command_str += cur_ent->d_name;
-                command_str += "\'";
-                pfp = popen(command_str.c_str(), "r");
+        for (const auto &entry : runtime_dir.entries) {
+            if (NULL != strstr(entry.c_str(), object_name.c_str()) && entry.size() == 14) {
+                std::string runtime_file = folder_loc + "/" + entry;
+                struct stat info;
 
-                generic_str << "[" << i++ << "]";
+                snprintf(generic_string, MAX_STRING_LENGTH - 1, "[%d]", i++);
 
                 PrintBeginTableRow();
-                PrintTableElement(generic_str.str(), ALIGN_RIGHT);
+                PrintTableElement(generic_string, ALIGN_RIGHT);
 
                 file_found = true;
 
-                if (pfp == NULL) {
-                    PrintTableElement(cur_ent->d_name);
+                // Get the source of this symbolic link
+                if (lstat(runtime_file.c_str(), &info) != 0) {
+                    PrintTableElement(entry);
                     PrintTableElement("Failed to retrieve symbolic link");
                     res = SYSTEM_CALL_FAILURE;
-                } else {
-                    if (NULL != fgets(path, sizeof(path) - 1, pfp)) {
-                        std::string cmd = path;
-                        size_t arrow_loc = cmd.find("->");
-                        if (arrow_loc == std::string::npos) {
-                            std::string trimmed_path = TrimWhitespace(path, " \t\n\r\'\"");
-
-                            PrintTableElement(trimmed_path);
-                            PrintTableElement("");
-                        } else {
-                            std::string before_arrow = cmd.substr(0, arrow_loc);
-                            std::string trim_before = TrimWhitespace(before_arrow, " \t\n\r\'\"");
-                            std::string after_arrow = cmd.substr(arrow_loc + 2, std::string::npos);
-                            std::string trim_after = TrimWhitespace(after_arrow, " \t\n\r\'\"");
-                            PrintTableElement(trim_before);
-                            PrintTableElement(trim_after);
-                        }
-                    } else {
-                        PrintTableElement(cur_ent->d_name);
+                } else if (S_ISLNK(info.st_mode)) {
+                    ssize_t len = readlink(runtime_file.c_str(), link_target, sizeof(link_target) - 1);
+                    if (len == -1) {
+                        PrintTableElement(entry);
                         PrintTableElement("Failed to retrieve symbolic link");
+                    } else {
+                        link_target[len] = '\0';
+                        PrintTableElement(runtime_file);
+                        PrintTableElement(link_target);
                     }
-
-                    PrintEndTableRow();
-
-                    pclose(pfp);
+                } else {
+                    PrintTableElement(runtime_file);
+                    PrintTableElement("");
                 }
+
+                PrintEndTableRow();
             }
         }
         if (!file_found) {
@@ -3439,7 +3755,6 @@ ErrorResults PrintRuntimesInFolder(std::string &folder_loc, std::string &object_
             PrintTableElement("");
             PrintEndTableRow();
         }
-        closedir(runtime_dir);
     } else {
         PrintBeginTableRow();
         PrintTableElement(folder_loc, ALIGN_RIGHT);
@@ -3461,12 +3776,7 @@ bool CheckRuntime(std::string &folder_loc, std::string &object_name) {
 ErrorResults PrintRunTimeInfo(void) {
     ErrorResults res = SUCCESSFUL;
     const char vulkan_so_prefix[] = "libvulkan.so.";
-    char path[1035];
-    char generic_string[MAX_STRING_LENGTH];
-    char buff[PATH_MAX];
-    std::string runtime_dir_name;
     std::string location;
-    FILE *pfp;
     PrintBeginTable("Vulkan Runtimes", 3);
 
     PrintBeginTableRow();
@@ -3479,69 +3789,52 @@ ErrorResults PrintRunTimeInfo(void) {
         res = VULKAN_CANT_FIND_RUNTIME;
     }
 
-    ssize_t len = ::readlink("/proc/self/exe", buff, sizeof(buff) - 1);
-    if (len != -1) {
-        buff[len] = '\0';
-
-        std::string runtime_dir_id = "Runtime Folder Used By via";
-        snprintf(generic_string, MAX_STRING_LENGTH - 1, "ldd \'%s\'", buff);
-        pfp = popen(generic_string, "r");
-        if (pfp == NULL) {
-            PrintBeginTableRow();
-            PrintTableElement(runtime_dir_id);
-            PrintTableElement("Failed to query via library info");
-            PrintTableElement("");
-            PrintEndTableRow();
-            res = SYSTEM_CALL_FAILURE;
-        } else {
-            bool found = false;
-            while (fgets(path, sizeof(path) - 1, pfp) != NULL) {
-                if (NULL != strstr(path, vulkan_so_prefix)) {
-                    std::string cmd = path;
-                    size_t arrow_loc = cmd.find("=>");
-                    if (arrow_loc == std::string::npos) {
-                        std::string trimmed_path = TrimWhitespace(path, " \t\n\r\'\"");
-                        PrintBeginTableRow();
-                        PrintTableElement(runtime_dir_id);
-                        PrintTableElement(trimmed_path);
-                        PrintTableElement("");
-                        PrintEndTableRow();
-                    } else {
-                        std::string after_arrow = cmd.substr(arrow_loc + 2);
-                        std::string before_slash = after_arrow.substr(0, after_arrow.rfind("/"));
-                        std::string trimmed = TrimWhitespace(before_slash, " \t\n\r\'\"");
+    std::string runtime_dir_id = "Runtime Folder Used By via";
 
-                        PrintBeginTableRow();
-                        PrintTableElement(runtime_dir_id);
-                        PrintTableElement(trimmed);
-                        PrintTableElement("");
-                        PrintEndTableRow();
+    // The loader via is linked against is mapped into this process, so
+    // read its location from there instead of running ldd on ourselves.
+    std::ifstream maps("/proc/self/maps", std::ifstream::in);
+    if (maps.fail()) {
+        PrintBeginTableRow();
+        PrintTableElement(runtime_dir_id);
+        PrintTableElement("Failed to query via library info");
+        PrintTableElement("");
+        PrintEndTableRow();
+        res = SYSTEM_CALL_FAILURE;
+    } else {
+        bool found = false;
+        std::string line;
+        while (std::getline(maps, line)) {
+            size_t path_loc = line.find('/');
+            if (path_loc != std::string::npos && line.find(vulkan_so_prefix, path_loc) != std::string::npos) {
+                std::string library_path = line.substr(path_loc);
+                std::string library_dir = library_path.substr(0, library_path.rfind("/"));
 
-                        std::string find_so = vulkan_so_prefix;
-                        ErrorResults temp_res = PrintRuntimesInFolder(trimmed, find_so, false);
-                        if (!found) {
-                            res = temp_res;
-                        } else {
-                            // We found one runtime, clear any failures
-                            if (res == VULKAN_CANT_FIND_RUNTIME) {
-                                res = SUCCESSFUL;
-                                found = true;
-                            }
-                        }
-                    }
-                    break;
-                }
-            }
-            if (!found) {
                 PrintBeginTableRow();
                 PrintTableElement(runtime_dir_id);
-                PrintTableElement("Failed to find Vulkan SO used for via");
+                PrintTableElement(library_dir);
                 PrintTableElement("");
                 PrintEndTableRow();
+
+                std::string find_so = vulkan_so_prefix;
+                ErrorResults temp_res = PrintRuntimesInFolder(library_dir, find_so, false);
+                if (temp_res != SUCCESSFUL) {
+                    res = temp_res;
+                } else if (res == VULKAN_CANT_FIND_RUNTIME) {
+                    // We found one runtime, clear any failures
+                    res = SUCCESSFUL;
+                }
+                found = true;
+                break;
             }
-            pclose(pfp);
         }
-        PrintEndTableRow();
+        if (!found) {
+            PrintBeginTableRow();
+            PrintTableElement(runtime_dir_id);
+            PrintTableElement("Failed to find Vulkan SO used for via");
+            PrintTableElement("");
+            PrintEndTableRow();
+        }
     }
 
     PrintEndTable();
@@ -3553,11 +3846,9 @@ ErrorResults PrintRunTimeInfo(void) {
 // locations.
 ErrorResults PrintExplicitLayersInFolder(std::string &id, std::string &folder_loc) {
     ErrorResults res = SUCCESSFUL;
-    DIR *layer_dir;
 
-    layer_dir = opendir(folder_loc.c_str());
-    if (NULL != layer_dir) {
-        dirent *cur_ent;
+    const SystemScanner::Folder &layer_dir = system_scanner->GetFolder(folder_loc);
+    if (layer_dir.exists) {
         std::string cur_layer;
         char generic_string[MAX_STRING_LENGTH];
         uint32_t i = 0;
@@ -3571,54 +3862,45 @@ ErrorResults PrintExplicitLayersInFolder(std::string &id, std::string &folder_lo
         PrintEndTableRow();
 
         // Loop through each JSON in a given folder
-        while ((cur_ent = readdir(layer_dir)) != NULL) {
-            if (NULL != strstr(cur_ent->d_name, ".json")) {
+        for (const auto &entry : layer_dir.entries) {
+            if (NULL != strstr(entry.c_str(), ".json")) {
                 found_json = true;
 
                 snprintf(generic_string, MAX_STRING_LENGTH - 1, "[%d]", i++);
                 cur_layer = folder_loc;
                 cur_layer += "/";
-                cur_layer += cur_ent->d_name;
+                cur_layer += entry;
 
                 // Parse the JSON file
-                std::ifstream *stream = NULL;
-                stream = new std::ifstream(cur_layer, std::ifstream::in);
-                if (nullptr == stream || stream->fail()) {
+                const SystemScanner::Manifest &manifest = system_scanner->GetManifest(cur_layer);
+                if (!manifest.opened) {
                     PrintBeginTableRow();
                     PrintTableElement("");
                     PrintTableElement(generic_string, ALIGN_RIGHT);
-                    PrintTableElement(cur_ent->d_name);
+                    PrintTableElement(entry);
                     PrintTableElement("ERROR reading JSON file!");
                     PrintEndTableRow();
                     res = MISSING_LAYER_JSON;
+                } else if (!manifest.parsed) {
+                    // Report to the user the failure and their
+                    // locations in the document.
+                    PrintBeginTableRow();
+                    PrintTableElement("");
+                    PrintTableElement(generic_string, ALIGN_RIGHT);
+                    PrintTableElement(entry);
+                    PrintTableElement(manifest.errors);
+                    PrintEndTableRow();
+                    res = LAYER_JSON_PARSING_ERROR;
                 } else {
-                    Json::Value root = Json::nullValue;
-                    Json::Reader reader;
-                    if (!reader.parse(*stream, root, false) || root.isNull()) {
-                        // Report to the user the failure and their
-                        // locations in the document.
-                        PrintBeginTableRow();
-                        PrintTableElement("");
-                        PrintTableElement(generic_string, ALIGN_RIGHT);
-                        PrintTableElement(cur_ent->d_name);
-                        PrintTableElement(reader.getFormattedErrorMessages());
-                        PrintEndTableRow();
-                        res = LAYER_JSON_PARSING_ERROR;
-                    } else {
-                        PrintBeginTableRow();
-                        PrintTableElement("");
-                        PrintTableElement(generic_string, ALIGN_RIGHT);
-                        PrintTableElement(cur_ent->d_name);
-                        PrintTableElement("");
-                        PrintEndTableRow();
-
-                        // Dump out the standard explicit layer information.
-                        PrintExplicitLayerJsonInfo(cur_layer.c_str(), root);
-                    }
+                    PrintBeginTableRow();
+                    PrintTableElement("");
+                    PrintTableElement(generic_string, ALIGN_RIGHT);
+                    PrintTableElement(entry);
+                    PrintTableElement("");
+                    PrintEndTableRow();
 
-                    stream->close();
-                    delete stream;
-                    stream = NULL;
+                    // Dump out the standard explicit layer information.
+                    PrintExplicitLayerJsonInfo(cur_layer.c_str(), manifest.root);
                 }
             }
         }
@@ -3630,7 +3912,6 @@ ErrorResults PrintExplicitLayersInFolder(std::string &id, std::string &folder_lo
             PrintTableElement("No JSON files found");
             PrintEndTableRow();
         }
-        closedir(layer_dir);
     } else {
         PrintBeginTableRow();
         PrintTableElement("");
@@ -3651,9 +3932,6 @@ ErrorResults PrintSDKInfo(void) {
     bool sdk_exists = false;
     std::string sdk_path;
     std::string sdk_env_name;
-    const char vulkan_so_prefix[] = "libvulkan.so.";
-    DIR *sdk_dir;
-    dirent *cur_ent;
     char *env_value;
 
     PrintBeginTable("LunarG Vulkan SDKs", 4);
@@ -3684,14 +3962,7 @@ ErrorResults PrintSDKInfo(void) {
         std::string explicit_layer_path = sdk_path;
         explicit_layer_path += "/etc/explicit_layer.d";
 
-        sdk_dir = opendir(explicit_layer_path.c_str());
-        if (NULL != sdk_dir) {
-            while ((cur_ent = readdir(sdk_dir)) != NULL) {
-                if (NULL != strstr(cur_ent->d_name, vulkan_so_prefix) && strlen(cur_ent->d_name) == 14) {
-                }
-            }
-            closedir(sdk_dir);
-
+        if (system_scanner->GetFolder(explicit_layer_path).exists) {
             res = PrintExplicitLayersInFolder(sdk_env_name, explicit_layer_path);
 
             global_items.sdk_found = true;
@@ -3721,8 +3992,6 @@ ErrorResults PrintLayerInfo(void) {
     uint32_t i = 0;
     char generic_string[MAX_STRING_LENGTH];
     char cur_vulkan_layer_json[MAX_STRING_LENGTH];
-    DIR *layer_dir;
-    dirent *cur_ent;
     std::string layer_path;
     char *env_value = NULL;
     std::vector<std::string> override_search_paths;
@@ -3733,57 +4002,29 @@ ErrorResults PrintLayerInfo(void) {
 
     // There are several folders implicit layers could be in.  So,
     // try all of them.
-    for (uint32_t dir = 0; dir < 5; dir++) {
-        std::string cur_layer_path;
-        switch (dir) {
-            case 0:
-                cur_layer_path = "/etc/vulkan/implicit_layer.d";
-                break;
-            case 1:
-                cur_layer_path = "/usr/share/vulkan/implicit_layer.d";
-                break;
-            case 2:
-                cur_layer_path = "/usr/local/etc/vulkan/implicit_layer.d";
-                break;
-            case 3:
-                cur_layer_path = "/usr/local/share/vulkan/implicit_layer.d";
-                break;
-            case 4:
-                env_value = getenv("HOME");
-                if (NULL == env_value) {
-                    cur_layer_path = "~/.local/share/vulkan/implicit_layer.d";
-                } else {
-                    cur_layer_path = env_value;
-                    cur_layer_path += "/.local/share/vulkan/implicit_layer.d";
-                }
-                break;
-            default:
-                continue;
-        }
-
-        layer_dir = opendir(cur_layer_path.c_str());
-        if (NULL != layer_dir) {
+    for (const auto &cur_layer_path : VulkanManifestPaths("implicit_layer.d")) {
+        const SystemScanner::Folder &layer_dir = system_scanner->GetFolder(cur_layer_path);
+        if (layer_dir.exists) {
             PrintBeginTableRow();
             PrintTableElement(cur_layer_path, ALIGN_RIGHT);
             PrintTableElement("");
             PrintTableElement("");
             PrintTableElement("");
             PrintEndTableRow();
-            while ((cur_ent = readdir(layer_dir)) != NULL) {
-                if (NULL != strstr(cur_ent->d_name, ".json")) {
+            for (const auto &entry : layer_dir.entries) {
+                if (NULL != strstr(entry.c_str(), ".json")) {
                     snprintf(generic_string, MAX_STRING_LENGTH - 1, "[%d]", i++);
-                    snprintf(cur_vulkan_layer_json, MAX_STRING_LENGTH - 1, "%s/%s", cur_layer_path.c_str(), cur_ent->d_name);
+                    snprintf(cur_vulkan_layer_json, MAX_STRING_LENGTH - 1, "%s/%s", cur_layer_path.c_str(), entry.c_str());
 
                     PrintBeginTableRow();
                     PrintTableElement(generic_string, ALIGN_RIGHT);
-                    PrintTableElement(cur_ent->d_name);
+                    PrintTableElement(entry);
                     PrintTableElement("");
                     PrintTableElement("");
                     PrintEndTableRow();
 
-                    std::ifstream *stream = NULL;
-                    stream = new std::ifstream(cur_vulkan_layer_json, std::ifstream::in);
-                    if (nullptr == stream || stream->fail()) {
+                    const SystemScanner::Manifest &manifest = system_scanner->GetManifest(cur_vulkan_layer_json);
+                    if (!manifest.opened) {
                         PrintBeginTableRow();
                         PrintTableElement("");
                         PrintTableElement("ERROR reading JSON file!");
@@ -3791,30 +4032,21 @@ ErrorResults PrintLayerInfo(void) {
                         PrintTableElement("");
                         PrintEndTableRow();
                         res = MISSING_LAYER_JSON;
+                    } else if (!manifest.parsed) {
+                        // Report to the user the failure and their
+                        // locations in the document.
+                        PrintBeginTableRow();
+                        PrintTableElement("");
+                        PrintTableElement("ERROR parsing JSON file!");
+                        PrintTableElement(manifest.errors);
+                        PrintTableElement("");
+                        PrintEndTableRow();
+                        res = LAYER_JSON_PARSING_ERROR;
                     } else {
-                        Json::Value root = Json::nullValue;
-                        Json::Reader reader;
-                        if (!reader.parse(*stream, root, false) || root.isNull()) {
-                            // Report to the user the failure and their
-                            // locations in the document.
-                            PrintBeginTableRow();
-                            PrintTableElement("");
-                            PrintTableElement("ERROR parsing JSON file!");
-                            PrintTableElement(reader.getFormattedErrorMessages());
-                            PrintTableElement("");
-                            PrintEndTableRow();
-                            res = LAYER_JSON_PARSING_ERROR;
-                        } else {
-                            PrintImplicitLayerJsonInfo(cur_vulkan_layer_json, root, override_search_paths);
-                        }
-
-                        stream->close();
-                        delete stream;
-                        stream = NULL;
+                        PrintImplicitLayerJsonInfo(cur_vulkan_layer_json, manifest.root, override_search_paths);
                     }
                 }
             }
-            closedir(layer_dir);
         } else {
             PrintBeginTableRow();
             PrintTableElement(cur_layer_path, ALIGN_RIGHT);
@@ -3848,7 +4080,7 @@ ErrorResults PrintLayerInfo(void) {
     env_value = getenv("VK_LAYER_PATH");
     std::string cur_json;
     if (NULL != env_value) {
-        char *tok = strtok(env_value, ":");
+        std::vector<std::string> layer_paths = SplitPathList(env_value);
         explicit_layer_id = "VK_LAYER_PATH";
 
         PrintBeginTableRow();
@@ -3858,16 +4090,15 @@ ErrorResults PrintLayerInfo(void) {
         PrintTableElement("");
         PrintEndTableRow();
 
-        if (NULL != tok) {
+        if (!layer_paths.empty()) {
             uint32_t offset = 0;
             std::stringstream cur_name;
-            while (NULL != tok) {
-                cur_json = tok;
+            for (const auto &layer_path : layer_paths) {
+                cur_json = layer_path;
                 cur_name.str("");
                 cur_name << "Path " << offset++;
                 explicit_layer_id = cur_name.str();
                 res = PrintExplicitLayersInFolder(explicit_layer_id, cur_json);
-                tok = strtok(NULL, ":");
             }
         } else {
             cur_json = env_value;
@@ -140,11 +140,53 @@ static const uint32_t  INVALID_BINDING_INDEX = UINT32_MAX;
 // disabled.
 #define VKTRACE_PAGEGUARD_ENABLE_LAZY_COPY_ENV "VKTRACE_PAGEGUARD_ENABLE_LAZY_COPY"
 
+// VKTRACE_PAGEGUARD_TRACKING env var selects how PMB tracking detects
+// writes to mapped memory. "pageguard" uses page guards or write protection
+// and an exception handler. "userfaultfd" write protects the memory with
+// userfaultfd and handles the faults on a separate thread; it needs Linux 5.7
+// or later. "softdirty" reads the soft-dirty bits of /proc/self/pagemap when
+// mapped memory is flushed, so the app takes no page faults; it is only
+// supported on Linux kernels built with CONFIG_MEM_SOFT_DIRTY. "auto" uses
+// "userfaultfd" if the kernel supports it. "pageguard" is the default, and is
+// also used if the selected mode isn't supported.
+#define VKTRACE_PAGEGUARD_TRACKING_ENV "VKTRACE_PAGEGUARD_TRACKING"
+
 // VKTRACE_TRIM_TRIGGER env var is set by the vktrace program to
 // communicate the --TraceTrigger command line argument to the
 // trace layer.
 #define VKTRACE_TRIM_TRIGGER_ENV "VKTRACE_TRIM_TRIGGER"
 
+// VKTRACE_ASYNC_WRITER env var controls the trace layer's background
+// packet writer thread. If it is set to "0", finished trace packets are
+// written synchronously on the thread that made the Vulkan call. Any other
+// value, or leaving it undefined, enables the writer thread. The env var is
+// set by the vktrace program to communicate the --AsyncWriter arg value to
+// the trace layer.
+#define VKTRACE_ASYNC_WRITER_ENV "VKTRACE_ASYNC_WRITER"
+
+// _VKTRACE_ASYNC_WRITER_MAX_QUEUED_BYTES env var specifies how many bytes of
+// trace packets may be queued for the writer thread before application
+// threads are made to wait for it. There is typically no need to set it.
+#define _VKTRACE_ASYNC_WRITER_MAX_QUEUED_BYTES_ENV "_VKTRACE_ASYNC_WRITER_MAX_QUEUED_BYTES"
+
+// VKTRACE_SHM_TRANSPORT env var controls whether the trace layer sends
+// trace packets to a vktrace server on the same machine through a shared
+// memory ring instead of the loopback socket. If it is set to "0", the socket
+// is always used. Any other value, or leaving it undefined, lets the layer
+// offer shared memory when it connects to a loopback address.
+#define VKTRACE_SHM_TRANSPORT_ENV "VKTRACE_SHM_TRANSPORT"
+
+// _VKTRACE_SHM_RING_SIZE env var specifies the size in bytes of the shared
+// memory ring. It is rounded up to a power of two. There is typically no need
+// to set it.
+#define _VKTRACE_SHM_RING_SIZE_ENV "_VKTRACE_SHM_RING_SIZE"
+
+// VKTRACE_OUTPUT_TRACE env var specifies a trace file for the trace layer
+// to write directly, without a vktrace server. The process ID is appended to
+// the file name, so each traced process writes <name>-<pid><extension>. If it
+// is undefined or empty, the layer sends trace packets to the vktrace server.
+#define VKTRACE_OUTPUT_TRACE_ENV "VKTRACE_OUTPUT_TRACE"
+
 // _VKTRACE_VERBOSITY env var is set by the vktrace program to
 // communicate verbosity level to the trace layer. It is set to
 // one of "quiet", "errors", "warnings", "full", or "debug".
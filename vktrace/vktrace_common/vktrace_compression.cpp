@@ -0,0 +1,451 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vktrace_compression.h"
+
+#if defined(VKTRACE_HAVE_LZ4)
+#include <lz4.h>
+#endif
+#if defined(VKTRACE_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+// zstd is the archival option, so favor ratio over speed, within reason for a live capture.
+#define VKTRACE_COMPRESSION_ZSTD_LEVEL 6
+
+struct ReadAheadBlock {
+    std::vector<uint8_t> data;
+    bool done;
+    bool result;
+};
+
+struct CompressedFileReader {
+    FILE* pFile;
+    std::mutex fileLock;
+    std::vector<vktrace_compressed_block> blocks;
+    uint64_t size;
+
+    // State for the sequential read interface.
+    uint64_t position;
+    uint64_t cachedBlock;
+    std::vector<uint8_t> cache;
+
+    // Read-ahead, protected by readAheadLock. The threads decompress the blocks from
+    // readAheadNext on, keeping at most readAheadWindow of them decompressed or in progress.
+    std::mutex readAheadLock;
+    std::condition_variable readAheadCondition;
+    std::vector<std::thread> readAheadThreads;
+    std::map<uint64_t, std::unique_ptr<ReadAheadBlock>> readAheadBlocks;
+    uint64_t readAheadNext;
+    uint64_t readAheadWindow;
+    bool readAheadStop;
+};
+
+namespace {
+
+const uint64_t kNoBlock = UINT64_MAX;
+
+bool readAt(CompressedFileReader* pReader, uint64_t offset, void* pOut, uint64_t len) {
+    std::lock_guard<std::mutex> lock(pReader->fileLock);
+    return Fseek(pReader->pFile, offset, SEEK_SET) == 0 && (len == 0 || 1 == fread(pOut, (size_t)len, 1, pReader->pFile));
+}
+
+bool blockIsSane(const vktrace_compressed_block& block, uint64_t fileLength) {
+    return block.magic == VKTRACE_COMPRESSED_BLOCK_MAGIC && block.compressed_offset <= fileLength &&
+           block.compressed_size <= fileLength - block.compressed_offset &&
+           (block.compression_type != VKTRACE_COMPRESSION_NONE || block.compressed_size == block.uncompressed_size);
+}
+
+// Walk the blocks one after the other, for files that didn't get as far as writing the block table.
+void recoverBlocks(CompressedFileReader* pReader, uint64_t fileLength) {
+    uint64_t offset = sizeof(vktrace_compressed_file_header);
+    vktrace_compressed_block block;
+    while (offset + sizeof(block) <= fileLength && readAt(pReader, offset, &block, sizeof(block)) &&
+           block.compressed_offset == offset + sizeof(block) && blockIsSane(block, fileLength)) {
+        pReader->blocks.push_back(block);
+        offset = block.compressed_offset + block.compressed_size;
+    }
+}
+
+bool compareUncompressedOffsets(const vktrace_compressed_block& a, const vktrace_compressed_block& b) {
+    return a.uncompressed_offset < b.uncompressed_offset;
+}
+
+uint64_t findBlock(const CompressedFileReader* pReader, uint64_t offset) {
+    vktrace_compressed_block key;
+    key.uncompressed_offset = offset;
+    auto it = std::upper_bound(pReader->blocks.begin(), pReader->blocks.end(), key, compareUncompressedOffsets);
+    if (it == pReader->blocks.begin()) {
+        return kNoBlock;
+    }
+    return (uint64_t)(it - pReader->blocks.begin()) - 1;
+}
+
+void readAheadThread(CompressedFileReader* pReader) {
+    std::unique_lock<std::mutex> lock(pReader->readAheadLock);
+    while (!pReader->readAheadStop) {
+        // Blocks still held from before a seek don't have to be decompressed again.
+        while (pReader->readAheadBlocks.count(pReader->readAheadNext) != 0) {
+            pReader->readAheadNext++;
+        }
+        if (pReader->readAheadNext >= pReader->blocks.size() || pReader->readAheadBlocks.size() >= pReader->readAheadWindow) {
+            pReader->readAheadCondition.wait(lock);
+            continue;
+        }
+        uint64_t blockIndex = pReader->readAheadNext++;
+        ReadAheadBlock* pBlock = new ReadAheadBlock();
+        pBlock->data.resize(pReader->blocks[(size_t)blockIndex].uncompressed_size);
+        pBlock->done = false;
+        pReader->readAheadBlocks[blockIndex].reset(pBlock);
+
+        lock.unlock();
+        bool result = vktrace_CompressedFileReader_read_block(pReader, blockIndex, pBlock->data.data()) != FALSE;
+        lock.lock();
+        pBlock->result = result;
+        pBlock->done = true;
+        pReader->readAheadCondition.notify_all();
+    }
+}
+
+// Decompress a block into the cache of the sequential read interface, taking it from the
+// read-ahead threads if they are running.
+bool loadBlock(CompressedFileReader* pReader, uint64_t blockIndex) {
+    if (pReader->readAheadThreads.empty()) {
+        pReader->cache.resize(pReader->blocks[(size_t)blockIndex].uncompressed_size);
+        return vktrace_CompressedFileReader_read_block(pReader, blockIndex, pReader->cache.data()) != FALSE;
+    }
+
+    std::unique_lock<std::mutex> lock(pReader->readAheadLock);
+    while (true) {
+        // Drop blocks that were decompressed for a part of the file the reader has moved away from.
+        for (auto it = pReader->readAheadBlocks.begin(); it != pReader->readAheadBlocks.end();) {
+            if (it->second->done && (it->first < blockIndex || it->first >= blockIndex + pReader->readAheadWindow)) {
+                it = pReader->readAheadBlocks.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto it = pReader->readAheadBlocks.find(blockIndex);
+        if (it == pReader->readAheadBlocks.end()) {
+            // The reader skipped ahead or went back, start reading ahead from here.
+            pReader->readAheadNext = blockIndex;
+        } else if (it->second->done) {
+            bool result = it->second->result;
+            pReader->cache.swap(it->second->data);
+            pReader->readAheadBlocks.erase(it);
+            pReader->readAheadCondition.notify_all();
+            return result;
+        }
+        pReader->readAheadCondition.notify_all();
+        pReader->readAheadCondition.wait(lock);
+    }
+}
+
+void stopReadAhead(CompressedFileReader* pReader) {
+    {
+        std::lock_guard<std::mutex> lock(pReader->readAheadLock);
+        pReader->readAheadStop = true;
+    }
+    pReader->readAheadCondition.notify_all();
+    for (auto& thread : pReader->readAheadThreads) {
+        thread.join();
+    }
+    pReader->readAheadThreads.clear();
+    pReader->readAheadBlocks.clear();
+}
+
+}  // namespace
+
+BOOL vktrace_compression_supported(VKTRACE_COMPRESSION_TYPE type) {
+    switch (type) {
+        case VKTRACE_COMPRESSION_NONE:
+            return TRUE;
+#if defined(VKTRACE_HAVE_LZ4)
+        case VKTRACE_COMPRESSION_LZ4:
+            return TRUE;
+#endif
+#if defined(VKTRACE_HAVE_ZSTD)
+        case VKTRACE_COMPRESSION_ZSTD:
+            return TRUE;
+#endif
+        default:
+            return FALSE;
+    }
+}
+
+BOOL vktrace_compression_parse_type(const char* name, VKTRACE_COMPRESSION_TYPE* pType) {
+    if (name == NULL || strcmp(name, "none") == 0) {
+        *pType = VKTRACE_COMPRESSION_NONE;
+    } else if (strcmp(name, "lz4") == 0) {
+        *pType = VKTRACE_COMPRESSION_LZ4;
+    } else if (strcmp(name, "zstd") == 0) {
+        *pType = VKTRACE_COMPRESSION_ZSTD;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+const char* vktrace_compression_type_name(VKTRACE_COMPRESSION_TYPE type) {
+    switch (type) {
+        case VKTRACE_COMPRESSION_NONE:
+            return "none";
+        case VKTRACE_COMPRESSION_LZ4:
+            return "lz4";
+        case VKTRACE_COMPRESSION_ZSTD:
+            return "zstd";
+        default:
+            return "unknown";
+    }
+}
+
+uint64_t vktrace_compress_bound(VKTRACE_COMPRESSION_TYPE type, uint64_t srcSize) {
+    switch (type) {
+#if defined(VKTRACE_HAVE_LZ4)
+        case VKTRACE_COMPRESSION_LZ4:
+            return (uint64_t)LZ4_compressBound((int)srcSize);
+#endif
+#if defined(VKTRACE_HAVE_ZSTD)
+        case VKTRACE_COMPRESSION_ZSTD:
+            return (uint64_t)ZSTD_compressBound((size_t)srcSize);
+#endif
+        default:
+            return srcSize;
+    }
+}
+
+uint64_t vktrace_compress(VKTRACE_COMPRESSION_TYPE type, const void* pSrc, uint64_t srcSize, void* pDst, uint64_t dstCapacity) {
+    switch (type) {
+#if defined(VKTRACE_HAVE_LZ4)
+        case VKTRACE_COMPRESSION_LZ4: {
+            int capacity = (int)std::min<uint64_t>(dstCapacity, INT32_MAX);
+            int result = LZ4_compress_default((const char*)pSrc, (char*)pDst, (int)srcSize, capacity);
+            return (result > 0) ? (uint64_t)result : 0;
+        }
+#endif
+#if defined(VKTRACE_HAVE_ZSTD)
+        case VKTRACE_COMPRESSION_ZSTD: {
+            size_t result = ZSTD_compress(pDst, (size_t)dstCapacity, pSrc, (size_t)srcSize, VKTRACE_COMPRESSION_ZSTD_LEVEL);
+            return ZSTD_isError(result) ? 0 : (uint64_t)result;
+        }
+#endif
+        default:
+            return 0;
+    }
+}
+
+BOOL vktrace_decompress(VKTRACE_COMPRESSION_TYPE type, const void* pSrc, uint64_t srcSize, void* pDst, uint64_t uncompressedSize) {
+    switch (type) {
+        case VKTRACE_COMPRESSION_NONE:
+            if (srcSize != uncompressedSize) {
+                return FALSE;
+            }
+            memcpy(pDst, pSrc, (size_t)srcSize);
+            return TRUE;
+#if defined(VKTRACE_HAVE_LZ4)
+        case VKTRACE_COMPRESSION_LZ4:
+            return LZ4_decompress_safe((const char*)pSrc, (char*)pDst, (int)srcSize, (int)uncompressedSize) ==
+                   (int)uncompressedSize;
+#endif
+#if defined(VKTRACE_HAVE_ZSTD)
+        case VKTRACE_COMPRESSION_ZSTD:
+            return ZSTD_decompress(pDst, (size_t)uncompressedSize, pSrc, (size_t)srcSize) == (size_t)uncompressedSize;
+#endif
+        default:
+            vktrace_LogError("Trace file block uses %s compression, which this build doesn't support.",
+                             vktrace_compression_type_name(type));
+            return FALSE;
+    }
+}
+
+BOOL vktrace_CompressedFile_is_compressed(FILE* fp) {
+    uint64_t magic = 0;
+    int64_t position = Ftell(fp);
+    BOOL result = (Fseek(fp, 0, SEEK_SET) == 0 && 1 == fread(&magic, sizeof(magic), 1, fp) &&
+                   magic == VKTRACE_COMPRESSED_FILE_MAGIC);
+    Fseek(fp, position, SEEK_SET);
+    return result;
+}
+
+CompressedFileReader* vktrace_CompressedFileReader_create(FILE* fp) {
+    vktrace_compressed_file_header header;
+    CompressedFileReader* pReader = new CompressedFileReader();
+    pReader->pFile = fp;
+    pReader->size = 0;
+    pReader->position = 0;
+    pReader->cachedBlock = kNoBlock;
+    pReader->readAheadNext = 0;
+    pReader->readAheadWindow = 0;
+    pReader->readAheadStop = false;
+
+    uint64_t fileLength = 0;
+    if (Fseek(fp, 0, SEEK_END) == 0) {
+        fileLength = (uint64_t)Ftell(fp);
+    }
+    if (!readAt(pReader, 0, &header, sizeof(header)) || header.magic != VKTRACE_COMPRESSED_FILE_MAGIC) {
+        vktrace_LogError("Not a compressed trace file.");
+        delete pReader;
+        return NULL;
+    }
+    if (header.version != VKTRACE_COMPRESSED_FILE_VERSION) {
+        vktrace_LogError("Unsupported compressed trace file version %llu.", (unsigned long long)header.version);
+        delete pReader;
+        return NULL;
+    }
+
+    bool recovered = false;
+    if (header.block_table_offset != 0 && header.block_count <= fileLength / sizeof(vktrace_compressed_block)) {
+        pReader->blocks.resize((size_t)header.block_count);
+        if (!readAt(pReader, header.block_table_offset, pReader->blocks.data(),
+                    header.block_count * sizeof(vktrace_compressed_block))) {
+            pReader->blocks.clear();
+        }
+    }
+    if (pReader->blocks.empty()) {
+        vktrace_LogWarning("Compressed trace file has no block table, the trace may be incomplete.");
+        recoverBlocks(pReader, fileLength);
+        std::sort(pReader->blocks.begin(), pReader->blocks.end(), compareUncompressedOffsets);
+        recovered = true;
+    }
+
+    // The blocks have to cover the trace file without gaps. A recovered file is cut at the first gap.
+    uint64_t expectedOffset = 0;
+    for (size_t i = 0; i < pReader->blocks.size(); i++) {
+        const vktrace_compressed_block& block = pReader->blocks[i];
+        if (block.uncompressed_offset != expectedOffset || !blockIsSane(block, fileLength)) {
+            if (!recovered) {
+                vktrace_LogError("Compressed trace file block table is corrupt.");
+                delete pReader;
+                return NULL;
+            }
+            pReader->blocks.resize(i);
+            break;
+        }
+        expectedOffset += block.uncompressed_size;
+    }
+    pReader->size = expectedOffset;
+
+    if (pReader->blocks.empty()) {
+        vktrace_LogError("Compressed trace file contains no blocks.");
+        delete pReader;
+        return NULL;
+    }
+    return pReader;
+}
+
+void vktrace_CompressedFileReader_destroy(CompressedFileReader** ppReader) {
+    if (ppReader == NULL || *ppReader == NULL) {
+        return;
+    }
+    stopReadAhead(*ppReader);
+    delete *ppReader;
+    *ppReader = NULL;
+}
+
+uint64_t vktrace_CompressedFileReader_get_size(const CompressedFileReader* pReader) { return pReader->size; }
+
+uint64_t vktrace_CompressedFileReader_get_block_count(const CompressedFileReader* pReader) { return pReader->blocks.size(); }
+
+const vktrace_compressed_block* vktrace_CompressedFileReader_get_block(const CompressedFileReader* pReader, uint64_t blockIndex) {
+    return (blockIndex < pReader->blocks.size()) ? &pReader->blocks[(size_t)blockIndex] : NULL;
+}
+
+BOOL vktrace_CompressedFileReader_read_block(CompressedFileReader* pReader, uint64_t blockIndex, void* pOut) {
+    if (blockIndex >= pReader->blocks.size()) {
+        return FALSE;
+    }
+    const vktrace_compressed_block& block = pReader->blocks[(size_t)blockIndex];
+    if (block.compression_type == VKTRACE_COMPRESSION_NONE) {
+        return readAt(pReader, block.compressed_offset, pOut, block.uncompressed_size);
+    }
+
+    std::vector<uint8_t> compressed(block.compressed_size);
+    if (!readAt(pReader, block.compressed_offset, compressed.data(), block.compressed_size)) {
+        vktrace_LogError("Failed to read block %llu of the compressed trace file.", (unsigned long long)blockIndex);
+        return FALSE;
+    }
+    if (!vktrace_decompress((VKTRACE_COMPRESSION_TYPE)block.compression_type, compressed.data(), block.compressed_size, pOut,
+                            block.uncompressed_size)) {
+        vktrace_LogError("Failed to decompress block %llu of the compressed trace file.", (unsigned long long)blockIndex);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL vktrace_CompressedFileReader_read(CompressedFileReader* pReader, void* pBytes, uint64_t len) {
+    uint8_t* pDst = (uint8_t*)pBytes;
+    if (len > pReader->size - pReader->position) {
+        vktrace_LogVerbose("Reached end of file.");
+        return FALSE;
+    }
+    while (len > 0) {
+        uint64_t blockIndex = findBlock(pReader, pReader->position);
+        const vktrace_compressed_block& block = pReader->blocks[(size_t)blockIndex];
+        if (blockIndex != pReader->cachedBlock) {
+            pReader->cachedBlock = kNoBlock;
+            if (!loadBlock(pReader, blockIndex)) {
+                return FALSE;
+            }
+            pReader->cachedBlock = blockIndex;
+        }
+
+        uint64_t offsetInBlock = pReader->position - block.uncompressed_offset;
+        uint64_t chunk = std::min<uint64_t>(len, block.uncompressed_size - offsetInBlock);
+        memcpy(pDst, pReader->cache.data() + offsetInBlock, (size_t)chunk);
+        pDst += chunk;
+        len -= chunk;
+        pReader->position += chunk;
+    }
+    return TRUE;
+}
+
+BOOL vktrace_CompressedFileReader_seek(CompressedFileReader* pReader, uint64_t offset) {
+    if (offset > pReader->size) {
+        return FALSE;
+    }
+    pReader->position = offset;
+    return TRUE;
+}
+
+uint64_t vktrace_CompressedFileReader_tell(const CompressedFileReader* pReader) { return pReader->position; }
+
+void vktrace_CompressedFileReader_start_read_ahead(CompressedFileReader* pReader, uint32_t threadCount) {
+    if (!pReader->readAheadThreads.empty() || pReader->blocks.size() < 2) {
+        return;
+    }
+    if (threadCount == 0) {
+        threadCount = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+    }
+    threadCount = (uint32_t)std::min<uint64_t>(threadCount, pReader->blocks.size());
+
+    // Twice as many blocks as threads, so the threads keep working while the reader copies out of a block.
+    pReader->readAheadNext = (pReader->cachedBlock != kNoBlock) ? pReader->cachedBlock + 1 : findBlock(pReader, pReader->position);
+    pReader->readAheadWindow = 2 * (uint64_t)threadCount;
+    pReader->readAheadStop = false;
+    for (uint32_t i = 0; i < threadCount; i++) {
+        pReader->readAheadThreads.emplace_back(readAheadThread, pReader);
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "vktrace_common.h"
+#include "vktrace_trace_packet_identifiers.h"
+
+// Compressed trace files.
+//
+// A compressed trace file holds an ordinary trace file (header, packets, packet
+// index, portability table) cut into blocks that are compressed independently:
+//
+//   vktrace_compressed_file_header
+//   vktrace_compressed_block, followed by compressed_size bytes of block data
+//   ...
+//   block table: block_count vktrace_compressed_block entries, ordered by uncompressed_offset
+//
+// All offsets stored inside the trace file (first_packet_offset, the packet index,
+// the portability table) are offsets into the uncompressed trace file. The first
+// block holds just the trace file header and gpuinfo and is stored uncompressed, so
+// the header can be updated in place when the trace is finished.
+//
+// The block table is written when the trace is finished. Each block carries a copy
+// of its table entry, so a file whose capture was cut short can still be read by
+// walking the blocks.
+//
+// LZ4 and zstd are optional: a codec that wasn't found at build time can be
+// neither written nor read.
+
+#define VKTRACE_COMPRESSED_FILE_MAGIC 0x5A45434152544B56ULL  // "VKTRACEZ"
+#define VKTRACE_COMPRESSED_BLOCK_MAGIC 0x4B4C4243ULL          // "CBLK"
+#define VKTRACE_COMPRESSED_FILE_VERSION 1
+
+typedef enum {
+    VKTRACE_COMPRESSION_NONE = 0,
+    VKTRACE_COMPRESSION_LZ4 = 1,
+    VKTRACE_COMPRESSION_ZSTD = 2,
+} VKTRACE_COMPRESSION_TYPE;
+
+typedef struct {
+    ALIGN8 uint64_t magic;  // VKTRACE_COMPRESSED_FILE_MAGIC
+    ALIGN8 uint64_t version;
+    ALIGN8 uint64_t compression_type;    // codec used for the blocks that were worth compressing
+    ALIGN8 uint64_t uncompressed_size;   // size of the trace file held in the blocks; 0 until finished
+    ALIGN8 uint64_t block_count;         // 0 until finished
+    ALIGN8 uint64_t block_table_offset;  // 0 until finished
+    ALIGN8 uint64_t reserved[2];
+} vktrace_compressed_file_header;
+
+typedef struct {
+    uint32_t magic;  // VKTRACE_COMPRESSED_BLOCK_MAGIC
+    uint32_t compression_type;  // VKTRACE_COMPRESSION_NONE if the block is stored as is
+    ALIGN8 uint64_t uncompressed_offset;
+    ALIGN8 uint64_t compressed_offset;  // file offset of the block data, just after this struct
+    uint32_t uncompressed_size;
+    uint32_t compressed_size;
+} vktrace_compressed_block;
+
+typedef struct CompressedFileReader CompressedFileReader;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Whether support for the codec was built in.
+BOOL vktrace_compression_supported(VKTRACE_COMPRESSION_TYPE type);
+
+// Parse "none", "lz4" or "zstd". Returns FALSE for anything else.
+BOOL vktrace_compression_parse_type(const char* name, VKTRACE_COMPRESSION_TYPE* pType);
+const char* vktrace_compression_type_name(VKTRACE_COMPRESSION_TYPE type);
+
+// Upper bound on the compressed size of srcSize bytes.
+uint64_t vktrace_compress_bound(VKTRACE_COMPRESSION_TYPE type, uint64_t srcSize);
+
+// Returns the compressed size, or 0 if the data could not be compressed into dstCapacity bytes.
+uint64_t vktrace_compress(VKTRACE_COMPRESSION_TYPE type, const void* pSrc, uint64_t srcSize, void* pDst, uint64_t dstCapacity);
+
+// pDst must have room for exactly uncompressedSize bytes.
+BOOL vktrace_decompress(VKTRACE_COMPRESSION_TYPE type, const void* pSrc, uint64_t srcSize, void* pDst, uint64_t uncompressedSize);
+
+// Check whether fp starts with a compressed file header. The file position is restored.
+BOOL vktrace_CompressedFile_is_compressed(FILE* fp);
+
+// Read the block table of a compressed trace file, or rebuild it from the blocks
+// if the file wasn't finished. fp stays owned by the caller.
+CompressedFileReader* vktrace_CompressedFileReader_create(FILE* fp);
+void vktrace_CompressedFileReader_destroy(CompressedFileReader** ppReader);
+
+// Size of the uncompressed trace file.
+uint64_t vktrace_CompressedFileReader_get_size(const CompressedFileReader* pReader);
+uint64_t vktrace_CompressedFileReader_get_block_count(const CompressedFileReader* pReader);
+const vktrace_compressed_block* vktrace_CompressedFileReader_get_block(const CompressedFileReader* pReader, uint64_t blockIndex);
+
+// Decompress one block into pOut, which must hold the block's uncompressed_size
+// bytes. Only the file read is serialized, so blocks can be decompressed from
+// several threads at once.
+BOOL vktrace_CompressedFileReader_read_block(CompressedFileReader* pReader, uint64_t blockIndex, void* pOut);
+
+// Sequential reads from the uncompressed trace file, with a one block cache.
+// Not thread safe.
+BOOL vktrace_CompressedFileReader_read(CompressedFileReader* pReader, void* pBytes, uint64_t len);
+BOOL vktrace_CompressedFileReader_seek(CompressedFileReader* pReader, uint64_t offset);
+uint64_t vktrace_CompressedFileReader_tell(const CompressedFileReader* pReader);
+
+// Decompress the blocks following the read position on threadCount threads (0
+// picks one per core), so sequential reads rarely wait for a block. After a seek,
+// reading ahead restarts from the new position. The threads are stopped when the
+// reader is destroyed.
+void vktrace_CompressedFileReader_start_read_ahead(CompressedFileReader* pReader, uint32_t threadCount);
+
+#ifdef __cplusplus
+}
+#endif
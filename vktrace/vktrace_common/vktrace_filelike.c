@@ -22,6 +22,8 @@
 #include "vktrace_filelike.h"
 #include "vktrace_common.h"
 #include "vktrace_interconnect.h"
+#include "vktrace_compression.h"
+#include "vktrace_trace_file_writer.h"
 #include <assert.h>
 #include <stdlib.h>
 
@@ -95,7 +97,17 @@ FileLike* vktrace_FileLike_create_file(FILE* fp) {
         pFile->mMode = File;
         pFile->mFile = fp;
         pFile->mMessageStream = NULL;
+        pFile->mTraceFileWriter = NULL;
+        pFile->mCompressedReader = NULL;
         pFile->mFileLen = vktrace_FileLike_GetFileLength(fp);
+        if (vktrace_CompressedFile_is_compressed(fp)) {
+            pFile->mCompressedReader = vktrace_CompressedFileReader_create(fp);
+            if (pFile->mCompressedReader == NULL) {
+                VKTRACE_DELETE(pFile);
+                return NULL;
+            }
+            pFile->mFileLen = vktrace_CompressedFileReader_get_size(pFile->mCompressedReader);
+        }
     }
     return pFile;
 }
@@ -108,11 +120,41 @@ FileLike* vktrace_FileLike_create_msg(MessageStream* _msgStream) {
         pFile->mMode = Socket;
         pFile->mFile = NULL;
         pFile->mMessageStream = _msgStream;
+        pFile->mTraceFileWriter = NULL;
+        pFile->mCompressedReader = NULL;
         pFile->mFileLen = 0;
     }
     return pFile;
 }
 
+// ------------------------------------------------------------------------------------------------
+FileLike* vktrace_FileLike_create_trace_file_writer(FILE* fp) {
+    FileLike* pFile = NULL;
+    if (fp != NULL) {
+        TraceFileWriter* pWriter = vktrace_TraceFileWriter_create(fp, 0);
+        if (pWriter != NULL) {
+            pFile = VKTRACE_NEW(FileLike);
+            pFile->mMode = File;
+            pFile->mFile = fp;
+            pFile->mMessageStream = NULL;
+            pFile->mTraceFileWriter = pWriter;
+            pFile->mCompressedReader = NULL;
+            pFile->mFileLen = 0;
+        }
+    }
+    return pFile;
+}
+
+// ------------------------------------------------------------------------------------------------
+void vktrace_FileLike_destroy(FileLike** ppFileLike) {
+    if (ppFileLike == NULL || *ppFileLike == NULL) {
+        return;
+    }
+    vktrace_CompressedFileReader_destroy(&(*ppFileLike)->mCompressedReader);
+    VKTRACE_DELETE(*ppFileLike);
+    *ppFileLike = NULL;
+}
+
 // ------------------------------------------------------------------------------------------------
 uint64_t vktrace_FileLike_Read(FileLike* pFileLike, void* _bytes, uint64_t _len) {
     uint64_t minSize = 0;
@@ -135,7 +177,9 @@ BOOL vktrace_FileLike_ReadRaw(FileLike* pFileLike, void* _bytes, uint64_t _len)
 
     switch (pFileLike->mMode) {
         case File: {
-            if (1 != fread(_bytes, (size_t)_len, 1, pFileLike->mFile)) {
+            if (pFileLike->mCompressedReader != NULL) {
+                result = vktrace_CompressedFileReader_read(pFileLike->mCompressedReader, _bytes, _len);
+            } else if (1 != fread(_bytes, (size_t)_len, 1, pFileLike->mFile)) {
                 if (ferror(pFileLike->mFile) != 0) {
                     perror("fread error");
                 } else if (feof(pFileLike->mFile) != 0) {
@@ -170,7 +214,9 @@ BOOL vktrace_FileLike_WriteRaw(FileLike* pFile, const void* _bytes, uint64_t _le
     assert((pFile->mFile != 0) ^ (pFile->mMessageStream != 0));
     switch (pFile->mMode) {
         case File:
-            if (1 != fwrite(_bytes, (size_t)_len, 1, pFile->mFile)) {
+            if (pFile->mTraceFileWriter != NULL) {
+                result = vktrace_TraceFileWriter_write_packet(pFile->mTraceFileWriter, (const vktrace_trace_packet_header*)_bytes);
+            } else if (1 != fwrite(_bytes, (size_t)_len, 1, pFile->mFile)) {
                 result = FALSE;
             }
             break;
@@ -192,7 +238,11 @@ uint64_t vktrace_FileLike_GetCurrentPosition(FileLike* pFileLike) {
 
     switch (pFileLike->mMode) {
         case File: {
-            offset = Ftell(pFileLike->mFile);
+            if (pFileLike->mCompressedReader != NULL) {
+                offset = vktrace_CompressedFileReader_tell(pFileLike->mCompressedReader);
+            } else {
+                offset = Ftell(pFileLike->mFile);
+            }
             break;
         }
 
@@ -209,7 +259,9 @@ BOOL vktrace_FileLike_SetCurrentPosition(FileLike* pFileLike, uint64_t offset) {
 
     switch (pFileLike->mMode) {
         case File: {
-            if (Fseek(pFileLike->mFile, offset, SEEK_SET) == 0) {
+            if (pFileLike->mCompressedReader != NULL) {
+                ret = vktrace_CompressedFileReader_seek(pFileLike->mCompressedReader, offset);
+            } else if (Fseek(pFileLike->mFile, offset, SEEK_SET) == 0) {
                 ret = TRUE;
             }
             break;
@@ -31,6 +31,7 @@
 #include "vktrace_interconnect.h"
 
 typedef struct MessageStream MessageStream;
+struct TraceFileWriter;
 
 struct FileLike;
 typedef struct FileLike FileLike;
@@ -39,6 +40,8 @@ typedef struct FileLike {
     FILE* mFile;
     uint64_t mFileLen;
     MessageStream* mMessageStream;
+    struct TraceFileWriter* mTraceFileWriter;
+    struct CompressedFileReader* mCompressedReader;
 } FileLike;
 
 // For creating checkpoints (consistency checks) in the various streams we're interacting with.
@@ -59,12 +62,19 @@ BOOL vktrace_Checkpoint_read(Checkpoint* pCheckpoint, FileLike* _in);
 // This is a simple file-like interface--it doesn't support rewinding or anything fancy, just fifo
 // reads and writes.
 
-// create a filelike interface for file streaming
+// create a filelike interface for file streaming; compressed trace files are read as the trace file they hold
 FileLike* vktrace_FileLike_create_file(FILE* fp);
 
 // create a filelike interface for network streaming
 FileLike* vktrace_FileLike_create_msg(MessageStream* _msgStream);
 
+// create a filelike interface that writes trace packets to a new trace file through a TraceFileWriter;
+// every WriteRaw must be one whole packet
+FileLike* vktrace_FileLike_create_trace_file_writer(FILE* fp);
+
+// free a filelike interface from any of the create functions; the FILE or MessageStream isn't closed
+void vktrace_FileLike_destroy(FileLike** ppFileLike);
+
 // read a size and then a buffer of that size
 uint64_t vktrace_FileLike_Read(FileLike* pFileLike, void* _bytes, uint64_t _len);
 
@@ -40,6 +40,7 @@ BOOL vktrace_MessageStream_SetupSocket(MessageStream* pStream);
 BOOL vktrace_MessageStream_SetupHostSocket(MessageStream* pStream);
 BOOL vktrace_MessageStream_SetupClientSocket(MessageStream* pStream);
 BOOL vktrace_MessageStream_Handshake(MessageStream* pStream);
+BOOL vktrace_MessageStream_NegotiateSharedMemory(MessageStream* pStream, FileLike* fileLike);
 BOOL vktrace_MessageStream_ReallySend(MessageStream* pStream, const void* _bytes, uint64_t _size, BOOL _optional);
 void vktrace_MessageStream_FlushSendBuffer(MessageStream* pStream, BOOL _optional);
 
@@ -61,6 +62,7 @@ MessageStream* vktrace_MessageStream_create_port_string(BOOL _isHost, const char
     pStream->mNextPacketId = 0;
     pStream->mSocket = INVALID_SOCKET;
     pStream->mSendBuffer = NULL;
+    pStream->mShmRing = NULL;
 
     if (vktrace_MessageStream_SetupSocket(pStream) == FALSE) {
         VKTRACE_DELETE(pStream);
@@ -84,6 +86,10 @@ void vktrace_MessageStream_destroy(MessageStream** ppStream) {
         vktrace_SimpleBuffer_destroy(&(*ppStream)->mSendBuffer);
     }
 
+    if ((*ppStream)->mShmRing != NULL) {
+        vktrace_ShmRing_destroy(&(*ppStream)->mShmRing);
+    }
+
     if ((*ppStream)->mHostAddressInfo != NULL) {
         freeaddrinfo((*ppStream)->mHostAddressInfo);
         (*ppStream)->mHostAddressInfo = NULL;
@@ -296,6 +302,10 @@ BOOL vktrace_MessageStream_Handshake(MessageStream* pStream) {
         }
     }
 
+    if (result) {
+        result = vktrace_MessageStream_NegotiateSharedMemory(pStream, fileLike);
+    }
+
     // Turn on non-blocking modes for sockets now.
     if (result) {
 #if defined(WIN32)
@@ -313,6 +323,84 @@ BOOL vktrace_MessageStream_Handshake(MessageStream* pStream) {
     return result;
 }
 
+// ------------------------------------------------------------------------------------------------
+// Sent by the client right after the handshake. An empty name means the client doesn't offer shared memory.
+typedef struct ShmRingOffer {
+    char name[VKTRACE_SHM_RING_MAX_NAME];
+    uint64_t nonce;
+} ShmRingOffer;
+
+static BOOL vktrace_MessageStream_IsLoopbackAddress(const char* _address) {
+    return strncmp(_address, "127.", 4) == 0 || strcmp(_address, "localhost") == 0 || strcmp(_address, "::1") == 0;
+}
+
+static uint64_t vktrace_MessageStream_GetShmRingSize() {
+    uint64_t ringSize = VKTRACE_SHM_RING_DEFAULT_SIZE;
+    const char* env = vktrace_get_global_var(_VKTRACE_SHM_RING_SIZE_ENV);
+    if (env != NULL && strlen(env) > 0) {
+        uint64_t value = strtoull(env, NULL, 10);
+        if (value > 0) {
+            ringSize = value;
+        }
+    }
+    return ringSize;
+}
+
+// The client offers a shared memory ring for the data it sends to the host. Anything the host sends
+// back still goes through the socket. The host can only open the
+// ring if both run on the same machine; otherwise it declines and the socket is used as before.
+BOOL vktrace_MessageStream_NegotiateSharedMemory(MessageStream* pStream, FileLike* fileLike) {
+    ShmRingOffer offer;
+    ShmRing* pRing = NULL;
+    uint32_t accepted = 0;
+    memset(&offer, 0, sizeof(offer));
+
+    if (pStream->mHost) {
+        if (!vktrace_FileLike_ReadRaw(fileLike, &offer, sizeof(offer))) {
+            return FALSE;
+        }
+        offer.name[VKTRACE_SHM_RING_MAX_NAME - 1] = '\0';
+        if (offer.name[0] != '\0') {
+            pRing = vktrace_ShmRing_open(offer.name, offer.nonce, (int)pStream->mSocket);
+            accepted = (pRing != NULL) ? 1 : 0;
+        }
+        if (!vktrace_FileLike_WriteRaw(fileLike, &accepted, sizeof(accepted))) {
+            vktrace_ShmRing_destroy(&pRing);
+            return FALSE;
+        }
+        if (accepted) {
+            pStream->mShmRing = pRing;
+            vktrace_LogVerbose("Receiving trace data through shared memory.");
+        }
+    } else {
+        const char* env = vktrace_get_global_var(VKTRACE_SHM_TRANSPORT_ENV);
+        BOOL enabled = (env == NULL || strcmp(env, "0") != 0);
+        if (enabled && vktrace_MessageStream_IsLoopbackAddress(pStream->mAddress)) {
+            pRing = vktrace_ShmRing_create(vktrace_MessageStream_GetShmRingSize(), (int)pStream->mSocket);
+            if (pRing != NULL) {
+                strncpy(offer.name, vktrace_ShmRing_get_name(pRing), VKTRACE_SHM_RING_MAX_NAME - 1);
+                offer.nonce = vktrace_ShmRing_get_nonce(pRing);
+            }
+        }
+        if (!vktrace_FileLike_WriteRaw(fileLike, &offer, sizeof(offer)) ||
+            !vktrace_FileLike_ReadRaw(fileLike, &accepted, sizeof(accepted))) {
+            vktrace_ShmRing_destroy(&pRing);
+            return FALSE;
+        }
+        if (pRing != NULL) {
+            // Either the host has it mapped now or it never will, so the name isn't needed anymore.
+            vktrace_ShmRing_unlink(pRing);
+            if (accepted) {
+                pStream->mShmRing = pRing;
+                vktrace_LogVerbose("Sending trace data through shared memory.");
+            } else {
+                vktrace_ShmRing_destroy(&pRing);
+            }
+        }
+    }
+    return TRUE;
+}
+
 // ------------------------------------------------------------------------------------------------
 void vktrace_MessageStream_FlushSendBuffer(MessageStream* pStream, BOOL _optional) {
     uint64_t bufferedByteSize = 0;
@@ -357,6 +445,14 @@ BOOL vktrace_MessageStream_ReallySend(MessageStream* pStream, const void* _bytes
     size_t bytesSent = 0;
     assert(_size > 0);
 
+    if (pStream->mShmRing != NULL && !pStream->mHost) {
+        BOOL result;
+        vktrace_enter_critical_section(&gSendLock);
+        result = vktrace_ShmRing_Write(pStream->mShmRing, _bytes, _size);
+        vktrace_leave_critical_section(&gSendLock);
+        return result || _optional;
+    }
+
     vktrace_enter_critical_section(&gSendLock);
     do {
         int sentThisTime = send(pStream->mSocket, (const char*)_bytes + bytesSent, (int)_size - (int)bytesSent, 0);
@@ -392,6 +488,16 @@ BOOL vktrace_MessageStream_ReallySend(MessageStream* pStream, const void* _bytes
 BOOL vktrace_MessageStream_Recv(MessageStream* pStream, void* _out, uint64_t _len) {
     unsigned int totalDataRead = 0;
     unsigned int attempts = 0;
+
+    if (pStream->mShmRing != NULL && pStream->mHost) {
+        // Reads from the ring wait for all the data, so there are no partial reads to retry.
+        if (!vktrace_ShmRing_Read(pStream->mShmRing, _out, _len)) {
+            pStream->mErrorNum = WSAECONNRESET;
+            return FALSE;
+        }
+        return TRUE;
+    }
+
     do {
         attempts++;
         int dataRead = recv(pStream->mSocket, ((char*)_out) + totalDataRead, (int)_len - totalDataRead, 0);
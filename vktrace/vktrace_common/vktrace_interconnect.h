@@ -23,6 +23,7 @@
 
 #include <errno.h>
 #include "vktrace_common.h"
+#include "vktrace_shm_ring.h"
 
 #if defined(PLATFORM_POSIX)
 #include <arpa/inet.h>
@@ -68,6 +69,10 @@ typedef struct MessageStream {
 
     BOOL mHost;
     int mErrorNum;
+
+    // Set when the client and host agreed during the handshake to send the
+    // client's data through shared memory instead of the socket.
+    ShmRing* mShmRing;
 } MessageStream;
 
 #ifdef __cplusplus
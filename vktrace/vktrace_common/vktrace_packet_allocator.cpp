@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+
+#include "vktrace_packet_allocator.h"
+
+namespace {
+
+const uint32_t kClassCount = VKTRACE_PACKET_ALLOCATOR_MAX_CLASS_SHIFT - VKTRACE_PACKET_ALLOCATOR_MIN_CLASS_SHIFT + 1;
+const uint32_t kHeapClass = 0xFFFFFFFF;
+
+struct Arena;
+
+// Every block starts with a 16 byte prefix so the payload keeps malloc alignment.
+// While a block sits on a free list its link lives in the first payload bytes.
+struct BlockPrefix {
+    union {
+        Arena* pOwner;  // nullptr for blocks allocated straight from the heap
+        uint64_t ownerStorage;
+    };
+    uint32_t sizeClass;
+    uint32_t reserved;
+};
+
+struct Arena {
+    Arena() : cachedBytes(0), remoteFrees(nullptr), orphaned(false), pNextOrphan(nullptr) {
+        for (uint32_t i = 0; i < kClassCount; i++) {
+            freeLists[i] = nullptr;
+        }
+    }
+
+    // Only touched by the thread currently owning the arena.
+    BlockPrefix* freeLists[kClassCount];
+    uint64_t cachedBytes;
+
+    // Blocks freed by other threads; keep them off the owner's cache line.
+    char pad0[64];
+    std::atomic<BlockPrefix*> remoteFrees;
+    std::atomic<bool> orphaned;
+    Arena* pNextOrphan;  // protected by g_orphanLock
+};
+
+// Arenas are never deleted since packets allocated from them may be freed long
+// after their thread is gone. Arenas of exited threads are reused instead.
+std::mutex g_orphanLock;
+Arena* g_pOrphans = nullptr;
+
+VKTRACE_THREAD_LOCAL Arena* s_pArena = nullptr;
+VKTRACE_THREAD_LOCAL bool s_threadExiting = false;
+
+inline BlockPrefix*& nextBlock(BlockPrefix* pBlock) { return *reinterpret_cast<BlockPrefix**>(pBlock + 1); }
+
+inline uint64_t classBytes(uint32_t sizeClass) { return 1ULL << (sizeClass + VKTRACE_PACKET_ALLOCATOR_MIN_CLASS_SHIFT); }
+
+uint32_t getSizeClass(uint64_t blockSize) {
+    if (blockSize > (1ULL << VKTRACE_PACKET_ALLOCATOR_MAX_CLASS_SHIFT)) {
+        return kHeapClass;
+    }
+    uint32_t sizeClass = 0;
+    while (classBytes(sizeClass) < blockSize) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+void releaseBlockLocal(Arena* pArena, BlockPrefix* pBlock) {
+    uint64_t size = classBytes(pBlock->sizeClass);
+    if (pArena->cachedBytes + size > VKTRACE_PACKET_ALLOCATOR_MAX_CACHED_BYTES) {
+        free(pBlock);
+        return;
+    }
+    nextBlock(pBlock) = pArena->freeLists[pBlock->sizeClass];
+    pArena->freeLists[pBlock->sizeClass] = pBlock;
+    pArena->cachedBytes += size;
+}
+
+void drainRemoteFrees(Arena* pArena) {
+    // Taking the whole list at once means there is no ABA problem with the pushes in
+    // vktrace_PacketAllocator_free.
+    BlockPrefix* pBlock = pArena->remoteFrees.exchange(nullptr, std::memory_order_acquire);
+    while (pBlock != nullptr) {
+        BlockPrefix* pNext = nextBlock(pBlock);
+        releaseBlockLocal(pArena, pBlock);
+        pBlock = pNext;
+    }
+}
+
+void releaseArena(Arena* pArena) {
+    // From now on other threads free blocks of this arena straight to the heap.
+    pArena->orphaned.store(true, std::memory_order_seq_cst);
+    drainRemoteFrees(pArena);
+    for (uint32_t i = 0; i < kClassCount; i++) {
+        BlockPrefix* pBlock = pArena->freeLists[i];
+        while (pBlock != nullptr) {
+            BlockPrefix* pNext = nextBlock(pBlock);
+            free(pBlock);
+            pBlock = pNext;
+        }
+        pArena->freeLists[i] = nullptr;
+    }
+    pArena->cachedBytes = 0;
+
+    std::lock_guard<std::mutex> lock(g_orphanLock);
+    pArena->pNextOrphan = g_pOrphans;
+    g_pOrphans = pArena;
+}
+
+Arena* acquireArena() {
+    Arena* pArena = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(g_orphanLock);
+        if (g_pOrphans != nullptr) {
+            pArena = g_pOrphans;
+            g_pOrphans = pArena->pNextOrphan;
+            pArena->pNextOrphan = nullptr;
+        }
+    }
+    if (pArena != nullptr) {
+        pArena->orphaned.store(false, std::memory_order_seq_cst);
+        // Pick up anything freed while the arena was being orphaned.
+        drainRemoteFrees(pArena);
+    } else {
+        pArena = new (std::nothrow) Arena();
+    }
+    return pArena;
+}
+
+// The thread_local object is only there to get a callback when the thread exits.
+struct ArenaReleaser {
+    bool registered = false;
+    ~ArenaReleaser() {
+        s_threadExiting = true;
+        if (s_pArena != nullptr) {
+            releaseArena(s_pArena);
+            s_pArena = nullptr;
+        }
+    }
+};
+thread_local ArenaReleaser s_arenaReleaser;
+
+void* heapAlloc(uint64_t blockSize) {
+    BlockPrefix* pBlock = static_cast<BlockPrefix*>(malloc((size_t)blockSize));
+    if (pBlock == nullptr) {
+        return nullptr;
+    }
+    pBlock->pOwner = nullptr;
+    pBlock->sizeClass = kHeapClass;
+    return pBlock + 1;
+}
+
+}  // namespace
+
+extern "C" void* vktrace_PacketAllocator_alloc(uint64_t size) {
+    uint64_t blockSize = size + sizeof(BlockPrefix);
+    uint32_t sizeClass = getSizeClass(blockSize);
+    if (sizeClass == kHeapClass || s_threadExiting) {
+        return heapAlloc(blockSize);
+    }
+
+    Arena* pArena = s_pArena;
+    if (pArena == nullptr) {
+        pArena = acquireArena();
+        if (pArena == nullptr) {
+            return heapAlloc(blockSize);
+        }
+        s_pArena = pArena;
+        s_arenaReleaser.registered = true;
+    }
+
+    if (pArena->freeLists[sizeClass] == nullptr && pArena->remoteFrees.load(std::memory_order_relaxed) != nullptr) {
+        drainRemoteFrees(pArena);
+    }
+
+    BlockPrefix* pBlock = pArena->freeLists[sizeClass];
+    if (pBlock != nullptr) {
+        pArena->freeLists[sizeClass] = nextBlock(pBlock);
+        pArena->cachedBytes -= classBytes(sizeClass);
+    } else {
+        pBlock = static_cast<BlockPrefix*>(malloc((size_t)classBytes(sizeClass)));
+        if (pBlock == nullptr) {
+            return nullptr;
+        }
+        pBlock->pOwner = pArena;
+        pBlock->sizeClass = sizeClass;
+    }
+    return pBlock + 1;
+}
+
+extern "C" void vktrace_PacketAllocator_free(void* pMemory) {
+    if (pMemory == nullptr) {
+        return;
+    }
+
+    BlockPrefix* pBlock = static_cast<BlockPrefix*>(pMemory) - 1;
+    Arena* pOwner = pBlock->pOwner;
+    if (pOwner == nullptr) {
+        free(pBlock);
+    } else if (pOwner == s_pArena) {
+        releaseBlockLocal(pOwner, pBlock);
+    } else if (pOwner->orphaned.load(std::memory_order_seq_cst)) {
+        free(pBlock);
+    } else {
+        BlockPrefix* pHead = pOwner->remoteFrees.load(std::memory_order_relaxed);
+        do {
+            nextBlock(pBlock) = pHead;
+        } while (!pOwner->remoteFrees.compare_exchange_weak(pHead, pBlock, std::memory_order_release, std::memory_order_relaxed));
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "vktrace_common.h"
+
+// The packet allocator hands out trace packet memory from per-thread arenas so
+// that creating and deleting a packet for every API call doesn't go through the
+// global heap. Requests are rounded up to power-of-two size classes and freed
+// blocks are kept on the owning thread's free lists for reuse.
+//
+// A packet may be freed on a different thread than the one that created it (the
+// packet writer thread, trim). Such blocks are pushed onto a lock-free list of
+// the owning arena and picked up by the owner the next time it allocates.
+// Arenas of exited threads are handed to the next thread that needs one.
+//
+// Blocks larger than the biggest size class go straight to the heap.
+
+// Smallest and largest size class, as powers of two.
+#define VKTRACE_PACKET_ALLOCATOR_MIN_CLASS_SHIFT 9
+#define VKTRACE_PACKET_ALLOCATOR_MAX_CLASS_SHIFT 20
+
+// Upper bound on free memory an arena keeps cached; anything above is returned to the heap.
+#define VKTRACE_PACKET_ALLOCATOR_MAX_CACHED_BYTES (32 * 1024 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Allocate size bytes of uninitialized, 16 byte aligned packet memory.
+void* vktrace_PacketAllocator_alloc(uint64_t size);
+
+// Return memory from vktrace_PacketAllocator_alloc. May be called from any thread.
+void vktrace_PacketAllocator_free(void* pMemory);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <atomic>
+#include <ctime>
+#include <thread>
+
+#include "vktrace_packet_writer.h"
+#include "vktrace_pageguard_memorycopy.h"
+
+extern "C" {
+#include "vktrace_trace_packet_utils.h"
+}
+
+namespace {
+
+// Bounded MPSC ring based on Dmitry Vyukov's bounded queue. Each cell carries a
+// sequence number; a producer owns a cell once it wins the CAS on enqueuePos and
+// publishes it by bumping the cell sequence. The single consumer reads cells in
+// ticket order, so packets are written in the order their tickets were taken.
+struct PacketCell {
+    std::atomic<uint64_t> sequence;
+    vktrace_trace_packet_header* pHeader;
+};
+
+struct PacketWriter {
+    PacketCell* cells;
+    uint64_t mask;
+    FileLike* pFile;
+    uint64_t maxQueuedBytes;
+    vktrace_thread thread;
+    vktrace_sem_id wakeSem;
+
+    // Keep the producer and consumer counters on separate cache lines.
+    char pad0[64];
+    std::atomic<uint64_t> enqueuePos;
+    char pad1[64];
+    uint64_t dequeuePos;
+    std::atomic<uint64_t> writtenCount;
+    char pad2[64];
+    std::atomic<uint64_t> queuedBytes;
+    std::atomic<bool> writerSleeping;
+    std::atomic<bool> stopRequested;
+};
+
+std::atomic<PacketWriter*> g_pWriter(nullptr);
+VKTRACE_THREAD_LOCAL bool s_isWriterThread = false;
+
+// Number of threads using the writer through g_pWriter. vktrace_PacketWriter_stop waits for them
+// to finish before it frees the writer.
+std::atomic<uint32_t> g_writerUsers(0);
+
+PacketWriter* acquireWriter() {
+    g_writerUsers.fetch_add(1, std::memory_order_seq_cst);
+    PacketWriter* pWriter = g_pWriter.load(std::memory_order_seq_cst);
+    if (pWriter == nullptr) {
+        g_writerUsers.fetch_sub(1, std::memory_order_release);
+    }
+    return pWriter;
+}
+
+void releaseWriter() { g_writerUsers.fetch_sub(1, std::memory_order_release); }
+
+uint64_t getMaxQueuedBytesFromEnv() {
+    uint64_t maxQueuedBytes = VKTRACE_PACKET_WRITER_DEFAULT_MAX_QUEUED_BYTES;
+    const char* env = vktrace_get_global_var(_VKTRACE_ASYNC_WRITER_MAX_QUEUED_BYTES_ENV);
+    if (env != NULL && strlen(env) > 0) {
+        uint64_t value = strtoull(env, NULL, 10);
+        if (value > 0) {
+            maxQueuedBytes = value;
+        }
+    }
+    return maxQueuedBytes;
+}
+
+void writePacket(PacketWriter* pWriter, vktrace_trace_packet_header* pHeader) {
+    BOOL res = vktrace_FileLike_WriteRaw(pWriter->pFile, pHeader, (size_t)pHeader->size);
+    if (!res && pHeader->packet_id != VKTRACE_TPI_MARKER_TERMINATE_PROCESS) {
+        vktrace_LogWarning("Failed to write trace packet.");
+        exit(1);
+    }
+}
+
+// Pop and write the next packet if one has been published. Only the writer thread,
+// or a caller that knows the writer thread is gone, may call this.
+bool writeNextPacket(PacketWriter* pWriter) {
+    uint64_t pos = pWriter->dequeuePos;
+    PacketCell* pCell = &pWriter->cells[pos & pWriter->mask];
+    if (pCell->sequence.load(std::memory_order_acquire) != pos + 1) {
+        return false;
+    }
+
+    vktrace_trace_packet_header* pHeader = pCell->pHeader;
+    uint64_t size = pHeader->size;
+    pCell->pHeader = NULL;
+    pCell->sequence.store(pos + pWriter->mask + 1, std::memory_order_release);
+    pWriter->dequeuePos = pos + 1;
+
+    writePacket(pWriter, pHeader);
+    vktrace_delete_trace_packet(&pHeader);
+
+    pWriter->queuedBytes.fetch_sub(size, std::memory_order_relaxed);
+    pWriter->writtenCount.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool hasPublishedPacket(PacketWriter* pWriter) {
+    uint64_t pos = pWriter->dequeuePos;
+    return pWriter->cells[pos & pWriter->mask].sequence.load(std::memory_order_acquire) == pos + 1;
+}
+
+VKTRACE_THREAD_ROUTINE_RETURN_TYPE writerThreadMain(LPVOID param) {
+    PacketWriter* pWriter = (PacketWriter*)param;
+    s_isWriterThread = true;
+
+    while (true) {
+        while (writeNextPacket(pWriter)) {
+        }
+
+        if (pWriter->stopRequested.load(std::memory_order_acquire) &&
+            pWriter->writtenCount.load(std::memory_order_acquire) == pWriter->enqueuePos.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        // Announce that we are going to sleep, then re-check the queue so a producer that
+        // published between the check above and the store below is not missed.
+        pWriter->writerSleeping.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (hasPublishedPacket(pWriter) || pWriter->stopRequested.load(std::memory_order_acquire) ||
+            pWriter->writtenCount.load(std::memory_order_acquire) != pWriter->enqueuePos.load(std::memory_order_acquire)) {
+            if (!pWriter->writerSleeping.exchange(false, std::memory_order_seq_cst)) {
+                // A producer already posted the semaphore; consume the wakeup.
+                vktrace_sem_wait(pWriter->wakeSem);
+            }
+            if (!hasPublishedPacket(pWriter)) {
+                // A ticket has been taken but the packet isn't published yet.
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        vktrace_sem_wait(pWriter->wakeSem);
+    }
+
+    s_isWriterThread = false;
+    return 0;
+}
+
+void wakeWriter(PacketWriter* pWriter) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pWriter->writerSleeping.load(std::memory_order_relaxed) && pWriter->writerSleeping.exchange(false)) {
+        vktrace_sem_post(pWriter->wakeSem);
+    }
+}
+
+bool isWriterThreadAlive(PacketWriter* pWriter) {
+#if defined(WIN32)
+    // On Windows all other threads are already gone when DLL_PROCESS_DETACH runs at process exit.
+    return WaitForSingleObject(pWriter->thread, 0) == WAIT_TIMEOUT;
+#else
+    return true;
+#endif
+}
+
+void flushWriter(PacketWriter* pWriter) {
+    uint64_t target = pWriter->enqueuePos.load(std::memory_order_acquire);
+    while (pWriter->writtenCount.load(std::memory_order_acquire) < target) {
+        if (!isWriterThreadAlive(pWriter)) {
+            // Nobody else is consuming, so take over the consumer role.
+            if (!writeNextPacket(pWriter)) std::this_thread::yield();
+            continue;
+        }
+        wakeWriter(pWriter);
+        std::this_thread::yield();
+    }
+}
+
+}  // namespace
+
+BOOL vktrace_PacketWriter_start(FileLike* pFile, uint64_t maxQueuedBytes) {
+    if (pFile == NULL || g_pWriter.load() != nullptr) {
+        return FALSE;
+    }
+
+    const char* env = vktrace_get_global_var(VKTRACE_ASYNC_WRITER_ENV);
+    if (env != NULL && strcmp(env, "0") == 0) {
+        vktrace_LogVerbose("Asynchronous packet writer disabled by %s.", VKTRACE_ASYNC_WRITER_ENV);
+        return FALSE;
+    }
+
+    PacketWriter* pWriter = new PacketWriter;
+    pWriter->cells = new PacketCell[VKTRACE_PACKET_WRITER_QUEUE_SLOTS];
+    for (uint64_t i = 0; i < VKTRACE_PACKET_WRITER_QUEUE_SLOTS; i++) {
+        pWriter->cells[i].sequence.store(i, std::memory_order_relaxed);
+        pWriter->cells[i].pHeader = NULL;
+    }
+    pWriter->mask = VKTRACE_PACKET_WRITER_QUEUE_SLOTS - 1;
+    pWriter->pFile = pFile;
+    pWriter->maxQueuedBytes = (maxQueuedBytes != 0) ? maxQueuedBytes : getMaxQueuedBytesFromEnv();
+    pWriter->enqueuePos.store(0);
+    pWriter->dequeuePos = 0;
+    pWriter->writtenCount.store(0);
+    pWriter->queuedBytes.store(0);
+    pWriter->writerSleeping.store(false);
+    pWriter->stopRequested.store(false);
+
+    if (!vktrace_sem_create(&pWriter->wakeSem, 0)) {
+        vktrace_LogError("Failed to create the packet writer semaphore, writing packets synchronously.");
+        delete[] pWriter->cells;
+        delete pWriter;
+        return FALSE;
+    }
+
+    pWriter->thread = vktrace_platform_create_thread(writerThreadMain, pWriter);
+    if (pWriter->thread == VKTRACE_NULL_THREAD) {
+        vktrace_LogError("Failed to create the packet writer thread, writing packets synchronously.");
+        vktrace_sem_delete(pWriter->wakeSem);
+        delete[] pWriter->cells;
+        delete pWriter;
+        return FALSE;
+    }
+
+    g_pWriter.store(pWriter, std::memory_order_release);
+    vktrace_LogVerbose("Asynchronous packet writer started (queue limit %llu bytes).",
+                       (unsigned long long)pWriter->maxQueuedBytes);
+    return TRUE;
+}
+
+BOOL vktrace_PacketWriter_is_active(const FileLike* pFile) {
+    // Packets produced on the writer thread itself (e.g. log messages emitted while
+    // writing) are written synchronously so the writer never waits on itself.
+    PacketWriter* pWriter = g_pWriter.load(std::memory_order_acquire);
+    return (pWriter != nullptr && pWriter->pFile == pFile && !s_isWriterThread) ? TRUE : FALSE;
+}
+
+BOOL vktrace_PacketWriter_enqueue(vktrace_trace_packet_header* pHeader) {
+    assert(!s_isWriterThread);
+    PacketWriter* pWriter = acquireWriter();
+    if (pWriter == nullptr) {
+        // The writer was stopped after the caller checked vktrace_PacketWriter_is_active.
+        return FALSE;
+    }
+    uint64_t size = pHeader->size;
+
+    // Byte limit: wait for the writer unless the queue is empty, so a single
+    // packet bigger than the limit can still make progress.
+    while (pWriter->queuedBytes.load(std::memory_order_relaxed) + size > pWriter->maxQueuedBytes &&
+           pWriter->writtenCount.load(std::memory_order_relaxed) != pWriter->enqueuePos.load(std::memory_order_relaxed)) {
+        wakeWriter(pWriter);
+        std::this_thread::yield();
+    }
+    pWriter->queuedBytes.fetch_add(size, std::memory_order_relaxed);
+
+    // Slot limit: claim a ticket whose cell has been released by the consumer.
+    PacketCell* pCell;
+    uint64_t pos = pWriter->enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        pCell = &pWriter->cells[pos & pWriter->mask];
+        int64_t diff = (int64_t)pCell->sequence.load(std::memory_order_acquire) - (int64_t)pos;
+        if (diff == 0) {
+            if (pWriter->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Ring is full.
+            wakeWriter(pWriter);
+            std::this_thread::yield();
+            pos = pWriter->enqueuePos.load(std::memory_order_relaxed);
+        } else {
+            pos = pWriter->enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    pCell->pHeader = pHeader;
+    pCell->sequence.store(pos + 1, std::memory_order_release);
+    wakeWriter(pWriter);
+    releaseWriter();
+    return TRUE;
+}
+
+void vktrace_PacketWriter_flush() {
+    if (s_isWriterThread) {
+        return;
+    }
+    PacketWriter* pWriter = acquireWriter();
+    if (pWriter == nullptr) {
+        return;
+    }
+    flushWriter(pWriter);
+    releaseWriter();
+}
+
+BOOL vktrace_PacketWriter_flush_for_crash(uint32_t timeoutMs) {
+    if (s_isWriterThread) {
+        return FALSE;
+    }
+    PacketWriter* pWriter = acquireWriter();
+    if (pWriter == nullptr) {
+        return TRUE;
+    }
+
+    uint64_t target = pWriter->enqueuePos.load(std::memory_order_acquire);
+    for (uint32_t waited = 0; pWriter->writtenCount.load(std::memory_order_acquire) < target; waited++) {
+        if (waited >= timeoutMs) {
+            releaseWriter();
+            return FALSE;
+        }
+        if (pWriter->writerSleeping.exchange(false)) {
+            vktrace_sem_post(pWriter->wakeSem);
+        }
+#if defined(WIN32)
+        Sleep(1);
+#else
+        // usleep() isn't async-signal-safe, nanosleep() is
+        struct timespec delay = {0, 1000000};
+        nanosleep(&delay, NULL);
+#endif
+    }
+    releaseWriter();
+    return TRUE;
+}
+
+void vktrace_PacketWriter_stop() {
+    if (s_isWriterThread) {
+        return;
+    }
+    PacketWriter* pWriter = g_pWriter.exchange(nullptr, std::memory_order_seq_cst);
+    if (pWriter == nullptr) {
+        return;
+    }
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_OSX)
+    // Threads that picked up the writer before it was unpublished may still be queueing packets.
+    // On Windows they may have been terminated already, and the writer is never freed there.
+    while (g_writerUsers.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+#endif
+    flushWriter(pWriter);
+
+    pWriter->stopRequested.store(true, std::memory_order_release);
+    vktrace_sem_post(pWriter->wakeSem);
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_OSX)
+    vktrace_linux_sync_wait_for_thread(&pWriter->thread);
+#elif defined(WIN32)
+    // Don't wait for the thread to exit: we may be called from DllMain, and thread
+    // exit needs the loader lock. The queue is already empty at this point.
+    vktrace_platform_delete_thread(&pWriter->thread);
+#endif
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_OSX)
+    vktrace_sem_delete(pWriter->wakeSem);
+    delete[] pWriter->cells;
+    delete pWriter;
+#endif
+}
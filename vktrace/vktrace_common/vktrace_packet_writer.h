@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "vktrace_common.h"
+#include "vktrace_filelike.h"
+#include "vktrace_trace_packet_identifiers.h"
+
+// The packet writer moves the cost of sending finished trace packets off the
+// application threads. Packets are pushed into a bounded lock-free
+// multi-producer/single-consumer ring and a dedicated writer thread sends them
+// to the FileLike in the order they were queued.
+//
+// Backpressure: the ring holds at most VKTRACE_PACKET_WRITER_QUEUE_SLOTS packets
+// and at most maxQueuedBytes bytes of packet data. Once either limit is reached
+// producers spin/yield until the writer thread catches up, so memory use stays
+// bounded even if the consumer of the trace stream is slow.
+
+#define VKTRACE_PACKET_WRITER_QUEUE_SLOTS (64 * 1024)
+#define VKTRACE_PACKET_WRITER_DEFAULT_MAX_QUEUED_BYTES (256 * 1024 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Start the writer thread for pFile. If maxQueuedBytes is 0 the value from
+// _VKTRACE_ASYNC_WRITER_MAX_QUEUED_BYTES, or the default, is used.
+// Returns FALSE if the writer is disabled via VKTRACE_ASYNC_WRITER or could not be started,
+// in which case packets continue to be written synchronously.
+BOOL vktrace_PacketWriter_start(FileLike* pFile, uint64_t maxQueuedBytes);
+
+// Returns TRUE if packets written to pFile are handed to the writer thread.
+BOOL vktrace_PacketWriter_is_active(const FileLike* pFile);
+
+// Queue a finalized packet. Ownership of the packet passes to the writer,
+// which deletes it once it has been written. Returns FALSE, leaving the packet
+// with the caller, if the writer was stopped after vktrace_PacketWriter_is_active.
+BOOL vktrace_PacketWriter_enqueue(vktrace_trace_packet_header* pHeader);
+
+// Block until every packet queued so far has been written.
+void vktrace_PacketWriter_flush();
+
+// Wait at most timeoutMs for the queue to drain without taking any locks or
+// allocating memory. This is safe to call from a signal handler.
+BOOL vktrace_PacketWriter_flush_for_crash(uint32_t timeoutMs);
+
+// Drain the queue and stop the writer thread. Packets written after this call
+// are sent synchronously again.
+void vktrace_PacketWriter_stop();
+
+#ifdef __cplusplus
+}
+#endif
@@ -21,6 +21,7 @@
  * Author: David Pinedo <david@lunarg.com>
  **************************************************************************/
 #include "vktrace_process.h"
+#include "vktrace_trace_file_writer.h"
 
 BOOL vktrace_process_spawn(vktrace_process_info* pInfo) {
     assert(pInfo != NULL);
@@ -115,6 +116,8 @@ void vktrace_process_info_delete(vktrace_process_info* pInfo) {
     vktrace_platform_delete_thread(&(pInfo->watchdogThread));
 #endif
 
+    vktrace_TraceFileWriter_destroy(&pInfo->pTraceFileWriter);
+
     if (pInfo->pTraceFile != NULL) {
         vktrace_LogDebug("Closing trace file: '%s'", pInfo->traceFilename);
         fclose(pInfo->pTraceFile);
@@ -33,6 +33,7 @@ typedef struct vktrace_process_info {
     char* workingDirectory;
     char* traceFilename;
     FILE* pTraceFile;
+    struct TraceFileWriter* pTraceFileWriter;
 
     // vktrace's thread id
     vktrace_thread_id parentThreadId;
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "vktrace_shm_ring.h"
+
+#if defined(VKTRACE_SHM_RING_SUPPORTED)
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define SHM_RING_MAGIC 0x474E495254564B56ULL  // "VKTRRING"
+#define SHM_RING_DATA_OFFSET 4096
+#define SHM_RING_MIN_SIZE (64 * 1024)
+#define SHM_RING_SPIN_COUNT 128
+#define SHM_RING_WAIT_TIMEOUT_MS 100
+
+// Lives at the start of the shared mapping. Each side only writes the fields in
+// its own block, and the blocks are kept on separate cache lines.
+typedef struct ShmRingHeader {
+    uint64_t magic;
+    uint64_t nonce;
+    uint64_t capacity;
+    uint8_t pad0[40];
+
+    // Written by the producer.
+    uint64_t writePos;
+    uint32_t dataSeq;
+    uint32_t producerWaiting;
+    uint32_t producerClosed;
+    uint8_t pad1[44];
+
+    // Written by the consumer.
+    uint64_t readPos;
+    uint32_t spaceSeq;
+    uint32_t consumerWaiting;
+    uint32_t consumerClosed;
+    uint8_t pad2[44];
+} ShmRingHeader;
+
+struct ShmRing {
+    ShmRingHeader* pHeader;
+    uint8_t* pData;
+    uint64_t capacity;
+    size_t mappedSize;
+    int peerSocket;
+    BOOL isProducer;
+    BOOL linked;
+    char name[VKTRACE_SHM_RING_MAX_NAME];
+};
+
+static void shmRingFutexWait(uint32_t* pSeq, uint32_t seq) {
+    struct timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = SHM_RING_WAIT_TIMEOUT_MS * 1000 * 1000;
+    // The mapping is shared between processes, so the private futex ops can't be used.
+    syscall(SYS_futex, pSeq, FUTEX_WAIT, seq, &timeout, NULL, 0);
+}
+
+static void shmRingFutexWake(uint32_t* pSeq) {
+    __atomic_add_fetch(pSeq, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, pSeq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// The other process is considered gone if it closed its end of the ring or its
+// socket has been shut down.
+static BOOL shmRingPeerAlive(ShmRing* pRing, uint32_t* pPeerClosed) {
+    char byte;
+    ssize_t result;
+
+    if (__atomic_load_n(pPeerClosed, __ATOMIC_ACQUIRE)) {
+        return FALSE;
+    }
+    if (pRing->peerSocket < 0) {
+        return TRUE;
+    }
+    result = recv(pRing->peerSocket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (result == 0) {
+        return FALSE;
+    }
+    if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Wait until *pPos moves away from pos. Spins briefly before going to sleep so a
+// steady stream of packets doesn't turn into a futex call per packet.
+static BOOL shmRingWaitForPos(ShmRing* pRing, uint64_t* pPos, uint64_t pos, uint32_t* pSeq, uint32_t* pWaiting,
+                              uint32_t* pPeerClosed) {
+    uint32_t spin;
+    for (spin = 0; spin < SHM_RING_SPIN_COUNT; spin++) {
+        if (__atomic_load_n(pPos, __ATOMIC_ACQUIRE) != pos) {
+            return TRUE;
+        }
+        sched_yield();
+    }
+
+    while (TRUE) {
+        uint32_t seq = __atomic_load_n(pSeq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(pWaiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(pPos, __ATOMIC_SEQ_CST) != pos) {
+            break;
+        }
+        // Check after the last look at pPos, so anything the peer wrote before
+        // closing has been seen.
+        if (!shmRingPeerAlive(pRing, pPeerClosed)) {
+            if (__atomic_load_n(pPos, __ATOMIC_ACQUIRE) != pos) {
+                break;
+            }
+            __atomic_store_n(pWaiting, 0, __ATOMIC_RELAXED);
+            return FALSE;
+        }
+        shmRingFutexWait(pSeq, seq);
+    }
+    __atomic_store_n(pWaiting, 0, __ATOMIC_RELAXED);
+    return TRUE;
+}
+
+static ShmRing* shmRingMap(const char* name, int fd, size_t size, BOOL isProducer, int peerSocket) {
+    ShmRing* pRing;
+    void* pMemory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pMemory == MAP_FAILED) {
+        vktrace_LogError("Failed to map shared memory ring %s, errno=%d.", name, errno);
+        return NULL;
+    }
+
+    pRing = VKTRACE_NEW(ShmRing);
+    if (pRing == NULL) {
+        munmap(pMemory, size);
+        return NULL;
+    }
+    memset(pRing, 0, sizeof(ShmRing));
+    pRing->pHeader = (ShmRingHeader*)pMemory;
+    pRing->pData = (uint8_t*)pMemory + SHM_RING_DATA_OFFSET;
+    pRing->capacity = size - SHM_RING_DATA_OFFSET;
+    pRing->mappedSize = size;
+    pRing->peerSocket = peerSocket;
+    pRing->isProducer = isProducer;
+    pRing->linked = isProducer;
+    strncpy(pRing->name, name, VKTRACE_SHM_RING_MAX_NAME - 1);
+    return pRing;
+}
+
+ShmRing* vktrace_ShmRing_create(uint64_t capacity, int peerSocket) {
+    static uint32_t s_ringCount = 0;
+    char name[VKTRACE_SHM_RING_MAX_NAME];
+    uint64_t ringSize = SHM_RING_MIN_SIZE;
+    struct timespec now;
+    ShmRing* pRing;
+    int fd;
+
+    while (ringSize < capacity) {
+        ringSize <<= 1;
+    }
+
+    snprintf(name, sizeof(name), "/vktrace-%d-%u", (int)getpid(), __atomic_fetch_add(&s_ringCount, 1, __ATOMIC_RELAXED));
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        vktrace_LogVerbose("Failed to create shared memory ring %s, errno=%d.", name, errno);
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)(SHM_RING_DATA_OFFSET + ringSize)) != 0) {
+        vktrace_LogVerbose("Failed to size shared memory ring %s, errno=%d.", name, errno);
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    pRing = shmRingMap(name, fd, (size_t)(SHM_RING_DATA_OFFSET + ringSize), TRUE, peerSocket);
+    close(fd);
+    if (pRing == NULL) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // ftruncate zero filled the header. The nonce lets the consumer check it opened
+    // this ring and not a leftover one with the same name.
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pRing->pHeader->nonce = ((uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec) ^ ((uint64_t)getpid() << 32) ^
+                            (uint64_t)(uintptr_t)pRing->pHeader;
+    pRing->pHeader->capacity = ringSize;
+    __atomic_store_n(&pRing->pHeader->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    return pRing;
+}
+
+ShmRing* vktrace_ShmRing_open(const char* name, uint64_t nonce, int peerSocket) {
+    struct stat fileStat;
+    ShmRing* pRing;
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        vktrace_LogVerbose("Shared memory ring %s is not available, errno=%d.", name, errno);
+        return NULL;
+    }
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= SHM_RING_DATA_OFFSET) {
+        close(fd);
+        return NULL;
+    }
+
+    pRing = shmRingMap(name, fd, (size_t)fileStat.st_size, FALSE, peerSocket);
+    close(fd);
+    if (pRing == NULL) {
+        return NULL;
+    }
+
+    if (__atomic_load_n(&pRing->pHeader->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC || pRing->pHeader->nonce != nonce ||
+        pRing->pHeader->capacity != pRing->capacity || (pRing->capacity & (pRing->capacity - 1)) != 0) {
+        vktrace_LogVerbose("Shared memory ring %s does not match the connection.", name);
+        vktrace_ShmRing_destroy(&pRing);
+        return NULL;
+    }
+    return pRing;
+}
+
+const char* vktrace_ShmRing_get_name(const ShmRing* pRing) { return pRing->name; }
+
+uint64_t vktrace_ShmRing_get_nonce(const ShmRing* pRing) { return pRing->pHeader->nonce; }
+
+void vktrace_ShmRing_unlink(ShmRing* pRing) {
+    if (pRing->linked) {
+        shm_unlink(pRing->name);
+        pRing->linked = FALSE;
+    }
+}
+
+BOOL vktrace_ShmRing_Write(ShmRing* pRing, const void* pBytes, uint64_t len) {
+    ShmRingHeader* pHeader = pRing->pHeader;
+    const uint8_t* pSrc = (const uint8_t*)pBytes;
+    uint64_t writePos = pHeader->writePos;
+    assert(pRing->isProducer);
+
+    while (len > 0) {
+        uint64_t readPos = __atomic_load_n(&pHeader->readPos, __ATOMIC_ACQUIRE);
+        uint64_t space = pRing->capacity - (writePos - readPos);
+        uint64_t chunk, offset, firstPart;
+
+        if (space == 0) {
+            if (!shmRingWaitForPos(pRing, &pHeader->readPos, readPos, &pHeader->spaceSeq, &pHeader->producerWaiting,
+                                   &pHeader->consumerClosed)) {
+                return FALSE;
+            }
+            continue;
+        }
+
+        chunk = (len < space) ? len : space;
+        offset = writePos & (pRing->capacity - 1);
+        firstPart = (chunk < pRing->capacity - offset) ? chunk : pRing->capacity - offset;
+        memcpy(pRing->pData + offset, pSrc, (size_t)firstPart);
+        memcpy(pRing->pData, pSrc + firstPart, (size_t)(chunk - firstPart));
+        writePos += chunk;
+        pSrc += chunk;
+        len -= chunk;
+
+        __atomic_store_n(&pHeader->writePos, writePos, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pHeader->consumerWaiting, __ATOMIC_SEQ_CST)) {
+            shmRingFutexWake(&pHeader->dataSeq);
+        }
+    }
+    return TRUE;
+}
+
+BOOL vktrace_ShmRing_Read(ShmRing* pRing, void* pOut, uint64_t len) {
+    ShmRingHeader* pHeader = pRing->pHeader;
+    uint8_t* pDst = (uint8_t*)pOut;
+    uint64_t readPos = pHeader->readPos;
+    assert(!pRing->isProducer);
+
+    while (len > 0) {
+        uint64_t writePos = __atomic_load_n(&pHeader->writePos, __ATOMIC_ACQUIRE);
+        uint64_t available = writePos - readPos;
+        uint64_t chunk, offset, firstPart;
+
+        if (available == 0) {
+            if (!shmRingWaitForPos(pRing, &pHeader->writePos, writePos, &pHeader->dataSeq, &pHeader->consumerWaiting,
+                                   &pHeader->producerClosed)) {
+                return FALSE;
+            }
+            continue;
+        }
+
+        chunk = (len < available) ? len : available;
+        offset = readPos & (pRing->capacity - 1);
+        firstPart = (chunk < pRing->capacity - offset) ? chunk : pRing->capacity - offset;
+        memcpy(pDst, pRing->pData + offset, (size_t)firstPart);
+        memcpy(pDst + firstPart, pRing->pData, (size_t)(chunk - firstPart));
+        readPos += chunk;
+        pDst += chunk;
+        len -= chunk;
+
+        __atomic_store_n(&pHeader->readPos, readPos, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pHeader->producerWaiting, __ATOMIC_SEQ_CST)) {
+            shmRingFutexWake(&pHeader->spaceSeq);
+        }
+    }
+    return TRUE;
+}
+
+void vktrace_ShmRing_destroy(ShmRing** ppRing) {
+    ShmRing* pRing;
+    if (ppRing == NULL || *ppRing == NULL) {
+        return;
+    }
+    pRing = *ppRing;
+
+    if (pRing->isProducer) {
+        __atomic_store_n(&pRing->pHeader->producerClosed, 1, __ATOMIC_SEQ_CST);
+        shmRingFutexWake(&pRing->pHeader->dataSeq);
+    } else {
+        __atomic_store_n(&pRing->pHeader->consumerClosed, 1, __ATOMIC_SEQ_CST);
+        shmRingFutexWake(&pRing->pHeader->spaceSeq);
+    }
+    vktrace_ShmRing_unlink(pRing);
+    munmap(pRing->pHeader, pRing->mappedSize);
+
+    VKTRACE_DELETE(pRing);
+    *ppRing = NULL;
+}
+
+#else  // !VKTRACE_SHM_RING_SUPPORTED
+
+ShmRing* vktrace_ShmRing_create(uint64_t capacity, int peerSocket) { return NULL; }
+
+ShmRing* vktrace_ShmRing_open(const char* name, uint64_t nonce, int peerSocket) { return NULL; }
+
+const char* vktrace_ShmRing_get_name(const ShmRing* pRing) { return ""; }
+
+uint64_t vktrace_ShmRing_get_nonce(const ShmRing* pRing) { return 0; }
+
+void vktrace_ShmRing_unlink(ShmRing* pRing) {}
+
+BOOL vktrace_ShmRing_Write(ShmRing* pRing, const void* pBytes, uint64_t len) { return FALSE; }
+
+BOOL vktrace_ShmRing_Read(ShmRing* pRing, void* pOut, uint64_t len) { return FALSE; }
+
+void vktrace_ShmRing_destroy(ShmRing** ppRing) {}
+
+#endif  // VKTRACE_SHM_RING_SUPPORTED
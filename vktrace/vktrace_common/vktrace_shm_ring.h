@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "vktrace_common.h"
+
+// Single-producer/single-consumer byte ring in POSIX shared memory, used to send
+// the trace stream from the trace layer to the vktrace server when both run on
+// the same machine. The producer creates the ring under a unique name and passes
+// the name to the consumer over the regular socket connection. Waiting for data or
+// space is done with futexes in the shared header, so neither side makes a system
+// call unless the other one is asleep.
+//
+// The socket connection is kept open alongside the ring and is used to notice
+// that the other process went away without closing its end of the ring.
+
+#if defined(PLATFORM_LINUX) && !defined(ANDROID)
+#define VKTRACE_SHM_RING_SUPPORTED 1
+#endif
+
+#define VKTRACE_SHM_RING_DEFAULT_SIZE (64 * 1024 * 1024)
+#define VKTRACE_SHM_RING_MAX_NAME 64
+
+typedef struct ShmRing ShmRing;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Producer side: create a ring with room for at least capacity bytes.
+// peerSocket is the connected socket to the consumer.
+ShmRing* vktrace_ShmRing_create(uint64_t capacity, int peerSocket);
+
+// Consumer side: attach to the ring created by the producer.
+// Fails if the ring doesn't exist on this machine or nonce doesn't match.
+ShmRing* vktrace_ShmRing_open(const char* name, uint64_t nonce, int peerSocket);
+
+const char* vktrace_ShmRing_get_name(const ShmRing* pRing);
+uint64_t vktrace_ShmRing_get_nonce(const ShmRing* pRing);
+
+// Remove the ring's name once the consumer is attached (or has declined it).
+void vktrace_ShmRing_unlink(ShmRing* pRing);
+
+// Blocks until all of len bytes are in the ring. Returns FALSE if the consumer is gone.
+BOOL vktrace_ShmRing_Write(ShmRing* pRing, const void* pBytes, uint64_t len);
+
+// Blocks until len bytes have been read. Returns FALSE once the producer is gone
+// and the ring has been drained.
+BOOL vktrace_ShmRing_Read(ShmRing* pRing, void* pOut, uint64_t len);
+
+// Close this side of the ring, waking the other side, and unmap it.
+void vktrace_ShmRing_destroy(ShmRing** ppRing);
+
+#ifdef __cplusplus
+}
+#endif
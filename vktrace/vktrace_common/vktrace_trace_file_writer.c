@@ -0,0 +1,590 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "vktrace_trace_file_writer.h"
+#include "vktrace_compression.h"
+
+#include <string.h>
+#if defined(WIN32)
+#include <malloc.h>
+#endif
+
+struct TraceFileWriter {
+    FILE* pFile;
+#if defined(PLATFORM_LINUX)
+    int fileDescriptor;  // for vktrace_TraceFileWriter_flush_for_crash, fileno() isn't async-signal-safe
+#endif
+    uint8_t* pBuffer;
+    uint64_t bufferSize;
+    uint64_t bufferUsed;
+
+    // File offset of the next packet, counting what is still buffered, and of the start of the buffer.
+    // For a compressed file these are offsets into the uncompressed trace.
+    uint64_t fileOffset;
+    uint64_t bufferFileOffset;
+    BOOL headerWritten;
+    BOOL finished;
+
+    // Portability table - Table of trace file offsets to packets
+    // we need to access to determine what memory index should be used
+    // in vkAllocateMemory during trace playback. This table is appended
+    // to the trace file.
+    uint64_t* pPortabilityTable;
+    uint64_t portabilityTableCount;
+    uint64_t portabilityTableCapacity;
+
+    uint32_t lastPacketThreadId;
+    uint64_t lastPacketIndex;
+    uint64_t lastPacketEndTime;
+
+    // Packet index, written at the end of the trace file for trace file versions that have one.
+    // Entries are collected in pIndexEntries and moved to a temporary file whenever it fills up,
+    // so long traces don't keep the whole index in memory.
+    BOOL writeIndex;
+    vktrace_packet_index_entry* pIndexEntries;
+    uint64_t indexEntriesUsed;
+    uint64_t indexEntriesCapacity;
+    uint64_t indexEntryCount;
+    FILE* pIndexSpillFile;
+    BOOL indexSpillFailed;
+    uint64_t* pFrameOffsets;
+    uint64_t frameCount;
+    uint64_t frameOffsetsCapacity;
+    uint32_t frameNumber;
+
+    // Block compression, see vktrace_compression.h. Every buffer written out becomes one block.
+    VKTRACE_COMPRESSION_TYPE compressionType;
+    uint8_t* pCompressBuffer;
+    uint64_t compressBufferSize;
+    uint64_t compressedFileOffset;
+    vktrace_compressed_block* pBlocks;
+    uint64_t blockCount;
+    uint64_t blockCapacity;
+
+    // Where the trace file header is in the file.
+    uint64_t headerFileOffset;
+
+    VKTRACE_CRITICAL_SECTION lock;
+};
+
+static void* vktrace_TraceFileWriter_aligned_alloc(uint64_t size) {
+#if defined(WIN32)
+    return _aligned_malloc((size_t)size, VKTRACE_TRACE_FILE_WRITER_BUFFER_ALIGNMENT);
+#else
+    void* pMemory = NULL;
+    if (posix_memalign(&pMemory, VKTRACE_TRACE_FILE_WRITER_BUFFER_ALIGNMENT, (size_t)size) != 0) {
+        return NULL;
+    }
+    return pMemory;
+#endif
+}
+
+static void vktrace_TraceFileWriter_aligned_free(void* pMemory) {
+#if defined(WIN32)
+    _aligned_free(pMemory);
+#else
+    free(pMemory);
+#endif
+}
+
+static BOOL vktrace_TraceFileWriter_is_portability_packet(uint16_t packet_id) {
+    return packet_id == VKTRACE_TPI_VK_vkBindImageMemory || packet_id == VKTRACE_TPI_VK_vkBindBufferMemory ||
+           packet_id == VKTRACE_TPI_VK_vkBindImageMemory2KHR || packet_id == VKTRACE_TPI_VK_vkBindBufferMemory2KHR ||
+           packet_id == VKTRACE_TPI_VK_vkAllocateMemory || packet_id == VKTRACE_TPI_VK_vkDestroyImage ||
+           packet_id == VKTRACE_TPI_VK_vkDestroyBuffer || packet_id == VKTRACE_TPI_VK_vkFreeMemory ||
+           packet_id == VKTRACE_TPI_VK_vkCreateBuffer || packet_id == VKTRACE_TPI_VK_vkCreateImage;
+}
+
+static BOOL vktrace_TraceFileWriter_add_portability_entry(TraceFileWriter* pWriter, uint64_t offset) {
+    if (pWriter->portabilityTableCount == pWriter->portabilityTableCapacity) {
+        uint64_t newCapacity = (pWriter->portabilityTableCapacity == 0) ? 1024 : pWriter->portabilityTableCapacity * 2;
+        uint64_t* pNewTable = (uint64_t*)vktrace_realloc(pWriter->pPortabilityTable, (size_t)(newCapacity * sizeof(uint64_t)));
+        if (pNewTable == NULL) {
+            return FALSE;
+        }
+        pWriter->pPortabilityTable = pNewTable;
+        pWriter->portabilityTableCapacity = newCapacity;
+    }
+    pWriter->pPortabilityTable[pWriter->portabilityTableCount++] = offset;
+    return TRUE;
+}
+
+static BOOL vktrace_TraceFileWriter_add_index_entry(TraceFileWriter* pWriter, const vktrace_trace_packet_header* pHeader) {
+    vktrace_packet_index_entry* pEntry;
+
+    if (pWriter->indexEntriesUsed == pWriter->indexEntriesCapacity) {
+        if (pWriter->pIndexSpillFile == NULL && !pWriter->indexSpillFailed) {
+            pWriter->pIndexSpillFile = tmpfile();
+            pWriter->indexSpillFailed = (pWriter->pIndexSpillFile == NULL);
+        }
+        if (pWriter->pIndexSpillFile != NULL) {
+            if (1 != fwrite(pWriter->pIndexEntries, (size_t)(pWriter->indexEntriesUsed * sizeof(vktrace_packet_index_entry)), 1,
+                            pWriter->pIndexSpillFile)) {
+                return FALSE;
+            }
+            pWriter->indexEntriesUsed = 0;
+        } else {
+            // No temporary file to spill to, keep the index in memory instead.
+            uint64_t newCapacity = pWriter->indexEntriesCapacity * 2;
+            vktrace_packet_index_entry* pNewEntries = (vktrace_packet_index_entry*)vktrace_realloc(
+                pWriter->pIndexEntries, (size_t)(newCapacity * sizeof(vktrace_packet_index_entry)));
+            if (pNewEntries == NULL) {
+                return FALSE;
+            }
+            pWriter->pIndexEntries = pNewEntries;
+            pWriter->indexEntriesCapacity = newCapacity;
+        }
+    }
+
+    // The first packet of each frame marks the frame boundary.
+    if (pWriter->frameCount == pWriter->frameNumber) {
+        if (pWriter->frameCount == pWriter->frameOffsetsCapacity) {
+            uint64_t newCapacity = (pWriter->frameOffsetsCapacity == 0) ? 1024 : pWriter->frameOffsetsCapacity * 2;
+            uint64_t* pNewOffsets = (uint64_t*)vktrace_realloc(pWriter->pFrameOffsets, (size_t)(newCapacity * sizeof(uint64_t)));
+            if (pNewOffsets == NULL) {
+                return FALSE;
+            }
+            pWriter->pFrameOffsets = pNewOffsets;
+            pWriter->frameOffsetsCapacity = newCapacity;
+        }
+        pWriter->pFrameOffsets[pWriter->frameCount++] = pWriter->fileOffset;
+    }
+
+    pEntry = &pWriter->pIndexEntries[pWriter->indexEntriesUsed++];
+    pEntry->offset = pWriter->fileOffset;
+    pEntry->packet_id = pHeader->packet_id;
+    pEntry->reserved = 0;
+    pEntry->frame_number = pWriter->frameNumber;
+    pWriter->indexEntryCount++;
+
+    if (pHeader->packet_id == VKTRACE_TPI_VK_vkQueuePresentKHR) {
+        pWriter->frameNumber++;
+    }
+    return TRUE;
+}
+
+static void vktrace_TraceFileWriter_init_block(TraceFileWriter* pWriter, vktrace_compressed_block* pBlock,
+                                               VKTRACE_COMPRESSION_TYPE compressionType, uint64_t compressedSize) {
+    pBlock->magic = VKTRACE_COMPRESSED_BLOCK_MAGIC;
+    pBlock->compression_type = compressionType;
+    pBlock->uncompressed_offset = pWriter->bufferFileOffset;
+    pBlock->compressed_offset = pWriter->compressedFileOffset + sizeof(vktrace_compressed_block);
+    pBlock->uncompressed_size = (uint32_t)pWriter->bufferUsed;
+    pBlock->compressed_size = (uint32_t)compressedSize;
+}
+
+static BOOL vktrace_TraceFileWriter_write_block(TraceFileWriter* pWriter) {
+    vktrace_compressed_block block;
+    const uint8_t* pData = pWriter->pBuffer;
+    uint64_t compressedSize = 0;
+
+    // The header block is written before headerWritten is set. It stays uncompressed
+    // so finish can update the header in place.
+    if (pWriter->headerWritten) {
+        compressedSize = vktrace_compress(pWriter->compressionType, pWriter->pBuffer, pWriter->bufferUsed, pWriter->pCompressBuffer,
+                                          pWriter->compressBufferSize);
+    }
+    if (compressedSize > 0 && compressedSize < pWriter->bufferUsed) {
+        vktrace_TraceFileWriter_init_block(pWriter, &block, pWriter->compressionType, compressedSize);
+        pData = pWriter->pCompressBuffer;
+    } else {
+        vktrace_TraceFileWriter_init_block(pWriter, &block, VKTRACE_COMPRESSION_NONE, pWriter->bufferUsed);
+    }
+
+    if (pWriter->blockCount == pWriter->blockCapacity) {
+        uint64_t newCapacity = (pWriter->blockCapacity == 0) ? 1024 : pWriter->blockCapacity * 2;
+        vktrace_compressed_block* pNewBlocks =
+            (vktrace_compressed_block*)vktrace_realloc(pWriter->pBlocks, (size_t)(newCapacity * sizeof(vktrace_compressed_block)));
+        if (pNewBlocks == NULL) {
+            return FALSE;
+        }
+        pWriter->pBlocks = pNewBlocks;
+        pWriter->blockCapacity = newCapacity;
+    }
+    pWriter->pBlocks[pWriter->blockCount++] = block;
+
+    if (1 != fwrite(&block, sizeof(block), 1, pWriter->pFile) ||
+        1 != fwrite(pData, (size_t)block.compressed_size, 1, pWriter->pFile)) {
+        return FALSE;
+    }
+    pWriter->compressedFileOffset = block.compressed_offset + block.compressed_size;
+    return TRUE;
+}
+
+static BOOL vktrace_TraceFileWriter_flush_buffer(TraceFileWriter* pWriter) {
+    BOOL result = TRUE;
+    if (pWriter->bufferUsed > 0) {
+        if (pWriter->compressionType != VKTRACE_COMPRESSION_NONE) {
+            result = vktrace_TraceFileWriter_write_block(pWriter);
+        } else {
+            result = (1 == fwrite(pWriter->pBuffer, (size_t)pWriter->bufferUsed, 1, pWriter->pFile));
+        }
+        pWriter->bufferFileOffset += pWriter->bufferUsed;
+        pWriter->bufferUsed = 0;
+    }
+    return result;
+}
+
+static BOOL vktrace_TraceFileWriter_write_bytes(TraceFileWriter* pWriter, const void* pBytes, uint64_t len) {
+    const uint8_t* pSrc = (const uint8_t*)pBytes;
+    pWriter->fileOffset += len;
+
+    // Anything at least as big as the buffer goes straight to the file, unless it has to be cut into blocks.
+    if (len >= pWriter->bufferSize && pWriter->compressionType == VKTRACE_COMPRESSION_NONE) {
+        if (!vktrace_TraceFileWriter_flush_buffer(pWriter)) {
+            return FALSE;
+        }
+        pWriter->bufferFileOffset += len;
+        return (1 == fwrite(pSrc, (size_t)len, 1, pWriter->pFile));
+    }
+
+    while (len > 0) {
+        uint64_t chunk = pWriter->bufferSize - pWriter->bufferUsed;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(pWriter->pBuffer + pWriter->bufferUsed, pSrc, (size_t)chunk);
+        pWriter->bufferUsed += chunk;
+        pSrc += chunk;
+        len -= chunk;
+        if (pWriter->bufferUsed == pWriter->bufferSize && !vktrace_TraceFileWriter_flush_buffer(pWriter)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+TraceFileWriter* vktrace_TraceFileWriter_create(FILE* pFile, uint64_t bufferSize) {
+    TraceFileWriter* pWriter;
+    if (pFile == NULL) {
+        return NULL;
+    }
+    if (bufferSize == 0) {
+        bufferSize = VKTRACE_TRACE_FILE_WRITER_DEFAULT_BUFFER_SIZE;
+    }
+    bufferSize = (bufferSize + VKTRACE_TRACE_FILE_WRITER_BUFFER_ALIGNMENT - 1) &
+                 ~(uint64_t)(VKTRACE_TRACE_FILE_WRITER_BUFFER_ALIGNMENT - 1);
+
+    pWriter = VKTRACE_NEW(TraceFileWriter);
+    if (pWriter == NULL) {
+        return NULL;
+    }
+    memset(pWriter, 0, sizeof(TraceFileWriter));
+    pWriter->pBuffer = (uint8_t*)vktrace_TraceFileWriter_aligned_alloc(bufferSize);
+    if (pWriter->pBuffer == NULL) {
+        vktrace_LogError("Failed to allocate %llu bytes for the trace file buffer.", (unsigned long long)bufferSize);
+        VKTRACE_DELETE(pWriter);
+        return NULL;
+    }
+    pWriter->indexEntriesCapacity = VKTRACE_TRACE_FILE_WRITER_INDEX_CHUNK_ENTRIES;
+    pWriter->pIndexEntries = VKTRACE_NEW_ARRAY(vktrace_packet_index_entry, pWriter->indexEntriesCapacity);
+    if (pWriter->pIndexEntries == NULL) {
+        vktrace_TraceFileWriter_aligned_free(pWriter->pBuffer);
+        VKTRACE_DELETE(pWriter);
+        return NULL;
+    }
+    pWriter->pFile = pFile;
+#if defined(PLATFORM_LINUX)
+    pWriter->fileDescriptor = fileno(pFile);
+#endif
+    pWriter->bufferSize = bufferSize;
+    vktrace_create_critical_section(&pWriter->lock);
+
+    // Everything is buffered here already, so don't let stdio copy it again.
+    setvbuf(pFile, NULL, _IONBF, 0);
+    return pWriter;
+}
+
+void vktrace_TraceFileWriter_destroy(TraceFileWriter** ppWriter) {
+    if (ppWriter == NULL || *ppWriter == NULL) {
+        return;
+    }
+    vktrace_TraceFileWriter_flush(*ppWriter);
+    vktrace_delete_critical_section(&(*ppWriter)->lock);
+    vktrace_TraceFileWriter_aligned_free((*ppWriter)->pBuffer);
+    vktrace_free((*ppWriter)->pCompressBuffer);
+    vktrace_free((*ppWriter)->pBlocks);
+    vktrace_free((*ppWriter)->pPortabilityTable);
+    vktrace_free((*ppWriter)->pIndexEntries);
+    vktrace_free((*ppWriter)->pFrameOffsets);
+    if ((*ppWriter)->pIndexSpillFile != NULL) {
+        fclose((*ppWriter)->pIndexSpillFile);
+    }
+    VKTRACE_DELETE(*ppWriter);
+    *ppWriter = NULL;
+}
+
+BOOL vktrace_TraceFileWriter_set_compression(TraceFileWriter* pWriter, VKTRACE_COMPRESSION_TYPE compressionType) {
+    BOOL result = TRUE;
+    vktrace_enter_critical_section(&pWriter->lock);
+    assert(!pWriter->headerWritten && pWriter->fileOffset == 0);
+    if (!vktrace_compression_supported(compressionType)) {
+        vktrace_LogError("This build of vktrace doesn't support %s compression.", vktrace_compression_type_name(compressionType));
+        result = FALSE;
+    } else if (compressionType != VKTRACE_COMPRESSION_NONE) {
+        vktrace_free(pWriter->pCompressBuffer);
+        pWriter->compressBufferSize = vktrace_compress_bound(compressionType, pWriter->bufferSize);
+        pWriter->pCompressBuffer = (uint8_t*)vktrace_malloc((size_t)pWriter->compressBufferSize);
+        result = (pWriter->pCompressBuffer != NULL);
+    }
+    if (result) {
+        pWriter->compressionType = compressionType;
+    }
+    vktrace_leave_critical_section(&pWriter->lock);
+    return result;
+}
+
+BOOL vktrace_TraceFileWriter_write_header(TraceFileWriter* pWriter, const vktrace_trace_file_header* pHeader,
+                                          const struct_gpuinfo* pGpuInfo) {
+    BOOL result = TRUE;
+    vktrace_enter_critical_section(&pWriter->lock);
+    assert(!pWriter->headerWritten && pWriter->fileOffset == 0);
+    if (pWriter->compressionType != VKTRACE_COMPRESSION_NONE) {
+        // The block count and table offset are filled in by finish.
+        vktrace_compressed_file_header fileHeader;
+        memset(&fileHeader, 0, sizeof(fileHeader));
+        fileHeader.magic = VKTRACE_COMPRESSED_FILE_MAGIC;
+        fileHeader.version = VKTRACE_COMPRESSED_FILE_VERSION;
+        fileHeader.compression_type = pWriter->compressionType;
+        result = (1 == fwrite(&fileHeader, sizeof(fileHeader), 1, pWriter->pFile));
+        pWriter->compressedFileOffset = sizeof(fileHeader);
+        pWriter->headerFileOffset = pWriter->compressedFileOffset + sizeof(vktrace_compressed_block);
+    }
+    result = result && vktrace_TraceFileWriter_write_bytes(pWriter, pHeader, sizeof(vktrace_trace_file_header));
+    if (result && pHeader->n_gpuinfo > 0) {
+        result = vktrace_TraceFileWriter_write_bytes(pWriter, pGpuInfo, pHeader->n_gpuinfo * sizeof(struct_gpuinfo));
+    }
+    // Get the header on disk right away, it's what makes the file recognizable as a trace.
+    result = vktrace_TraceFileWriter_flush_buffer(pWriter) && result;
+    pWriter->headerWritten = result;
+    pWriter->writeIndex = (pHeader->trace_file_version >= VKTRACE_TRACE_FILE_VERSION_8);
+    vktrace_leave_critical_section(&pWriter->lock);
+    return result;
+}
+
+BOOL vktrace_TraceFileWriter_write_packet(TraceFileWriter* pWriter, const vktrace_trace_packet_header* pHeader) {
+    BOOL result = TRUE;
+    vktrace_enter_critical_section(&pWriter->lock);
+    if (!pWriter->headerWritten || pWriter->finished) {
+        // A packet outside of the trace can't be read back, so leave it out.
+        vktrace_LogDebug("Dropping packet id %hu written outside of the trace file.", pHeader->packet_id);
+    } else {
+        // If the packet is one we need to track, add it to the table
+        if (vktrace_TraceFileWriter_is_portability_packet(pHeader->packet_id)) {
+            result = vktrace_TraceFileWriter_add_portability_entry(pWriter, pWriter->fileOffset);
+        }
+        if (pWriter->writeIndex && !vktrace_TraceFileWriter_add_index_entry(pWriter, pHeader)) {
+            vktrace_LogError("Unable to add packet to the packet index, the trace file will not have one.");
+            pWriter->writeIndex = FALSE;
+        }
+        result = vktrace_TraceFileWriter_write_bytes(pWriter, pHeader, pHeader->size) && result;
+        pWriter->lastPacketIndex = pHeader->global_packet_index;
+        pWriter->lastPacketThreadId = pHeader->thread_id;
+        pWriter->lastPacketEndTime = pHeader->vktrace_end_time;
+    }
+    vktrace_leave_critical_section(&pWriter->lock);
+    return result;
+}
+
+BOOL vktrace_TraceFileWriter_flush(TraceFileWriter* pWriter) {
+    BOOL result;
+    vktrace_enter_critical_section(&pWriter->lock);
+    result = vktrace_TraceFileWriter_flush_buffer(pWriter);
+    fflush(pWriter->pFile);
+    vktrace_leave_critical_section(&pWriter->lock);
+    return result;
+}
+
+static void vktrace_TraceFileWriter_init_trailer_packet_header(TraceFileWriter* pWriter, vktrace_trace_packet_header* pHdr,
+                                                               uint16_t packet_id, uint64_t global_packet_index, uint64_t size) {
+    memset(pHdr, 0, sizeof(*pHdr));
+    pHdr->size = size;
+    pHdr->global_packet_index = global_packet_index;
+    pHdr->tracer_id = VKTRACE_TID_VULKAN;
+    pHdr->packet_id = packet_id;
+    pHdr->thread_id = pWriter->lastPacketThreadId;
+    pHdr->vktrace_begin_time = pHdr->entrypoint_begin_time = pHdr->entrypoint_end_time = pHdr->vktrace_end_time =
+        pWriter->lastPacketEndTime;
+    pHdr->next_buffers_offset = 0;
+    pHdr->pBody = (uintptr_t)NULL;
+}
+
+static uint64_t vktrace_TraceFileWriter_index_size(const TraceFileWriter* pWriter) {
+    return sizeof(vktrace_trace_packet_index) + pWriter->indexEntryCount * sizeof(vktrace_packet_index_entry) +
+           pWriter->frameCount * sizeof(uint64_t);
+}
+
+// Writes vktrace_TraceFileWriter_index_size() bytes of packet index. If the entries can't be read back from
+// the temporary file they are written as zeros, to keep the size the trailer packet header has, and
+// *pIndexValid is set to FALSE.
+static BOOL vktrace_TraceFileWriter_write_index(TraceFileWriter* pWriter, BOOL* pIndexValid) {
+    vktrace_trace_packet_index index;
+
+    *pIndexValid = TRUE;
+    index.packet_count = pWriter->indexEntryCount;
+    index.frame_count = pWriter->frameCount;
+    if (!vktrace_TraceFileWriter_write_bytes(pWriter, &index, sizeof(index))) {
+        return FALSE;
+    }
+
+    if (pWriter->pIndexSpillFile != NULL) {
+        // Move the rest of the entries to the temporary file as well, then copy all of them
+        // from there, using the entry array as the copy buffer.
+        uint64_t remaining = index.packet_count;
+        if (pWriter->indexEntriesUsed > 0 &&
+            1 != fwrite(pWriter->pIndexEntries, (size_t)(pWriter->indexEntriesUsed * sizeof(vktrace_packet_index_entry)), 1,
+                        pWriter->pIndexSpillFile)) {
+            *pIndexValid = FALSE;
+        }
+        pWriter->indexEntriesUsed = 0;
+        fflush(pWriter->pIndexSpillFile);
+        rewind(pWriter->pIndexSpillFile);
+        while (remaining > 0) {
+            uint64_t count = (remaining < pWriter->indexEntriesCapacity) ? remaining : pWriter->indexEntriesCapacity;
+            size_t bytes = (size_t)(count * sizeof(vktrace_packet_index_entry));
+            if (!*pIndexValid || 1 != fread(pWriter->pIndexEntries, bytes, 1, pWriter->pIndexSpillFile)) {
+                *pIndexValid = FALSE;
+                memset(pWriter->pIndexEntries, 0, bytes);
+            }
+            if (!vktrace_TraceFileWriter_write_bytes(pWriter, pWriter->pIndexEntries, bytes)) {
+                return FALSE;
+            }
+            remaining -= count;
+        }
+    } else if (!vktrace_TraceFileWriter_write_bytes(pWriter, pWriter->pIndexEntries,
+                                                   pWriter->indexEntriesUsed * sizeof(vktrace_packet_index_entry))) {
+        return FALSE;
+    }
+
+    return vktrace_TraceFileWriter_write_bytes(pWriter, pWriter->pFrameOffsets, index.frame_count * sizeof(uint64_t));
+}
+
+static BOOL vktrace_TraceFileWriter_write_block_table(TraceFileWriter* pWriter) {
+    vktrace_compressed_file_header fileHeader;
+    memset(&fileHeader, 0, sizeof(fileHeader));
+    fileHeader.magic = VKTRACE_COMPRESSED_FILE_MAGIC;
+    fileHeader.version = VKTRACE_COMPRESSED_FILE_VERSION;
+    fileHeader.compression_type = pWriter->compressionType;
+    fileHeader.uncompressed_size = pWriter->fileOffset;
+    fileHeader.block_count = pWriter->blockCount;
+    fileHeader.block_table_offset = pWriter->compressedFileOffset;
+
+    // Blocks are written in order, so the table is already sorted by uncompressed offset.
+    if (1 != fwrite(pWriter->pBlocks, (size_t)(pWriter->blockCount * sizeof(vktrace_compressed_block)), 1, pWriter->pFile)) {
+        return FALSE;
+    }
+    pWriter->compressedFileOffset += pWriter->blockCount * sizeof(vktrace_compressed_block);
+    return 0 == Fseek(pWriter->pFile, 0, SEEK_SET) && 1 == fwrite(&fileHeader, sizeof(fileHeader), 1, pWriter->pFile) &&
+           0 == Fseek(pWriter->pFile, 0, SEEK_END);
+}
+
+BOOL vktrace_TraceFileWriter_finish(TraceFileWriter* pWriter) {
+    vktrace_trace_packet_header hdr;
+    uint64_t one_64 = 1;
+    uint64_t tableSize;
+    uint64_t indexOffset;
+    uint64_t indexSize;
+    BOOL indexValid = TRUE;
+    BOOL result = FALSE;
+
+    vktrace_enter_critical_section(&pWriter->lock);
+    if (!pWriter->headerWritten || pWriter->finished) {
+        vktrace_leave_critical_section(&pWriter->lock);
+        return FALSE;
+    }
+    pWriter->finished = TRUE;
+
+    vktrace_LogVerbose("Post processing trace file");
+
+    // Add a word containing the size of the table to the table.
+    // This will be the last word in the file.
+    tableSize = pWriter->portabilityTableCount;
+    if (vktrace_TraceFileWriter_add_portability_entry(pWriter, tableSize)) {
+        // Append the table packet to the trace file. The packet index goes at the start of its body, so
+        // the index isn't a packet of its own and the table stays at the end of the file.
+        indexSize = pWriter->writeIndex ? vktrace_TraceFileWriter_index_size(pWriter) : 0;
+        vktrace_TraceFileWriter_init_trailer_packet_header(
+            pWriter, &hdr, VKTRACE_TPI_PORTABILITY_TABLE, pWriter->lastPacketIndex + 1,
+            sizeof(hdr) + indexSize + pWriter->portabilityTableCount * sizeof(uint64_t));
+        indexOffset = pWriter->fileOffset + sizeof(hdr);
+        if (vktrace_TraceFileWriter_write_bytes(pWriter, &hdr, sizeof(hdr)) &&
+            (indexSize == 0 || vktrace_TraceFileWriter_write_index(pWriter, &indexValid)) &&
+            vktrace_TraceFileWriter_write_bytes(pWriter, pWriter->pPortabilityTable,
+                                                pWriter->portabilityTableCount * sizeof(uint64_t)) &&
+            vktrace_TraceFileWriter_flush_buffer(pWriter)) {
+            if (!indexValid) {
+                vktrace_LogError("Failed to write the packet index to the trace file.");
+            }
+            if (indexSize == 0 || !indexValid) {
+                indexOffset = 0;
+            }
+            // Set the flag in the file header that indicates the portability table has been written
+            if (0 == Fseek(pWriter->pFile, pWriter->headerFileOffset + offsetof(vktrace_trace_file_header, portability_table_valid),
+                           SEEK_SET) &&
+                1 == fwrite(&one_64, sizeof(uint64_t), 1, pWriter->pFile)) {
+                result = TRUE;
+            }
+            // Point the file header at the packet index
+            if (indexOffset != 0 &&
+                (0 != Fseek(pWriter->pFile, pWriter->headerFileOffset + offsetof(vktrace_trace_file_header, packet_index_offset),
+                            SEEK_SET) ||
+                 1 != fwrite(&indexOffset, sizeof(uint64_t), 1, pWriter->pFile))) {
+                result = FALSE;
+            }
+            Fseek(pWriter->pFile, 0, SEEK_END);
+            if (pWriter->compressionType != VKTRACE_COMPRESSION_NONE && !vktrace_TraceFileWriter_write_block_table(pWriter)) {
+                vktrace_LogError("Failed to write the block table to the compressed trace file.");
+                result = FALSE;
+            }
+        }
+    }
+    fflush(pWriter->pFile);
+
+    vktrace_free(pWriter->pPortabilityTable);
+    pWriter->pPortabilityTable = NULL;
+    pWriter->portabilityTableCount = 0;
+    pWriter->portabilityTableCapacity = 0;
+    vktrace_leave_critical_section(&pWriter->lock);
+
+    vktrace_LogVerbose("Post processing of trace file completed");
+    return result;
+}
+
+void vktrace_TraceFileWriter_flush_for_crash(TraceFileWriter* pWriter) {
+#if defined(PLATFORM_LINUX)
+    // write() is async-signal-safe, fwrite() is not. The stream is unbuffered, so the
+    // file descriptor's position is the stream's position.
+    // A compressed file gets the buffer as an uncompressed block: the codecs may allocate memory,
+    // and the block can be found again without the block table.
+    int fd = pWriter->fileDescriptor;
+    vktrace_compressed_block block;
+    uint64_t written = 0;
+    if (pWriter->bufferUsed > 0 && pWriter->compressionType != VKTRACE_COMPRESSION_NONE) {
+        vktrace_TraceFileWriter_init_block(pWriter, &block, VKTRACE_COMPRESSION_NONE, pWriter->bufferUsed);
+        if (write(fd, &block, sizeof(block)) != (ssize_t)sizeof(block)) {
+            return;
+        }
+    }
+    while (written < pWriter->bufferUsed) {
+        ssize_t result = write(fd, pWriter->pBuffer + written, (size_t)(pWriter->bufferUsed - written));
+        if (result <= 0) {
+            break;
+        }
+        written += (uint64_t)result;
+    }
+    pWriter->bufferUsed = 0;
+#endif
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "vktrace_common.h"
+#include "vktrace_compression.h"
+#include "vktrace_trace_packet_identifiers.h"
+
+// Writes a vktrace trace file: the file header, the trace packets, and the
+// packet index and portability table that are appended when the trace is finished. It is used by
+// the vktrace server for packets received from the trace layer, and by the trace
+// layer itself when it writes the trace file directly.
+//
+// Packets are collected in a large page aligned buffer and written to the file a
+// buffer at a time. If compression is enabled, each buffer is written as one
+// compressed block (see vktrace_compression.h). All functions may be called from
+// any thread.
+
+#define VKTRACE_TRACE_FILE_WRITER_DEFAULT_BUFFER_SIZE (4 * 1024 * 1024)
+#define VKTRACE_TRACE_FILE_WRITER_BUFFER_ALIGNMENT 4096
+
+// Number of packet index entries kept in memory before they are moved to a temporary file.
+#define VKTRACE_TRACE_FILE_WRITER_INDEX_CHUNK_ENTRIES (64 * 1024)
+
+typedef struct TraceFileWriter TraceFileWriter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// pFile must be freshly opened for writing and stays owned by the caller.
+// If bufferSize is 0 the default is used.
+TraceFileWriter* vktrace_TraceFileWriter_create(FILE* pFile, uint64_t bufferSize);
+
+// Flushes buffered packets but doesn't finish the trace or close the file.
+void vktrace_TraceFileWriter_destroy(TraceFileWriter** ppWriter);
+
+// Write the trace as a compressed trace file. Must be called before the header is
+// written; fails if support for the codec wasn't built in.
+BOOL vktrace_TraceFileWriter_set_compression(TraceFileWriter* pWriter, VKTRACE_COMPRESSION_TYPE compressionType);
+
+// Write the file header, followed by pHeader->n_gpuinfo entries of pGpuInfo.
+BOOL vktrace_TraceFileWriter_write_header(TraceFileWriter* pWriter, const vktrace_trace_file_header* pHeader,
+                                          const struct_gpuinfo* pGpuInfo);
+
+// Append a finalized packet. Every packet is recorded in the packet index, and
+// packets that replay needs to find again in the portability table.
+BOOL vktrace_TraceFileWriter_write_packet(TraceFileWriter* pWriter, const vktrace_trace_packet_header* pHeader);
+
+// Write out everything buffered so far.
+BOOL vktrace_TraceFileWriter_flush(TraceFileWriter* pWriter);
+
+// Append the portability table packet, with the packet index at the start of its body,
+// and point the file header at them. Nothing can be written after this.
+BOOL vktrace_TraceFileWriter_finish(TraceFileWriter* pWriter);
+
+// Write out the buffer without taking any locks, for use from a fatal signal
+// handler once nothing else is writing. Only available on Linux.
+void vktrace_TraceFileWriter_flush_for_crash(TraceFileWriter* pWriter);
+
+#ifdef __cplusplus
+}
+#endif
@@ -29,7 +29,8 @@
 #define VKTRACE_TRACE_FILE_VERSION_5 0x0005
 #define VKTRACE_TRACE_FILE_VERSION_6 0x0006
 #define VKTRACE_TRACE_FILE_VERSION_7 0x0007  // Vulkan 1.1
-#define VKTRACE_TRACE_FILE_VERSION VKTRACE_TRACE_FILE_VERSION_7
+#define VKTRACE_TRACE_FILE_VERSION_8 0x0008  // Packet index
+#define VKTRACE_TRACE_FILE_VERSION VKTRACE_TRACE_FILE_VERSION_8
 
 // vkreplay can replay version 6 (the last Vulkan 1.0 format)
 #define VKTRACE_TRACE_FILE_VERSION_MINIMUM_COMPATIBLE VKTRACE_TRACE_FILE_VERSION_6
@@ -410,8 +411,12 @@ typedef struct {
     ALIGN8 uint64_t arch;
     ALIGN8 uint64_t os;
 
+    // File offset of the packet index, or 0 if the trace has no index. The index is at the start of
+    // the body of the VKTRACE_TPI_PORTABILITY_TABLE packet. Only valid in VKTRACE_TRACE_FILE_VERSION_8 and later.
+    ALIGN8 uint64_t packet_index_offset;
+
     // Reserve some spaece in case more fields need to be added in the future
-    ALIGN8 uint64_t reserved2[8];
+    ALIGN8 uint64_t reserved2[7];
 
     // The header ends with number of gpus and a gpu_id/drv_vers pair for each gpu
     ALIGN8 uint64_t n_gpuinfo;
@@ -445,6 +450,22 @@ typedef struct {
     char* label;
 } vktrace_trace_packet_marker_checkpoint;
 
+// The packet index is written at the end of the trace file, in the same packet as the
+// portability table. It lists every packet in the file except that one.
+typedef struct {
+    ALIGN8 uint64_t offset;  // file offset of the packet
+    uint16_t packet_id;
+    uint16_t reserved;
+    uint32_t frame_number;  // number of vkQueuePresentKHR packets before this one
+} vktrace_packet_index_entry;
+
+typedef struct {
+    ALIGN8 uint64_t packet_count;
+    ALIGN8 uint64_t frame_count;
+    // A vktrace_packet_index_entry array of length packet_count follows this,
+    // then an array of frame_count uint64_t file offsets of the first packet of each frame
+} vktrace_trace_packet_index;
+
 typedef vktrace_trace_packet_marker_checkpoint vktrace_trace_packet_marker_api_boundary;
 typedef vktrace_trace_packet_marker_checkpoint vktrace_trace_packet_marker_api_group_begin;
 typedef vktrace_trace_packet_marker_checkpoint vktrace_trace_packet_marker_api_group_end;
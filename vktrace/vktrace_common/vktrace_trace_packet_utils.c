@@ -24,6 +24,8 @@
 #include "vktrace_trace_packet_utils.h"
 #include "vktrace_interconnect.h"
 #include "vktrace_filelike.h"
+#include "vktrace_packet_allocator.h"
+#include "vktrace_packet_writer.h"
 #include "vktrace_pageguard_memorycopy.h"
 
 #ifdef WIN32
@@ -175,8 +177,14 @@ vktrace_trace_packet_header* vktrace_create_trace_packet(uint8_t tracer_id, uint
     // Always allocate at least enough space for the packet header
     uint64_t total_packet_size =
         ROUNDUP_TO_8(sizeof(vktrace_trace_packet_header) + ROUNDUP_TO_8(packet_size) + additional_buffers_size);
-    void* pMemory = vktrace_malloc((size_t)total_packet_size);
-    memset(pMemory, 0, (size_t)total_packet_size);
+    void* pMemory = vktrace_PacketAllocator_alloc(total_packet_size);
+    if (pMemory == NULL) {
+        vktrace_LogError("Failed to allocate trace packet of size %llu.", (unsigned long long)total_packet_size);
+        return NULL;
+    }
+    // Only the header and packet body need to start out zeroed. The buffer area is filled in by
+    // vktrace_add_buffer_to_trace_packet and whatever is left unused is cleared when the packet is finalized.
+    memset(pMemory, 0, (size_t)(sizeof(vktrace_trace_packet_header) + ROUNDUP_TO_8(packet_size)));
 
     vktrace_trace_packet_header* pHeader = (vktrace_trace_packet_header*)pMemory;
     pHeader->size = total_packet_size;
@@ -205,7 +213,7 @@ void vktrace_delete_trace_packet(vktrace_trace_packet_header** ppHeader) {
     if (ppHeader == NULL) return;
     if (*ppHeader == NULL) return;
 
-    VKTRACE_DELETE(*ppHeader);
+    vktrace_PacketAllocator_free(*ppHeader);
     *ppHeader = NULL;
 }
 
@@ -248,6 +256,9 @@ void vktrace_add_buffer_to_trace_packet(vktrace_trace_packet_header* pHeader, vo
 
         // copy buffer to the location
         vktrace_pageguard_memcpy(*ptr_address, pBuffer, (size_t)size);
+        if (ROUNDUP_TO_4(size) != size) {
+            memset((char*)*ptr_address + size, 0, (size_t)(ROUNDUP_TO_4(size) - size));
+        }
     }
 }
 
@@ -402,10 +413,28 @@ void vktrace_finalize_trace_packet(vktrace_trace_packet_header* pHeader) {
         vktrace_set_packet_entrypoint_end_time(pHeader);
     }
     pHeader->vktrace_end_time = vktrace_get_time();
+    // Packets are not zeroed when created, so clear the unused part of the buffer area to keep stale data out of the trace.
+    if (pHeader->size > pHeader->next_buffers_offset) {
+        memset((char*)pHeader + pHeader->next_buffers_offset, 0, (size_t)(pHeader->size - pHeader->next_buffers_offset));
+    }
 }
 
 void vktrace_write_trace_packet(const vktrace_trace_packet_header* pHeader, FileLike* pFile) {
-    BOOL res = vktrace_FileLike_WriteRaw(pFile, pHeader, (size_t)pHeader->size);
+    BOOL res;
+    if (vktrace_PacketWriter_is_active(pFile)) {
+        // The caller keeps ownership of this packet, so queue a copy of it behind the packets already queued.
+        void* pCopy = vktrace_PacketAllocator_alloc(pHeader->size);
+        if (pCopy != NULL) {
+            memcpy(pCopy, pHeader, (size_t)pHeader->size);
+            if (vktrace_PacketWriter_enqueue((vktrace_trace_packet_header*)pCopy)) {
+                return;
+            }
+            vktrace_PacketAllocator_free(pCopy);
+        }
+        // Out of memory, or the writer was just stopped, so write it here once everything queued ahead of it has gone out.
+        vktrace_PacketWriter_flush();
+    }
+    res = vktrace_FileLike_WriteRaw(pFile, pHeader, (size_t)pHeader->size);
     if (!res && pHeader->packet_id != VKTRACE_TPI_MARKER_TERMINATE_PROCESS) {
         // We don't retry on failure because vktrace_FileLike_WriteRaw already retried and gave up.
         vktrace_LogWarning("Failed to write trace packet.");
@@ -413,6 +442,17 @@ void vktrace_write_trace_packet(const vktrace_trace_packet_header* pHeader, File
     }
 }
 
+void vktrace_write_and_delete_trace_packet(vktrace_trace_packet_header** ppHeader, FileLike* pFile) {
+    if (ppHeader == NULL || *ppHeader == NULL) return;
+
+    if (vktrace_PacketWriter_is_active(pFile) && vktrace_PacketWriter_enqueue(*ppHeader)) {
+        *ppHeader = NULL;
+    } else {
+        vktrace_write_trace_packet(*ppHeader, pFile);
+        vktrace_delete_trace_packet(ppHeader);
+    }
+}
+
 //=============================================================================
 // Methods for Reading and interpretting trace packets
 
@@ -428,13 +468,14 @@ vktrace_trace_packet_header* vktrace_read_trace_packet(FileLike* pFile) {
     }
 
     // allocate space
-    vktrace_trace_packet_header* pHeader = (vktrace_trace_packet_header*)vktrace_malloc((size_t)total_packet_size);
+    vktrace_trace_packet_header* pHeader = (vktrace_trace_packet_header*)vktrace_PacketAllocator_alloc(total_packet_size);
 
     if (pHeader != NULL) {
         pHeader->size = total_packet_size;
         if (vktrace_FileLike_ReadRaw(pFile, (char*)pHeader + sizeof(uint64_t), (size_t)total_packet_size - sizeof(uint64_t)) ==
             FALSE) {
             vktrace_LogError("Failed to read trace packet with size of %u.", total_packet_size);
+            vktrace_PacketAllocator_free(pHeader);
             return NULL;
         }
 
@@ -446,6 +487,51 @@ vktrace_trace_packet_header* vktrace_read_trace_packet(FileLike* pFile) {
     return pHeader;
 }
 
+vktrace_trace_packet_index* vktrace_read_trace_packet_index(FileLike* pFile, const vktrace_trace_file_header* pFileHeader) {
+    vktrace_trace_packet_header tableHeader;
+    vktrace_trace_packet_index counts;
+    vktrace_trace_packet_index* pIndex = NULL;
+    uint64_t originalFilePos;
+    uint64_t maxIndexSize = 0;
+    uint64_t indexSize;
+
+    if (pFileHeader->trace_file_version < VKTRACE_TRACE_FILE_VERSION_8 ||
+        pFileHeader->packet_index_offset < sizeof(vktrace_trace_packet_header)) {
+        return NULL;
+    }
+
+    // The index is at the start of the body of the portability table packet
+    originalFilePos = vktrace_FileLike_GetCurrentPosition(pFile);
+    if (!vktrace_FileLike_SetCurrentPosition(pFile, pFileHeader->packet_index_offset - sizeof(tableHeader)) ||
+        !vktrace_FileLike_ReadRaw(pFile, &tableHeader, sizeof(tableHeader)) ||
+        !vktrace_FileLike_ReadRaw(pFile, &counts, sizeof(counts))) {
+        vktrace_FileLike_SetCurrentPosition(pFile, originalFilePos);
+        return NULL;
+    }
+
+    // Make sure the index fits in the packet, ahead of the word holding the portability table size
+    if (tableHeader.size >= sizeof(tableHeader) + sizeof(uint64_t)) {
+        maxIndexSize = tableHeader.size - sizeof(tableHeader) - sizeof(uint64_t);
+    }
+    if (tableHeader.packet_id != VKTRACE_TPI_PORTABILITY_TABLE || counts.frame_count > counts.packet_count ||
+        counts.packet_count > maxIndexSize / sizeof(vktrace_packet_index_entry) ||
+        (indexSize = sizeof(counts) + counts.packet_count * sizeof(vktrace_packet_index_entry) +
+                     counts.frame_count * sizeof(uint64_t)) > maxIndexSize) {
+        vktrace_LogWarning("Packet index in the trace file is invalid, ignoring it.");
+    } else {
+        pIndex = (vktrace_trace_packet_index*)vktrace_malloc((size_t)indexSize);
+        if (pIndex != NULL) {
+            *pIndex = counts;
+            if (!vktrace_FileLike_ReadRaw(pFile, pIndex + 1, indexSize - sizeof(counts))) {
+                vktrace_free(pIndex);
+                pIndex = NULL;
+            }
+        }
+    }
+    vktrace_FileLike_SetCurrentPosition(pFile, originalFilePos);
+    return pIndex;
+}
+
 void* vktrace_trace_packet_interpret_buffer_pointer(vktrace_trace_packet_header* pHeader, intptr_t ptr_variable) {
     // the pointer variable actually contains a byte offset from the packet body to the start of the buffer.
     uint64_t offset = ptr_variable;
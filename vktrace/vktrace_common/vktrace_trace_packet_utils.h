@@ -77,6 +77,7 @@ vktrace_trace_packet_header* vktrace_create_trace_packet(uint8_t tracer_id, uint
                                                          uint64_t additional_buffers_size);
 
 // deletes a trace packet and sets pointer to NULL
+// Packets are allocated with vktrace_PacketAllocator_alloc and must only be released through this function.
 void vktrace_delete_trace_packet(vktrace_trace_packet_header** ppHeader);
 
 // gets the next address available to write a buffer into the packet
@@ -102,14 +103,23 @@ void vktrace_finalize_trace_packet(vktrace_trace_packet_header* pHeader);
 
 // Write the trace packet to the filelike thing.
 // This has no knowledge of the details of the packet other than its size.
+// If the packet writer thread is active, a copy of the packet is queued for it and the caller keeps the original.
 void vktrace_write_trace_packet(const vktrace_trace_packet_header* pHeader, FileLike* pFile);
 
+// Write the trace packet and delete it, setting the pointer to NULL.
+// If the packet writer thread is active the packet is handed to it instead of being written on this thread.
+void vktrace_write_and_delete_trace_packet(vktrace_trace_packet_header** ppHeader, FileLike* pFile);
+
 //=============================================================================
 // Methods for Reading and interpretting trace packets
 
 // Reads in the trace packet header, the body of the packet, and additional buffers
 vktrace_trace_packet_header* vktrace_read_trace_packet(FileLike* pFile);
 
+// Reads the packet index that pFileHeader points to, to be freed with vktrace_free(). Returns NULL if the
+// trace file has no packet index. The read position of pFile is left unchanged.
+vktrace_trace_packet_index* vktrace_read_trace_packet_index(FileLike* pFile, const vktrace_trace_file_header* pFileHeader);
+
 // converts a pointer variable that is currently byte offset into a pointer to the actual offset location
 void* vktrace_trace_packet_interpret_buffer_pointer(vktrace_trace_packet_header* pHeader, intptr_t ptr_variable);
 
@@ -145,6 +155,16 @@ static vktrace_trace_packet_message* vktrace_interpret_body_as_trace_packet_mess
     return pPacket;
 }
 
+//=============================================================================
+// trace packet index
+static vktrace_packet_index_entry* vktrace_trace_packet_index_entries(vktrace_trace_packet_index* pIndex) {
+    return (vktrace_packet_index_entry*)(pIndex + 1);
+}
+
+static uint64_t* vktrace_trace_packet_index_frame_offsets(vktrace_trace_packet_index* pIndex) {
+    return (uint64_t*)(vktrace_trace_packet_index_entries(pIndex) + pIndex->packet_count);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,8 @@
 #include "vktrace_common.h"
 #include "vktrace_filelike.h"
 #include "vktrace_interconnect.h"
+#include "vktrace_packet_writer.h"
+#include "vktrace_trace_file_writer.h"
 #include "vktrace_vk_vk.h"
 #include "vktrace_lib_trim.h"
 #include "vktrace_lib_helpers.h"
@@ -54,7 +56,59 @@ static inline char* vktrace_layer_getenv(const char* name) { return getenv(name)
 static inline void vktrace_layer_free_getenv(const char* val) {}
 #endif
 
-VKTRACER_EXIT TrapExit(void) { vktrace_LogVerbose("vktrace_lib TrapExit."); }
+VKTRACER_EXIT TrapExit(void) {
+    vktrace_LogVerbose("vktrace_lib TrapExit.");
+    // Make sure packets queued for the writer thread reach the trace before the process goes away.
+    vktrace_PacketWriter_flush();
+}
+
+#if defined(PLATFORM_LINUX)
+// Fatal signals that should not lose the packets still queued for the writer thread.
+// The handler is only installed for signals whose action is still the default, so an
+// application that handles them itself (crash reporters, JIT guard pages) is left alone.
+// SIGINT and SIGTERM are left to the application as well.
+static const int kDrainSignals[] = {SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV};
+static const uint32_t kCrashDrainTimeoutMs = 2000;
+
+// Only async-signal-safe functions may be called from here, the crashing thread can hold any lock.
+static void CrashDrainHandler(int sig, siginfo_t *si, void *context) {
+    FileLike *pFileLike = vktrace_trace_get_trace_file();
+    if (vktrace_PacketWriter_flush_for_crash(kCrashDrainTimeoutMs) && pFileLike != NULL &&
+        pFileLike->mTraceFileWriter != NULL) {
+        // Get whatever the trace file writer has buffered onto the disk.
+        vktrace_TraceFileWriter_flush_for_crash(pFileLike->mTraceFileWriter);
+    }
+
+    // Go back to the default action. A fault happens again with its original details once
+    // the faulting instruction runs again after we return, a signal that was sent is sent again.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = SIG_DFL;
+    sigaction(sig, &sa, NULL);
+    if (si == NULL || si->si_code <= 0) {
+        raise(sig);
+    }
+}
+
+static void InstallCrashDrainHandlers() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_SIGINFO;
+    sa.sa_sigaction = CrashDrainHandler;
+    for (size_t i = 0; i < sizeof(kDrainSignals) / sizeof(kDrainSignals[0]); i++) {
+        struct sigaction oldAction;
+        if (sigaction(kDrainSignals[i], NULL, &oldAction) == -1 || (oldAction.sa_flags & SA_SIGINFO) != 0 ||
+            oldAction.sa_handler != SIG_DFL) {
+            continue;
+        }
+        if (sigaction(kDrainSignals[i], &sa, NULL) == -1) {
+            vktrace_LogWarning("Failed to install trace drain handler for signal %d.", kDrainSignals[i]);
+        }
+    }
+}
+#endif
 
 void loggingCallback(VktraceLogLevel level, const char *pMessage) {
     switch (level) {
@@ -89,8 +143,7 @@ void loggingCallback(VktraceLogLevel level, const char *pMessage) {
         vktrace_set_packet_entrypoint_end_time(pHeader);
         vktrace_finalize_trace_packet(pHeader);
 
-        vktrace_write_trace_packet(pHeader, vktrace_trace_get_trace_file());
-        vktrace_delete_trace_packet(&pHeader);
+        vktrace_write_and_delete_trace_packet(&pHeader, vktrace_trace_get_trace_file());
     }
 
 #if defined(WIN32)
@@ -145,6 +198,9 @@ extern VKTRACER_ENTRY _Load(void) {
 
         vktrace_LogVerbose("vktrace_lib library loaded into PID %d", vktrace_get_pid());
         atexit(TrapExit);
+#if defined(PLATFORM_LINUX)
+        InstallCrashDrainHandlers();
+#endif
 
 // If you need to debug startup, build with this set to true, then attach and change it to false.
 #ifdef _DEBUG
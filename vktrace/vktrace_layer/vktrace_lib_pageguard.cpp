@@ -22,6 +22,21 @@
 #include "vktrace_lib_pageguard.h"
 #include "vktrace_lib_trim.h"
 
+#if defined(PLATFORM_LINUX) && defined(__has_include)
+#if __has_include(<linux/userfaultfd.h>)
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/userfaultfd.h>
+#endif
+#endif
+
+#if defined(UFFDIO_WRITEPROTECT) && defined(__NR_userfaultfd) && !defined(PAGEGUARD_ADD_PAGEGUARD_ON_REAL_MAPPED_MEMORY)
+#define PAGEGUARD_USERFAULTFD_SUPPORTED
+#endif
+
 static const bool PAGEGUARD_PAGEGUARD_ENABLE_DEFAULT = true;
 
 static const VkDeviceSize PAGEGUARD_TARGET_RANGE_SIZE_DEFAULT = 2;  // cover all reasonal mapped memory size, the mapped memory size
@@ -138,6 +153,348 @@ bool getEnablePageGuardLazyCopyFlag() {
     return EnablePageGuardLazyCopyFlag;
 }
 
+#if defined(PLATFORM_LINUX) && !defined(PAGEGUARD_ADD_PAGEGUARD_ON_REAL_MAPPED_MEMORY)
+static int pagemapFd = -1;
+static int clearRefsFd = -1;
+static bool softDirtySyncDeferred = false;
+
+// Check that the kernel keeps soft-dirty bits (CONFIG_MEM_SOFT_DIRTY) and that
+// we are allowed to clear and read them, by writing to a scratch page.
+static bool pageguardSoftDirtyInit() {
+    bool supported = false;
+    pagemapFd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    clearRefsFd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if ((pagemapFd != -1) && (clearRefsFd != -1)) {
+        PBYTE pPage =
+            (PBYTE)mmap(NULL, pageguardGetSystemPageSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pPage != MAP_FAILED) {
+            uint64_t entry = 0;
+            *(volatile BYTE*)pPage = 1;
+            if (pageguardClearSoftDirty() && (pageguardReadPagemap(pPage, 1, &entry) == 1) &&
+                !(entry & PAGEGUARD_PAGEMAP_SOFT_DIRTY)) {
+                *(volatile BYTE*)pPage = 2;
+                supported = (pageguardReadPagemap(pPage, 1, &entry) == 1) && (entry & PAGEGUARD_PAGEMAP_SOFT_DIRTY);
+            }
+            munmap(pPage, pageguardGetSystemPageSize());
+        }
+    }
+    if (!supported) {
+        if (pagemapFd != -1) {
+            close(pagemapFd);
+            pagemapFd = -1;
+        }
+        if (clearRefsFd != -1) {
+            close(clearRefsFd);
+            clearRefsFd = -1;
+        }
+    }
+    return supported;
+}
+
+bool pageguardClearSoftDirty() {
+    // "4" clears the soft-dirty bits of all pages of the process, not just ours.
+    if (write(clearRefsFd, "4", 1) != 1) {
+        vktrace_LogError("Clear soft-dirty bits failed !");
+        return false;
+    }
+    return true;
+}
+
+uint64_t pageguardReadPagemap(PBYTE pStart, uint64_t pageCount, uint64_t* pEntries) {
+    off_t offset = (off_t)(((uintptr_t)pStart / pageguardGetSystemPageSize()) * sizeof(uint64_t));
+    ssize_t readSize = pread(pagemapFd, pEntries, (size_t)(pageCount * sizeof(uint64_t)), offset);
+    if (readSize < 0) {
+        vktrace_LogError("Read /proc/self/pagemap failed !");
+        return 0;
+    }
+    return (uint64_t)readSize / sizeof(uint64_t);
+}
+
+void pageguardSyncSoftDirty() {
+    if ((getPageGuardTrackingMode() != PAGEGUARD_TRACKING_MODE_SOFT_DIRTY) || softDirtySyncDeferred) {
+        return;
+    }
+    // Clearing affects every mapped memory object, so their dirty pages must be
+    // moved to the changed arrays first.
+    for (std::unordered_map<VkDeviceMemory, PageGuardMappedMemory>::iterator it =
+             getPageGuardControlInstance().getMapMemory().begin();
+         it != getPageGuardControlInstance().getMapMemory().end(); it++) {
+        it->second.collectSoftDirtyBlocks();
+    }
+    pageguardClearSoftDirty();
+}
+
+void pageguardDeferSoftDirtySync(bool bDefer) { softDirtySyncDeferred = bDefer; }
+#else
+void pageguardSyncSoftDirty() {}
+
+void pageguardDeferSoftDirtySync(bool bDefer) {}
+#endif
+
+#if defined(PAGEGUARD_USERFAULTFD_SUPPORTED)
+static const uint64_t PAGEGUARD_USERFAULTFD_MESSAGES_PER_READ = 64;
+static int userfaultFd = -1;
+static int userfaultStopFd = -1;  // eventfd that tells the fault handler thread to exit
+static vktrace_thread userfaultThread;
+
+static bool pageguardUserfaultfdIoctl(unsigned long request, void* pArg) {
+    int result;
+    do {
+        // EAGAIN means the address space was changing, try again
+        result = ioctl(userfaultFd, request, pArg);
+    } while ((result == -1) && (errno == EAGAIN));
+    return (result == 0);
+}
+
+bool pageguardUserfaultfdWriteProtect(PBYTE pStart, uint64_t size, bool bProtect) {
+    struct uffdio_writeprotect writeProtect;
+    writeProtect.range.start = (uintptr_t)pStart;
+    writeProtect.range.len = pageguardGetAdjustedSize(size);
+    // removing the protection also wakes up the threads which are waiting for it
+    writeProtect.mode = bProtect ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+    if (!pageguardUserfaultfdIoctl(UFFDIO_WRITEPROTECT, &writeProtect)) {
+        vktrace_LogError("Set userfaultfd write protect(%d) on memory failed !", bProtect);
+        return false;
+    }
+    return true;
+}
+
+bool pageguardUserfaultfdRegister(PBYTE pStart, uint64_t size) {
+    struct uffdio_register registerInfo;
+    registerInfo.range.start = (uintptr_t)pStart;
+    registerInfo.range.len = pageguardGetAdjustedSize(size);
+    registerInfo.mode = UFFDIO_REGISTER_MODE_WP;
+    if (!pageguardUserfaultfdIoctl(UFFDIO_REGISTER, &registerInfo)) {
+        vktrace_LogError("Register memory to userfaultfd failed !");
+        return false;
+    }
+    return pageguardUserfaultfdWriteProtect(pStart, size, true);
+}
+
+bool pageguardUserfaultfdUnregister(PBYTE pStart, uint64_t size) {
+    bool unregistered = pageguardUserfaultfdWriteProtect(pStart, size, false);
+    struct uffdio_range range;
+    range.start = (uintptr_t)pStart;
+    range.len = pageguardGetAdjustedSize(size);
+    if (!pageguardUserfaultfdIoctl(UFFDIO_UNREGISTER, &range)) {
+        vktrace_LogError("Unregister memory from userfaultfd failed !");
+        unregistered = false;
+    }
+    return unregistered;
+}
+
+// Handles the write faults on the shadow memory of all mapped memory objects. The
+// faults are read in batches, the pages are marked as changed and the write
+// protection is removed from each run of adjacent pages with one ioctl, which also
+// wakes up the faulting threads.
+static VKTRACE_THREAD_ROUTINE_RETURN_TYPE pageguardUserfaultfdHandler(LPVOID param) {
+    struct uffd_msg messages[PAGEGUARD_USERFAULTFD_MESSAGES_PER_READ];
+    PBYTE pages[PAGEGUARD_USERFAULTFD_MESSAGES_PER_READ];
+    uint64_t pageSize = pageguardGetSystemPageSize();
+    while (true) {
+        struct pollfd pollFds[2];
+        pollFds[0].fd = userfaultFd;
+        pollFds[0].events = POLLIN;
+        pollFds[1].fd = userfaultStopFd;
+        pollFds[1].events = POLLIN;
+        if (poll(pollFds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            vktrace_LogError("Poll userfaultfd failed, page tracking stopped !");
+            break;
+        }
+        if (pollFds[1].revents & POLLIN) {
+            break;
+        }
+
+        ssize_t readSize = read(userfaultFd, messages, sizeof(messages));
+        if (readSize < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN)) {
+                continue;
+            }
+            vktrace_LogError("Read userfaultfd failed, page tracking stopped !");
+            break;
+        }
+
+        uint64_t pageCount = 0;
+        for (uint64_t i = 0; i < (uint64_t)readSize / sizeof(messages[0]); i++) {
+            if (messages[i].event == UFFD_EVENT_PAGEFAULT) {
+                pages[pageCount++] = (PBYTE)(uintptr_t)(messages[i].arg.pagefault.address & ~(pageSize - 1));
+            }
+        }
+        std::sort(pages, pages + pageCount);
+        pageCount = std::unique(pages, pages + pageCount) - pages;
+
+        // The protection must be removed before the lock is released, otherwise a flush could
+        // copy the page and clear its changed flag before the faulting thread writes to it.
+        pageguardEnter();
+        uint64_t runStart = 0;
+        LPPageGuardMappedMemory pRunMappedMem = nullptr;
+        for (uint64_t i = 0; i <= pageCount; i++) {
+            LPPageGuardMappedMemory pMappedMem = nullptr;
+            if (i < pageCount) {
+                pMappedMem = getPageGuardControlInstance().findMappedMemoryObject(pages[i]);
+                if (pMappedMem) {
+                    pMappedMem->setMappedBlockChanged(pMappedMem->getIndexOfChangedBlockByAddr(pages[i]), true,
+                                                      BLOCK_FLAG_ARRAY_CHANGED);
+                } else {
+                    // the memory was unmapped after the fault, the unregister already woke up the thread
+                    struct uffdio_range range;
+                    range.start = (uintptr_t)pages[i];
+                    range.len = pageSize;
+                    pageguardUserfaultfdIoctl(UFFDIO_WAKE, &range);
+                }
+            }
+            if ((i > runStart) && ((i == pageCount) || (pMappedMem != pRunMappedMem) || (pages[i] != pages[i - 1] + pageSize))) {
+                if (pRunMappedMem) {
+                    pageguardUserfaultfdWriteProtect(pages[runStart], (i - runStart) * pageSize, false);
+                }
+                runStart = i;
+            }
+            pRunMappedMem = pMappedMem;
+        }
+        pageguardExit();
+    }
+    return 0;
+}
+
+// Check that the kernel supports write protect faults on anonymous memory (Linux
+// 5.7+) and that we are allowed to use userfaultfd, then start the fault handler.
+static bool pageguardUserfaultfdInit() {
+    bool supported = false;
+    // non-blocking, the handler thread polls it together with userfaultStopFd
+    userfaultFd = (int)syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+#if defined(UFFD_USER_MODE_ONLY)
+    if (userfaultFd == -1) {
+        // unprivileged processes may only handle faults from user mode, like the page guard
+        // mode, writes from the kernel to protected pages fail.
+        userfaultFd = (int)syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+    }
+#endif
+    if (userfaultFd != -1) {
+        struct uffdio_api api;
+        api.api = UFFD_API;
+        api.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+        if ((ioctl(userfaultFd, UFFDIO_API, &api) == 0) && (api.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP)) {
+            uint64_t pageSize = pageguardGetSystemPageSize();
+            PBYTE pPage = (PBYTE)mmap(NULL, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (pPage != MAP_FAILED) {
+                struct uffdio_register registerInfo;
+                struct uffdio_writeprotect writeProtect;
+                *(volatile BYTE*)pPage = 1;
+                registerInfo.range.start = (uintptr_t)pPage;
+                registerInfo.range.len = pageSize;
+                registerInfo.mode = UFFDIO_REGISTER_MODE_WP;
+                writeProtect.range = registerInfo.range;
+                writeProtect.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+                supported = (ioctl(userfaultFd, UFFDIO_REGISTER, &registerInfo) == 0) &&
+                            (ioctl(userfaultFd, UFFDIO_WRITEPROTECT, &writeProtect) == 0);
+                munmap(pPage, pageSize);
+            }
+        }
+    }
+    if (supported) {
+        userfaultStopFd = eventfd(0, EFD_CLOEXEC);
+        supported = (userfaultStopFd != -1);
+    }
+    if (supported) {
+        userfaultThread = vktrace_platform_create_thread(pageguardUserfaultfdHandler, nullptr);
+        supported = (userfaultThread != 0);
+    }
+    if (!supported) {
+        if (userfaultStopFd != -1) {
+            close(userfaultStopFd);
+            userfaultStopFd = -1;
+        }
+        if (userfaultFd != -1) {
+            close(userfaultFd);
+            userfaultFd = -1;
+        }
+    }
+    return supported;
+}
+
+void pageguardUserfaultfdShutdown() {
+    if (userfaultFd == -1) {
+        return;
+    }
+
+    uint64_t stop = 1;
+    if (write(userfaultStopFd, &stop, sizeof(stop)) != sizeof(stop)) {
+        vktrace_LogError("Stop userfaultfd handler thread failed !");
+    } else {
+        vktrace_linux_sync_wait_for_thread(&userfaultThread);
+    }
+
+    // removing the protection wakes up the threads which faulted after the handler thread stopped,
+    // their writes are no longer tracked.
+    pageguardEnter();
+    for (std::unordered_map<VkDeviceMemory, PageGuardMappedMemory>::iterator it =
+             getPageGuardControlInstance().getMapMemory().begin();
+         it != getPageGuardControlInstance().getMapMemory().end(); it++) {
+        pageguardUserfaultfdUnregister(it->second.getMappedDataPointer(), it->second.getMappedSize());
+    }
+    close(userfaultStopFd);
+    userfaultStopFd = -1;
+    close(userfaultFd);
+    userfaultFd = -1;
+    pageguardExit();
+}
+#else
+bool pageguardUserfaultfdWriteProtect(PBYTE pStart, uint64_t size, bool bProtect) { return false; }
+
+bool pageguardUserfaultfdRegister(PBYTE pStart, uint64_t size) { return false; }
+
+bool pageguardUserfaultfdUnregister(PBYTE pStart, uint64_t size) { return false; }
+
+void pageguardUserfaultfdShutdown() {}
+#endif
+
+// return how writes to the shadow memory of mapped memory are detected, see
+// VKTRACE_PAGEGUARD_TRACKING_ENV. If the requested mode isn't supported, the
+// page guard mode is used.
+PageGuardTrackingMode getPageGuardTrackingMode() {
+    static PageGuardTrackingMode TrackingMode = PAGEGUARD_TRACKING_MODE_PAGE_GUARD;
+    static bool FirstTimeRun = true;
+    if (FirstTimeRun) {
+        FirstTimeRun = false;
+        const char* env_tracking = vktrace_get_global_var(VKTRACE_PAGEGUARD_TRACKING_ENV);
+        if (!env_tracking || (strcmp(env_tracking, "pageguard") == 0)) {
+            // Page guard is the default; userfaultfd and soft-dirty tracking are opt-in.
+        } else if (strcmp(env_tracking, "auto") == 0) {
+#if defined(PAGEGUARD_USERFAULTFD_SUPPORTED)
+            if (pageguardUserfaultfdInit()) {
+                TrackingMode = PAGEGUARD_TRACKING_MODE_USERFAULTFD;
+            }
+#endif
+        } else if (strcmp(env_tracking, "userfaultfd") == 0) {
+#if defined(PAGEGUARD_USERFAULTFD_SUPPORTED)
+            if (pageguardUserfaultfdInit()) {
+                TrackingMode = PAGEGUARD_TRACKING_MODE_USERFAULTFD;
+            } else {
+                vktrace_LogWarning("Userfaultfd write protection is not supported by the kernel, using page guard.");
+            }
+#else
+            vktrace_LogWarning("Userfaultfd write protection is only supported on Linux, using page guard.");
+#endif
+        } else if (strcmp(env_tracking, "softdirty") == 0) {
+#if defined(PLATFORM_LINUX) && !defined(PAGEGUARD_ADD_PAGEGUARD_ON_REAL_MAPPED_MEMORY)
+            if (pageguardSoftDirtyInit()) {
+                TrackingMode = PAGEGUARD_TRACKING_MODE_SOFT_DIRTY;
+            } else {
+                vktrace_LogWarning("Soft-dirty page tracking is not supported by the kernel, using page guard.");
+            }
+#else
+            vktrace_LogWarning("Soft-dirty page tracking is only supported on Linux, using page guard.");
+#endif
+        } else {
+            vktrace_LogWarning("Unknown %s value \"%s\", using page guard.", VKTRACE_PAGEGUARD_TRACKING_ENV, env_tracking);
+        }
+    }
+    return TrackingMode;
+}
+
 #if defined(PLATFORM_LINUX)
 static struct sigaction g_old_sa;
 #endif
@@ -147,6 +504,9 @@ void setPageGuardExceptionHandler() {
     if (!ref_amount_sem_id_create_success) {
         vktrace_LogError("Semaphore create failed!");
     }
+    if (getPageGuardTrackingMode() != PAGEGUARD_TRACKING_MODE_PAGE_GUARD) {
+        return;
+    }
 
     vktrace_sem_wait(ref_amount_sem_id);
     if (!OPTHandler) {
@@ -172,6 +532,9 @@ void setPageGuardExceptionHandler() {
 }
 
 void removePageGuardExceptionHandler() {
+    if (getPageGuardTrackingMode() != PAGEGUARD_TRACKING_MODE_PAGE_GUARD) {
+        return;
+    }
     vktrace_sem_wait(ref_amount_sem_id);
     if (OPTHandler) {
         if (OPTHandlerRefAmount) {
@@ -207,7 +570,7 @@ static std::unordered_map<void*, size_t> allocateMemoryMap;
 
 // Page guard only works for virtual memory. Real device memory
 // sometimes doesn't have a page concept, so we can't use page guard
-// to track it (or check dirty bits in /proc/<pid>/pagemap).
+// to track it (or check its soft-dirty bits in /proc/self/pagemap).
 // So we allocate virtual memory to return to the app and we
 // keep it sync'ed it with real device memory.
 void* pageguardAllocateMemory(uint64_t size) {
@@ -280,6 +643,8 @@ void flushAllChangedMappedMemory(vkFlushMappedMemoryRangesFunc pFunc) {
     if (amount) {
         int i = 0;
         VkMappedMemoryRange* pMemoryRanges = new VkMappedMemoryRange[1];  // amount
+        pageguardSyncSoftDirty();
+        pageguardDeferSoftDirtySync(true);  // one sync covers the flush of every mapped memory object
         for (std::unordered_map<VkDeviceMemory, PageGuardMappedMemory>::iterator it =
                  getPageGuardControlInstance().getMapMemory().begin();
              it != getPageGuardControlInstance().getMapMemory().end(); it++) {
@@ -287,6 +652,7 @@ void flushAllChangedMappedMemory(vkFlushMappedMemoryRangesFunc pFunc) {
             flushTargetChangedMappedMemory(pMappedMemoryTemp, pFunc, pMemoryRanges);
             i++;
         }
+        pageguardDeferSoftDirtySync(false);
         delete[] pMemoryRanges;
     }
 }
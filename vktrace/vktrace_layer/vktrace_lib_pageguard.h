@@ -64,6 +64,23 @@
 //
 //     2. one page accessed by a thread and the access just happen when another thread already finish copying date to real mapped
 //     memory for that page but haven't reset page guard of that page, that page will not be recorded as changed page.
+//
+//  Soft-dirty tracking:
+//
+//     On Linux, VKTRACE_PAGEGUARD_TRACKING=softdirty replaces the page guards with the kernel's soft-dirty bits, so the target
+//     app takes no faults at all. The soft-dirty bits are cleared through /proc/self/clear_refs after the shadow memory is
+//     filled in map process, and at every flush the dirty pages are read from /proc/self/pagemap into the changed block array
+//     before the bits are cleared again. clear_refs clears the bits of the whole process, so the dirty pages of every mapped
+//     memory are collected first, and the cost of a flush grows with the size of the process instead of the number of
+//     written pages. Writes which happen between reading pagemap and clearing the bits are missed, like limitation 2.
+//
+//  Userfaultfd tracking:
+//
+//     On Linux 5.7 and later, the shadow memory is registered to a userfaultfd and write protected with UFFDIO_WRITEPROTECT
+//     instead of mprotect. A write to a protected page blocks the writing thread and queues a fault message, which a handler
+//     thread reads in batches; it marks the pages as changed and removes the protection from each run of adjacent pages with
+//     one ioctl, which lets the writing threads continue. No signal handler runs in the target app's threads. This mode is
+//     used by default when the kernel supports it, VKTRACE_PAGEGUARD_TRACKING selects the mode explicitly.
 
 #pragma once
 
@@ -88,10 +105,21 @@
         exit(1);                              \
     } while (0)
 
+// pagemap entry bit which is set if the page was written since the soft-dirty bits were cleared
+#define PAGEGUARD_PAGEMAP_SOFT_DIRTY (1ULL << 55)
+
+// How writes to the shadow memory of mapped memory are detected.
+enum PageGuardTrackingMode {
+    PAGEGUARD_TRACKING_MODE_PAGE_GUARD,  // page guard/mprotect and the exception handler
+    PAGEGUARD_TRACKING_MODE_SOFT_DIRTY,  // Linux soft-dirty bits in /proc/self/pagemap
+    PAGEGUARD_TRACKING_MODE_USERFAULTFD,  // Linux userfaultfd write protection and a fault handler thread
+};
+
 VkDeviceSize& ref_target_range_size();
 bool getPageGuardEnableFlag();
 bool getEnableReadPMBFlag();
 bool getEnablePageGuardLazyCopyFlag();
+PageGuardTrackingMode getPageGuardTrackingMode();
 void setPageGuardExceptionHandler();
 void removePageGuardExceptionHandler();
 uint64_t pageguardGetAdjustedSize(uint64_t size);
@@ -102,6 +130,22 @@ uint64_t pageguardGetSystemPageSize();
 void pageguardEnter();
 void pageguardExit();
 
+#if defined(PLATFORM_LINUX)
+bool pageguardClearSoftDirty();
+// read the pagemap entries of pageCount pages from pStart, return the amount of entries read.
+uint64_t pageguardReadPagemap(PBYTE pStart, uint64_t pageCount, uint64_t* pEntries);
+#endif
+// in soft-dirty mode, move the dirty pages of all mapped memory to their changed block arrays and clear the soft-dirty bits.
+void pageguardSyncSoftDirty();
+void pageguardDeferSoftDirtySync(bool bDefer);
+
+// in userfaultfd mode, register the shadow memory of a mapped memory object and write protect all of it, or remove it.
+bool pageguardUserfaultfdRegister(PBYTE pStart, uint64_t size);
+bool pageguardUserfaultfdUnregister(PBYTE pStart, uint64_t size);
+bool pageguardUserfaultfdWriteProtect(PBYTE pStart, uint64_t size, bool bProtect);
+// stop the userfaultfd fault handler thread, remove all registered memory and close the userfaultfd.
+void pageguardUserfaultfdShutdown();
+
 void setFlagTovkFlushMappedMemoryRangesSpecial(PBYTE pOPTPackageData);
 
 void flushAllChangedMappedMemory(vkFlushMappedMemoryRangesFunc pFunc);
@@ -79,6 +79,7 @@ bool PageGuardCapture::vkFlushMappedMemoryRangesPageGuardHandle(VkDevice device,
                                                                 PBYTE* ppPackageDataforOutOfMap) {
     bool handleSuccessfully = false, bChanged = false;
     std::unordered_map<VkDeviceMemory, PageGuardMappedMemory>::const_iterator mappedmem_it;
+    pageguardSyncSoftDirty();
     for (uint32_t i = 0; i < memoryRangeCount; i++) {
         VkMappedMemoryRange* pRange = (VkMappedMemoryRange*)&pMemoryRanges[i];
 
@@ -223,7 +223,9 @@ void PageGuardMappedMemory::resetMemoryObjectAllChangedFlagAndPageGuard() {
                 setMappedBlockChanged(i, false, BLOCK_FLAG_ARRAY_READ);
             }
 #else
-            if (mprotect(pMappedData + i * PageGuardSize, (SIZE_T)getMappedBlockSize(i), PROT_READ) == -1) {
+            // in userfaultfd mode, the page was already protected again before it was copied.
+            if ((getPageGuardTrackingMode() == PAGEGUARD_TRACKING_MODE_PAGE_GUARD) &&
+                (mprotect(pMappedData + i * PageGuardSize, (SIZE_T)getMappedBlockSize(i), PROT_READ) == -1)) {
                 vktrace_LogError("Set memory protect on page(%d) failed !", i);
             }
 #endif
@@ -240,7 +242,8 @@ void PageGuardMappedMemory::resetMemoryObjectAllReadFlagAndPageGuard() {
             DWORD oldProt;
             VirtualProtect(pMappedData + i * PageGuardSize, (SIZE_T)getMappedBlockSize(i), PAGE_READWRITE | PAGE_GUARD, &oldProt);
 #else
-            if (mprotect(pMappedData + i * PageGuardSize, (SIZE_T)getMappedBlockSize(i), PROT_READ) == -1) {
+            if ((getPageGuardTrackingMode() == PAGEGUARD_TRACKING_MODE_PAGE_GUARD) &&
+                (mprotect(pMappedData + i * PageGuardSize, (SIZE_T)getMappedBlockSize(i), PROT_READ) == -1)) {
                 vktrace_LogError("Set memory protect on page(%d) failed !", i);
             }
 #endif
@@ -262,6 +265,11 @@ bool PageGuardMappedMemory::setAllPageGuardAndFlag(bool bSetPageGuard, bool bSet
     DWORD dwMemSetting = bSetPageGuard ? (PAGE_READWRITE | PAGE_GUARD) : PAGE_READWRITE;
 #else
     int prot = bSetPageGuard ? PROT_READ : (PROT_READ | PROT_WRITE);
+    PageGuardTrackingMode trackingMode = getPageGuardTrackingMode();
+    if (trackingMode == PAGEGUARD_TRACKING_MODE_USERFAULTFD) {
+        setSuccessfully = bSetPageGuard ? pageguardUserfaultfdRegister(pMappedData, MappedSize)
+                                        : pageguardUserfaultfdUnregister(pMappedData, MappedSize);
+    }
 #endif
 
     for (uint64_t i = 0; i < PageGuardAmount; i++) {
@@ -272,13 +280,21 @@ bool PageGuardMappedMemory::setAllPageGuardAndFlag(bool bSetPageGuard, bool bSet
             setSuccessfully = false;
         }
 #else
-        if (mprotect(pMappedData + i * PageGuardSize, (SIZE_T)getMappedBlockSize(i), prot) == -1) {
+        if ((trackingMode == PAGEGUARD_TRACKING_MODE_PAGE_GUARD) &&
+            (mprotect(pMappedData + i * PageGuardSize, (SIZE_T)getMappedBlockSize(i), prot) == -1)) {
             vktrace_LogError("Set memory protect(%d) on page(%d) failed !", prot, i);
             setSuccessfully = false;
         }
 #endif
         setMappedBlockChanged(i, bSetBlockChanged, BLOCK_FLAG_ARRAY_CHANGED);
     }
+#if defined(PLATFORM_LINUX)
+    if ((trackingMode == PAGEGUARD_TRACKING_MODE_SOFT_DIRTY) && bSetPageGuard) {
+        // the pages written by the memcpy in map process are dirty, clear them. This object isn't in the
+        // mapped memory list yet, so its pages are not collected.
+        pageguardSyncSoftDirty();
+    }
+#endif
     return setSuccessfully;
 }
 
@@ -354,6 +370,26 @@ void PageGuardMappedMemory::vkUnmapMemoryPageGuardHandle(VkDevice device, VkDevi
 
 void PageGuardMappedMemory::backupBlockChangedArraySnapshot() { pPageStatus->backupChangedArray(); }
 
+#if defined(PLATFORM_LINUX)
+void PageGuardMappedMemory::collectSoftDirtyBlocks() {
+    static const uint64_t PAGEMAP_ENTRIES_PER_READ = 512;
+    uint64_t entries[PAGEMAP_ENTRIES_PER_READ];
+    for (uint64_t i = 0; i < PageGuardAmount; i += PAGEMAP_ENTRIES_PER_READ) {
+        uint64_t count = PageGuardAmount - i;
+        if (count > PAGEMAP_ENTRIES_PER_READ) {
+            count = PAGEMAP_ENTRIES_PER_READ;
+        }
+        uint64_t readCount = pageguardReadPagemap(pMappedData + i * PageGuardSize, count, entries);
+        for (uint64_t j = 0; j < count; j++) {
+            // if pagemap can't be read, treat the pages as changed rather than lose writes.
+            if ((j >= readCount) || (entries[j] & PAGEGUARD_PAGEMAP_SOFT_DIRTY)) {
+                setMappedBlockChanged(i + j, true, BLOCK_FLAG_ARRAY_CHANGED);
+            }
+        }
+    }
+}
+#endif
+
 void PageGuardMappedMemory::backupBlockReadArraySnapshot() { pPageStatus->backupReadArray(); }
 
 size_t PageGuardMappedMemory::getChangedBlockAmount(int useWhich) {
@@ -441,9 +477,21 @@ uint64_t PageGuardMappedMemory::getChangedBlockInfo(VkDeviceSize RangeOffset, Vk
                 // Disable writes to the page before we copy from it.
                 // If it is modified by another thread while copying, we'll get
                 // another signal and mark it dirty, and we will copy it again.
-                if (mprotect(srcAddr, CurrentBlockSize, PROT_READ) == -1) {
+                // In soft-dirty mode, such a write sets the soft-dirty bit again.
+                PageGuardTrackingMode trackingMode = getPageGuardTrackingMode();
+                if ((trackingMode == PAGEGUARD_TRACKING_MODE_PAGE_GUARD) &&
+                    (mprotect(srcAddr, CurrentBlockSize, PROT_READ) == -1)) {
                     vktrace_LogError("Set memory protect on page failed!");
                 }
+                if ((trackingMode == PAGEGUARD_TRACKING_MODE_USERFAULTFD) &&
+                    ((i == 0) || !isMappedBlockChanged(i - 1, useWhich))) {
+                    // protect the whole run of changed blocks which starts here with one ioctl
+                    uint64_t runEnd = i + 1;
+                    while ((runEnd < PageGuardAmount) && isMappedBlockChanged(runEnd, useWhich)) {
+                        runEnd++;
+                    }
+                    pageguardUserfaultfdWriteProtect(pMappedData + offset, (runEnd - i) * PageGuardSize, true);
+                }
 #endif
                 vktrace_pageguard_memcpy(pChangedData, srcAddr, CurrentBlockSize);
             }
@@ -105,6 +105,11 @@ typedef class PageGuardMappedMemory {
 
     void backupBlockChangedArraySnapshot();
 
+#if defined(PLATFORM_LINUX)
+    /// mark the blocks whose soft-dirty bit is set in /proc/self/pagemap as changed
+    void collectSoftDirtyBlocks();
+#endif
+
     void backupBlockReadArraySnapshot();
 
     size_t getChangedBlockAmount(int useWhich);
@@ -38,6 +38,8 @@
 
 #include "vktrace_interconnect.h"
 #include "vktrace_filelike.h"
+#include "vktrace_packet_writer.h"
+#include "vktrace_trace_file_writer.h"
 #include "vktrace_trace_packet_utils.h"
 #include "vktrace_vk_exts.h"
 #include <stdio.h>
@@ -54,16 +56,28 @@ VKTRACER_LEAVE _Unload(void) {
     // only do the hooking and networking if the tracer is NOT loaded by vktrace
     if (vktrace_is_loaded_into_vktrace() == FALSE) {
         if (vktrace_trace_get_trace_file() != NULL) {
-            vktrace_trace_packet_header *pHeader =
-                vktrace_create_trace_packet(VKTRACE_TID_VULKAN, VKTRACE_TPI_MARKER_TERMINATE_PROCESS, 0, 0);
-            vktrace_finalize_trace_packet(pHeader);
-            vktrace_write_trace_packet(pHeader, vktrace_trace_get_trace_file());
-            vktrace_delete_trace_packet(&pHeader);
+            TraceFileWriter *pTraceFileWriter = vktrace_trace_get_trace_file()->mTraceFileWriter;
+            if (pTraceFileWriter == NULL) {
+                // Tell the vktrace server we're done
+                vktrace_trace_packet_header *pHeader =
+                    vktrace_create_trace_packet(VKTRACE_TID_VULKAN, VKTRACE_TPI_MARKER_TERMINATE_PROCESS, 0, 0);
+                vktrace_finalize_trace_packet(pHeader);
+                vktrace_write_and_delete_trace_packet(&pHeader, vktrace_trace_get_trace_file());
+            }
+            vktrace_PacketWriter_stop();
+            if (pTraceFileWriter != NULL) {
+                // There is no vktrace server to finish the trace file, so do it here
+                FILE *pTraceFile = vktrace_trace_get_trace_file()->mFile;
+                vktrace_TraceFileWriter_finish(pTraceFileWriter);
+                vktrace_TraceFileWriter_destroy(&pTraceFileWriter);
+                fclose(pTraceFile);
+            }
             vktrace_free(vktrace_trace_get_trace_file());
             vktrace_trace_set_trace_file(NULL);
             vktrace_deinitialize_trace_packet_utils();
             trim::deinitialize();
         }
+        pageguardUserfaultfdShutdown();
         if (gMessageStream != NULL) {
             vktrace_MessageStream_destroy(&gMessageStream);
         }
@@ -1032,9 +1046,16 @@ static bool send_vk_trace_file_header(VkInstance instance) {
         pGpuinfo[i].gpu_drv_vers = (uint64_t)devProperties.driverVersion;
     }
 
-    vktrace_FileLike_WriteRaw(vktrace_trace_get_trace_file(), &packet_size, sizeof(packet_size));
-    vktrace_FileLike_WriteRaw(vktrace_trace_get_trace_file(), pHeader, header_size);
-    rval = true;
+    // The header is written with raw writes, so make sure nothing queued is still pending.
+    vktrace_PacketWriter_flush();
+    if (vktrace_trace_get_trace_file()->mTraceFileWriter != NULL) {
+        // Writing the trace file directly, the header goes in as is.
+        rval = vktrace_TraceFileWriter_write_header(vktrace_trace_get_trace_file()->mTraceFileWriter, pHeader, pGpuinfo) == TRUE;
+    } else {
+        vktrace_FileLike_WriteRaw(vktrace_trace_get_trace_file(), &packet_size, sizeof(packet_size));
+        vktrace_FileLike_WriteRaw(vktrace_trace_get_trace_file(), pHeader, header_size);
+        rval = true;
+    }
 
 cleanupAndReturn:
     vktrace_free(pPhysDevice);
@@ -4195,7 +4216,7 @@ VKTRACER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vktraceGetDeviceProcAdd
 /* GDPA with no trace packet creation */
 VKTRACER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL __HOOKED_vkGetDeviceProcAddr(VkDevice device, const char* funcName) {
     if (!strcmp("vkGetDeviceProcAddr", funcName)) {
-        if (gMessageStream != NULL) {
+        if (vktrace_trace_get_trace_file() != NULL) {
             return (PFN_vkVoidFunction)vktraceGetDeviceProcAddr;
         } else {
             return (PFN_vkVoidFunction)__HOOKED_vkGetDeviceProcAddr;
@@ -4203,7 +4224,7 @@ VKTRACER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL __HOOKED_vkGetDevicePro
     }
 
     layer_device_data* devData = mdd(device);
-    if (gMessageStream != NULL) {
+    if (vktrace_trace_get_trace_file() != NULL) {
         PFN_vkVoidFunction addr;
         addr = layer_intercept_proc(funcName);
         if (addr) return addr;
@@ -4265,14 +4286,14 @@ VKTRACER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL __HOOKED_vkGetInstanceP
 
     vktrace_platform_thread_once((void*)&gInitOnce, InitTracer);
     if (!strcmp("vkGetInstanceProcAddr", funcName)) {
-        if (gMessageStream != NULL) {
+        if (vktrace_trace_get_trace_file() != NULL) {
             return (PFN_vkVoidFunction)vktraceGetInstanceProcAddr;
         } else {
             return (PFN_vkVoidFunction)__HOOKED_vkGetInstanceProcAddr;
         }
     }
 
-    if (gMessageStream != NULL) {
+    if (vktrace_trace_get_trace_file() != NULL) {
         addr = layer_intercept_instance_proc(funcName);
         if (addr) return addr;
 
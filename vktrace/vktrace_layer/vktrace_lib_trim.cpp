@@ -21,6 +21,13 @@
 #include "vk_struct_size_helper.h"
 #include "vulkan.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
 // defined in vktrace_lib_trace.cpp
 extern layer_device_data *mdd(void *object);
 extern layer_instance_data *mid(void *object);
@@ -48,9 +55,103 @@ static const int MAX_TRIM_TRIGGER_TYPE_STRING_LENGTH = 16;
 static const int TRACE_TRIGGER_STRING_LENGTH = MAX_TRIM_TRIGGER_OPTION_STRING_LENGTH + MAX_TRIM_TRIGGER_TYPE_STRING_LENGTH;
 
 VKTRACE_CRITICAL_SECTION trimRecordedPacketLock;
-VKTRACE_CRITICAL_SECTION trimStateTrackerLock;
 VKTRACE_CRITICAL_SECTION trimCommandBufferPacketLock;
 
+//=========================================================================
+// Each type of object in the state trackers has a reader / writer lock of its
+// own, so that threads creating or looking up different types of objects
+// don't serialize on a single lock. Operations that span several types, such
+// as taking the snapshot or destroying a device, take every lock with
+// lockStateTracker().
+//=========================================================================
+enum StateTrackerLockType {
+    StateTrackerLock_Instance,
+    StateTrackerLock_PhysicalDevice,
+    StateTrackerLock_Device,
+    StateTrackerLock_SurfaceKHR,
+    StateTrackerLock_CommandPool,
+    StateTrackerLock_CommandBuffer,
+    StateTrackerLock_DescriptorPool,
+    StateTrackerLock_RenderPass,
+    StateTrackerLock_PipelineCache,
+    StateTrackerLock_Pipeline,
+    StateTrackerLock_Queue,
+    StateTrackerLock_Semaphore,
+    StateTrackerLock_DeviceMemory,
+    StateTrackerLock_Fence,
+    StateTrackerLock_SwapchainKHR,
+    StateTrackerLock_Image,
+    StateTrackerLock_ImageView,
+    StateTrackerLock_Buffer,
+    StateTrackerLock_BufferView,
+    StateTrackerLock_Framebuffer,
+    StateTrackerLock_Event,
+    StateTrackerLock_QueryPool,
+    StateTrackerLock_ShaderModule,
+    StateTrackerLock_PipelineLayout,
+    StateTrackerLock_Sampler,
+    StateTrackerLock_DescriptorSetLayout,
+    StateTrackerLock_DescriptorSet,
+    StateTrackerLock_Count
+};
+
+static VKTRACE_RW_LOCK s_stateTrackerLocks[StateTrackerLock_Count];
+
+// Number of nested lockStateTracker() calls on this thread. While it is not
+// zero the thread already holds every lock, so the per-type locks are skipped.
+static VKTRACE_THREAD_LOCAL uint32_t s_stateTrackerLockDepth = 0;
+
+//=========================================================================
+// Write access is needed to add or remove objects of the type, or to change
+// anything but the ObjectInfo of an existing object.
+//=========================================================================
+void lockObjectType(StateTrackerLockType type, bool write) {
+    if (s_stateTrackerLockDepth > 0) {
+        return;
+    }
+
+    if (write) {
+        vktrace_enter_write_lock(&s_stateTrackerLocks[type]);
+    } else {
+        vktrace_enter_read_lock(&s_stateTrackerLocks[type]);
+    }
+}
+
+//=========================================================================
+void unlockObjectType(StateTrackerLockType type, bool write) {
+    if (s_stateTrackerLockDepth > 0) {
+        return;
+    }
+
+    if (write) {
+        vktrace_leave_write_lock(&s_stateTrackerLocks[type]);
+    } else {
+        vktrace_leave_read_lock(&s_stateTrackerLocks[type]);
+    }
+}
+
+//=========================================================================
+// Takes every per-type lock for writing, always in the same order. The calling
+// thread may not hold any per-type lock already.
+//=========================================================================
+void lockStateTracker() {
+    if (s_stateTrackerLockDepth++ == 0) {
+        for (uint32_t i = 0; i < StateTrackerLock_Count; i++) {
+            vktrace_enter_write_lock(&s_stateTrackerLocks[i]);
+        }
+    }
+}
+
+//=========================================================================
+void unlockStateTracker() {
+    assert(s_stateTrackerLockDepth > 0);
+    if (--s_stateTrackerLockDepth == 0) {
+        for (uint32_t i = StateTrackerLock_Count; i > 0; i--) {
+            vktrace_leave_write_lock(&s_stateTrackerLocks[i - 1]);
+        }
+    }
+}
+
 //=========================================================================
 // Information necessary to create the staged buffer and memory for DEVICE_LOCAL
 // buffers.
@@ -101,11 +202,6 @@ static std::unordered_map<VkDevice, std::unordered_map<uint32_t, VkCommandPool>>
 //=========================================================================
 static std::unordered_map<const void *, VkAllocationCallbacks> s_trimAllocatorMap;
 
-//=========================================================================
-// Associates a Device to a trim-specific CommandBuffer
-//=========================================================================
-static std::unordered_map<VkDevice, VkCommandBuffer> s_deviceToCommandBufferMap;
-
 //=========================================================================
 // Start trimming
 //=========================================================================
@@ -457,7 +553,9 @@ void initialize() {
     }
 
     if (g_trimEnabled) {
-        vktrace_create_critical_section(&trimStateTrackerLock);
+        for (uint32_t i = 0; i < StateTrackerLock_Count; i++) {
+            vktrace_create_rw_lock(&s_stateTrackerLocks[i]);
+        }
         vktrace_create_critical_section(&trimRecordedPacketLock);
         vktrace_create_critical_section(&trimCommandBufferPacketLock);
         vktrace_create_critical_section(&trimTransitionMapLock);
@@ -470,7 +568,9 @@ void deinitialize() {
     s_trimGlobalStateTracker.clear();
 
     vktrace_delete_critical_section(&trimRecordedPacketLock);
-    vktrace_delete_critical_section(&trimStateTrackerLock);
+    for (uint32_t i = 0; i < StateTrackerLock_Count; i++) {
+        vktrace_delete_rw_lock(&s_stateTrackerLocks[i]);
+    }
     vktrace_delete_critical_section(&trimCommandBufferPacketLock);
     vktrace_delete_critical_section(&trimTransitionMapLock);
 }
@@ -615,57 +715,132 @@ VkCommandPool getCommandPoolFromDevice(VkDevice device, uint32_t queueFamilyInde
 }
 
 //=========================================================================
-// Find existing trim-specific CommandBuffer from the Device, or
-// create a new one.
+// Resources are copied out in batches that share one host-visible staging
+// buffer, command buffer and fence per batch, rather than one of each per
+// resource.
 //=========================================================================
-VkCommandBuffer getCommandBufferFromDevice(VkDevice device, VkCommandPool commandPool = VK_NULL_HANDLE,
-                                           uint32_t queueFamilyIndex = 0) {
-    assert(device != VK_NULL_HANDLE);
+static const VkDeviceSize SNAPSHOT_STAGING_BATCH_SIZE = 64 * 1024 * 1024;
 
-    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
-    if (s_deviceToCommandBufferMap.find(device) == s_deviceToCommandBufferMap.end()) {
-        if (commandPool == VK_NULL_HANDLE) {
-            commandPool = getCommandPoolFromDevice(device, queueFamilyIndex);
+// Offsets within a batch's staging buffer are a multiple of 4 and of every
+// texel block size (up to 48 bytes), as vkCmdCopyImageToBuffer requires.
+static const VkDeviceSize SNAPSHOT_STAGING_ALIGNMENT = 768;
+
+struct SnapshotResource {
+    // Exactly one of image or buffer is set
+    VkImage image = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    ObjectInfo *pInfo = NULL;
+
+    bool needsStagingBuffer = false;
+
+    // Number of bytes that will be mapped / unmapped to capture the contents
+    VkDeviceSize size = 0;
+
+    // Location of the contents within the batch's staging buffer
+    VkDeviceSize stagingOffset = 0;
+};
+
+struct SnapshotBatch {
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t queueFamilyIndex = 0;
+    std::vector<SnapshotResource> resources;
+
+    VkDeviceSize stagingSize = 0;
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+    uint8_t *pStagingData = NULL;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+
+    // The first command buffer copies the resources, the second returns
+    // resources that were read in place to their previous access state.
+    VkCommandBuffer commandBuffers[2] = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    VkQueue queue = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    bool submitted = false;
+};
+
+//=========================================================================
+// Threads that generate the map / unmap packets of one batch while the GPU
+// copies the next one.
+//=========================================================================
+class SnapshotWorkerPool {
+   public:
+    SnapshotWorkerPool() {
+        uint32_t threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), 8u));
+        for (uint32_t i = 0; i < threadCount; i++) {
+            m_threads.push_back(std::thread(&SnapshotWorkerPool::run, this));
         }
+    }
 
-        // allocate a new command buffer on the device
-        VkCommandBufferAllocateInfo allocateInfo;
-        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocateInfo.pNext = NULL;
-        allocateInfo.commandPool = commandPool;
-        allocateInfo.level = (VkCommandBufferLevel)VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocateInfo.commandBufferCount = 1;
+    ~SnapshotWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_exit = true;
+        }
+        m_taskAvailable.notify_all();
+        for (auto &thread : m_threads) {
+            thread.join();
+        }
+    }
 
-        VkResult result = mdd(device)->devTable.AllocateCommandBuffers(device, &allocateInfo, &commandBuffer);
-        assert(result == VK_SUCCESS);
-        if (result == VK_SUCCESS) {
-            s_deviceToCommandBufferMap[device] = commandBuffer;
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
         }
-    } else {
-        commandBuffer = s_deviceToCommandBufferMap[device];
+        m_taskAvailable.notify_one();
+    }
 
-        // by Doc, "Executable command buffers can be submitted, reset, or
-        // recorded to another command buffer.", the command buffer here
-        // will be reused to record command, reset is needed to make it
-        // come back to initial state. Directly using without reset is
-        // not supported by Doc, for the target title, vkBeginCommandBuffer
-        // return fail can be found on specific hardware and driver.
-        mdd(device)->devTable.ResetCommandBuffer(commandBuffer, 0);
+    // Returns once every submitted task has finished.
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_tasks.empty() && m_busyCount == 0; });
     }
 
-    return commandBuffer;
-}
+   private:
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_taskAvailable.wait(lock, [this] { return m_exit || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return;
+            }
+
+            std::function<void()> task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            m_busyCount++;
+            lock.unlock();
+            task();
+            lock.lock();
+            if (--m_busyCount == 0 && m_tasks.empty()) {
+                m_idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_idle;
+    uint32_t m_busyCount = 0;
+    bool m_exit = false;
+};
 
 //=========================================================================
-StagingInfo createStagingBuffer(VkDevice device, VkCommandPool commandPool, VkCommandBuffer commandBuffer,
-                                uint32_t queueFamilyIndex, VkDeviceSize size) {
+// Describes the staging buffer that replay uses to restore one resource.
+// At trace time the resource's contents are at an offset within the batch's
+// shared staging buffer instead, but the trace file gets a buffer of its own
+// size so replay doesn't have to allocate a whole batch per resource.
+//=========================================================================
+StagingInfo createStagingInfo(const SnapshotBatch &batch, VkDeviceSize size) {
     StagingInfo stagingInfo = {};
+    VkDevice device = batch.device;
 
-    stagingInfo.commandPool = commandPool;
-    stagingInfo.commandBuffer = commandBuffer;
-
-    VkQueue queue = trim::get_DeviceQueue(device, queueFamilyIndex, 0);
-    stagingInfo.queue = queue;
+    stagingInfo.commandPool = batch.commandPool;
+    stagingInfo.commandBuffer = batch.commandBuffers[0];
+    stagingInfo.queue = batch.queue;
 
     stagingInfo.bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     stagingInfo.bufferCreateInfo.pNext = NULL;
@@ -676,9 +851,18 @@ StagingInfo createStagingBuffer(VkDevice device, VkCommandPool commandPool, VkCo
     stagingInfo.bufferCreateInfo.queueFamilyIndexCount = 0;
     stagingInfo.bufferCreateInfo.pQueueFamilyIndices = NULL;
 
-    mdd(device)->devTable.CreateBuffer(device, &stagingInfo.bufferCreateInfo, NULL, &stagingInfo.buffer);
+    // Get the memory requirements of a buffer this size; no memory is bound to it.
+    VkBuffer buffer = VK_NULL_HANDLE;
+    if (mdd(device)->devTable.CreateBuffer(device, &stagingInfo.bufferCreateInfo, NULL, &buffer) == VK_SUCCESS) {
+        mdd(device)->devTable.GetBufferMemoryRequirements(device, buffer, &stagingInfo.bufferMemoryRequirements);
+        mdd(device)->devTable.DestroyBuffer(device, buffer, NULL);
+    } else {
+        mdd(device)->devTable.GetBufferMemoryRequirements(device, batch.stagingBuffer, &stagingInfo.bufferMemoryRequirements);
+        stagingInfo.bufferMemoryRequirements.size = ROUNDUP_TO_4(size);
+    }
 
-    mdd(device)->devTable.GetBufferMemoryRequirements(device, stagingInfo.buffer, &stagingInfo.bufferMemoryRequirements);
+    stagingInfo.buffer = batch.stagingBuffer;
+    stagingInfo.memory = batch.stagingMemory;
 
     stagingInfo.memoryAllocationInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     stagingInfo.memoryAllocationInfo.pNext = NULL;
@@ -686,10 +870,6 @@ StagingInfo createStagingBuffer(VkDevice device, VkCommandPool commandPool, VkCo
     stagingInfo.memoryAllocationInfo.memoryTypeIndex =
         FindMemoryTypeIndex(device, stagingInfo.bufferMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 
-    mdd(device)->devTable.AllocateMemory(device, &stagingInfo.memoryAllocationInfo, nullptr, &stagingInfo.memory);
-
-    mdd(device)->devTable.BindBufferMemory(device, stagingInfo.buffer, stagingInfo.memory, 0);
-
     return stagingInfo;
 }
 
@@ -877,205 +1057,281 @@ void generateMapUnmap(bool makeCalls, VkDevice device, VkDeviceMemory memory, Vk
     }
 }
 
-//=============================================================================
-// Use this to snapshot the global state tracker at the start of the trim
-// frames.
-//=============================================================================
-void snapshot_state_tracker() {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
-    s_trimStateTrackerSnapshot = s_trimGlobalStateTracker;
+//=========================================================================
+// Regions that copy the whole image into a tightly packed staging buffer,
+// with offsets relative to the start of that buffer.
+//=========================================================================
+std::vector<VkBufferImageCopy> getImageCopyRegions(VkDevice device, VkImage image, const ObjectInfo &imageInfo) {
+    std::vector<VkBufferImageCopy> imageCopyRegions;
+
+    // From Docs: srcImage must have a sample count equal to
+    // VK_SAMPLE_COUNT_1_BIT
+    // From Docs: srcImage must have been created with
+    // VK_IMAGE_USAGE_TRANSFER_SRC_BIT usage flag
+    VkImageAspectFlags aspectMask = imageInfo.ObjectInfo.Image.aspectMask;
+    if (aspectMask == (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT)) {
+        imageCopyRegions.reserve(2);
+
+        // First depth, then stencil
+        VkImageAspectFlagBits aspects[2] = {VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_ASPECT_STENCIL_BIT};
+        for (uint32_t i = 0; i < 2; i++) {
+            VkImageSubresource sub;
+            sub.arrayLayer = 0;
+            sub.aspectMask = aspects[i];
+            sub.mipLevel = 0;
+
+            VkSubresourceLayout layout;
+            mdd(device)->devTable.GetImageSubresourceLayout(device, image, &sub, &layout);
+
+            VkBufferImageCopy copyRegion = {};
+
+            copyRegion.bufferRowLength = 0;
+            copyRegion.bufferImageHeight = 0;
+            // On some platform, originally set to layout.rowPitch and layout.arrayPitch
+            // cause write outside of staging buffer memory size and hang at following
+            // queue submission in other frames after finish trim starting process when
+            // trim some titles.
+            //
+            // Here we set bufferRowLength and bufferImageHeight to 0 make the image
+            // copy to be tightly packed according to the imageExtent, the change fix
+            // the above problem.
+            //
+            // Although bufferRowLength,bufferImageHeight can be set to greater than
+            // the width and height member of imageExtent, but because we allocate memory
+            // for the staging buffer by image memory size and here we copy whole image,
+            // so greater than imageExtent take a risk that the copy beyond the staging
+            // buffer memory size.
+
+            copyRegion.bufferOffset = layout.offset;
+            copyRegion.imageExtent.depth = 1;
+            copyRegion.imageExtent.width = imageInfo.ObjectInfo.Image.extent.width;
+            copyRegion.imageExtent.height = imageInfo.ObjectInfo.Image.extent.height;
+            copyRegion.imageOffset.x = 0;
+            copyRegion.imageOffset.y = 0;
+            copyRegion.imageOffset.z = 0;
+            copyRegion.imageSubresource.aspectMask = sub.aspectMask;
+            copyRegion.imageSubresource.baseArrayLayer = 0;
+            copyRegion.imageSubresource.layerCount = imageInfo.ObjectInfo.Image.arrayLayers;
+            copyRegion.imageSubresource.mipLevel = 0;
+
+            imageCopyRegions.push_back(copyRegion);
+        }
+    } else {
+        VkImageSubresource sub;
+        sub.arrayLayer = 0;
+        sub.aspectMask = aspectMask;
+        sub.mipLevel = 0;
+
+        // need to make a VkBufferImageCopy for each mip level
+        imageCopyRegions.reserve(imageInfo.ObjectInfo.Image.mipLevels);
+        for (uint32_t i = 0; i < imageInfo.ObjectInfo.Image.mipLevels; i++) {
+            VkSubresourceLayout lay;
+            sub.mipLevel = i;
+            mdd(device)->devTable.GetImageSubresourceLayout(device, image, &sub, &lay);
+
+            VkBufferImageCopy copyRegion;
+            copyRegion.bufferRowLength = 0;    //< tightly packed texels
+            copyRegion.bufferImageHeight = 0;  //< tightly packed texels
+            copyRegion.bufferOffset = lay.offset;
+            copyRegion.imageExtent.depth = 1;
+            copyRegion.imageExtent.width = (imageInfo.ObjectInfo.Image.extent.width >> i);
+            copyRegion.imageExtent.height = (imageInfo.ObjectInfo.Image.extent.height >> i);
+            copyRegion.imageOffset.x = 0;
+            copyRegion.imageOffset.y = 0;
+            copyRegion.imageOffset.z = 0;
+            copyRegion.imageSubresource.aspectMask = aspectMask;
+            copyRegion.imageSubresource.baseArrayLayer = 0;
+            copyRegion.imageSubresource.layerCount = imageInfo.ObjectInfo.Image.arrayLayers;
+            copyRegion.imageSubresource.mipLevel = i;
+
+            imageCopyRegions.push_back(copyRegion);
+        }
+    }
+
+    return imageCopyRegions;
+}
+
+//=========================================================================
+// Queue family index to use in barriers on the image.
+//=========================================================================
+uint32_t getImageBarrierQueueFamilyIndex(const ObjectInfo &imageInfo) {
+    if (imageInfo.ObjectInfo.Image.sharingMode == VK_SHARING_MODE_CONCURRENT) {
+        return VK_QUEUE_FAMILY_IGNORED;
+    }
+    return imageInfo.ObjectInfo.Image.queueFamilyIndex;
+}
+
+//=========================================================================
+// Adds the resource to the open batch for its device and queue family,
+// starting a new batch when the staging buffer would grow past
+// SNAPSHOT_STAGING_BATCH_SIZE. Larger resources get a batch of their own.
+//=========================================================================
+void addSnapshotResource(std::vector<SnapshotBatch> &batches, std::map<std::pair<VkDevice, uint32_t>, size_t> &openBatches,
+                         VkDevice device, uint32_t queueFamilyIndex, SnapshotResource resource, VkDeviceSize stagingSize) {
+    if (queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED) {
+        queueFamilyIndex = 0;
+    }
+
+    auto key = std::make_pair(device, queueFamilyIndex);
+    auto openBatch = openBatches.find(key);
+    VkDeviceSize alignedSize = 0;
+    if (resource.needsStagingBuffer) {
+        alignedSize = ((stagingSize + SNAPSHOT_STAGING_ALIGNMENT - 1) / SNAPSHOT_STAGING_ALIGNMENT) * SNAPSHOT_STAGING_ALIGNMENT;
+    }
+
+    if (openBatch == openBatches.end() ||
+        (alignedSize != 0 && batches[openBatch->second].stagingSize != 0 &&
+         batches[openBatch->second].stagingSize + alignedSize > SNAPSHOT_STAGING_BATCH_SIZE)) {
+        batches.push_back(SnapshotBatch());
+        batches.back().device = device;
+        batches.back().queueFamilyIndex = queueFamilyIndex;
+        openBatches[key] = batches.size() - 1;
+        openBatch = openBatches.find(key);
+    }
+
+    SnapshotBatch &batch = batches[openBatch->second];
+    resource.stagingOffset = batch.stagingSize;
+    batch.stagingSize += alignedSize;
+    batch.resources.push_back(resource);
+}
+
+//=========================================================================
+// Sorts the images and buffers that need to be captured into batches.
+//=========================================================================
+std::vector<SnapshotBatch> createSnapshotBatches() {
+    std::vector<SnapshotBatch> batches;
+    std::map<std::pair<VkDevice, uint32_t>, size_t> openBatches;
 
-    //
-    // Copying all the buffers is a length process, it include the following
-    // sub-processes:
-    //
-    // for (any image in all tracked images)
-    // {
-    //    1a) Transition the image into host - readable state.
-    //    2a) Map, copy, unmap the image.
-    //    3a) Transition the images back to their previous state.
-    // }
-    //
-    // for (any buffer in all tracked buffers)
-    // {
-    //    1b) Transition the buffers into host - readable state.
-    //    2b) Map, copy, unmap the buffer.
-    //    3b) Transition the buffer back to their previous state.
-    // }
-    //
-    // 4) Destroy the command pools, command buffers, and fences.
-    //
-    // Please note: the above sub-process order arrangement include some
-    // consideration about driver limitation:
-    //
-    // Some driver has limitation on the max GPU memory allocations. For
-    // some title with heavily sub-allocation behavior, the staging memory
-    // allocations needed by trim will be a large number, the following
-    // sub-process order minimize the active GPU memory allocations needed
-    // by trim at same time, and avoid the allocations (needed by trim and
-    // by the title itself) beyond driver limitation. Otherwise, it cause
-    // some title hang problem due to fail to allocate memory.
-
-    // a) dump all images, the process include the following sub-process:
-    //    1a) Transition the image into host - readable state.
-    //    2a) Map, copy, unmap the image.
-    //    3a) Transition the image back to their previous state.
-    //
     for (auto imageIter = s_trimStateTrackerSnapshot.createdImages.begin();
          imageIter != s_trimStateTrackerSnapshot.createdImages.end(); imageIter++) {
         VkDevice device = imageIter->second.belongsToDevice;
-        VkImage image = imageIter->first;
-
-        if ((imageIter->second.ObjectInfo.Image.memorySize != 0) && (device != VK_NULL_HANDLE)) {
-            // If the memorysize is zero, it mean the image is not bound to any
-            // memory so far, it might be just created when starting to trim.
-            // for such case, what we need to do is recreating the image in
-            // playback without copy its content to host side, it doesn't
-            // has any content now and the title might set its content after
-            // the trim starting. So skip the following process.
-            // Some target title belong to such case, the following process
-            // cause the title running crash during tracing because
-            // the following part of loop suppose the image is bound to
-            // memory so memorysize is not zero.
-            // If device is VK_NULL_HANDLE, this is likely a swapchain image
-            // which we haven't associated a device to, just skip over it.
-
-            // 1a) Transition the image into host-readable state.
-
-            uint32_t queueFamilyIndex = imageIter->second.ObjectInfo.Image.queueFamilyIndex;
-
-            if (imageIter->second.ObjectInfo.Image.sharingMode == VK_SHARING_MODE_CONCURRENT) {
-                queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            }
 
-            VkCommandPool commandPool = getCommandPoolFromDevice(device, queueFamilyIndex);
-            VkCommandBuffer commandBuffer = getCommandBufferFromDevice(device, commandPool);
+        // If the memorysize is zero, it mean the image is not bound to any
+        // memory so far, it might be just created when starting to trim.
+        // for such case, what we need to do is recreating the image in
+        // playback without copy its content to host side, it doesn't
+        // has any content now and the title might set its content after
+        // the trim starting. So skip it.
+        // If device is VK_NULL_HANDLE, this is likely a swapchain image
+        // which we haven't associated a device to, just skip over it.
+        if ((imageIter->second.ObjectInfo.Image.memorySize == 0) || (device == VK_NULL_HANDLE)) {
+            continue;
+        }
 
-            // Begin the command buffer
-            VkCommandBufferBeginInfo commandBufferBeginInfo;
-            commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            commandBufferBeginInfo.pNext = NULL;
-            commandBufferBeginInfo.pInheritanceInfo = NULL;
-            commandBufferBeginInfo.flags = 0;
-            VkResult result = mdd(device)->devTable.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-            assert(result == VK_SUCCESS);
-            if (result != VK_SUCCESS) continue;
+        SnapshotResource resource;
+        resource.image = imageIter->first;
+        resource.pInfo = &imageIter->second;
+        resource.needsStagingBuffer = imageIter->second.ObjectInfo.Image.needsStagingBuffer;
+        resource.size = ROUNDUP_TO_4(imageIter->second.ObjectInfo.Image.memorySize);
+        addSnapshotResource(batches, openBatches, device, getImageBarrierQueueFamilyIndex(imageIter->second), resource,
+                            resource.size);
+    }
 
-            if (imageIter->second.ObjectInfo.Image.needsStagingBuffer) {
-                StagingInfo stagingInfo = createStagingBuffer(device, commandPool, commandBuffer,
-                                                              (queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED) ? 0 : queueFamilyIndex,
-                                                              imageIter->second.ObjectInfo.Image.memorySize);
+    for (auto bufferIter = s_trimStateTrackerSnapshot.createdBuffers.begin();
+         bufferIter != s_trimStateTrackerSnapshot.createdBuffers.end(); bufferIter++) {
+        // Similiar with image handling, skip the buffer if it is not bound
+        // to any memory.
+        if ((bufferIter->second.ObjectInfo.Buffer.pBindBufferMemoryPacket == nullptr) ||
+            (bufferIter->second.ObjectInfo.Buffer.size == 0)) {
+            continue;
+        }
 
-                // From Docs: srcImage must have a sample count equal to
-                // VK_SAMPLE_COUNT_1_BIT
-                // From Docs: srcImage must have been created with
-                // VK_IMAGE_USAGE_TRANSFER_SRC_BIT usage flag
+        SnapshotResource resource;
+        resource.buffer = bufferIter->first;
+        resource.pInfo = &bufferIter->second;
+        resource.needsStagingBuffer = bufferIter->second.ObjectInfo.Buffer.needsStagingBuffer;
+        resource.size = ROUNDUP_TO_4(bufferIter->second.ObjectInfo.Buffer.size);
+        addSnapshotResource(batches, openBatches, bufferIter->second.belongsToDevice,
+                            bufferIter->second.ObjectInfo.Buffer.queueFamilyIndex, resource, resource.size);
+    }
 
-                // Copy from device_local image to host_visible buffer
+    return batches;
+}
 
-                VkImageAspectFlags aspectMask = imageIter->second.ObjectInfo.Image.aspectMask;
-                if (aspectMask == (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT)) {
-                    stagingInfo.imageCopyRegions.reserve(2);
+//=========================================================================
+// Creates the batch's staging buffer, command buffers and fence, records the
+// transitions and copies of every resource in the batch and submits them.
+//=========================================================================
+void submitSnapshotBatch(SnapshotBatch &batch) {
+    VkDevice device = batch.device;
 
-                    // First depth, then stencil
-                    VkImageSubresource sub;
-                    sub.arrayLayer = 0;
-                    sub.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-                    sub.mipLevel = 0;
-                    {
-                        VkSubresourceLayout layout;
-                        mdd(device)->devTable.GetImageSubresourceLayout(device, image, &sub, &layout);
-
-                        VkBufferImageCopy copyRegion = {};
-
-                        copyRegion.bufferRowLength = 0;
-                        copyRegion.bufferImageHeight = 0;
-                        // On some platform, originally set to layout.rowPitch and layout.arrayPitch
-                        // cause write outside of staging buffer memory size and hang at following
-                        // queue submission in other frames after finish trim starting process when
-                        // trim some titles.
-                        //
-                        // Here we set bufferRowLength and bufferImageHeight to 0 make the image
-                        // copy to be tightly packed according to the imageExtent, the change fix
-                        // the above problem.
-                        //
-                        // Although bufferRowLength,bufferImageHeight can be set to greater than
-                        // the width and height member of imageExtent, but because we allocate memory
-                        // for the staging buffer by image memory size and here we copy whole image,
-                        // so greater than imageExtent take a risk that the copy beyond the staging
-                        // buffer memory size.
-
-                        copyRegion.bufferOffset = layout.offset;
-                        copyRegion.imageExtent.depth = 1;
-                        copyRegion.imageExtent.width = imageIter->second.ObjectInfo.Image.extent.width;
-                        copyRegion.imageExtent.height = imageIter->second.ObjectInfo.Image.extent.height;
-                        copyRegion.imageOffset.x = 0;
-                        copyRegion.imageOffset.y = 0;
-                        copyRegion.imageOffset.z = 0;
-                        copyRegion.imageSubresource.aspectMask = sub.aspectMask;
-                        copyRegion.imageSubresource.baseArrayLayer = 0;
-                        copyRegion.imageSubresource.layerCount = imageIter->second.ObjectInfo.Image.arrayLayers;
-                        copyRegion.imageSubresource.mipLevel = 0;
-
-                        stagingInfo.imageCopyRegions.push_back(copyRegion);
-                    }
+    batch.queue = trim::get_DeviceQueue(device, batch.queueFamilyIndex, 0);
+    assert(batch.queue != VK_NULL_HANDLE);
+    if (batch.queue == VK_NULL_HANDLE) return;
 
-                    sub.aspectMask = VK_IMAGE_ASPECT_STENCIL_BIT;
-                    {
-                        VkSubresourceLayout layout;
-                        mdd(device)->devTable.GetImageSubresourceLayout(device, image, &sub, &layout);
-
-                        VkBufferImageCopy copyRegion;
-
-                        copyRegion.bufferRowLength = 0;
-                        copyRegion.bufferImageHeight = 0;
-                        // set bufferRowLength and bufferImageHeight to 0 make the image
-                        // copy to be tightly packed according to the imageExtent.
-
-                        copyRegion.bufferOffset = layout.offset;
-                        copyRegion.imageExtent.depth = 1;
-                        copyRegion.imageExtent.width = imageIter->second.ObjectInfo.Image.extent.width;
-                        copyRegion.imageExtent.height = imageIter->second.ObjectInfo.Image.extent.height;
-                        copyRegion.imageOffset.x = 0;
-                        copyRegion.imageOffset.y = 0;
-                        copyRegion.imageOffset.z = 0;
-                        copyRegion.imageSubresource.aspectMask = sub.aspectMask;
-                        copyRegion.imageSubresource.baseArrayLayer = 0;
-                        copyRegion.imageSubresource.layerCount = imageIter->second.ObjectInfo.Image.arrayLayers;
-                        copyRegion.imageSubresource.mipLevel = 0;
-
-                        stagingInfo.imageCopyRegions.push_back(copyRegion);
-                    }
-                } else {
-                    VkImageSubresource sub;
-                    sub.arrayLayer = 0;
-                    sub.aspectMask = aspectMask;
-                    sub.mipLevel = 0;
-
-                    // need to make a VkBufferImageCopy for each mip level
-                    stagingInfo.imageCopyRegions.reserve(imageIter->second.ObjectInfo.Image.mipLevels);
-                    for (uint32_t i = 0; i < imageIter->second.ObjectInfo.Image.mipLevels; i++) {
-                        VkSubresourceLayout lay;
-                        sub.mipLevel = i;
-                        mdd(device)->devTable.GetImageSubresourceLayout(device, image, &sub, &lay);
-
-                        VkBufferImageCopy copyRegion;
-                        copyRegion.bufferRowLength = 0;    //< tightly packed texels
-                        copyRegion.bufferImageHeight = 0;  //< tightly packed texels
-                        copyRegion.bufferOffset = lay.offset;
-                        copyRegion.imageExtent.depth = 1;
-                        copyRegion.imageExtent.width = (imageIter->second.ObjectInfo.Image.extent.width >> i);
-                        copyRegion.imageExtent.height = (imageIter->second.ObjectInfo.Image.extent.height >> i);
-                        copyRegion.imageOffset.x = 0;
-                        copyRegion.imageOffset.y = 0;
-                        copyRegion.imageOffset.z = 0;
-                        copyRegion.imageSubresource.aspectMask = aspectMask;
-                        copyRegion.imageSubresource.baseArrayLayer = 0;
-                        copyRegion.imageSubresource.layerCount = imageIter->second.ObjectInfo.Image.arrayLayers;
-                        copyRegion.imageSubresource.mipLevel = i;
-
-                        stagingInfo.imageCopyRegions.push_back(copyRegion);
-                    }
+    batch.commandPool = getCommandPoolFromDevice(device, batch.queueFamilyIndex);
+
+    if (batch.stagingSize != 0) {
+        VkBufferCreateInfo bufferCreateInfo = {};
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.size = batch.stagingSize;
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkResult result = mdd(device)->devTable.CreateBuffer(device, &bufferCreateInfo, NULL, &batch.stagingBuffer);
+        assert(result == VK_SUCCESS);
+        if (result != VK_SUCCESS) return;
+
+        VkMemoryRequirements memoryRequirements;
+        mdd(device)->devTable.GetBufferMemoryRequirements(device, batch.stagingBuffer, &memoryRequirements);
+
+        VkMemoryAllocateInfo memoryAllocateInfo;
+        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memoryAllocateInfo.pNext = NULL;
+        memoryAllocateInfo.allocationSize = memoryRequirements.size;
+        memoryAllocateInfo.memoryTypeIndex =
+            FindMemoryTypeIndex(device, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        result = mdd(device)->devTable.AllocateMemory(device, &memoryAllocateInfo, NULL, &batch.stagingMemory);
+        assert(result == VK_SUCCESS);
+        if (result != VK_SUCCESS) return;
+
+        mdd(device)->devTable.BindBufferMemory(device, batch.stagingBuffer, batch.stagingMemory, 0);
+    }
+
+    VkCommandBufferAllocateInfo allocateInfo;
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.pNext = NULL;
+    allocateInfo.commandPool = batch.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 2;
+    VkResult result = mdd(device)->devTable.AllocateCommandBuffers(device, &allocateInfo, batch.commandBuffers);
+    assert(result == VK_SUCCESS);
+    if (result != VK_SUCCESS) {
+        batch.commandBuffers[0] = VK_NULL_HANDLE;
+        batch.commandBuffers[1] = VK_NULL_HANDLE;
+        return;
+    }
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    result = mdd(device)->devTable.CreateFence(device, &fenceCreateInfo, NULL, &batch.fence);
+    assert(result == VK_SUCCESS);
+    if (result != VK_SUCCESS) return;
+
+    VkCommandBuffer commandBuffer = batch.commandBuffers[0];
+    VkCommandBufferBeginInfo commandBufferBeginInfo;
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.pNext = NULL;
+    commandBufferBeginInfo.pInheritanceInfo = NULL;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    result = mdd(device)->devTable.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+    assert(result == VK_SUCCESS);
+    if (result != VK_SUCCESS) return;
+
+    for (auto &resource : batch.resources) {
+        if (resource.image != VK_NULL_HANDLE) {
+            VkImage image = resource.image;
+            const ObjectInfo &imageInfo = *resource.pInfo;
+            uint32_t queueFamilyIndex = getImageBarrierQueueFamilyIndex(imageInfo);
+
+            if (resource.needsStagingBuffer) {
+                // The staging info keeps the regions relative to a staging buffer
+                // of the image's own, which is what replay will create.
+                StagingInfo stagingInfo = createStagingInfo(batch, imageInfo.ObjectInfo.Image.memorySize);
+                stagingInfo.imageCopyRegions = getImageCopyRegions(device, image, imageInfo);
+
+                std::vector<VkBufferImageCopy> batchCopyRegions = stagingInfo.imageCopyRegions;
+                for (auto &copyRegion : batchCopyRegions) {
+                    copyRegion.bufferOffset += resource.stagingOffset;
                 }
 
                 // From docs: srcImageLayout must specify the layout of the image
@@ -1083,380 +1339,337 @@ void snapshot_state_tracker() {
                 // command is executed on a VkDevice
                 // From docs: srcImageLayout must be either of
                 // VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL or VK_IMAGE_LAYOUT_GENERAL
-                VkImageLayout srcImageLayout = imageIter->second.ObjectInfo.Image.mostRecentLayout;
+                VkImageLayout srcImageLayout = imageInfo.ObjectInfo.Image.mostRecentLayout;
 
                 // Transition the image so that it's in an optimal transfer source
                 // layout.
-                transitionImage(device, commandBuffer, image, imageIter->second.ObjectInfo.Image.accessFlags,
-                                imageIter->second.ObjectInfo.Image.accessFlags, queueFamilyIndex, srcImageLayout,
-                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, aspectMask, imageIter->second.ObjectInfo.Image.arrayLayers,
-                                imageIter->second.ObjectInfo.Image.mipLevels);
+                transitionImage(device, commandBuffer, image, imageInfo.ObjectInfo.Image.accessFlags,
+                                imageInfo.ObjectInfo.Image.accessFlags, queueFamilyIndex, srcImageLayout,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, imageInfo.ObjectInfo.Image.aspectMask,
+                                imageInfo.ObjectInfo.Image.arrayLayers, imageInfo.ObjectInfo.Image.mipLevels);
 
-                mdd(device)->devTable.CmdCopyImageToBuffer(
-                    commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingInfo.buffer,
-                    static_cast<uint32_t>(stagingInfo.imageCopyRegions.size()), stagingInfo.imageCopyRegions.data());
+                mdd(device)->devTable.CmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                                           batch.stagingBuffer, static_cast<uint32_t>(batchCopyRegions.size()),
+                                                           batchCopyRegions.data());
 
                 // save the staging info for later
                 s_imageToStagedInfoMap[image] = stagingInfo;
 
                 // now that the image data is in a host-readable buffer
                 // transition image back to it's previous layout
-                transitionImage(device, commandBuffer, image, imageIter->second.ObjectInfo.Image.accessFlags,
-                                imageIter->second.ObjectInfo.Image.accessFlags, queueFamilyIndex,
-                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, srcImageLayout, aspectMask,
-                                imageIter->second.ObjectInfo.Image.arrayLayers, imageIter->second.ObjectInfo.Image.mipLevels);
+                transitionImage(device, commandBuffer, image, imageInfo.ObjectInfo.Image.accessFlags,
+                                imageInfo.ObjectInfo.Image.accessFlags, queueFamilyIndex, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                srcImageLayout, imageInfo.ObjectInfo.Image.aspectMask, imageInfo.ObjectInfo.Image.arrayLayers,
+                                imageInfo.ObjectInfo.Image.mipLevels);
             } else {
                 // Create a pipeline barrier to make it host readable
-                transitionImage(device, commandBuffer, image, imageIter->second.ObjectInfo.Image.accessFlags,
-                                VK_ACCESS_HOST_READ_BIT, queueFamilyIndex, imageIter->second.ObjectInfo.Image.mostRecentLayout,
-                                imageIter->second.ObjectInfo.Image.mostRecentLayout, imageIter->second.ObjectInfo.Image.aspectMask,
-                                imageIter->second.ObjectInfo.Image.arrayLayers, imageIter->second.ObjectInfo.Image.mipLevels);
+                transitionImage(device, commandBuffer, image, imageInfo.ObjectInfo.Image.accessFlags, VK_ACCESS_HOST_READ_BIT,
+                                queueFamilyIndex, imageInfo.ObjectInfo.Image.mostRecentLayout,
+                                imageInfo.ObjectInfo.Image.mostRecentLayout, imageInfo.ObjectInfo.Image.aspectMask,
+                                imageInfo.ObjectInfo.Image.arrayLayers, imageInfo.ObjectInfo.Image.mipLevels);
             }
+        } else {
+            VkBuffer buffer = resource.buffer;
+            const ObjectInfo &bufferInfo = *resource.pInfo;
 
-            // End the CommandBuffer
-            mdd(device)->devTable.EndCommandBuffer(commandBuffer);
-
-            // now submit the command buffer
-            VkSubmitInfo submitInfo;
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.pNext = NULL;
-            submitInfo.waitSemaphoreCount = 0;
-            submitInfo.pWaitSemaphores = NULL;
-            submitInfo.pWaitDstStageMask = NULL;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &commandBuffer;
-            submitInfo.signalSemaphoreCount = 0;
-            submitInfo.pSignalSemaphores = NULL;
-
-            // Submit the queue and wait for it to complete
-            VkQueue queue = trim::get_DeviceQueue(device, queueFamilyIndex, 0);
-
-            mdd(device)->devTable.QueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-            VkResult waitResult = mdd(device)->devTable.QueueWaitIdle(queue);
-            assert(waitResult == VK_SUCCESS);
-            if (waitResult != VK_SUCCESS) continue;
-
-            // 2a) Map, copy, unmap the image.
-            device = imageIter->second.belongsToDevice;
-            image = imageIter->first;
-
-            VkDeviceMemory memory = imageIter->second.ObjectInfo.Image.memory;
-            VkDeviceSize offset = imageIter->second.ObjectInfo.Image.memoryOffset;
-            VkDeviceSize size = ROUNDUP_TO_4(imageIter->second.ObjectInfo.Image.memorySize);
-
-            if (imageIter->second.ObjectInfo.Image.needsStagingBuffer) {
-                // Note that the staged memory object won't be in the state tracker,
-                // so we want to swap out the buffer and memory
-                // that will be mapped / unmapped.
-                StagingInfo staged = s_imageToStagedInfoMap[image];
-                memory = staged.memory;
-                offset = 0;
-
-                void *mappedAddress = NULL;
-
-                if (size != 0) {
-                    generateMapUnmap(true, device, memory, offset, size, 0, mappedAddress,
-                                     &imageIter->second.ObjectInfo.Image.pMapMemoryPacket,
-                                     &imageIter->second.ObjectInfo.Image.pUnmapMemoryPacket);
-                }
-            } else {
-                auto memoryIter = s_trimStateTrackerSnapshot.createdDeviceMemorys.find(memory);
-
-                if (memoryIter != s_trimStateTrackerSnapshot.createdDeviceMemorys.end()) {
-                    void *mappedAddress = memoryIter->second.ObjectInfo.DeviceMemory.mappedAddress;
-                    VkDeviceSize mappedOffset = memoryIter->second.ObjectInfo.DeviceMemory.mappedOffset;
-                    VkDeviceSize mappedSize = memoryIter->second.ObjectInfo.DeviceMemory.mappedSize;
-
-                    if (size != 0) {
-                        // actually map the memory if it was not already mapped.
-                        bool bAlreadyMapped = (mappedAddress != NULL);
-                        if (bAlreadyMapped) {
-                            // I imagine there could be a scenario where the
-                            // application has persistently
-                            // mapped PART of the memory, which may not contain the
-                            // image that we're trying to copy right now.
-                            // In that case, there will be errors due to this code.
-                            // We know the range of memory that is mapped
-                            // so we should be able to confirm whether or not we get
-                            // into this situation.
-                            bAlreadyMapped = (offset >= mappedOffset && (offset + size) <= (mappedOffset + mappedSize));
-                        }
+            // If the buffer needs a staging buffer, it's because it's on
+            // DEVICE_LOCAL memory that is not HOST_VISIBLE.
+            // So we have to copy the data from the DEVICE_LOCAL memory into
+            // HOST_VISIBLE memory, then map / unmap the HOST_VISIBLE memory.
+            // The staging info is kept so that we can generate similar calls in the
+            // trace file in order to recreate the DEVICE_LOCAL buffer.
+            if (resource.needsStagingBuffer) {
+                StagingInfo stagingInfo = createStagingInfo(batch, bufferInfo.ObjectInfo.Buffer.size);
 
-                        generateMapUnmap(!bAlreadyMapped, device, memory, offset, size, 0, mappedAddress,
-                                         &imageIter->second.ObjectInfo.Image.pMapMemoryPacket,
-                                         &imageIter->second.ObjectInfo.Image.pUnmapMemoryPacket);
-                    }
-                }
-            }
+                // Copy from device_local buffer to host_visible buffer
+                stagingInfo.copyRegion.srcOffset = 0;
+                stagingInfo.copyRegion.dstOffset = 0;
+                stagingInfo.copyRegion.size = bufferInfo.ObjectInfo.Buffer.size;
 
-            // 3a) Transition the image back to their previous state.
-            device = imageIter->second.belongsToDevice;
-            image = imageIter->first;
+                VkBufferCopy batchCopyRegion = stagingInfo.copyRegion;
+                batchCopyRegion.dstOffset = resource.stagingOffset;
 
-            queueFamilyIndex = imageIter->second.ObjectInfo.Image.queueFamilyIndex;
+                transitionBuffer(device, commandBuffer, buffer, VK_ACCESS_FLAG_BITS_MAX_ENUM, VK_ACCESS_TRANSFER_READ_BIT, 0,
+                                 bufferInfo.ObjectInfo.Buffer.size, true);
+                mdd(device)->devTable.CmdCopyBuffer(commandBuffer, buffer, batch.stagingBuffer, 1, &batchCopyRegion);
+                transitionBuffer(device, commandBuffer, buffer, VK_ACCESS_TRANSFER_READ_BIT,
+                                 bufferInfo.ObjectInfo.Buffer.accessFlags, 0, bufferInfo.ObjectInfo.Buffer.size, true);
 
-            if (imageIter->second.ObjectInfo.Image.sharingMode == VK_SHARING_MODE_CONCURRENT) {
-                queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                // save the staging info for later
+                s_bufferToStagedInfoMap[buffer] = stagingInfo;
+            } else {
+                transitionBuffer(device, commandBuffer, buffer, bufferInfo.ObjectInfo.Buffer.accessFlags, VK_ACCESS_HOST_READ_BIT,
+                                 0, bufferInfo.ObjectInfo.Buffer.size);
             }
+        }
+    }
 
-            commandPool = getCommandPoolFromDevice(device, queueFamilyIndex);
-            commandBuffer = getCommandBufferFromDevice(device, commandPool);
-
-            // Begin the command buffer
-            memset(reinterpret_cast<void *>(&commandBufferBeginInfo), 0, sizeof(VkCommandBufferBeginInfo));
-            commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            commandBufferBeginInfo.pNext = NULL;
-            commandBufferBeginInfo.pInheritanceInfo = NULL;
-            commandBufferBeginInfo.flags = 0;
-            result = mdd(device)->devTable.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-            assert(result == VK_SUCCESS);
-            if (result != VK_SUCCESS) continue;
+    mdd(device)->devTable.EndCommandBuffer(commandBuffer);
 
-            // only need to restore the images that did NOT need a staging buffer
-            if (imageIter->second.ObjectInfo.Image.needsStagingBuffer) {
-                // delete the staging objects
-                StagingInfo staged = s_imageToStagedInfoMap[image];
-                mdd(device)->devTable.DestroyBuffer(device, staged.buffer, NULL);
-                mdd(device)->devTable.FreeMemory(device, staged.memory, NULL);
-            } else {
-                transitionImage(device, commandBuffer, image, VK_ACCESS_HOST_READ_BIT,
-                                imageIter->second.ObjectInfo.Image.accessFlags, queueFamilyIndex,
-                                imageIter->second.ObjectInfo.Image.mostRecentLayout,
-                                imageIter->second.ObjectInfo.Image.mostRecentLayout, imageIter->second.ObjectInfo.Image.aspectMask,
-                                imageIter->second.ObjectInfo.Image.arrayLayers, imageIter->second.ObjectInfo.Image.mipLevels);
-            }
+    VkSubmitInfo submitInfo;
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = NULL;
+    submitInfo.waitSemaphoreCount = 0;
+    submitInfo.pWaitSemaphores = NULL;
+    submitInfo.pWaitDstStageMask = NULL;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 0;
+    submitInfo.pSignalSemaphores = NULL;
 
-            // End the CommandBuffer
-            mdd(device)->devTable.EndCommandBuffer(commandBuffer);
+    result = mdd(device)->devTable.QueueSubmit(batch.queue, 1, &submitInfo, batch.fence);
+    assert(result == VK_SUCCESS);
+    batch.submitted = (result == VK_SUCCESS);
+}
 
-            // now submit the command buffer
-            memset(reinterpret_cast<void *>(&submitInfo), 0, sizeof(VkSubmitInfo));
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.pNext = NULL;
-            submitInfo.waitSemaphoreCount = 0;
-            submitInfo.pWaitSemaphores = NULL;
-            submitInfo.pWaitDstStageMask = NULL;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &commandBuffer;
-            submitInfo.signalSemaphoreCount = 0;
-            submitInfo.pSignalSemaphores = NULL;
+//=========================================================================
+// Waits for the batch's copies, then captures the contents of its resources
+// into map / unmap packets. Packets for resources in the staging buffer are
+// generated on the worker pool; resources read in place are mapped here and
+// then transitioned back to their previous state.
+//=========================================================================
+void readSnapshotBatch(SnapshotBatch &batch, SnapshotWorkerPool &workerPool) {
+    VkDevice device = batch.device;
 
-            // Submit the queue and wait for it to complete
-            queue = trim::get_DeviceQueue(device, queueFamilyIndex, 0);
+    VkResult waitResult = mdd(device)->devTable.WaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    assert(waitResult == VK_SUCCESS);
+    if (waitResult != VK_SUCCESS) return;
 
-            mdd(device)->devTable.QueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-            waitResult = mdd(device)->devTable.QueueWaitIdle(queue);
-            assert(waitResult == VK_SUCCESS);
+    if (batch.stagingMemory != VK_NULL_HANDLE) {
+        void *pStagingData = NULL;
+        VkResult result =
+            mdd(device)->devTable.MapMemory(device, batch.stagingMemory, 0, VK_WHOLE_SIZE, 0, &pStagingData);
+        assert(result == VK_SUCCESS);
+        if (result == VK_SUCCESS) {
+            batch.pStagingData = static_cast<uint8_t *>(pStagingData);
+
+            // The staging memory is only required to be HOST_VISIBLE
+            VkMappedMemoryRange range = {};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = batch.stagingMemory;
+            range.offset = 0;
+            range.size = VK_WHOLE_SIZE;
+            mdd(device)->devTable.InvalidateMappedMemoryRanges(device, 1, &range);
         }
     }
 
-    // b) Dump all buffers, the process include the following sub-process:
-    //    1b) Transition the buffer into host - readable state.
-    //    2b) Map, copy, unmap the buffer.
-    //    3b) Transition the buffer back to their previous state.
-    for (auto bufferIter = s_trimStateTrackerSnapshot.createdBuffers.begin();
-         bufferIter != s_trimStateTrackerSnapshot.createdBuffers.end(); bufferIter++) {
-        VkDevice device = bufferIter->second.belongsToDevice;
-        VkBuffer buffer = static_cast<VkBuffer>(bufferIter->first);
+    VkCommandBuffer commandBuffer = batch.commandBuffers[1];
+    bool recordedRestore = false;
+    vktrace_thread_id threadId = vktrace_platform_get_thread_id();
 
-        if ((bufferIter->second.ObjectInfo.Buffer.pBindBufferMemoryPacket != nullptr) &&
-            (bufferIter->second.ObjectInfo.Buffer.size != 0)) {
-            // Similiar with image handling, skip the following process
-            // if the buffer is not bound to any memory.
+    for (auto &resource : batch.resources) {
+        bool isImage = (resource.image != VK_NULL_HANDLE);
+        vktrace_trace_packet_header **ppMapMemoryPacket =
+            isImage ? &resource.pInfo->ObjectInfo.Image.pMapMemoryPacket : &resource.pInfo->ObjectInfo.Buffer.pMapMemoryPacket;
+        vktrace_trace_packet_header **ppUnmapMemoryPacket = isImage ? &resource.pInfo->ObjectInfo.Image.pUnmapMemoryPacket
+                                                                    : &resource.pInfo->ObjectInfo.Buffer.pUnmapMemoryPacket;
 
-            // 1b) Transition the buffer into host-readable state.
+        if (resource.needsStagingBuffer) {
+            if (batch.pStagingData == NULL || resource.size == 0) {
+                continue;
+            }
 
-            uint32_t queueFamilyIndex = bufferIter->second.ObjectInfo.Buffer.queueFamilyIndex;
+            // Note that the staged memory object won't be in the state tracker,
+            // so the map / unmap is of the staging memory, and is recorded as
+            // if it were the resource's own staging buffer.
+            VkDeviceMemory memory = batch.stagingMemory;
+            VkDeviceSize size = resource.size;
+            void *pData = batch.pStagingData + resource.stagingOffset;
+            workerPool.submit([device, memory, size, pData, ppMapMemoryPacket, ppUnmapMemoryPacket, threadId]() {
+                generateMapUnmap(false, device, memory, 0, size, 0, pData, ppMapMemoryPacket, ppUnmapMemoryPacket);
+
+                // keep the packets attributed to the thread that started trimming
+                if (*ppMapMemoryPacket != NULL) {
+                    (*ppMapMemoryPacket)->thread_id = threadId;
+                }
+                if (*ppUnmapMemoryPacket != NULL) {
+                    (*ppUnmapMemoryPacket)->thread_id = threadId;
+                }
+            });
+            continue;
+        }
 
-            VkCommandPool commandPool = getCommandPoolFromDevice(device, queueFamilyIndex);
-            VkCommandBuffer commandBuffer = getCommandBufferFromDevice(device, commandPool);
+        VkDeviceMemory memory = isImage ? resource.pInfo->ObjectInfo.Image.memory : resource.pInfo->ObjectInfo.Buffer.memory;
+        VkDeviceSize offset =
+            isImage ? resource.pInfo->ObjectInfo.Image.memoryOffset : resource.pInfo->ObjectInfo.Buffer.memoryOffset;
+        VkDeviceSize size = resource.size;
+
+        auto memoryIter = s_trimStateTrackerSnapshot.createdDeviceMemorys.find(memory);
+        if (memoryIter != s_trimStateTrackerSnapshot.createdDeviceMemorys.end() && size != 0) {
+            void *mappedAddress = memoryIter->second.ObjectInfo.DeviceMemory.mappedAddress;
+            VkDeviceSize mappedOffset = memoryIter->second.ObjectInfo.DeviceMemory.mappedOffset;
+            VkDeviceSize mappedSize = memoryIter->second.ObjectInfo.DeviceMemory.mappedSize;
+
+            // actually map the memory if it was not already mapped.
+            bool bAlreadyMapped = (mappedAddress != NULL);
+            if (bAlreadyMapped) {
+                // I imagine there could be a scenario where the application has
+                // persistently mapped PART of the memory, which may not contain
+                // the resource that we're trying to copy right now.
+                // In that case, there will be errors due to this code. We know
+                // the range of memory that is mapped so we should be able to
+                // confirm whether or not we get into this situation.
+                bAlreadyMapped = (offset >= mappedOffset && (offset + size) <= (mappedOffset + mappedSize));
+            }
 
-            // Begin the command buffer
+            generateMapUnmap(!bAlreadyMapped, device, memory, offset, size, 0, mappedAddress, ppMapMemoryPacket,
+                             ppUnmapMemoryPacket);
+        }
+
+        // Transition the resource back to its previous state.
+        if (!recordedRestore) {
             VkCommandBufferBeginInfo commandBufferBeginInfo;
             commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
             commandBufferBeginInfo.pNext = NULL;
             commandBufferBeginInfo.pInheritanceInfo = NULL;
-            commandBufferBeginInfo.flags = 0;
+            commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
             VkResult result = mdd(device)->devTable.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
             assert(result == VK_SUCCESS);
             if (result != VK_SUCCESS) continue;
+            recordedRestore = true;
+        }
 
-            // If the buffer needs a staging buffer, it's because it's on
-            // DEVICE_LOCAL memory that is not HOST_VISIBLE.
-            // So we have to create another buffer and memory that IS HOST_VISIBLE
-            // so that we can copy the data
-            // from the DEVICE_LOCAL memory into HOST_VISIBLE memory, then map /
-            // unmap the HOST_VISIBLE memory object.
-            // The staging info is kept so that we can generate similar calls in the
-            // trace file in order to recreate
-            // the DEVICE_LOCAL buffer.
-            if (bufferIter->second.ObjectInfo.Buffer.needsStagingBuffer) {
-                StagingInfo stagingInfo = createStagingBuffer(device, commandPool, commandBuffer, queueFamilyIndex,
-                                                              bufferIter->second.ObjectInfo.Buffer.size);
-
-                // Copy from device_local buffer to host_visible buffer
-                stagingInfo.copyRegion.srcOffset = 0;
-                stagingInfo.copyRegion.dstOffset = 0;
-                stagingInfo.copyRegion.size = bufferIter->second.ObjectInfo.Buffer.size;
-
-                transitionBuffer(device, commandBuffer, buffer, VK_ACCESS_FLAG_BITS_MAX_ENUM, VK_ACCESS_TRANSFER_READ_BIT, 0,
-                                 bufferIter->second.ObjectInfo.Buffer.size, true);
-                mdd(device)->devTable.CmdCopyBuffer(commandBuffer, buffer, stagingInfo.buffer, 1, &stagingInfo.copyRegion);
-                transitionBuffer(device, commandBuffer, buffer, VK_ACCESS_TRANSFER_READ_BIT,
-                                 bufferIter->second.ObjectInfo.Buffer.accessFlags, 0, bufferIter->second.ObjectInfo.Buffer.size,
-                                 true);
+        if (isImage) {
+            const ObjectInfo &imageInfo = *resource.pInfo;
+            transitionImage(device, commandBuffer, resource.image, VK_ACCESS_HOST_READ_BIT, imageInfo.ObjectInfo.Image.accessFlags,
+                            getImageBarrierQueueFamilyIndex(imageInfo), imageInfo.ObjectInfo.Image.mostRecentLayout,
+                            imageInfo.ObjectInfo.Image.mostRecentLayout, imageInfo.ObjectInfo.Image.aspectMask,
+                            imageInfo.ObjectInfo.Image.arrayLayers, imageInfo.ObjectInfo.Image.mipLevels);
+        } else {
+            const ObjectInfo &bufferInfo = *resource.pInfo;
+            transitionBuffer(device, commandBuffer, resource.buffer, VK_ACCESS_HOST_READ_BIT,
+                             bufferInfo.ObjectInfo.Buffer.accessFlags, 0, bufferInfo.ObjectInfo.Buffer.size);
+        }
+    }
 
-                // save the staging info for later
-                s_bufferToStagedInfoMap[buffer] = stagingInfo;
-            } else {
-                transitionBuffer(device, commandBuffer, buffer, bufferIter->second.ObjectInfo.Buffer.accessFlags,
-                                 VK_ACCESS_HOST_READ_BIT, 0, bufferIter->second.ObjectInfo.Buffer.size);
-            }
+    if (recordedRestore) {
+        mdd(device)->devTable.EndCommandBuffer(commandBuffer);
 
-            // TODO: LESS THAN IDEAL TO END & SUBMIT these super small command buffers
-            // End the CommandBuffer
-            mdd(device)->devTable.EndCommandBuffer(commandBuffer);
+        VkSubmitInfo submitInfo;
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = NULL;
+        submitInfo.waitSemaphoreCount = 0;
+        submitInfo.pWaitSemaphores = NULL;
+        submitInfo.pWaitDstStageMask = NULL;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = 0;
+        submitInfo.pSignalSemaphores = NULL;
 
-            // now submit the command buffer
-            VkSubmitInfo submitInfo;
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.pNext = NULL;
-            submitInfo.waitSemaphoreCount = 0;
-            submitInfo.pWaitSemaphores = NULL;
-            submitInfo.pWaitDstStageMask = NULL;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &commandBuffer;
-            submitInfo.signalSemaphoreCount = 0;
-            submitInfo.pSignalSemaphores = NULL;
+        // The fence now signals when the restore is done; releaseSnapshotBatch() waits for it.
+        mdd(device)->devTable.ResetFences(device, 1, &batch.fence);
+        VkResult result = mdd(device)->devTable.QueueSubmit(batch.queue, 1, &submitInfo, batch.fence);
+        assert(result == VK_SUCCESS);
+    }
+}
 
-            // Submit the queue and wait for it to complete
-            VkQueue queue = trim::get_DeviceQueue(device, queueFamilyIndex, 0);
+//=========================================================================
+// Frees everything that submitSnapshotBatch() created once the GPU is done
+// with it. The worker pool must not have packets of this batch pending.
+//=========================================================================
+void releaseSnapshotBatch(SnapshotBatch &batch) {
+    VkDevice device = batch.device;
+    if (device == VK_NULL_HANDLE) return;
 
-            mdd(device)->devTable.QueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-            VkResult waitResult = mdd(device)->devTable.QueueWaitIdle(queue);
+    if (batch.fence != VK_NULL_HANDLE) {
+        if (batch.submitted) {
+            VkResult waitResult = mdd(device)->devTable.WaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
             assert(waitResult == VK_SUCCESS);
-            if (waitResult != VK_SUCCESS) continue;
+        }
+        mdd(device)->devTable.DestroyFence(device, batch.fence, NULL);
+        batch.fence = VK_NULL_HANDLE;
+    }
 
-            // 2b) Map, copy, unmap the buffer.
+    if (batch.commandBuffers[0] != VK_NULL_HANDLE) {
+        mdd(device)->devTable.FreeCommandBuffers(device, batch.commandPool, 2, batch.commandBuffers);
+        batch.commandBuffers[0] = VK_NULL_HANDLE;
+        batch.commandBuffers[1] = VK_NULL_HANDLE;
+    }
 
-            device = bufferIter->second.belongsToDevice;
-            buffer = bufferIter->first;
+    if (batch.pStagingData != NULL) {
+        mdd(device)->devTable.UnmapMemory(device, batch.stagingMemory);
+        batch.pStagingData = NULL;
+    }
+    if (batch.stagingBuffer != VK_NULL_HANDLE) {
+        mdd(device)->devTable.DestroyBuffer(device, batch.stagingBuffer, NULL);
+        batch.stagingBuffer = VK_NULL_HANDLE;
+    }
+    if (batch.stagingMemory != VK_NULL_HANDLE) {
+        mdd(device)->devTable.FreeMemory(device, batch.stagingMemory, NULL);
+        batch.stagingMemory = VK_NULL_HANDLE;
+    }
+}
 
-            VkDeviceMemory memory = bufferIter->second.ObjectInfo.Buffer.memory;
-            VkDeviceSize offset = bufferIter->second.ObjectInfo.Buffer.memoryOffset;
-            VkDeviceSize size = ROUNDUP_TO_4(bufferIter->second.ObjectInfo.Buffer.size);
+//=============================================================================
+// Use this to snapshot the global state tracker at the start of the trim
+// frames.
+//=============================================================================
+void snapshot_state_tracker() {
+    lockStateTracker();
+    s_trimStateTrackerSnapshot = s_trimGlobalStateTracker;
 
-            void *mappedAddress = NULL;
-            VkDeviceSize mappedOffset = 0;
-            VkDeviceSize mappedSize = 0;
+    //
+    // Copying the contents of all the images and buffers is a lengthy
+    // process, so it is done in batches of resources that share a device
+    // and queue family:
+    //
+    // 1) Record the transitions and copies of every resource in the batch
+    //    into one command buffer and submit it with the batch's fence.
+    //    Resources in DEVICE_LOCAL memory are copied into the batch's
+    //    shared HOST_VISIBLE staging buffer; the others are transitioned
+    //    so that they can be read in place.
+    // 2) Wait for the fence, then generate the map / unmap packets that
+    //    capture the contents. Packets for staged resources are generated
+    //    on a worker pool while the GPU works on the next batch.
+    // 3) Transition the resources that were read in place back to their
+    //    previous state.
+    // 4) Once the batch's packets are generated, free its staging memory,
+    //    command buffers and fence.
+    //
+    // Staging memory is limited to SNAPSHOT_STAGING_BATCH_SIZE per batch and
+    // at most two batches are alive at once, which keeps the number and size
+    // of the allocations trim needs small. Some drivers limit the number of
+    // allocations, and titles that allocate close to that limit would
+    // otherwise hang or fail to allocate memory.
+    std::vector<SnapshotBatch> batches = createSnapshotBatches();
+    {
+        SnapshotWorkerPool workerPool;
+        if (!batches.empty()) {
+            submitSnapshotBatch(batches[0]);
+        }
 
-            if (bufferIter->second.ObjectInfo.Buffer.needsStagingBuffer) {
-                // Note that the staged memory object won't be in the state tracker,
-                // so we want to swap out the buffer and memory
-                // that will be mapped / unmapped.
-                StagingInfo staged = s_bufferToStagedInfoMap[buffer];
-                buffer = staged.buffer;
-                memory = staged.memory;
-                offset = 0;
-            } else {
-                auto memoryIter = s_trimStateTrackerSnapshot.createdDeviceMemorys.find(memory);
-                assert(memoryIter != s_trimStateTrackerSnapshot.createdDeviceMemorys.end());
-                if (memoryIter != s_trimStateTrackerSnapshot.createdDeviceMemorys.end()) {
-                    mappedAddress = memoryIter->second.ObjectInfo.DeviceMemory.mappedAddress;
-                    mappedOffset = memoryIter->second.ObjectInfo.DeviceMemory.mappedOffset;
-                    mappedSize = memoryIter->second.ObjectInfo.DeviceMemory.mappedSize;
-                }
+        for (size_t i = 0; i < batches.size(); i++) {
+            // packets for the previous batch have been generated, so its staging memory can go
+            workerPool.wait();
+            if (i > 0) {
+                releaseSnapshotBatch(batches[i - 1]);
             }
 
-            if (size != 0) {
-                // actually map the memory if it was not already mapped.
-                bool bAlreadyMapped = (mappedAddress != NULL);
-                if (bAlreadyMapped) {
-                    // I imagine there could be a scenario where the application has
-                    // persistently
-                    // mapped PART of the memory, which may not contain the image
-                    // that we're trying to copy right now.
-                    // In that case, there will be errors due to this code. We know
-                    // the range of memory that is mapped
-                    // so we should be able to confirm whether or not we get into
-                    // this situation.
-                    bAlreadyMapped = (offset >= mappedOffset && (offset + size) <= (mappedOffset + mappedSize));
-                }
-
-                generateMapUnmap(!bAlreadyMapped, device, memory, offset, size, 0, mappedAddress,
-                                 &bufferIter->second.ObjectInfo.Buffer.pMapMemoryPacket,
-                                 &bufferIter->second.ObjectInfo.Buffer.pUnmapMemoryPacket);
+            if (batches[i].submitted) {
+                readSnapshotBatch(batches[i], workerPool);
             }
 
-            // 3b) Transition the buffer back to their previous state.
-
-            device = bufferIter->second.belongsToDevice;
-            buffer = static_cast<VkBuffer>(bufferIter->first);
-
-            queueFamilyIndex = bufferIter->second.ObjectInfo.Buffer.queueFamilyIndex;
-
-            commandPool = getCommandPoolFromDevice(device, queueFamilyIndex);
-            commandBuffer = getCommandBufferFromDevice(device, commandPool);
-
-            // Begin the command buffer
-            memset(reinterpret_cast<void *>(&commandBufferBeginInfo), 0, sizeof(VkCommandBufferBeginInfo));
-            commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            commandBufferBeginInfo.pNext = NULL;
-            commandBufferBeginInfo.pInheritanceInfo = NULL;
-            commandBufferBeginInfo.flags = 0;
-            result = mdd(device)->devTable.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-            assert(result == VK_SUCCESS);
-            if (result != VK_SUCCESS) continue;
-
-            if (bufferIter->second.ObjectInfo.Buffer.needsStagingBuffer) {
-                // if this buffer had a staging buffer, then we only need to do
-                // delete the staging objects
-                StagingInfo staged = s_bufferToStagedInfoMap[buffer];
-                mdd(device)->devTable.DestroyBuffer(device, staged.buffer, NULL);
-                mdd(device)->devTable.FreeMemory(device, staged.memory, NULL);
-            } else {
-                transitionBuffer(device, commandBuffer, buffer, VK_ACCESS_HOST_READ_BIT,
-                                 bufferIter->second.ObjectInfo.Buffer.accessFlags, 0, bufferIter->second.ObjectInfo.Buffer.size);
+            // the GPU copies the next batch while the workers generate packets for this one
+            if (i + 1 < batches.size()) {
+                submitSnapshotBatch(batches[i + 1]);
             }
+        }
 
-            // End the CommandBuffer
-            mdd(device)->devTable.EndCommandBuffer(commandBuffer);
-
-            // now submit the command buffer
-            memset(reinterpret_cast<void *>(&submitInfo), 0, sizeof(VkSubmitInfo));
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.pNext = NULL;
-            submitInfo.waitSemaphoreCount = 0;
-            submitInfo.pWaitSemaphores = NULL;
-            submitInfo.pWaitDstStageMask = NULL;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &commandBuffer;
-            submitInfo.signalSemaphoreCount = 0;
-            submitInfo.pSignalSemaphores = NULL;
-
-            // Submit the queue and wait for it to complete
-            queue = trim::get_DeviceQueue(device, queueFamilyIndex, 0);
-
-            mdd(device)->devTable.QueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-            waitResult = mdd(device)->devTable.QueueWaitIdle(queue);
-            assert(waitResult == VK_SUCCESS);
+        workerPool.wait();
+        if (!batches.empty()) {
+            releaseSnapshotBatch(batches.back());
         }
     }
-    // 4) Destroy the command pools / command buffers and fences
-    for (auto deviceIter = s_trimStateTrackerSnapshot.createdDevices.begin();
-         deviceIter != s_trimStateTrackerSnapshot.createdDevices.end(); deviceIter++) {
-        VkDevice device = reinterpret_cast<VkDevice>(deviceIter->first);
-        VkCommandBuffer commandBuffer = getCommandBufferFromDevice(device);
-
-        mdd(device)->devTable.ResetCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
-        s_deviceToCommandBufferMap.erase(device);
 
-        // command pools
-        VkCommandPool commandPool = getCommandPoolFromDevice(device);
-        mdd(device)->devTable.ResetCommandPool(device, commandPool, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
-        mdd(device)->devTable.DestroyCommandPool(device, commandPool, NULL);
-        s_deviceToCommandPoolMap.erase(device);
+    // Destroy the trim-specific command pools
+    for (auto deviceIter = s_deviceToCommandPoolMap.begin(); deviceIter != s_deviceToCommandPoolMap.end(); deviceIter++) {
+        VkDevice device = deviceIter->first;
+        for (auto poolIter = deviceIter->second.begin(); poolIter != deviceIter->second.end(); poolIter++) {
+            mdd(device)->devTable.ResetCommandPool(device, poolIter->second, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+            mdd(device)->devTable.DestroyCommandPool(device, poolIter->second, NULL);
+        }
     }
+    s_deviceToCommandPoolMap.clear();
 
     // Now: generate a vkMapMemory to recreate the persistently mapped buffers
     for (auto iter = s_trimStateTrackerSnapshot.createdDeviceMemorys.begin();
@@ -1481,69 +1694,69 @@ void snapshot_state_tracker() {
         }
     }
 
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockStateTracker();
 }
 
 //=========================================================================
 void add_Image_call(vktrace_trace_packet_header *pHeader) {
     if (pHeader != NULL) {
-        vktrace_enter_critical_section(&trimStateTrackerLock);
+        lockObjectType(StateTrackerLock_Image, true);
         s_trimGlobalStateTracker.add_Image_call(pHeader);
-        vktrace_leave_critical_section(&trimStateTrackerLock);
+        unlockObjectType(StateTrackerLock_Image, true);
     }
 }
 
 //=========================================================================
 ObjectInfo &add_Instance_object(VkInstance var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Instance, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Instance(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Instance, true);
     return info;
 }
 
 //=========================================================================
 void remove_Instance_object(VkInstance var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Instance, true);
     s_trimGlobalStateTracker.remove_Instance(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Instance, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Instance_objectInfo(VkInstance var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Instance, false);
     auto iter = s_trimGlobalStateTracker.createdInstances.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdInstances.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Instance, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_PhysicalDevice_object(VkPhysicalDevice var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PhysicalDevice, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_PhysicalDevice(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PhysicalDevice, true);
     return info;
 }
 
 //=========================================================================
 void remove_PhysicalDevice_object(VkPhysicalDevice var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PhysicalDevice, true);
     s_trimGlobalStateTracker.remove_PhysicalDevice(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PhysicalDevice, true);
 }
 
 //=========================================================================
 ObjectInfo *get_PhysicalDevice_objectInfo(VkPhysicalDevice var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PhysicalDevice, false);
     auto iter = s_trimGlobalStateTracker.createdPhysicalDevices.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdPhysicalDevices.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PhysicalDevice, false);
     return pResult;
 }
 
@@ -1574,9 +1787,9 @@ VkQueue get_DeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t que
 
 //=========================================================================
 ObjectInfo &add_Device_object(VkDevice var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Device, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Device(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Device, true);
     return info;
 }
 
@@ -1808,7 +2021,7 @@ void delete_objects_for_destroy_device(VkDevice device) {
 
 //=========================================================================
 void remove_Device_object(VkDevice var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockStateTracker();
 
     std::vector<VkQueue> queuesToRemove;
     for (auto info = s_trimGlobalStateTracker.createdQueues.begin(); info != s_trimGlobalStateTracker.createdQueues.end(); ++info) {
@@ -1854,665 +2067,665 @@ void remove_Device_object(VkDevice var) {
     }
 
     s_trimGlobalStateTracker.remove_Device(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockStateTracker();
 }
 
 //=========================================================================
 ObjectInfo *get_Device_objectInfo(VkDevice var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Device, false);
     auto iter = s_trimGlobalStateTracker.createdDevices.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdDevices.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Device, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_SurfaceKHR_object(VkSurfaceKHR var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_SurfaceKHR, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_SurfaceKHR(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_SurfaceKHR, true);
     return info;
 }
 
 //=========================================================================
 void remove_SurfaceKHR_object(VkSurfaceKHR var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_SurfaceKHR, true);
     s_trimGlobalStateTracker.remove_SurfaceKHR(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_SurfaceKHR, true);
 }
 
 //=========================================================================
 ObjectInfo *get_SurfaceKHR_objectInfo(VkSurfaceKHR var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_SurfaceKHR, false);
     auto iter = s_trimGlobalStateTracker.createdSurfaceKHRs.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdSurfaceKHRs.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_SurfaceKHR, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Queue_object(VkQueue var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Queue, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Queue(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Queue, true);
     return info;
 }
 
 //=========================================================================
 void remove_Queue_object(const VkQueue var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Queue, true);
     s_trimGlobalStateTracker.remove_Queue(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Queue, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Queue_objectInfo(VkQueue var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Queue, false);
     auto iter = s_trimGlobalStateTracker.createdQueues.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdQueues.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Queue, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_SwapchainKHR_object(VkSwapchainKHR var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_SwapchainKHR, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_SwapchainKHR(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_SwapchainKHR, true);
     return info;
 }
 
 //=========================================================================
 void remove_SwapchainKHR_object(const VkSwapchainKHR var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_SwapchainKHR, true);
     s_trimGlobalStateTracker.remove_SwapchainKHR(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_SwapchainKHR, true);
 }
 
 //=========================================================================
 ObjectInfo *get_SwapchainKHR_objectInfo(VkSwapchainKHR var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_SwapchainKHR, false);
     auto iter = s_trimGlobalStateTracker.createdSwapchainKHRs.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdSwapchainKHRs.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_SwapchainKHR, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_CommandPool_object(VkCommandPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_CommandPool, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_CommandPool(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_CommandPool, true);
     return info;
 }
 
 //=========================================================================
 void remove_CommandPool_object(const VkCommandPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_CommandPool, true);
     s_trimGlobalStateTracker.remove_CommandPool(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_CommandPool, true);
 }
 
 //=========================================================================
 ObjectInfo *get_CommandPool_objectInfo(VkCommandPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_CommandPool, false);
     auto iter = s_trimGlobalStateTracker.createdCommandPools.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdCommandPools.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_CommandPool, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_CommandBuffer_object(VkCommandBuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_CommandBuffer, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_CommandBuffer(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_CommandBuffer, true);
     return info;
 }
 
 //=========================================================================
 void remove_CommandBuffer_object(const VkCommandBuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_CommandBuffer, true);
     s_trimGlobalStateTracker.remove_CommandBuffer(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_CommandBuffer, true);
 }
 
 //=========================================================================
 ObjectInfo *get_CommandBuffer_objectInfo(VkCommandBuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_CommandBuffer, false);
     auto iter = s_trimGlobalStateTracker.createdCommandBuffers.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdCommandBuffers.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_CommandBuffer, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_DeviceMemory_object(VkDeviceMemory var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DeviceMemory, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_DeviceMemory(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DeviceMemory, true);
     return info;
 }
 
 //=========================================================================
 void remove_DeviceMemory_object(const VkDeviceMemory var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DeviceMemory, true);
     s_trimGlobalStateTracker.remove_DeviceMemory(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DeviceMemory, true);
 }
 
 //=========================================================================
 ObjectInfo *get_DeviceMemory_objectInfo(VkDeviceMemory var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DeviceMemory, false);
     auto iter = s_trimGlobalStateTracker.createdDeviceMemorys.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdDeviceMemorys.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DeviceMemory, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_ImageView_object(VkImageView var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_ImageView, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_ImageView(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_ImageView, true);
     return info;
 }
 
 //=========================================================================
 void remove_ImageView_object(const VkImageView var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_ImageView, true);
     s_trimGlobalStateTracker.remove_ImageView(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_ImageView, true);
 }
 
 //=========================================================================
 ObjectInfo *get_ImageView_objectInfo(VkImageView var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_ImageView, false);
     auto iter = s_trimGlobalStateTracker.createdImageViews.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdImageViews.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_ImageView, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Image_object(VkImage var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Image, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Image(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Image, true);
     return info;
 }
 
 //=========================================================================
 void remove_Image_object(const VkImage var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Image, true);
     s_trimGlobalStateTracker.remove_Image(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Image, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Image_objectInfo(VkImage var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Image, false);
     auto iter = s_trimGlobalStateTracker.createdImages.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdImages.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Image, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_BufferView_object(VkBufferView var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_BufferView, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_BufferView(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_BufferView, true);
     return info;
 }
 
 //=========================================================================
 void remove_BufferView_object(const VkBufferView var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_BufferView, true);
     s_trimGlobalStateTracker.remove_BufferView(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_BufferView, true);
 }
 
 //=========================================================================
 ObjectInfo *get_BufferView_objectInfo(VkBufferView var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_BufferView, false);
     auto iter = s_trimGlobalStateTracker.createdBufferViews.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdBufferViews.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_BufferView, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Buffer_object(VkBuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Buffer, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Buffer(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Buffer, true);
     return info;
 }
 
 //=========================================================================
 void remove_Buffer_object(const VkBuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Buffer, true);
     s_trimGlobalStateTracker.remove_Buffer(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Buffer, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Buffer_objectInfo(VkBuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Buffer, false);
     auto iter = s_trimGlobalStateTracker.createdBuffers.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdBuffers.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Buffer, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Sampler_object(VkSampler var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Sampler, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Sampler(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Sampler, true);
     return info;
 }
 
 //=========================================================================
 void remove_Sampler_object(const VkSampler var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Sampler, true);
     s_trimGlobalStateTracker.remove_Sampler(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Sampler, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Sampler_objectInfo(VkSampler var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Sampler, false);
     auto iter = s_trimGlobalStateTracker.createdSamplers.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdSamplers.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Sampler, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_DescriptorSetLayout_object(VkDescriptorSetLayout var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorSetLayout, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_DescriptorSetLayout(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorSetLayout, true);
     return info;
 }
 
 //=========================================================================
 void remove_DescriptorSetLayout_object(VkDescriptorSetLayout var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorSetLayout, true);
     s_trimGlobalStateTracker.remove_DescriptorSetLayout(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorSetLayout, true);
 }
 
 //=========================================================================
 ObjectInfo *get_DescriptorSetLayout_objectInfo(VkDescriptorSetLayout var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorSetLayout, false);
     auto iter = s_trimGlobalStateTracker.createdDescriptorSetLayouts.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdDescriptorSetLayouts.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorSetLayout, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_PipelineLayout_object(VkPipelineLayout var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PipelineLayout, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_PipelineLayout(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PipelineLayout, true);
     return info;
 }
 
 //=========================================================================
 void remove_PipelineLayout_object(const VkPipelineLayout var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PipelineLayout, true);
     s_trimGlobalStateTracker.remove_PipelineLayout(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PipelineLayout, true);
 }
 
 //=========================================================================
 ObjectInfo *get_PipelineLayout_objectInfo(VkPipelineLayout var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PipelineLayout, false);
     auto iter = s_trimGlobalStateTracker.createdPipelineLayouts.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdPipelineLayouts.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PipelineLayout, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_RenderPass_object(VkRenderPass var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_RenderPass, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_RenderPass(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_RenderPass, true);
     return info;
 }
 
 //=========================================================================
 void remove_RenderPass_object(const VkRenderPass var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_RenderPass, true);
     s_trimGlobalStateTracker.remove_RenderPass(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_RenderPass, true);
 }
 
 //=========================================================================
 ObjectInfo *get_RenderPass_objectInfo(VkRenderPass var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_RenderPass, false);
     auto iter = s_trimGlobalStateTracker.createdRenderPasss.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdRenderPasss.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_RenderPass, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_ShaderModule_object(VkShaderModule var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_ShaderModule, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_ShaderModule(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_ShaderModule, true);
     return info;
 }
 
 //=========================================================================
 void remove_ShaderModule_object(const VkShaderModule var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_ShaderModule, true);
     s_trimGlobalStateTracker.remove_ShaderModule(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_ShaderModule, true);
 }
 
 //=========================================================================
 ObjectInfo *get_ShaderModule_objectInfo(VkShaderModule var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_ShaderModule, false);
     auto iter = s_trimGlobalStateTracker.createdShaderModules.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdShaderModules.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_ShaderModule, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_PipelineCache_object(VkPipelineCache var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PipelineCache, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_PipelineCache(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PipelineCache, true);
     return info;
 }
 
 void remove_PipelineCache_object(const VkPipelineCache var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PipelineCache, true);
     s_trimGlobalStateTracker.remove_PipelineCache(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PipelineCache, true);
 }
 
 //=========================================================================
 ObjectInfo *get_PipelineCache_objectInfo(VkPipelineCache var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_PipelineCache, false);
     auto iter = s_trimGlobalStateTracker.createdPipelineCaches.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdPipelineCaches.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_PipelineCache, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_DescriptorPool_object(VkDescriptorPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorPool, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_DescriptorPool(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorPool, true);
     return info;
 }
 
 //=========================================================================
 void remove_DescriptorPool_object(const VkDescriptorPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorPool, true);
     s_trimGlobalStateTracker.remove_DescriptorPool(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorPool, true);
 }
 
 //=========================================================================
 ObjectInfo *get_DescriptorPool_objectInfo(VkDescriptorPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorPool, false);
     auto iter = s_trimGlobalStateTracker.createdDescriptorPools.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdDescriptorPools.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorPool, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Pipeline_object(VkPipeline var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Pipeline, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Pipeline(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Pipeline, true);
     return info;
 }
 
 //=========================================================================
 void remove_Pipeline_object(const VkPipeline var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Pipeline, true);
     s_trimGlobalStateTracker.remove_Pipeline(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Pipeline, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Pipeline_objectInfo(VkPipeline var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Pipeline, false);
     auto iter = s_trimGlobalStateTracker.createdPipelines.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdPipelines.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Pipeline, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Semaphore_object(VkSemaphore var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Semaphore, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Semaphore(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Semaphore, true);
     return info;
 }
 
 //=========================================================================
 void remove_Semaphore_object(const VkSemaphore var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Semaphore, true);
     s_trimGlobalStateTracker.remove_Semaphore(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Semaphore, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Semaphore_objectInfo(VkSemaphore var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Semaphore, false);
     auto iter = s_trimGlobalStateTracker.createdSemaphores.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdSemaphores.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Semaphore, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Fence_object(VkFence var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Fence, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Fence(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Fence, true);
     return info;
 }
 
 //=========================================================================
 void remove_Fence_object(const VkFence var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Fence, true);
     s_trimGlobalStateTracker.remove_Fence(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Fence, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Fence_objectInfo(VkFence var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Fence, false);
     auto iter = s_trimGlobalStateTracker.createdFences.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdFences.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Fence, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Framebuffer_object(VkFramebuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Framebuffer, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Framebuffer(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Framebuffer, true);
     return info;
 }
 
 //=========================================================================
 void remove_Framebuffer_object(const VkFramebuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Framebuffer, true);
     s_trimGlobalStateTracker.remove_Framebuffer(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Framebuffer, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Framebuffer_objectInfo(VkFramebuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Framebuffer, false);
     auto iter = s_trimGlobalStateTracker.createdFramebuffers.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdFramebuffers.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Framebuffer, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_Event_object(VkEvent var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Event, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_Event(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Event, true);
     return info;
 }
 
 //=========================================================================
 void remove_Event_object(const VkEvent var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Event, true);
     s_trimGlobalStateTracker.remove_Event(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Event, true);
 }
 
 //=========================================================================
 ObjectInfo *get_Event_objectInfo(VkEvent var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_Event, false);
     auto iter = s_trimGlobalStateTracker.createdEvents.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdEvents.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_Event, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_QueryPool_object(VkQueryPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_QueryPool, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_QueryPool(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_QueryPool, true);
     return info;
 }
 
 //=========================================================================
 void remove_QueryPool_object(const VkQueryPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_QueryPool, true);
     s_trimGlobalStateTracker.remove_QueryPool(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_QueryPool, true);
 }
 
 //=========================================================================
 ObjectInfo *get_QueryPool_objectInfo(VkQueryPool var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_QueryPool, false);
     auto iter = s_trimGlobalStateTracker.createdQueryPools.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdQueryPools.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_QueryPool, false);
     return pResult;
 }
 
 //=========================================================================
 ObjectInfo &add_DescriptorSet_object(VkDescriptorSet var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorSet, true);
     ObjectInfo &info = s_trimGlobalStateTracker.add_DescriptorSet(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorSet, true);
     return info;
 }
 
 //=========================================================================
 void remove_DescriptorSet_object(const VkDescriptorSet var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorSet, true);
     s_trimGlobalStateTracker.remove_DescriptorSet(var);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorSet, true);
 }
 
 //=========================================================================
 ObjectInfo *get_DescriptorSet_objectInfo(VkDescriptorSet var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorSet, false);
     auto iter = s_trimGlobalStateTracker.createdDescriptorSets.find(var);
     ObjectInfo *pResult = NULL;
     if (iter != s_trimGlobalStateTracker.createdDescriptorSets.end()) {
         pResult = &(iter->second);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorSet, false);
     return pResult;
 }
 
@@ -2520,7 +2733,7 @@ ObjectInfo *get_DescriptorSet_objectInfo(VkDescriptorSet var) {
 
 #define TRIM_MARK_OBJECT_REFERENCE(type)                                   \
     void mark_##type##_reference(Vk##type var) {                           \
-        vktrace_enter_critical_section(&trimStateTrackerLock);             \
+        lockObjectType(StateTrackerLock_##type, true);                     \
         auto iter = s_trimStateTrackerSnapshot.created##type##s.find(var); \
         if (iter != s_trimStateTrackerSnapshot.created##type##s.end()) {   \
             ObjectInfo *info = &iter->second;                              \
@@ -2528,25 +2741,31 @@ ObjectInfo *get_DescriptorSet_objectInfo(VkDescriptorSet var) {
                 info->bReferencedInTrim = true;                            \
             }                                                              \
         }                                                                  \
-        vktrace_leave_critical_section(&trimStateTrackerLock);             \
+        unlockObjectType(StateTrackerLock_##type, true);                   \
     }
 
+// The device is marked after the object's lock is released, so that the
+// locks are never taken out of order.
 #define TRIM_MARK_OBJECT_REFERENCE_WITH_DEVICE_DEPENDENCY(type)            \
     void mark_##type##_reference(Vk##type var) {                           \
-        vktrace_enter_critical_section(&trimStateTrackerLock);             \
+        VkDevice device = VK_NULL_HANDLE;                                  \
+        lockObjectType(StateTrackerLock_##type, true);                     \
         auto iter = s_trimStateTrackerSnapshot.created##type##s.find(var); \
         if (iter != s_trimStateTrackerSnapshot.created##type##s.end()) {   \
             ObjectInfo *info = &iter->second;                              \
             if (info != nullptr) {                                         \
                 info->bReferencedInTrim = true;                            \
-                mark_Device_reference((VkDevice)info->belongsToDevice);    \
+                device = (VkDevice)info->belongsToDevice;                  \
             }                                                              \
         }                                                                  \
-        vktrace_leave_critical_section(&trimStateTrackerLock);             \
+        unlockObjectType(StateTrackerLock_##type, true);                   \
+        if (device != VK_NULL_HANDLE) {                                    \
+            mark_Device_reference(device);                                 \
+        }                                                                  \
     }
 
 void mark_CommandBuffer_reference(VkCommandBuffer var) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_CommandBuffer, true);
     auto iter = s_trimStateTrackerSnapshot.createdCommandBuffers.find(var);
     if (iter != s_trimStateTrackerSnapshot.createdCommandBuffers.end()) {
         ObjectInfo *info = &iter->second;
@@ -2554,7 +2773,7 @@ void mark_CommandBuffer_reference(VkCommandBuffer var) {
             info->bReferencedInTrim = true;
         }
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_CommandBuffer, true);
 }
 
 TRIM_MARK_OBJECT_REFERENCE(Instance);
@@ -2590,10 +2809,10 @@ TRIM_MARK_OBJECT_REFERENCE_WITH_DEVICE_DEPENDENCY(DescriptorSetLayout)
 void write_all_referenced_object_calls() {
     vktrace_LogDebug("vktrace recreating objects for trim.");
 
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockStateTracker();
     // write the referenced objects from the snapshot
     StateTracker &stateTracker = s_trimStateTrackerSnapshot;
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockStateTracker();
 
     // Instances (& PhysicalDevices)
     for (auto obj = stateTracker.createdInstances.begin(); obj != stateTracker.createdInstances.end(); obj++) {
@@ -3686,17 +3905,17 @@ void write_all_referenced_object_calls() {
 // Object tracking
 //=========================================================================
 void add_RenderPassCreateInfo(VkRenderPass renderPass, const VkRenderPassCreateInfo *pCreateInfo) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_RenderPass, true);
     s_trimGlobalStateTracker.add_RenderPassCreateInfo(renderPass, pCreateInfo);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_RenderPass, true);
 }
 
 //=========================================================================
 uint32_t get_RenderPassVersion(VkRenderPass renderPass) {
     uint32_t version = 0;
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_RenderPass, true);
     version = s_trimGlobalStateTracker.get_RenderPassVersion(renderPass);
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_RenderPass, true);
     return version;
 }
 
@@ -3718,7 +3937,7 @@ void remove_CommandBuffer_calls(VkCommandBuffer commandBuffer) {
 
 //=========================================================================
 void reset_DescriptorPool(VkDescriptorPool descriptorPool) {
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockObjectType(StateTrackerLock_DescriptorSet, true);
     for (auto dsIter = s_trimGlobalStateTracker.createdDescriptorSets.begin();
          dsIter != s_trimGlobalStateTracker.createdDescriptorSets.end();) {
         if (dsIter->second.ObjectInfo.DescriptorSet.descriptorPool == descriptorPool) {
@@ -3729,7 +3948,7 @@ void reset_DescriptorPool(VkDescriptorPool descriptorPool) {
             dsIter++;
         }
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockObjectType(StateTrackerLock_DescriptorSet, true);
 }
 
 //===============================================
@@ -4047,7 +4266,7 @@ void add_destroy_device_object_packets(VkDevice device) {
 void write_destroy_packets() {
     vktrace_LogDebug("vktrace destroying objects after trim.");
 
-    vktrace_enter_critical_section(&trimStateTrackerLock);
+    lockStateTracker();
     // Make sure all queues have completed before trying to delete anything
     for (auto obj = s_trimGlobalStateTracker.createdQueues.begin(); obj != s_trimGlobalStateTracker.createdQueues.end(); obj++) {
         VkQueue queue = obj->first;
@@ -4084,7 +4303,7 @@ void write_destroy_packets() {
         vktrace_write_trace_packet(pHeader, vktrace_trace_get_trace_file());
         vktrace_delete_trace_packet(&pHeader);
     }
-    vktrace_leave_critical_section(&trimStateTrackerLock);
+    unlockStateTracker();
 
     vktrace_LogDebug("vktrace done destroying objects after trim.");
 }
@@ -15,6 +15,7 @@
 */
 #include "vktrace_lib_trim_statetracker.h"
 #include "vktrace_lib_trim.h"
+#include "vktrace_packet_allocator.h"
 
 namespace trim {
 // declared extern in statetracker.h
@@ -29,7 +30,7 @@ vktrace_trace_packet_header *copy_packet(vktrace_trace_packet_header *pHeader) {
     }
 
     uint64_t packetSize = pHeader->size;
-    vktrace_trace_packet_header *pCopy = static_cast<vktrace_trace_packet_header *>(malloc((size_t)packetSize));
+    vktrace_trace_packet_header *pCopy = static_cast<vktrace_trace_packet_header *>(vktrace_PacketAllocator_alloc(packetSize));
     if (pCopy != nullptr) {
         memcpy(pCopy, pHeader, (size_t)packetSize);
     }
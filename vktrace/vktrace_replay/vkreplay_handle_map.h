@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2018 LunarG, Inc.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "vktrace_common.h"
+
+// Maps the handles found in a trace file to replay handles or objects.
+//
+// remap_*() runs for nearly every handle of every packet, so this is an open
+// addressing hash table with linear probing rather than a std::map. Some drivers
+// hand out small sequential ids as handles; those are kept in a plain array
+// indexed by the handle instead, as long as the array stays within about twice
+// the number of entries.
+//
+// Like std::map, find() returns end() for a missing handle and entries have
+// first and second members. Unlike std::map, adding or removing a handle may
+// move the other entries, so the result of find() is only valid until the map
+// is changed.
+template <typename Key, typename Value>
+class vkReplayHandleMap {
+   public:
+    struct Entry {
+        Key first;
+        Value second;
+    };
+    typedef Entry *iterator;
+    typedef const Entry *const_iterator;
+
+    vkReplayHandleMap() : m_count(0), m_hashCount(0), m_lookupCount(0), m_missCount(0) {}
+
+    iterator end() { return nullptr; }
+    const_iterator end() const { return nullptr; }
+    size_t size() const { return (size_t)m_count; }
+
+    iterator find(const Key &key) {
+        Entry *pEntry = findEntry(*this, handleValue(key));
+        countLookup(pEntry != nullptr);
+        return pEntry;
+    }
+
+    const_iterator find(const Key &key) const {
+        const Entry *pEntry = findEntry(*this, handleValue(key));
+        countLookup(pEntry != nullptr);
+        return pEntry;
+    }
+
+    Value &operator[](const Key &key) {
+        uint64_t handle = handleValue(key);
+        Entry *pEntry = findEntry(*this, handle);
+        if (pEntry != nullptr) {
+            return pEntry->second;
+        }
+
+        m_count++;
+        uint64_t denseLimit = 2 * m_count + DENSE_MIN_SIZE;
+        if (handle < denseLimit) {
+            if (handle >= m_dense.size()) {
+                uint64_t newSize = std::max(handle + 1, std::min((uint64_t)(2 * m_dense.size()), denseLimit));
+                m_dense.resize((size_t)newSize);
+                m_denseUsed.resize((size_t)newSize, 0);
+            }
+            pEntry = &m_dense[(size_t)handle];
+            m_denseUsed[(size_t)handle] = 1;
+        } else {
+            if (2 * (m_hashCount + 1) > m_slots.size()) {
+                rehash(std::max((uint64_t)HASH_MIN_SIZE, (uint64_t)(2 * m_slots.size())));
+            }
+            uint64_t mask = m_slots.size() - 1;
+            uint64_t i = hash(handle) & mask;
+            while (m_slotUsed[(size_t)i]) {
+                i = (i + 1) & mask;
+            }
+            pEntry = &m_slots[(size_t)i];
+            m_slotUsed[(size_t)i] = 1;
+            m_hashCount++;
+        }
+        pEntry->first = key;
+        pEntry->second = Value();
+        return pEntry->second;
+    }
+
+    size_t erase(const Key &key) {
+        uint64_t handle = handleValue(key);
+        if ((handle < m_dense.size()) && m_denseUsed[(size_t)handle]) {
+            m_denseUsed[(size_t)handle] = 0;
+            m_dense[(size_t)handle].second = Value();
+            m_count--;
+            return 1;
+        }
+        if (m_hashCount == 0) {
+            return 0;
+        }
+
+        uint64_t mask = m_slots.size() - 1;
+        uint64_t i = hash(handle) & mask;
+        while (m_slotUsed[(size_t)i] && (handleValue(m_slots[(size_t)i].first) != handle)) {
+            i = (i + 1) & mask;
+        }
+        if (!m_slotUsed[(size_t)i]) {
+            return 0;
+        }
+        // Shift the following entries of the probe sequence back instead of
+        // leaving a tombstone, so lookups never have to skip deleted slots.
+        for (uint64_t j = (i + 1) & mask; m_slotUsed[(size_t)j]; j = (j + 1) & mask) {
+            uint64_t home = hash(handleValue(m_slots[(size_t)j].first)) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                m_slots[(size_t)i] = m_slots[(size_t)j];
+                i = j;
+            }
+        }
+        m_slotUsed[(size_t)i] = 0;
+        m_slots[(size_t)i].second = Value();
+        m_hashCount--;
+        m_count--;
+        return 1;
+    }
+
+    void clear() {
+        m_dense.clear();
+        m_denseUsed.clear();
+        m_slots.clear();
+        m_slotUsed.clear();
+        m_count = 0;
+        m_hashCount = 0;
+    }
+
+    void log_lookup_counts(const char *typeName) const {
+        if (m_lookupCount != 0) {
+            vktrace_LogVerbose("%s remap: %" PRIu64 " lookups, %" PRIu64 " misses, %" PRIu64 " of %" PRIu64
+                               " handles in dense array.",
+                               typeName, m_lookupCount, m_missCount, m_count - m_hashCount, m_count);
+        }
+    }
+
+   private:
+    static const uint64_t DENSE_MIN_SIZE = 1024;
+    static const uint64_t HASH_MIN_SIZE = 64;  // must be a power of 2
+
+    // Handles are pointers for dispatchable objects and on 64-bit platforms, and uint64_t otherwise.
+    static uint64_t handleValue(const Key &key) { return (uint64_t)key; }
+
+    // Handles are often aligned pointers, mix all the bits into the low ones used as index.
+    static uint64_t hash(uint64_t handle) {
+        handle ^= handle >> 33;
+        handle *= 0xff51afd7ed558ccdULL;
+        handle ^= handle >> 33;
+        return handle;
+    }
+
+    // Shared by the const and non-const find(), Map is vkReplayHandleMap or const vkReplayHandleMap.
+    template <typename Map>
+    static auto findEntry(Map &map, uint64_t handle) -> decltype(&map.m_dense[0]) {
+        if ((handle < map.m_dense.size()) && map.m_denseUsed[(size_t)handle]) {
+            return &map.m_dense[(size_t)handle];
+        }
+        if (map.m_hashCount == 0) {
+            return nullptr;
+        }
+        uint64_t mask = map.m_slots.size() - 1;
+        for (uint64_t i = hash(handle) & mask; map.m_slotUsed[(size_t)i]; i = (i + 1) & mask) {
+            if (handleValue(map.m_slots[(size_t)i].first) == handle) {
+                return &map.m_slots[(size_t)i];
+            }
+        }
+        return nullptr;
+    }
+
+    void countLookup(bool found) const {
+        m_lookupCount++;
+        if (!found) {
+            m_missCount++;
+        }
+    }
+
+    void rehash(uint64_t newSize) {
+        std::vector<Entry> oldSlots(newSize);
+        std::vector<uint8_t> oldSlotUsed(newSize, 0);
+        oldSlots.swap(m_slots);
+        oldSlotUsed.swap(m_slotUsed);
+        uint64_t mask = newSize - 1;
+        for (size_t j = 0; j < oldSlots.size(); j++) {
+            if (oldSlotUsed[j]) {
+                uint64_t i = hash(handleValue(oldSlots[j].first)) & mask;
+                while (m_slotUsed[(size_t)i]) {
+                    i = (i + 1) & mask;
+                }
+                m_slots[(size_t)i] = oldSlots[j];
+                m_slotUsed[(size_t)i] = 1;
+            }
+        }
+    }
+
+    std::vector<Entry> m_dense;  // indexed by handle
+    std::vector<uint8_t> m_denseUsed;
+    std::vector<Entry> m_slots;  // hash table, the size is a power of 2
+    std::vector<uint8_t> m_slotUsed;
+    uint64_t m_count;      // entries in both parts
+    uint64_t m_hashCount;  // entries in the hash table
+    mutable uint64_t m_lookupCount;  // statistics, also counted by the const find()
+    mutable uint64_t m_missCount;
+};
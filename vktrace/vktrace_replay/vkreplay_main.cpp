@@ -32,6 +32,7 @@
 #include "vktrace_common.h"
 #include "vktrace_tracelog.h"
 #include "vktrace_filelike.h"
+#include "vktrace_compression.h"
 #include "vktrace_trace_packet_utils.h"
 #include "vkreplay_main.h"
 #include "vkreplay_factory.h"
@@ -39,7 +40,7 @@
 #include "vkreplay_window.h"
 #include "screenshot_parsing.h"
 
-vkreplayer_settings replaySettings = {NULL, 1, -1, -1, NULL, NULL, NULL};
+vkreplayer_settings replaySettings = {NULL, 1, -1, -1, NULL, NULL, NULL, 0, 64};
 
 vktrace_SettingInfo g_settings_info[] = {
     {"o",
@@ -94,6 +95,20 @@ vktrace_SettingInfo g_settings_info[] = {
      {&replaySettings.screenshotColorFormat},
      TRUE,
      "Color Space format of screenshot files. Formats are UNORM, SNORM, USCALED, SSCALED, UINT, SINT, SRGB"},
+    {"pp",
+     "PrefetchPackets",
+     VKTRACE_SETTING_UINT,
+     {&replaySettings.prefetchPackets},
+     {&replaySettings.prefetchPackets},
+     TRUE,
+     "Read and interpret up to this many packets ahead of replay on separate threads. 0 disables read ahead."},
+    {"pm",
+     "PrefetchMemory",
+     VKTRACE_SETTING_UINT,
+     {&replaySettings.prefetchMemory},
+     {&replaySettings.prefetchMemory},
+     TRUE,
+     "The number of MB of packets that may be read ahead of replay."},
 #if _DEBUG
     {"v",
      "Verbosity",
@@ -118,8 +133,9 @@ vktrace_SettingInfo g_settings_info[] = {
 vktrace_SettingGroup g_replaySettingGroup = {"vkreplay", sizeof(g_settings_info) / sizeof(g_settings_info[0]), &g_settings_info[0]};
 
 namespace vktrace_replay {
-int main_loop(vktrace_replay::ReplayDisplay display, Sequencer& seq, vktrace_trace_packet_replay_library* replayerArray[],
-              vkreplayer_settings settings) {
+// loopStartOffset is the file offset of the first packet of settings.loopStartFrame, or 0 to find it while replaying.
+int main_loop(vktrace_replay::ReplayDisplay display, AbstractSequencer& seq, vktrace_trace_packet_replay_library* replayerArray[],
+              vkreplayer_settings settings, uint64_t loopStartOffset) {
     int err = 0;
     vktrace_trace_packet_header* packet;
     unsigned int res;
@@ -140,6 +156,9 @@ int main_loop(vktrace_replay::ReplayDisplay display, Sequencer& seq, vktrace_tra
     // record the location of looping start packet
     seq.record_bookmark();
     seq.get_bookmark(startingPacket);
+    if (loopStartOffset != 0) {
+        startingPacket.file_offset = loopStartOffset;
+    }
     uint64_t totalLoops = settings.numLoops;
     uint64_t totalLoopFrames = 0;
     uint64_t start_time = vktrace_get_time();
@@ -189,8 +208,12 @@ int main_loop(vktrace_replay::ReplayDisplay display, Sequencer& seq, vktrace_tra
                         continue;
                     }
                     if (packet->packet_id >= VKTRACE_TPI_VK_vkApiVersion) {
-                        // replay the API packet
-                        res = replayer->Replay(replayer->Interpret(packet));
+                        // replay the API packet, the sequencer may have interpreted it already
+                        vktrace_trace_packet_header* pInterpretedPacket;
+                        if (!seq.get_interpreted_packet(&pInterpretedPacket)) {
+                            pInterpretedPacket = replayer->Interpret(packet);
+                        }
+                        res = replayer->Replay(pInterpretedPacket);
                         if (res != VKTRACE_REPLAY_SUCCESS) {
                             vktrace_LogError("Failed to replay packet_id %d, with global_packet_index %d.", packet->packet_id,
                                              packet->global_packet_index);
@@ -208,7 +231,7 @@ int main_loop(vktrace_replay::ReplayDisplay display, Sequencer& seq, vktrace_tra
 
                             // Only set the loop start location in the first loop when loopStartFrame is not 0
                             if (frameNumber == settings.loopStartFrame && settings.loopStartFrame > 0 &&
-                                settings.numLoops == totalLoops) {
+                                settings.numLoops == totalLoops && loopStartOffset == 0) {
                                 // record the location of looping start packet
                                 seq.record_bookmark();
                                 seq.get_bookmark(startingPacket);
@@ -433,14 +456,14 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
 
     // read the header
     traceFile = vktrace_FileLike_create_file(tracefp);
-    if (vktrace_FileLike_ReadRaw(traceFile, &fileHeader, sizeof(fileHeader)) == false) {
+    if (traceFile == NULL || vktrace_FileLike_ReadRaw(traceFile, &fileHeader, sizeof(fileHeader)) == false) {
         vktrace_LogError("Unable to read header from file.");
         if (pAllSettings != NULL) {
             vktrace_SettingGroup_Delete_Loaded(&pAllSettings, &numAllSettings);
         }
         fclose(tracefp);
         vktrace_free(pTraceFile);
-        vktrace_free(traceFile);
+        vktrace_FileLike_destroy(&traceFile);
         return -1;
     }
 
@@ -459,7 +482,7 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
             fileHeader.trace_file_version, VKTRACE_TRACE_FILE_VERSION_MINIMUM_COMPATIBLE);
         fclose(tracefp);
         vktrace_free(pTraceFile);
-        vktrace_free(traceFile);
+        vktrace_FileLike_destroy(&traceFile);
         return -1;
     }
 
@@ -468,7 +491,7 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
         vktrace_LogError("%s does not appear to be a valid Vulkan trace file.", pTraceFile);
         fclose(tracefp);
         vktrace_free(pTraceFile);
-        vktrace_free(traceFile);
+        vktrace_FileLike_destroy(&traceFile);
         return -1;
     }
 
@@ -481,7 +504,7 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
         }
         fclose(tracefp);
         vktrace_free(pTraceFile);
-        vktrace_free(traceFile);
+        vktrace_FileLike_destroy(&traceFile);
         return -1;
     }
 
@@ -494,7 +517,7 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
         }
         fclose(tracefp);
         vktrace_free(pTraceFile);
-        vktrace_free(traceFile);
+        vktrace_FileLike_destroy(&traceFile);
         return -1;
     }
 
@@ -503,6 +526,43 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
     if (!pFileHeader->portability_table_valid)
         vktrace_LogAlways("Trace file does not appear to contain portability table. Will not attempt to map memoryType indices.");
 
+    // With a packet index, check the loop range against the frames in the trace and find where the loop starts and ends
+    uint64_t loopStartOffset = 0;
+    uint64_t endOffset = 0;
+    vktrace_trace_packet_index* pPacketIndex = vktrace_read_trace_packet_index(traceFile, pFileHeader);
+    if (pPacketIndex != NULL) {
+        const uint64_t* pFrameOffsets = vktrace_trace_packet_index_frame_offsets(pPacketIndex);
+        vktrace_LogVerbose("Trace file contains %llu packets in %llu frames.", (unsigned long long)pPacketIndex->packet_count,
+                           (unsigned long long)pPacketIndex->frame_count);
+        if (replaySettings.loopStartFrame > 0 && (uint64_t)replaySettings.loopStartFrame >= pPacketIndex->frame_count) {
+            vktrace_LogError("Loop start frame %d is out of range, the trace file has %llu frames.", replaySettings.loopStartFrame,
+                             (unsigned long long)pPacketIndex->frame_count);
+            vktrace_free(pPacketIndex);
+            if (pAllSettings != NULL) {
+                vktrace_SettingGroup_Delete_Loaded(&pAllSettings, &numAllSettings);
+            }
+            fclose(tracefp);
+            vktrace_free(pTraceFile);
+            vktrace_FileLike_destroy(&traceFile);
+            return -1;
+        }
+        if (replaySettings.loopStartFrame > 0) {
+            loopStartOffset = pFrameOffsets[replaySettings.loopStartFrame];
+        }
+
+        // Packets from the portability table on, or after the last frame of the loop, are never replayed
+        endOffset = pFileHeader->packet_index_offset - sizeof(vktrace_trace_packet_header);
+        if (replaySettings.loopEndFrame != -1) {
+            if ((uint64_t)replaySettings.loopEndFrame >= pPacketIndex->frame_count) {
+                vktrace_LogWarning("Loop end frame %d is out of range, the trace file has %llu frames.",
+                                   replaySettings.loopEndFrame, (unsigned long long)pPacketIndex->frame_count);
+            } else if ((uint64_t)replaySettings.loopEndFrame + 1 < pPacketIndex->frame_count) {
+                endOffset = pFrameOffsets[replaySettings.loopEndFrame + 1];
+            }
+        }
+        vktrace_free(pPacketIndex);
+    }
+
     // load any API specific driver libraries and init replayer objects
     uint8_t tidApi = VKTRACE_TID_RESERVED;
     vktrace_trace_packet_replay_library* replayer[VKTRACE_MAX_TRACER_ID_ARRAY_SIZE];
@@ -547,7 +607,7 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
                 }
                 fclose(tracefp);
                 vktrace_free(pTraceFile);
-                vktrace_free(traceFile);
+                vktrace_FileLike_destroy(&traceFile);
                 return -1;
             }
 
@@ -567,7 +627,7 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
                 }
                 fclose(tracefp);
                 vktrace_free(pTraceFile);
-                vktrace_free(traceFile);
+                vktrace_FileLike_destroy(&traceFile);
                 return err;
             }
         }
@@ -580,13 +640,49 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
         }
         fclose(tracefp);
         vktrace_free(pTraceFile);
-        vktrace_free(traceFile);
+        vktrace_FileLike_destroy(&traceFile);
         return -1;
     }
 
     // main loop
-    Sequencer sequencer(traceFile);
-    err = vktrace_replay::main_loop(disp, sequencer, replayer, replaySettings);
+    // When packets are read ahead, replay still reads the trace file to look up packets in the
+    // portability table, so the packets are read through a FileLike of their own.
+    FILE* prefetchfp = NULL;
+    FileLike* prefetchFile = NULL;
+    if (replaySettings.prefetchPackets > 0) {
+        prefetchfp = fopen(pTraceFile, "rb");
+        if (prefetchfp != NULL) {
+            prefetchFile = vktrace_FileLike_create_file(prefetchfp);
+        }
+        if (prefetchFile == NULL ||
+            !vktrace_FileLike_SetCurrentPosition(prefetchFile, vktrace_FileLike_GetCurrentPosition(traceFile))) {
+            vktrace_LogWarning("Unable to open the trace file a second time, packets will not be read ahead of replay.");
+            vktrace_FileLike_destroy(&prefetchFile);
+            if (prefetchfp != NULL) {
+                fclose(prefetchfp);
+                prefetchfp = NULL;
+            }
+        } else if (prefetchFile->mCompressedReader != NULL) {
+            // Nothing else seeks this FileLike, so the blocks ahead of the read thread can be decompressed in parallel.
+            vktrace_CompressedFileReader_start_read_ahead(prefetchFile->mCompressedReader, 0);
+        }
+    }
+    FileLike* sequencerFile = (prefetchFile != NULL) ? prefetchFile : traceFile;
+    Sequencer sequencer(sequencerFile);
+    MappedSequencer mappedSequencer(sequencerFile);
+    AbstractSequencer* pSequencer = &sequencer;
+    if (mappedSequencer.map_file()) {
+        pSequencer = &mappedSequencer;
+    }
+    PrefetchSequencer* pPrefetchSequencer = NULL;
+    if (prefetchFile != NULL) {
+        pPrefetchSequencer = new PrefetchSequencer(pSequencer, replayer, replaySettings.prefetchPackets,
+                                                   (uint64_t)replaySettings.prefetchMemory * 1024 * 1024);
+        pSequencer = pPrefetchSequencer;
+    }
+    pSequencer->set_end_offset(endOffset);
+    err = vktrace_replay::main_loop(disp, *pSequencer, replayer, replaySettings, loopStartOffset);
+    delete pPrefetchSequencer;
 
     for (int i = 0; i < VKTRACE_MAX_TRACER_ID_ARRAY_SIZE; i++) {
         if (replayer[i] != NULL) {
@@ -601,7 +697,11 @@ int vkreplay_main(int argc, char** argv, vktrace_window_handle window = 0) {
 
     fclose(tracefp);
     vktrace_free(pTraceFile);
-    vktrace_free(traceFile);
+    vktrace_FileLike_destroy(&traceFile);
+    if (prefetchFile != NULL) {
+        vktrace_FileLike_destroy(&prefetchFile);
+        fclose(prefetchfp);
+    }
 
     return err;
 }
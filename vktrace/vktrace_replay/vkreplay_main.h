@@ -30,6 +30,8 @@ typedef struct vkreplayer_settings {
     const char* screenshotList;
     const char* screenshotColorFormat;
     const char* verbosity;
+    unsigned int prefetchPackets;  // 0 replays packets as they are read
+    unsigned int prefetchMemory;   // in MB
 } vkreplayer_settings;
 
 #include <vector>
@@ -18,7 +18,10 @@
  *
  * Author: Jon Ashburn <jon@lunarg.com>
  **************************************************************************/
+#include <algorithm>
+
 #include "vkreplay_seq.h"
+#include "vkreplay_factory.h"
 
 extern "C" {
 #include "vktrace_trace_packet_utils.h"
@@ -27,16 +30,365 @@ extern "C" {
 namespace vktrace_replay {
 
 vktrace_trace_packet_header *Sequencer::get_next_packet() {
-    vktrace_free(m_lastPacket);
+    vktrace_delete_trace_packet(&m_lastPacket);
     if (!m_pFile) return (NULL);
-    m_lastPacket = vktrace_read_trace_packet(m_pFile);
-    return (m_lastPacket);
+    if (m_endOffset != 0 && m_fileOffset >= m_endOffset) return (NULL);
+    vktrace_trace_packet_header *pPacket = vktrace_read_trace_packet(m_pFile);
+    if (pPacket) m_fileOffset += pPacket->size;
+    if (!m_holdPackets) m_lastPacket = pPacket;  // else the caller releases it
+    return (pPacket);
 }
 
 void Sequencer::get_bookmark(seqBookmark &bookmark) { bookmark.file_offset = m_bookmark.file_offset; }
 
-void Sequencer::set_bookmark(const seqBookmark &bookmark) { vktrace_FileLike_SetCurrentPosition(m_pFile, m_bookmark.file_offset); }
+void Sequencer::set_bookmark(const seqBookmark &bookmark) {
+    vktrace_FileLike_SetCurrentPosition(m_pFile, bookmark.file_offset);
+    m_fileOffset = bookmark.file_offset;
+}
+
+void Sequencer::record_bookmark() { m_bookmark.file_offset = m_fileOffset; }
+
+static uint64_t get_page_size() {
+#if defined(PLATFORM_LINUX)
+    return (uint64_t)sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+}
+
+MappedSequencer::MappedSequencer(FileLike *pFile)
+    : m_pFile(pFile),
+      m_pMapping(NULL),
+      m_mappingSize(0),
+      m_copiedPacket(NULL),
+      m_fileOffset(pFile ? vktrace_FileLike_GetCurrentPosition(pFile) : 0),
+      m_endOffset(0),
+      m_releasedOffset(0),
+      m_prefetchedOffset(0),
+      m_touchedOffset(0),
+      m_maxHeldBytes(0),
+      m_holdPackets(false) {
+    m_bookmark.file_offset = m_fileOffset;
+}
+
+MappedSequencer::~MappedSequencer() {
+    this->clean_up();
+#if defined(PLATFORM_LINUX)
+    if (m_pMapping != NULL) {
+        munmap(m_pMapping, (size_t)m_mappingSize);
+    }
+#endif
+}
+
+bool MappedSequencer::map_file() {
+#if defined(PLATFORM_LINUX)
+    if (m_pFile == NULL || m_pFile->mMode != FileLike::File || m_pFile->mCompressedReader != NULL || m_pFile->mFileLen == 0 ||
+        m_pFile->mFileLen > SIZE_MAX) {
+        return false;
+    }
+
+    // The mapping is private, writes to it never reach the file.
+    void *pMapping = mmap(NULL, (size_t)m_pFile->mFileLen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(m_pFile->mFile), 0);
+    if (pMapping == MAP_FAILED) {
+        vktrace_LogVerbose("Unable to map the trace file, reading it instead.");
+        return false;
+    }
+    m_pMapping = (uint8_t *)pMapping;
+    m_mappingSize = m_pFile->mFileLen;
+    madvise(m_pMapping, (size_t)m_mappingSize, MADV_SEQUENTIAL);
+    m_releasedOffset = m_fileOffset - m_fileOffset % get_page_size();
+    m_prefetchedOffset = m_releasedOffset;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MappedSequencer::clean_up() { vktrace_delete_trace_packet(&m_copiedPacket); }
+
+vktrace_trace_packet_header *MappedSequencer::get_next_packet() {
+    vktrace_delete_trace_packet(&m_copiedPacket);
+    if (m_pMapping == NULL) return (NULL);
+    if (m_endOffset != 0 && m_fileOffset >= m_endOffset) return (NULL);
+    if (m_mappingSize - m_fileOffset < sizeof(vktrace_trace_packet_header)) return (NULL);
+
+    // The packets before this one are done with, except for the ones still held. Give back
+    // their pages once a window's worth has been replayed.
+    uint64_t pageSize = get_page_size();
+    uint64_t packetPageOffset = m_fileOffset - m_fileOffset % pageSize;
+    uint64_t releaseOffset = m_fileOffset - std::min(m_fileOffset, m_maxHeldBytes);
+    releaseOffset -= releaseOffset % pageSize;
+    if (releaseOffset >= m_releasedOffset + VKREPLAY_MAPPED_SEQUENCER_WINDOW_SIZE) {
+        release_pages(m_releasedOffset, releaseOffset);
+        m_releasedOffset = releaseOffset;
+    }
+
+    vktrace_trace_packet_header *pHeader = (vktrace_trace_packet_header *)(m_pMapping + m_fileOffset);
+    uint64_t packetSize;
+    memcpy(&packetSize, m_pMapping + m_fileOffset, sizeof(packetSize));
+    if (packetSize < sizeof(vktrace_trace_packet_header) || packetSize > m_mappingSize - m_fileOffset) {
+        vktrace_LogError("Failed to read trace packet with size of %llu.", (unsigned long long)packetSize);
+        return (NULL);
+    }
+
+    // Start reading the next window while this one is replayed
+    if (m_fileOffset + packetSize + VKREPLAY_MAPPED_SEQUENCER_WINDOW_SIZE / 2 > m_prefetchedOffset &&
+        m_prefetchedOffset < m_mappingSize) {
+        uint64_t prefetchOffset = std::max(m_prefetchedOffset, packetPageOffset);
+        uint64_t prefetchSize = std::min((uint64_t)VKREPLAY_MAPPED_SEQUENCER_WINDOW_SIZE, m_mappingSize - prefetchOffset);
+#if defined(PLATFORM_LINUX)
+        madvise(m_pMapping + prefetchOffset, (size_t)prefetchSize, MADV_WILLNEED);
+#endif
+        m_prefetchedOffset = prefetchOffset + prefetchSize;
+    }
+
+    if (m_fileOffset % sizeof(uint64_t) != 0) {
+        // Packet sizes are multiples of 8, so this only happens with unusual trace files. The interpreter
+        // needs aligned packets, read this one into a buffer of its own.
+        vktrace_FileLike_SetCurrentPosition(m_pFile, m_fileOffset);
+        pHeader = vktrace_read_trace_packet(m_pFile);
+        if (!m_holdPackets) m_copiedPacket = pHeader;  // else the caller releases it
+    } else {
+        pHeader->pBody = (uintptr_t)pHeader + sizeof(vktrace_trace_packet_header);
+    }
+    m_fileOffset += packetSize;
+    m_touchedOffset = std::max(m_touchedOffset, m_fileOffset);
+    return (pHeader);
+}
+
+void MappedSequencer::get_bookmark(seqBookmark &bookmark) { bookmark.file_offset = m_bookmark.file_offset; }
+
+void MappedSequencer::set_bookmark(const seqBookmark &bookmark) {
+    // Packets from the bookmark on were patched by the interpreter, drop the changes so they're read from the file again.
+    uint64_t pageSize = get_page_size();
+    uint64_t bookmarkPageOffset = bookmark.file_offset - bookmark.file_offset % pageSize;
+    if (m_pMapping != NULL && m_touchedOffset > bookmarkPageOffset) {
+        release_pages(bookmarkPageOffset, m_touchedOffset);
+    }
+    m_fileOffset = bookmark.file_offset;
+    m_releasedOffset = bookmarkPageOffset;
+    m_prefetchedOffset = bookmarkPageOffset;
+    m_touchedOffset = bookmark.file_offset;
+}
+
+void MappedSequencer::record_bookmark() { m_bookmark.file_offset = m_fileOffset; }
+
+bool MappedSequencer::hold_packets(uint64_t maxHeldBytes) {
+    m_holdPackets = true;
+    m_maxHeldBytes = maxHeldBytes;
+    return true;
+}
+
+void MappedSequencer::release_packet(vktrace_trace_packet_header *pPacket) {
+    // Only packets that had to be copied need to be freed, the others are released with their pages
+    if ((uint8_t *)pPacket < m_pMapping || (uint8_t *)pPacket >= m_pMapping + m_mappingSize) {
+        vktrace_delete_trace_packet(&pPacket);
+    }
+}
+
+void MappedSequencer::release_pages(uint64_t startOffset, uint64_t endOffset) {
+#if defined(PLATFORM_LINUX)
+    // For a private file mapping this discards the copies of pages that were written to,
+    // later accesses see the file contents again. A partial last page is released as a whole.
+    if (endOffset > startOffset) {
+        madvise(m_pMapping + startOffset, (size_t)(endOffset - startOffset), MADV_DONTNEED);
+    }
+#endif
+}
+
+
+PrefetchSequencer::PrefetchSequencer(AbstractSequencer *pSource, vktrace_trace_packet_replay_library *replayerArray[],
+                                     uint32_t maxQueuedPackets, uint64_t maxQueuedBytes)
+    : m_pSource(pSource),
+      m_replayerArray(replayerArray),
+      m_maxQueuedPackets(std::max(maxQueuedPackets, 1u)),
+      m_maxQueuedBytes(std::max<uint64_t>(maxQueuedBytes, 1)),
+      m_queuedPackets(0),
+      m_queuedBytes(0),
+      m_readDone(false),
+      m_interpretDone(false),
+      m_stopping(false),
+      m_running(false),
+      m_haveCurrentPacket(false) {
+    bool holding = m_pSource->hold_packets(m_maxQueuedBytes);
+    assert(holding);
+    (void)holding;
+    m_pSource->record_bookmark();
+    m_pSource->get_bookmark(m_position);
+    m_bookmark = m_position;
+}
+
+PrefetchSequencer::~PrefetchSequencer() { stop_threads(); }
+
+void PrefetchSequencer::clean_up() {
+    stop_threads();
+    m_pSource->clean_up();
+}
+
+void PrefetchSequencer::start_threads() {
+    m_readDone = false;
+    m_interpretDone = false;
+    m_stopping = false;
+    m_readThread = std::thread(&PrefetchSequencer::read_packets, this);
+    m_interpretThread = std::thread(&PrefetchSequencer::interpret_packets, this);
+    m_running = true;
+}
 
-void Sequencer::record_bookmark() { m_bookmark.file_offset = vktrace_FileLike_GetCurrentPosition(m_pFile); }
+void PrefetchSequencer::stop_threads() {
+    release_current_packet();
+    if (!m_running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    m_readThread.join();
+    m_interpretThread.join();
+    m_running = false;
+
+    for (QueuedPacket &queued : m_readPackets) {
+        m_pSource->release_packet(queued.pPacket);
+    }
+    for (QueuedPacket &queued : m_interpretedPackets) {
+        m_pSource->release_packet(queued.pPacket);
+    }
+    m_readPackets.clear();
+    m_interpretedPackets.clear();
+    m_queuedPackets = 0;
+    m_queuedBytes = 0;
+}
+
+void PrefetchSequencer::release_current_packet() {
+    if (!m_haveCurrentPacket) {
+        return;
+    }
+    uint64_t size = m_currentPacket.pPacket->size;
+    m_pSource->release_packet(m_currentPacket.pPacket);
+    m_haveCurrentPacket = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queuedPackets--;
+        m_queuedBytes -= size;
+    }
+    m_condition.notify_all();
+}
+
+vktrace_trace_packet_header *PrefetchSequencer::get_next_packet() {
+    release_current_packet();
+    if (!m_running) {
+        start_threads();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this] { return !m_interpretedPackets.empty() || m_interpretDone; });
+    if (m_interpretedPackets.empty()) {
+        return (NULL);
+    }
+    m_currentPacket = m_interpretedPackets.front();
+    m_interpretedPackets.pop_front();
+    m_haveCurrentPacket = true;
+    m_position = m_currentPacket.nextPacket;
+    return (m_currentPacket.pPacket);
+}
+
+bool PrefetchSequencer::get_interpreted_packet(vktrace_trace_packet_header **ppInterpreted) {
+    if (!m_haveCurrentPacket || !m_currentPacket.interpreted) {
+        return false;
+    }
+    *ppInterpreted = m_currentPacket.pInterpreted;
+    return true;
+}
+
+void PrefetchSequencer::get_bookmark(seqBookmark &bookmark) { bookmark.file_offset = m_bookmark.file_offset; }
+
+void PrefetchSequencer::set_bookmark(const seqBookmark &bookmark) {
+    // Throw away what was read ahead and start over from the bookmark
+    stop_threads();
+    m_pSource->set_bookmark(bookmark);
+    m_position = bookmark;
+}
+
+void PrefetchSequencer::record_bookmark() { m_bookmark = m_position; }
+
+void PrefetchSequencer::read_packets() {
+    uint64_t pageSize = get_page_size();
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] {
+                return m_stopping || (m_queuedPackets < m_maxQueuedPackets && m_queuedBytes < m_maxQueuedBytes);
+            });
+            if (m_stopping) {
+                break;
+            }
+        }
+
+        QueuedPacket queued = {};
+        queued.pPacket = m_pSource->get_next_packet();
+        if (queued.pPacket != NULL) {
+            // Take the page faults of packets in a memory mapping here rather than on the replay thread
+            volatile const uint8_t *pBytes = (const uint8_t *)queued.pPacket;
+            for (uint64_t offset = 0; offset < queued.pPacket->size; offset += pageSize) {
+                (void)pBytes[offset];
+            }
+            m_pSource->record_bookmark();
+            m_pSource->get_bookmark(queued.nextPacket);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (queued.pPacket == NULL) {
+            m_readDone = true;
+            m_condition.notify_all();
+            break;
+        }
+        m_readPackets.push_back(queued);
+        m_queuedPackets++;
+        m_queuedBytes += queued.pPacket->size;
+        m_condition.notify_all();
+    }
+}
+
+void PrefetchSequencer::interpret_packets() {
+    for (;;) {
+        QueuedPacket queued;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_readPackets.empty() || m_readDone; });
+            if (m_stopping) {
+                break;
+            }
+            if (m_readPackets.empty()) {
+                m_interpretDone = true;
+                m_condition.notify_all();
+                break;
+            }
+            queued = m_readPackets.front();
+            m_readPackets.pop_front();
+        }
+
+        // Same checks as the main loop does before it replays a packet
+        vktrace_trace_packet_header *pPacket = queued.pPacket;
+        if (pPacket->packet_id >= VKTRACE_TPI_VK_vkApiVersion && pPacket->tracer_id < VKTRACE_MAX_TRACER_ID_ARRAY_SIZE &&
+            pPacket->tracer_id != VKTRACE_TID_RESERVED && m_replayerArray[pPacket->tracer_id] != NULL) {
+            queued.pInterpreted = m_replayerArray[pPacket->tracer_id]->Interpret(pPacket);
+            queued.interpreted = true;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            // Interpret() rewrites the packet in place, so releasing the packet releases the interpreted header too
+            m_queuedPackets--;
+            m_queuedBytes -= queued.pPacket->size;
+            queued.pInterpreted = NULL;
+            queued.interpreted = false;
+            m_pSource->release_packet(queued.pPacket);
+            break;
+        }
+        m_interpretedPackets.push_back(queued);
+        m_condition.notify_all();
+    }
+}
 
 } /* namespace vktrace_replay */
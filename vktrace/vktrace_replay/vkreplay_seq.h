@@ -20,9 +20,15 @@
  **************************************************************************/
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 extern "C" {
 #include "vktrace_filelike.h"
 #include "vktrace_trace_packet_identifiers.h"
+#include "vktrace_trace_packet_utils.h"
 }
 
 /* Class to handle fetching and sequencing packets from a tracefile.
@@ -41,29 +47,159 @@ class AbstractSequencer {
     virtual vktrace_trace_packet_header *get_next_packet() = 0;
     virtual void get_bookmark(seqBookmark &bookmark) = 0;
     virtual void set_bookmark(const seqBookmark &bookmark) = 0;
+    virtual void record_bookmark() = 0;
+    virtual void set_end_offset(uint64_t endOffset) = 0;
+    virtual void clean_up() = 0;
+
+    // Keep the packets returned by get_next_packet() valid until they are passed to
+    // release_packet(), instead of only until the next call. The packets held when
+    // get_next_packet() is called must add up to less than maxHeldBytes. Returns false if
+    // the sequencer can't do this. release_packet() may be called from any thread.
+    virtual bool hold_packets(uint64_t maxHeldBytes) { return false; }
+    virtual void release_packet(vktrace_trace_packet_header *pPacket) {}
+
+    // Sequencers that interpret packets ahead of replay return the result of Interpret()
+    // for the packet get_next_packet() returned last.
+    virtual bool get_interpreted_packet(vktrace_trace_packet_header **ppInterpreted) { return false; }
 };
 
+struct vktrace_trace_packet_replay_library;
+
 class Sequencer : public AbstractSequencer {
    public:
-    Sequencer(FileLike *pFile) : m_lastPacket(NULL), m_pFile(pFile) {}
+    Sequencer(FileLike *pFile)
+        : m_lastPacket(NULL),
+          m_pFile(pFile),
+          m_fileOffset(pFile ? vktrace_FileLike_GetCurrentPosition(pFile) : 0),
+          m_endOffset(0),
+          m_holdPackets(false) {}
     ~Sequencer() { this->clean_up(); }
 
-    void clean_up() {
-        if (m_lastPacket) {
-            free(m_lastPacket);
-            m_lastPacket = NULL;
-        }
-    }
+    void clean_up() { vktrace_delete_trace_packet(&m_lastPacket); }
 
     vktrace_trace_packet_header *get_next_packet();
     void get_bookmark(seqBookmark &bookmark);
     void set_bookmark(const seqBookmark &bookmark);
     void record_bookmark();
 
+    // Stop returning packets at this file offset, e.g. where the portability table packet
+    // or the frame after the last looped frame starts. 0 reads to the end of the file.
+    void set_end_offset(uint64_t endOffset) { m_endOffset = endOffset; }
+
+    bool hold_packets(uint64_t maxHeldBytes) {
+        m_holdPackets = true;
+        return true;
+    }
+    void release_packet(vktrace_trace_packet_header *pPacket) { vktrace_delete_trace_packet(&pPacket); }
+
    private:
     vktrace_trace_packet_header *m_lastPacket;
     seqBookmark m_bookmark;
     FileLike *m_pFile;
+    uint64_t m_fileOffset;
+    uint64_t m_endOffset;
+    bool m_holdPackets;
+};
+
+// Size of the read-ahead and release windows of MappedSequencer.
+#define VKREPLAY_MAPPED_SEQUENCER_WINDOW_SIZE (16 * 1024 * 1024)
+
+// Hands out packets that point directly into a private memory mapping of the trace file,
+// instead of allocating and reading every packet. The interpreter patches the packets in
+// place, so only the pages it writes to get copied. Pages behind the packet being
+// replayed are given back to the system, which also drops what was patched, so packets
+// read again after set_bookmark() are unchanged.
+class MappedSequencer : public AbstractSequencer {
+   public:
+    MappedSequencer(FileLike *pFile);
+    ~MappedSequencer();
+
+    // Map the trace file. Fails for compressed trace files and on platforms without
+    // support, in which case Sequencer has to be used.
+    bool map_file();
+
+    void clean_up();
+    vktrace_trace_packet_header *get_next_packet();
+    void get_bookmark(seqBookmark &bookmark);
+    void set_bookmark(const seqBookmark &bookmark);
+    void record_bookmark();
+    void set_end_offset(uint64_t endOffset) { m_endOffset = endOffset; }
+    bool hold_packets(uint64_t maxHeldBytes);
+    void release_packet(vktrace_trace_packet_header *pPacket);
+
+   private:
+    void release_pages(uint64_t startOffset, uint64_t endOffset);
+
+    FileLike *m_pFile;
+    uint8_t *m_pMapping;
+    uint64_t m_mappingSize;
+    vktrace_trace_packet_header *m_copiedPacket;  // misaligned packets are copied
+    seqBookmark m_bookmark;
+    uint64_t m_fileOffset;
+    uint64_t m_endOffset;
+    uint64_t m_releasedOffset;    // pages before this offset have been released
+    uint64_t m_prefetchedOffset;  // read ahead has been requested up to this offset
+    uint64_t m_touchedOffset;     // end of the furthest packet handed out
+    uint64_t m_maxHeldBytes;      // pages this far behind the next packet are kept
+    bool m_holdPackets;
+};
+
+// Reads packets from another sequencer on a thread of its own and interprets them on a
+// second thread, so replay neither waits for the trace file nor spends time fixing up
+// pointers. At most maxQueuedPackets packets and about maxQueuedBytes bytes, counting the
+// packet being replayed, are read ahead. The source sequencer must be able to hold packets
+// and must not share its FileLike with anything that reads the trace file during replay.
+class PrefetchSequencer : public AbstractSequencer {
+   public:
+    PrefetchSequencer(AbstractSequencer *pSource, vktrace_trace_packet_replay_library *replayerArray[],
+                      uint32_t maxQueuedPackets, uint64_t maxQueuedBytes);
+    ~PrefetchSequencer();
+
+    void clean_up();
+    vktrace_trace_packet_header *get_next_packet();
+    bool get_interpreted_packet(vktrace_trace_packet_header **ppInterpreted);
+    void get_bookmark(seqBookmark &bookmark);
+    void set_bookmark(const seqBookmark &bookmark);
+    void record_bookmark();
+    void set_end_offset(uint64_t endOffset) { m_pSource->set_end_offset(endOffset); }
+
+   private:
+    struct QueuedPacket {
+        vktrace_trace_packet_header *pPacket;
+        vktrace_trace_packet_header *pInterpreted;
+        bool interpreted;
+        seqBookmark nextPacket;  // file offset just after the packet
+    };
+
+    void start_threads();
+    void stop_threads();
+    void release_current_packet();
+    void read_packets();
+    void interpret_packets();
+
+    AbstractSequencer *m_pSource;
+    vktrace_trace_packet_replay_library **m_replayerArray;
+    uint32_t m_maxQueuedPackets;
+    uint64_t m_maxQueuedBytes;
+
+    // Protected by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<QueuedPacket> m_readPackets;         // waiting to be interpreted
+    std::deque<QueuedPacket> m_interpretedPackets;  // waiting to be replayed
+    uint32_t m_queuedPackets;                       // packets in the queues, being interpreted or replayed
+    uint64_t m_queuedBytes;
+    bool m_readDone;
+    bool m_interpretDone;
+    bool m_stopping;
+
+    std::thread m_readThread;
+    std::thread m_interpretThread;
+    bool m_running;
+    QueuedPacket m_currentPacket;
+    bool m_haveCurrentPacket;
+    seqBookmark m_position;  // file offset just after the packet being replayed
+    seqBookmark m_bookmark;
 };
 
 } /* namespace vktrace_replay */
@@ -60,6 +60,7 @@ std::vector<uint64_t> portabilityTable;
 FileLike *traceFile;
 
 vkReplay::~vkReplay() {
+    m_objMapper.log_lookup_counts();
     delete m_display;
     vktrace_platform_close_library(m_libHandle);
 }
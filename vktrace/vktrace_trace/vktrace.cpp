@@ -25,10 +25,12 @@
 
 extern "C" {
 #include "vktrace_common.h"
+#include "vktrace_compression.h"
 #include "vktrace_filelike.h"
 #include "vktrace_interconnect.h"
 #include "vktrace_trace_packet_identifiers.h"
 #include "vktrace_trace_packet_utils.h"
+#include "vktrace_trace_file_writer.h"
 }
 
 #include <sys/types.h>
@@ -37,6 +39,7 @@ extern "C" {
 
 vktrace_settings g_settings;
 vktrace_settings g_default_settings;
+VKTRACE_COMPRESSION_TYPE g_compressionType = VKTRACE_COMPRESSION_NONE;
 
 vktrace_SettingInfo g_settings_info[] = {
     // common command options
@@ -93,6 +96,20 @@ vktrace_SettingInfo g_settings_info[] = {
      {&g_default_settings.enable_pmb},
      TRUE,
      "Enable tracking of persistently mapped buffers, default is TRUE."},
+    {"aw",
+     "AsyncWriter",
+     VKTRACE_SETTING_BOOL,
+     {&g_settings.enable_async_writer},
+     {&g_default_settings.enable_async_writer},
+     TRUE,
+     "Send trace packets from a background thread in the trace layer, default is TRUE."},
+    {"c",
+     "Compression",
+     VKTRACE_SETTING_STRING,
+     {&g_settings.compression},
+     {&g_default_settings.compression},
+     TRUE,
+     "Write a block compressed trace file. <string> is one of none, lz4 (fast) or zstd (smaller). Default is none."},
 #if _DEBUG
     {"v",
      "Verbosity",
@@ -261,49 +278,6 @@ char* find_available_filename(const char* originalFilename, bool bForceOverwrite
     return pOutputFilename;
 }
 
-// Portability table - Table of trace file offsets to packets
-// we need to access to determine what memory index should be used
-// in vkAllocateMemory during trace playback. This table is appended
-// to the trace file.
-std::vector<uint64_t> portabilityTable;
-uint32_t lastPacketThreadId;
-uint64_t lastPacketIndex;
-uint64_t lastPacketEndTime;
-
-static void vktrace_appendPortabilityPacket(FILE* pTraceFile) {
-    vktrace_trace_packet_header hdr;
-    uint64_t one_64 = 1;
-
-    if (pTraceFile == NULL) {
-        vktrace_LogError("tracefile was not created");
-        return;
-    }
-
-    vktrace_LogVerbose("Post processing trace file");
-
-    // Add a word containing the size of the table to the table.
-    // This will be the last word in the file.
-    portabilityTable.push_back(portabilityTable.size());
-
-    // Append the table packet to the trace file.
-    hdr.size = sizeof(hdr) + portabilityTable.size() * sizeof(uint64_t);
-    hdr.global_packet_index = lastPacketIndex + 1;
-    hdr.tracer_id = VKTRACE_TID_VULKAN;
-    hdr.packet_id = VKTRACE_TPI_PORTABILITY_TABLE;
-    hdr.thread_id = lastPacketThreadId;
-    hdr.vktrace_begin_time = hdr.entrypoint_begin_time = hdr.entrypoint_end_time = hdr.vktrace_end_time = lastPacketEndTime;
-    hdr.next_buffers_offset = 0;
-    hdr.pBody = (uintptr_t)NULL;
-    if (0 == Fseek(pTraceFile, 0, SEEK_END) && 1 == fwrite(&hdr, sizeof(hdr), 1, pTraceFile) &&
-        portabilityTable.size() == fwrite(&portabilityTable[0], sizeof(uint64_t), portabilityTable.size(), pTraceFile)) {
-        // Set the flag in the file header that indicates the portability table has been written
-        if (0 == fseek(pTraceFile, offsetof(vktrace_trace_file_header, portability_table_valid), SEEK_SET))
-            fwrite(&one_64, sizeof(uint64_t), 1, pTraceFile);
-    }
-    portabilityTable.clear();
-    vktrace_LogVerbose("Post processing of trace file completed");
-}
-
 // ------------------------------------------------------------------------------------------------
 int main(int argc, char* argv[]) {
     int exitval = 0;
@@ -319,6 +293,8 @@ int main(int argc, char* argv[]) {
     g_default_settings.screenshotList = NULL;
     g_default_settings.screenshotColorFormat = NULL;
     g_default_settings.enable_pmb = true;
+    g_default_settings.enable_async_writer = true;
+    g_default_settings.compression = "none";
 
     // Check to see if the PAGEGUARD_PAGEGUARD_ENABLE_ENV env var is set.
     // If it is set to anything but "1", set the default to false.
@@ -326,6 +302,10 @@ int main(int argc, char* argv[]) {
     char* pmbEnableEnv = vktrace_get_global_var(VKTRACE_PMB_ENABLE_ENV);
     if (pmbEnableEnv && strcmp(pmbEnableEnv, "1")) g_default_settings.enable_pmb = false;
 
+    // Likewise, VKTRACE_ASYNC_WRITER set to "0" changes the default for the packet writer thread.
+    char* asyncWriterEnv = vktrace_get_global_var(VKTRACE_ASYNC_WRITER_ENV);
+    if (asyncWriterEnv && !strcmp(asyncWriterEnv, "0")) g_default_settings.enable_async_writer = false;
+
     if (vktrace_SettingGroup_init(&g_settingGroup, NULL, argc, argv, &g_settings.arguments) != 0) {
         // invalid cmd-line parameters
         vktrace_SettingGroup_delete(&g_settingGroup);
@@ -357,6 +337,14 @@ int main(int argc, char* argv[]) {
         }
         vktrace_set_global_var(_VKTRACE_VERBOSITY_ENV, g_settings.verbosity);
 
+        if (!vktrace_compression_parse_type(g_settings.compression, &g_compressionType)) {
+            vktrace_LogError("Unknown compression type '%s'.", g_settings.compression);
+            validArgs = FALSE;
+        } else if (!vktrace_compression_supported(g_compressionType)) {
+            vktrace_LogError("This build of vktrace doesn't support %s compression.", g_settings.compression);
+            validArgs = FALSE;
+        }
+
         if (g_settings.screenshotList) {
             if (!screenshot::checkParsingFrameRange(g_settings.screenshotList)) {
                 vktrace_LogError("Screenshot range error");
@@ -406,6 +394,7 @@ int main(int argc, char* argv[]) {
     }
 
     vktrace_set_global_var(VKTRACE_PMB_ENABLE_ENV, g_settings.enable_pmb ? "1" : "0");
+    vktrace_set_global_var(VKTRACE_ASYNC_WRITER_ENV, g_settings.enable_async_writer ? "1" : "0");
 
     if (g_settings.traceTrigger) {
         // Export list to screenshot layer
@@ -505,7 +494,11 @@ int main(int argc, char* argv[]) {
             exitval = (int)MessageLoop();
 #endif
         }
-        vktrace_appendPortabilityPacket(procInfo.pTraceFile);
+        if (procInfo.pTraceFileWriter == NULL) {
+            vktrace_LogError("tracefile was not created");
+        } else {
+            vktrace_TraceFileWriter_finish(procInfo.pTraceFileWriter);
+        }
         vktrace_process_info_delete(&procInfo);
         serverIndex++;
     } while (g_settings.program == NULL);
@@ -23,6 +23,7 @@
 extern "C" {
 #include "vktrace_settings.h"
 }
+#include "vktrace_compression.h"
 
 #include <vector>
 
@@ -42,6 +43,8 @@ typedef struct vktrace_settings {
     const char* screenshotList;
     const char* screenshotColorFormat;
     BOOL enable_pmb;
+    BOOL enable_async_writer;
+    const char* compression;
     const char* verbosity;
     const char* traceTrigger;
 
@@ -49,11 +52,5 @@ typedef struct vktrace_settings {
 
 extern vktrace_settings g_settings;
 
-// Portability table - Table of trace file offsets to packets
-// we need to access to determine what memory index should be used
-// in vkAllocateMemory during trace playback. This table is appended
-// to the trace file.
-extern std::vector<uint64_t> portabilityTable;
-extern uint32_t lastPacketThreadId;
-extern uint64_t lastPacketIndex;
-extern uint64_t lastPacketEndTime;
+// Parsed from g_settings.compression.
+extern VKTRACE_COMPRESSION_TYPE g_compressionType;
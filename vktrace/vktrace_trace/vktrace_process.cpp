@@ -38,6 +38,7 @@ extern "C" {
 #include "vktrace_filelike.h"
 #include "vktrace_interconnect.h"
 #include "vktrace_trace_packet_utils.h"
+#include "vktrace_trace_file_writer.h"
 #include "vktrace_vk_packet_id.h"
 }
 
@@ -120,8 +121,6 @@ VKTRACE_THREAD_ROUTINE_RETURN_TYPE Process_RunRecordTraceThread(LPVOID _threadIn
     uint64_t fileHeaderSize;
     vktrace_trace_file_header file_header;
     vktrace_trace_packet_header* pHeader = NULL;
-    uint64_t bytes_written;
-    uint64_t fileOffset;
 #if defined(WIN32)
     BOOL rval;
 #elif defined(PLATFORM_LINUX)
@@ -164,26 +163,21 @@ VKTRACE_THREAD_ROUTINE_RETURN_TYPE Process_RunRecordTraceThread(LPVOID _threadIn
         return 1;
     }
 
-    vktrace_enter_critical_section(&pInfo->pProcessInfo->traceFileCriticalSection);
-
-    // Write the trace file header to the file
-    bytes_written = fwrite(&file_header, 1, sizeof(file_header), pInfo->pProcessInfo->pTraceFile);
-
-    // Read and write the gpu_info structs
-    struct_gpuinfo gpuinfo;
+    // Read the gpu_info structs
+    std::vector<struct_gpuinfo> gpuinfo((size_t)file_header.n_gpuinfo);
     for (uint64_t i = 0; i < file_header.n_gpuinfo; i++) {
-        vktrace_FileLike_ReadRaw(fileLikeSocket, &gpuinfo, sizeof(struct_gpuinfo));
-        bytes_written += fwrite(&gpuinfo, 1, sizeof(struct_gpuinfo), pInfo->pProcessInfo->pTraceFile);
+        vktrace_FileLike_ReadRaw(fileLikeSocket, &gpuinfo[(size_t)i], sizeof(struct_gpuinfo));
     }
-    fflush(pInfo->pProcessInfo->pTraceFile);
-    vktrace_leave_critical_section(&pInfo->pProcessInfo->traceFileCriticalSection);
 
-    if (bytes_written != sizeof(file_header) + file_header.n_gpuinfo * sizeof(struct_gpuinfo)) {
+    // Write the trace file header to the file
+    pInfo->pProcessInfo->pTraceFileWriter = vktrace_TraceFileWriter_create(pInfo->pProcessInfo->pTraceFile, 0);
+    if (pInfo->pProcessInfo->pTraceFileWriter == NULL ||
+        !vktrace_TraceFileWriter_set_compression(pInfo->pProcessInfo->pTraceFileWriter, g_compressionType) ||
+        !vktrace_TraceFileWriter_write_header(pInfo->pProcessInfo->pTraceFileWriter, &file_header, gpuinfo.data())) {
         vktrace_LogError("Unable to write trace file header - fwrite failed.");
         vktrace_process_info_delete(pInfo->pProcessInfo);
         return 1;
     }
-    fileOffset = file_header.first_packet_offset;
 
 #if defined(WIN32)
     rval = SetConsoleCtrlHandler((PHANDLER_ROUTINE)terminationSignalHandler, TRUE);
@@ -235,31 +229,10 @@ VKTRACE_THREAD_ROUTINE_RETURN_TYPE Process_RunRecordTraceThread(LPVOID _threadIn
                 break;
             }
 
-            if (pInfo->pProcessInfo->pTraceFile != NULL) {
-                vktrace_enter_critical_section(&pInfo->pProcessInfo->traceFileCriticalSection);
-                bytes_written = fwrite(pHeader, 1, (size_t)pHeader->size, pInfo->pProcessInfo->pTraceFile);
-                fflush(pInfo->pProcessInfo->pTraceFile);
-                vktrace_leave_critical_section(&pInfo->pProcessInfo->traceFileCriticalSection);
-                if (bytes_written != pHeader->size) {
+            if (pInfo->pProcessInfo->pTraceFileWriter != NULL) {
+                if (!vktrace_TraceFileWriter_write_packet(pInfo->pProcessInfo->pTraceFileWriter, pHeader)) {
                     vktrace_LogError("Failed to write the packet for packet_id = %hu", pHeader->packet_id);
                 }
-
-                // If the packet is one we need to track, add it to the table
-                if (pHeader->packet_id == VKTRACE_TPI_VK_vkBindImageMemory ||
-                    pHeader->packet_id == VKTRACE_TPI_VK_vkBindBufferMemory ||
-                    pHeader->packet_id == VKTRACE_TPI_VK_vkBindImageMemory2KHR ||
-                    pHeader->packet_id == VKTRACE_TPI_VK_vkBindBufferMemory2KHR ||
-                    pHeader->packet_id == VKTRACE_TPI_VK_vkAllocateMemory || pHeader->packet_id == VKTRACE_TPI_VK_vkDestroyImage ||
-                    pHeader->packet_id == VKTRACE_TPI_VK_vkDestroyBuffer || pHeader->packet_id == VKTRACE_TPI_VK_vkFreeMemory ||
-                    pHeader->packet_id == VKTRACE_TPI_VK_vkCreateBuffer || pHeader->packet_id == VKTRACE_TPI_VK_vkCreateImage) {
-                    vktrace_LogDebug("Add packet to portability table: %s",
-                                     vktrace_vk_packet_id_name((VKTRACE_TRACE_PACKET_ID_VK)pHeader->packet_id));
-                    portabilityTable.push_back(fileOffset);
-                }
-                lastPacketIndex = pHeader->global_packet_index;
-                lastPacketThreadId = pHeader->thread_id;
-                lastPacketEndTime = pHeader->vktrace_end_time;
-                fileOffset += bytes_written;
             }
         }
 
@@ -457,14 +457,14 @@ void vktraceviewer::GenerateTraceFileStats() {
     uint64_t totalTraceTime = 0;
 
     if (m_traceFileInfo.packetCount > 0) {
-        uint64_t start = m_traceFileInfo.pPacketOffsets[0].pHeader->entrypoint_begin_time;
-        uint64_t end = m_traceFileInfo.pPacketOffsets[m_traceFileInfo.packetCount - 1].pHeader->entrypoint_end_time;
+        uint64_t start = m_traceFileInfo.pPacketOffsets[0].header.entrypoint_begin_time;
+        uint64_t end = m_traceFileInfo.pPacketOffsets[m_traceFileInfo.packetCount - 1].header.entrypoint_end_time;
         totalTraceTime = end - start;
     }
 
     QMap<uint16_t, vtvApiUsageStats> statMap;
     for (uint64_t i = 0; i < m_traceFileInfo.packetCount; i++) {
-        vktrace_trace_packet_header* pHeader = m_traceFileInfo.pPacketOffsets[i].pHeader;
+        const vktrace_trace_packet_header* pHeader = &m_traceFileInfo.pPacketOffsets[i].header;
         if (pHeader->packet_id >= VKTRACE_TPI_VK_vkApiVersion) {
             totalStats.totalCallCount++;
             totalStats.totalCpuExecutionTime += (pHeader->entrypoint_end_time - pHeader->entrypoint_begin_time);
@@ -644,23 +644,7 @@ void vktraceviewer::close_trace_file() {
         m_pTimeline->repaint();
     }
 
-    if (m_traceFileInfo.packetCount > 0) {
-        for (unsigned int i = 0; i < m_traceFileInfo.packetCount; i++) {
-            if (m_traceFileInfo.pPacketOffsets[i].pHeader != NULL) {
-                vktrace_free(m_traceFileInfo.pPacketOffsets[i].pHeader);
-                m_traceFileInfo.pPacketOffsets[i].pHeader = NULL;
-            }
-        }
-
-        VKTRACE_DELETE(m_traceFileInfo.pPacketOffsets);
-        m_traceFileInfo.pPacketOffsets = NULL;
-        m_traceFileInfo.packetCount = 0;
-    }
-
-    if (m_traceFileInfo.pFile != NULL) {
-        fclose(m_traceFileInfo.pFile);
-        m_traceFileInfo.pFile = NULL;
-    }
+    vktraceviewer_free_trace_file_info(&m_traceFileInfo);
 
     if (m_traceFileInfo.filename != NULL) {
         vktrace_free(m_traceFileInfo.filename);
@@ -702,10 +686,10 @@ void vktraceviewer::on_actionExport_API_Calls_triggered() {
 
         // iterate through every packet
         for (unsigned int i = 0; i < m_traceFileInfo.packetCount; i++) {
-            vktraceviewer_trace_file_packet_offsets* pOffsets = &m_traceFileInfo.pPacketOffsets[i];
-            vktrace_trace_packet_header* pHeader = pOffsets->pHeader;
-            assert(pHeader != NULL);
-            QString string = m_pTraceFileModel->get_packet_string(pHeader);
+            vktrace_trace_packet_header* pHeader = vktraceviewer_acquire_trace_packet(&m_traceFileInfo, i);
+            QString string = (pHeader != NULL) ? m_pTraceFileModel->get_packet_string(pHeader)
+                                               : QString("%1").arg(m_traceFileInfo.pPacketOffsets[i].header.packet_id);
+            vktraceviewer_release_trace_packet(&m_traceFileInfo, i);
 
             // output packet string
             fprintf(pFile, "%s\n", string.toStdString().c_str());
@@ -235,12 +235,15 @@ void vktraceviewer_QReplayWorker::playCurrentTraceFile(uint64_t startPacketIndex
         emit ReplayProgressUpdate(m_currentReplayPacketIndex);
 
         pCurPacket = &pTraceFileInfo->pPacketOffsets[i];
-        s_currentReplayPacket = pCurPacket->pHeader->global_packet_index;
-        switch (pCurPacket->pHeader->packet_id) {
+        s_currentReplayPacket = pCurPacket->header.global_packet_index;
+        switch (pCurPacket->header.packet_id) {
             case VKTRACE_TPI_MESSAGE: {
-                vktrace_trace_packet_message* msgPacket;
-                msgPacket = (vktrace_trace_packet_message*)pCurPacket->pHeader;
-                replayWorkerLoggingCallback(msgPacket->type, msgPacket->message);
+                vktrace_trace_packet_header* pPacket = vktraceviewer_acquire_trace_packet(pTraceFileInfo, i);
+                if (pPacket != NULL) {
+                    vktrace_trace_packet_message* msgPacket = (vktrace_trace_packet_message*)pPacket->pBody;
+                    replayWorkerLoggingCallback(msgPacket->type, msgPacket->message);
+                }
+                vktraceviewer_release_trace_packet(pTraceFileInfo, i);
                 break;
             }
             case VKTRACE_TPI_MARKER_CHECKPOINT:
@@ -257,29 +260,33 @@ void vktraceviewer_QReplayWorker::playCurrentTraceFile(uint64_t startPacketIndex
                 break;
             // TODO processing code for all the above cases
             default: {
-                if (pCurPacket->pHeader->tracer_id >= VKTRACE_MAX_TRACER_ID_ARRAY_SIZE ||
-                    pCurPacket->pHeader->tracer_id == VKTRACE_TID_RESERVED) {
+                if (pCurPacket->header.tracer_id >= VKTRACE_MAX_TRACER_ID_ARRAY_SIZE ||
+                    pCurPacket->header.tracer_id == VKTRACE_TID_RESERVED) {
                     replayWorkerLoggingCallback(VKTRACE_LOG_WARNING, QString("Tracer_id from packet num packet %1 invalid.")
-                                                                         .arg(pCurPacket->pHeader->packet_id)
+                                                                         .arg(pCurPacket->header.packet_id)
                                                                          .toStdString()
                                                                          .c_str());
                     continue;
                 }
-                replayer = m_pReplayers[pCurPacket->pHeader->tracer_id];
+                replayer = m_pReplayers[pCurPacket->header.tracer_id];
                 if (replayer == NULL) {
                     replayWorkerLoggingCallback(
                         VKTRACE_LOG_WARNING,
-                        QString("Tracer_id %1 has no valid replayer.").arg(pCurPacket->pHeader->tracer_id).toStdString().c_str());
+                        QString("Tracer_id %1 has no valid replayer.").arg(pCurPacket->header.tracer_id).toStdString().c_str());
                     continue;
                 }
-                if (pCurPacket->pHeader->packet_id >= VKTRACE_TPI_VK_vkApiVersion) {
-                    // replay the API packet
+                if (pCurPacket->header.packet_id >= VKTRACE_TPI_VK_vkApiVersion) {
+                    // replay the API packet, reading it from the trace file if it isn't cached
+                    vktrace_trace_packet_header* pPacket = vktraceviewer_acquire_trace_packet(pTraceFileInfo, i);
+                    res = vktrace_replay::VKTRACE_REPLAY_ERROR;
                     try {
-                        res = replayer->Replay(pCurPacket->pHeader);
+                        if (pPacket != NULL) {
+                            res = replayer->Replay(pPacket);
+                        }
                     } catch (std::exception& e) {
                         replayWorkerLoggingCallback(VKTRACE_LOG_ERROR,
                                                     QString("Caught std::exception while replaying packet %1: %2")
-                                                        .arg(pCurPacket->pHeader->global_packet_index)
+                                                        .arg(pCurPacket->header.global_packet_index)
                                                         .arg(e.what())
                                                         .toStdString()
                                                         .c_str());
@@ -289,18 +296,19 @@ void vktraceviewer_QReplayWorker::playCurrentTraceFile(uint64_t startPacketIndex
                     } catch (...) {
                         replayWorkerLoggingCallback(VKTRACE_LOG_ERROR, "Caught unknown exception.");
                     }
+                    vktraceviewer_release_trace_packet(pTraceFileInfo, i);
 
                     if (res == vktrace_replay::VKTRACE_REPLAY_ERROR || res == vktrace_replay::VKTRACE_REPLAY_INVALID_ID ||
                         res == vktrace_replay::VKTRACE_REPLAY_CALL_ERROR) {
                         replayWorkerLoggingCallback(VKTRACE_LOG_ERROR, QString("Failed to replay packet %1.")
-                                                                           .arg(pCurPacket->pHeader->global_packet_index)
+                                                                           .arg(pCurPacket->header.global_packet_index)
                                                                            .toStdString()
                                                                            .c_str());
                     } else if (res == vktrace_replay::VKTRACE_REPLAY_BAD_RETURN) {
                         replayWorkerLoggingCallback(
                             VKTRACE_LOG_WARNING,
                             QString("Replay of packet %1 has diverged from trace due to a different return value.")
-                                .arg(pCurPacket->pHeader->global_packet_index)
+                                .arg(pCurPacket->header.global_packet_index)
                                 .toStdString()
                                 .c_str());
                     } else if (res == vktrace_replay::VKTRACE_REPLAY_INVALID_PARAMS ||
@@ -309,14 +317,14 @@ void vktraceviewer_QReplayWorker::playCurrentTraceFile(uint64_t startPacketIndex
                         // warnings here.
                     } else if (res != vktrace_replay::VKTRACE_REPLAY_SUCCESS) {
                         replayWorkerLoggingCallback(VKTRACE_LOG_ERROR, QString("Unknown error caused by packet %1.")
-                                                                           .arg(pCurPacket->pHeader->global_packet_index)
+                                                                           .arg(pCurPacket->header.global_packet_index)
                                                                            .toStdString()
                                                                            .c_str());
                     }
                 } else {
                     replayWorkerLoggingCallback(VKTRACE_LOG_ERROR, QString("Bad packet type id=%1, index=%2.")
-                                                                       .arg(pCurPacket->pHeader->packet_id)
-                                                                       .arg(pCurPacket->pHeader->global_packet_index)
+                                                                       .arg(pCurPacket->header.packet_id)
+                                                                       .arg(pCurPacket->header.global_packet_index)
                                                                        .toStdString()
                                                                        .c_str());
                 }
@@ -324,26 +332,26 @@ void vktraceviewer_QReplayWorker::playCurrentTraceFile(uint64_t startPacketIndex
         }
 
         // Process events and pause or stop if needed
-        if (m_bPauseReplay || m_pauseAtPacketIndex == pCurPacket->pHeader->global_packet_index) {
-            if (m_pauseAtPacketIndex == pCurPacket->pHeader->global_packet_index) {
+        if (m_bPauseReplay || m_pauseAtPacketIndex == pCurPacket->header.global_packet_index) {
+            if (m_pauseAtPacketIndex == pCurPacket->header.global_packet_index) {
                 // reset
                 m_pauseAtPacketIndex = (uint64_t)-1;
             }
 
             m_bReplayInProgress = false;
-            doReplayPaused(pCurPacket->pHeader->global_packet_index);
+            doReplayPaused(pCurPacket->header.global_packet_index);
             return;
         }
 
         if (m_bStopReplay) {
             m_bReplayInProgress = false;
-            doReplayStopped(pCurPacket->pHeader->global_packet_index);
+            doReplayStopped(pCurPacket->header.global_packet_index);
             return;
         }
     }
 
     m_bReplayInProgress = false;
-    doReplayFinished(pCurPacket->pHeader->global_packet_index);
+    doReplayFinished(pCurPacket->header.global_packet_index);
 }
 
 void vktraceviewer_QReplayWorker::onPlayToHere() {
@@ -407,7 +415,7 @@ void vktraceviewer_QReplayWorker::StopReplay() {
         // Replay is not in progress means:
         // 1) replay wasn't started (in which case stop button should be disabled and we can't get to this point),
         // 2) replay is currently paused, so do same actions as if the replay detected that it should stop.
-        uint64_t packetIndex = this->m_pTraceFileInfo->pPacketOffsets[m_currentReplayPacketIndex].pHeader->global_packet_index;
+        uint64_t packetIndex = this->m_pTraceFileInfo->pPacketOffsets[m_currentReplayPacketIndex].header.global_packet_index;
         doReplayStopped(packetIndex);
     }
 }
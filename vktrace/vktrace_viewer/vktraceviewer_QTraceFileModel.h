@@ -120,9 +120,7 @@ class vktraceviewer_QTraceFileModel : public QAbstractItemModel {
         if (role == Qt::DisplayRole) {
             switch (index.column()) {
                 case Column_EntrypointName: {
-                    vktrace_trace_packet_header* pHeader = (vktrace_trace_packet_header*)index.internalPointer();
-                    QString apiStr = this->get_packet_string(pHeader);
-                    return apiStr;
+                    return get_packet_string_at(index.row(), false);
                 }
                 case Column_TracerId:
                     return QVariant(*(uint8_t*)index.internalPointer());
@@ -165,7 +163,7 @@ class vktraceviewer_QTraceFileModel : public QAbstractItemModel {
             tip += "<br>";
 #endif
             tip += "<tr><td><b>";
-            QString multiline = this->get_packet_string_multiline(pHeader);
+            QString multiline = get_packet_string_at(index.row(), true);
             // only replaces the first '('
             multiline.replace(multiline.indexOf("("), 1, "</b>(</td><td/></tr><tr><td>");
             multiline.replace(", ", ", </td></tr><tr><td>");
@@ -191,7 +189,7 @@ class vktraceviewer_QTraceFileModel : public QAbstractItemModel {
             return QModelIndex();
         }
 
-        vktrace_trace_packet_header* pHeader = m_pTraceFileInfo->pPacketOffsets[row].pHeader;
+        vktrace_trace_packet_header* pHeader = &m_pTraceFileInfo->pPacketOffsets[row].header;
         void* pData = NULL;
         switch (column) {
             case Column_EntrypointName:
@@ -255,5 +253,18 @@ class vktraceviewer_QTraceFileModel : public QAbstractItemModel {
 
    private:
     vktraceviewer_trace_file_info* m_pTraceFileInfo;
+
+    // The index only points at the header, so the packet body is read (or found in the cache) to build the string.
+    QString get_packet_string_at(int row, bool multiline) const {
+        vktrace_trace_packet_header* pPacket = vktraceviewer_acquire_trace_packet(m_pTraceFileInfo, row);
+        QString packetString;
+        if (pPacket == NULL) {
+            packetString = QString("%1").arg(m_pTraceFileInfo->pPacketOffsets[row].header.packet_id);
+        } else {
+            packetString = multiline ? get_packet_string_multiline(pPacket) : get_packet_string(pPacket);
+        }
+        vktraceviewer_release_trace_packet(m_pTraceFileInfo, row);
+        return packetString;
+    }
     QString m_searchString;
 };
@@ -19,23 +19,147 @@
  * Author: Peter Lohrmann <peterl@valvesoftware.com> <plohrmann@gmail.com>
  **************************************************************************/
 #include "vktraceviewer_trace_file_utils.h"
+#include "vktraceviewer_controller.h"
+#include "vktrace_compression.h"
 #include "vktrace_memory.h"
 
-BOOL vktraceviewer_populate_trace_file_info(vktraceviewer_trace_file_info* pTraceFileInfo) {
+#include <QMutex>
+#include <QMutexLocker>
+#include <list>
+#include <unordered_map>
+
+#if defined(WIN32)
+#include <io.h>
+#endif
+
+extern "C" {
+#include "vktrace_trace_packet_utils.h"
+}
+
+struct vktraceviewer_cached_packet {
+    vktrace_trace_packet_header* pPacket;
+    uint32_t refCount;
+
+    // position in the LRU list while refCount is 0
+    std::list<uint64_t>::iterator lruPosition;
+};
+
+struct vktraceviewer_trace_packet_cache {
+    // serializes reads from the trace file and access to the cache; packets are requested by both the UI and the replay worker
+    QMutex mutex;
+
+    // read-only mapping of the whole trace file, or NULL to read packets with fread instead
+    const uint8_t* pMapping;
+    uint64_t fileSize;
+
+    // reads compressed trace files block by block, or NULL for uncompressed trace files
+    CompressedFileReader* pCompressedReader;
+#if defined(WIN32)
+    HANDLE hMapping;
+#endif
+
+    vktraceviewer_QController* pController;
+
+    std::unordered_map<uint64_t, vktraceviewer_cached_packet> packets;
+
+    // packets that are no longer in use, most recently released first
+    std::list<uint64_t> lru;
+    uint64_t unusedBytes;
+};
+
+static void map_trace_file(vktraceviewer_trace_packet_cache* pCache, FILE* pFile) {
+    pCache->pMapping = NULL;
+    if (pCache->fileSize == 0 || pCache->fileSize != (size_t)pCache->fileSize) {
+        return;
+    }
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_OSX)
+    void* pMapping = mmap(NULL, (size_t)pCache->fileSize, PROT_READ, MAP_SHARED, fileno(pFile), 0);
+    if (pMapping != MAP_FAILED) {
+        pCache->pMapping = (const uint8_t*)pMapping;
+    }
+#elif defined(WIN32)
+    pCache->hMapping = CreateFileMapping((HANDLE)_get_osfhandle(_fileno(pFile)), NULL, PAGE_READONLY, 0, 0, NULL);
+    if (pCache->hMapping != NULL) {
+        pCache->pMapping = (const uint8_t*)MapViewOfFile(pCache->hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (pCache->pMapping == NULL) {
+            CloseHandle(pCache->hMapping);
+            pCache->hMapping = NULL;
+        }
+    }
+#endif
+}
+
+static void unmap_trace_file(vktraceviewer_trace_packet_cache* pCache) {
+    if (pCache->pMapping == NULL) {
+        return;
+    }
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_OSX)
+    munmap((void*)pCache->pMapping, (size_t)pCache->fileSize);
+#elif defined(WIN32)
+    UnmapViewOfFile(pCache->pMapping);
+    CloseHandle(pCache->hMapping);
+    pCache->hMapping = NULL;
+#endif
+    pCache->pMapping = NULL;
+}
+
+// Copies size bytes at offset out of the mapping, or out of the file if it couldn't be mapped or is compressed.
+static bool read_trace_file(vktraceviewer_trace_file_info* pTraceFileInfo, uint64_t offset, void* pDst, uint64_t size) {
+    vktraceviewer_trace_packet_cache* pCache = pTraceFileInfo->pPacketCache;
+    if (offset > pCache->fileSize || size > pCache->fileSize - offset) {
+        return false;
+    }
+
+    if (pCache->pMapping != NULL) {
+        memcpy(pDst, pCache->pMapping + offset, (size_t)size);
+        return true;
+    }
+
+    if (pCache->pCompressedReader != NULL) {
+        return vktrace_CompressedFileReader_seek(pCache->pCompressedReader, offset) &&
+               vktrace_CompressedFileReader_read(pCache->pCompressedReader, pDst, size);
+    }
+
+    return Fseek(pTraceFileInfo->pFile, offset, SEEK_SET) == 0 && fread(pDst, (size_t)size, 1, pTraceFileInfo->pFile) == 1;
+}
+
+BOOL vktraceviewer_populate_trace_file_info(vktraceviewer_trace_file_info* pTraceFileInfo, QString& errorMessage) {
     vktrace_trace_file_header header;
 
     assert(pTraceFileInfo != NULL);
     assert(pTraceFileInfo->pFile != NULL);
 
+    pTraceFileInfo->pPacketCache = new vktraceviewer_trace_packet_cache();
+    vktraceviewer_trace_packet_cache* pCache = pTraceFileInfo->pPacketCache;
+    pCache->pMapping = NULL;
+    pCache->pCompressedReader = NULL;
+    if (vktrace_CompressedFile_is_compressed(pTraceFileInfo->pFile)) {
+        // Blocks are decompressed as packets are read.
+        pCache->pCompressedReader = vktrace_CompressedFileReader_create(pTraceFileInfo->pFile);
+        if (pCache->pCompressedReader == NULL) {
+            errorMessage = "Unable to read the block table of the compressed trace file.";
+            return FALSE;
+        }
+        pCache->fileSize = vktrace_CompressedFileReader_get_size(pCache->pCompressedReader);
+    } else {
+        int64_t fileSize = (Fseek(pTraceFileInfo->pFile, 0, SEEK_END) == 0) ? (int64_t)Ftell(pTraceFileInfo->pFile) : -1;
+        if (fileSize < 0) {
+            errorMessage = "Unable to determine the size of the trace file.";
+            return FALSE;
+        }
+        pCache->fileSize = (uint64_t)fileSize;
+        map_trace_file(pCache, pTraceFileInfo->pFile);
+    }
+
     // read trace file header
-    if (1 != fread(&header, sizeof(vktrace_trace_file_header), 1, pTraceFileInfo->pFile)) {
-        vktraceviewer_output_error("Unable to read header from file.");
+    if (!read_trace_file(pTraceFileInfo, 0, &header, sizeof(vktrace_trace_file_header))) {
+        errorMessage = "Unable to read header from file.";
         return FALSE;
     }
 
     // Make sure there is at least one gpuinfo struct in header
     if (header.n_gpuinfo < 1) {
-        vktraceviewer_output_error("Trace file head may be corrupt - gpu info missing.");
+        errorMessage = "Trace file head may be corrupt - gpu info missing.";
         return FALSE;
     }
 
@@ -43,95 +167,200 @@ BOOL vktraceviewer_populate_trace_file_info(vktraceviewer_trace_file_info* pTrac
     pTraceFileInfo->pHeader =
         (vktrace_trace_file_header*)vktrace_malloc(sizeof(vktrace_trace_file_header) + header.n_gpuinfo * sizeof(struct_gpuinfo));
     if (!pTraceFileInfo->pHeader) {
-        vktraceviewer_output_error("Unable to allocate memory for file read header.");
+        errorMessage = "Unable to allocate memory for file read header.";
         return FALSE;
     }
     *pTraceFileInfo->pHeader = header;
     pTraceFileInfo->pGpuinfo = (struct_gpuinfo*)(pTraceFileInfo->pHeader + 1);
 
     // read the gpuinfo array
-    if (1 != fread(pTraceFileInfo->pGpuinfo, header.n_gpuinfo * sizeof(struct_gpuinfo), 1, pTraceFileInfo->pFile)) {
-        vktrace_free(pTraceFileInfo->pHeader);
-        vktraceviewer_output_error("Unable to read header from file.");
+    if (!read_trace_file(pTraceFileInfo, sizeof(vktrace_trace_file_header), pTraceFileInfo->pGpuinfo,
+                         header.n_gpuinfo * sizeof(struct_gpuinfo))) {
+        errorMessage = "Unable to read header from file.";
         return FALSE;
     }
 
     // Set global version num
     vktrace_set_trace_version(pTraceFileInfo->pHeader->trace_file_version);
 
-    // Find out how many trace packets there are.
-
-    // Seek to first packet
-    long first_offset = pTraceFileInfo->pHeader->first_packet_offset;
-    int seekResult = Fseek(pTraceFileInfo->pFile, first_offset, SEEK_SET);
-    if (seekResult != 0) {
-        vktraceviewer_output_warning("Failed to seek to the first packet offset in the trace file.");
+    // If the trace file has a packet index, each packet's header is read straight from the offset the index has for it.
+    vktrace_trace_packet_index* pPacketIndex = NULL;
+    FileLike* pFileLike = vktrace_FileLike_create_file(pTraceFileInfo->pFile);
+    if (pFileLike != NULL) {
+        pPacketIndex = vktrace_read_trace_packet_index(pFileLike, pTraceFileInfo->pHeader);
+        vktrace_FileLike_destroy(&pFileLike);
+    }
+    if (pCache->pCompressedReader != NULL) {
+        // The FileLike above read the same FILE, so only now can the blocks after the packet being read be decompressed
+        // ahead on other threads.
+        vktrace_CompressedFileReader_start_read_ahead(pCache->pCompressedReader, 0);
+    }
+    pTraceFileInfo->packetCount = 0;
+    if (pPacketIndex != NULL) {
+        const vktrace_packet_index_entry* pEntries = vktrace_trace_packet_index_entries(pPacketIndex);
+        uint64_t capacity = (pPacketIndex->packet_count > 0) ? pPacketIndex->packet_count : 1;
+        pTraceFileInfo->pPacketOffsets = VKTRACE_NEW_ARRAY(vktraceviewer_trace_file_packet_offsets, capacity);
+        for (uint64_t i = 0; i < pPacketIndex->packet_count; i++) {
+            vktraceviewer_trace_file_packet_offsets* pOffsets = &pTraceFileInfo->pPacketOffsets[i];
+            pOffsets->fileOffset = pEntries[i].offset;
+            if (!read_trace_file(pTraceFileInfo, pOffsets->fileOffset, &pOffsets->header, sizeof(pOffsets->header)) ||
+                pOffsets->header.packet_id != pEntries[i].packet_id || pOffsets->header.size < sizeof(pOffsets->header) ||
+                pOffsets->header.size > pCache->fileSize - pOffsets->fileOffset) {
+                break;
+            }
+            pOffsets->header.pBody = 0;
+            pTraceFileInfo->packetCount++;
+        }
+        if (pTraceFileInfo->packetCount != pPacketIndex->packet_count) {
+            vktrace_LogWarning("Packet index in the trace file doesn't match its packets, ignoring it.");
+            VKTRACE_DELETE(pTraceFileInfo->pPacketOffsets);
+            pTraceFileInfo->pPacketOffsets = NULL;
+            pTraceFileInfo->packetCount = 0;
+        }
+        vktrace_free(pPacketIndex);
+    }
+    if (pTraceFileInfo->pPacketOffsets != NULL) {
+        return TRUE;
     }
 
+    // "Walk" through each packet based on the packet size, keeping only the offset and a copy of the header.
+    uint64_t capacity = 1024;
+    pTraceFileInfo->pPacketOffsets = VKTRACE_NEW_ARRAY(vktraceviewer_trace_file_packet_offsets, capacity);
     uint64_t fileOffset = pTraceFileInfo->pHeader->first_packet_offset;
-    uint64_t packetSize = 0;
-    while (1 == fread(&packetSize, sizeof(uint64_t), 1, pTraceFileInfo->pFile)) {
-        // success!
-        pTraceFileInfo->packetCount++;
-        fileOffset += packetSize;
+    vktrace_trace_packet_header packetHeader;
+    while (read_trace_file(pTraceFileInfo, fileOffset, &packetHeader, sizeof(packetHeader))) {
+        if (packetHeader.size < sizeof(packetHeader) || packetHeader.size > pCache->fileSize - fileOffset) {
+            // a truncated trace ends with a partially written packet
+            break;
+        }
 
-        Fseek(pTraceFileInfo->pFile, fileOffset, SEEK_SET);
+        if (pTraceFileInfo->packetCount == capacity) {
+            capacity *= 2;
+            pTraceFileInfo->pPacketOffsets = (vktraceviewer_trace_file_packet_offsets*)VKTRACE_REALLOC(
+                pTraceFileInfo->pPacketOffsets, sizeof(vktraceviewer_trace_file_packet_offsets) * capacity);
+        }
+
+        vktraceviewer_trace_file_packet_offsets* pOffsets = &pTraceFileInfo->pPacketOffsets[pTraceFileInfo->packetCount++];
+        pOffsets->fileOffset = fileOffset;
+        pOffsets->header = packetHeader;
+        pOffsets->header.pBody = 0;
+        fileOffset += packetHeader.size;
     }
 
-    if (pTraceFileInfo->packetCount == 0) {
-        if (ferror(pTraceFileInfo->pFile) != 0) {
-            perror("File Read error:");
-            vktraceviewer_output_warning("There was an error reading the trace file.");
-            vktrace_free(pTraceFileInfo->pHeader);
-            return FALSE;
-        } else if (feof(pTraceFileInfo->pFile) != 0) {
-            vktraceviewer_output_warning("Reached the end of the file.");
+    if (pTraceFileInfo->packetCount > 0) {
+        // If the last packet is the portability table, remove it
+        if (pTraceFileInfo->pPacketOffsets[pTraceFileInfo->packetCount - 1].header.packet_id == VKTRACE_TPI_PORTABILITY_TABLE) {
+            pTraceFileInfo->packetCount--;
         }
-        vktraceviewer_output_warning("There are no trace packets in this trace file.");
-        pTraceFileInfo->pPacketOffsets = NULL;
-    } else {
-        pTraceFileInfo->pPacketOffsets = VKTRACE_NEW_ARRAY(vktraceviewer_trace_file_packet_offsets, pTraceFileInfo->packetCount);
+    } else if (ferror(pTraceFileInfo->pFile) != 0) {
+        errorMessage = "There was an error reading the trace file.";
+        return FALSE;
+    }
 
-        // rewind to first packet and this time, populate the packet offsets
-        if (Fseek(pTraceFileInfo->pFile, first_offset, SEEK_SET) != 0) {
-            vktraceviewer_output_error("Unable to rewind trace file to gather packet offsets.");
-            vktrace_free(pTraceFileInfo->pHeader);
-            return FALSE;
+    return TRUE;
+}
+
+void vktraceviewer_free_trace_file_info(vktraceviewer_trace_file_info* pTraceFileInfo) {
+    vktraceviewer_trace_packet_cache* pCache = pTraceFileInfo->pPacketCache;
+    if (pCache != NULL) {
+        for (auto& entry : pCache->packets) {
+            vktrace_free(entry.second.pPacket);
         }
+        unmap_trace_file(pCache);
+        vktrace_CompressedFileReader_destroy(&pCache->pCompressedReader);
+        delete pCache;
+        pTraceFileInfo->pPacketCache = NULL;
+    }
 
-        unsigned int packetIndex = 0;
-        fileOffset = first_offset;
-        while (1 == fread(&packetSize, sizeof(uint64_t), 1, pTraceFileInfo->pFile)) {
-            // the fread confirms that this packet exists
-            // NOTE: We do not actually read the entire packet into memory right now.
-            pTraceFileInfo->pPacketOffsets[packetIndex].fileOffset = fileOffset;
-
-            // rewind slightly
-            Fseek(pTraceFileInfo->pFile, -1 * (long)sizeof(uint64_t), SEEK_CUR);
-
-            // allocate space for the packet and read it in
-            pTraceFileInfo->pPacketOffsets[packetIndex].pHeader = (vktrace_trace_packet_header*)vktrace_malloc(packetSize);
-            if (1 != fread(pTraceFileInfo->pPacketOffsets[packetIndex].pHeader, packetSize, 1, pTraceFileInfo->pFile)) {
-                vktraceviewer_output_error("Unable to read in a trace packet.");
-                vktrace_free(pTraceFileInfo->pHeader);
-                return FALSE;
-            }
+    if (pTraceFileInfo->pPacketOffsets != NULL) {
+        VKTRACE_DELETE(pTraceFileInfo->pPacketOffsets);
+        pTraceFileInfo->pPacketOffsets = NULL;
+    }
+    pTraceFileInfo->packetCount = 0;
 
-            // adjust pointer to body of the packet
-            pTraceFileInfo->pPacketOffsets[packetIndex].pHeader->pBody =
-                (uintptr_t)pTraceFileInfo->pPacketOffsets[packetIndex].pHeader + sizeof(vktrace_trace_packet_header);
+    if (pTraceFileInfo->pHeader != NULL) {
+        vktrace_free(pTraceFileInfo->pHeader);
+        pTraceFileInfo->pHeader = NULL;
+        pTraceFileInfo->pGpuinfo = NULL;
+    }
 
-            // now seek to what should be the next packet
-            fileOffset += packetSize;
-            packetIndex++;
+    if (pTraceFileInfo->pFile != NULL) {
+        fclose(pTraceFileInfo->pFile);
+        pTraceFileInfo->pFile = NULL;
+    }
+}
+
+void vktraceviewer_set_trace_packet_controller(vktraceviewer_trace_file_info* pTraceFileInfo,
+                                               vktraceviewer_QController* pController) {
+    if (pTraceFileInfo->pPacketCache != NULL) {
+        QMutexLocker locker(&pTraceFileInfo->pPacketCache->mutex);
+        pTraceFileInfo->pPacketCache->pController = pController;
+    }
+}
+
+vktrace_trace_packet_header* vktraceviewer_acquire_trace_packet(vktraceviewer_trace_file_info* pTraceFileInfo,
+                                                                uint64_t packetIndex) {
+    vktraceviewer_trace_packet_cache* pCache = pTraceFileInfo->pPacketCache;
+    if (pCache == NULL || packetIndex >= pTraceFileInfo->packetCount) {
+        return NULL;
+    }
+
+    QMutexLocker locker(&pCache->mutex);
+    auto cached = pCache->packets.find(packetIndex);
+    if (cached != pCache->packets.end()) {
+        if (cached->second.refCount++ == 0) {
+            pCache->lru.erase(cached->second.lruPosition);
+            pCache->unusedBytes -= cached->second.pPacket->size;
         }
+        return cached->second.pPacket;
+    }
 
-        if (Fseek(pTraceFileInfo->pFile, first_offset, SEEK_SET) != 0) {
-            vktraceviewer_output_error("Unable to rewind trace file to restore position.");
-            vktrace_free(pTraceFileInfo->pHeader);
-            return FALSE;
+    const vktraceviewer_trace_file_packet_offsets* pOffsets = &pTraceFileInfo->pPacketOffsets[packetIndex];
+    vktrace_trace_packet_header* pPacket = (vktrace_trace_packet_header*)vktrace_malloc((size_t)pOffsets->header.size);
+    if (pPacket == NULL || !read_trace_file(pTraceFileInfo, pOffsets->fileOffset, pPacket, pOffsets->header.size)) {
+        vktrace_free(pPacket);
+        return NULL;
+    }
+    pPacket->pBody = (uintptr_t)pPacket + sizeof(vktrace_trace_packet_header);
+
+    if (pPacket->packet_id == VKTRACE_TPI_MESSAGE) {
+        vktrace_interpret_body_as_trace_packet_message(pPacket);
+    } else if (pPacket->packet_id >= VKTRACE_TPI_VK_vkApiVersion) {
+        // API packets are interpreted in place, so the returned header is the one that was read
+        if (pCache->pController == NULL || pCache->pController->InterpretTracePacket(pPacket) == NULL) {
+            vktrace_free(pPacket);
+            return NULL;
         }
     }
 
-    return TRUE;
+    vktraceviewer_cached_packet& entry = pCache->packets[packetIndex];
+    entry.pPacket = pPacket;
+    entry.refCount = 1;
+    return pPacket;
+}
+
+void vktraceviewer_release_trace_packet(vktraceviewer_trace_file_info* pTraceFileInfo, uint64_t packetIndex) {
+    vktraceviewer_trace_packet_cache* pCache = pTraceFileInfo->pPacketCache;
+    if (pCache == NULL) {
+        return;
+    }
+
+    QMutexLocker locker(&pCache->mutex);
+    auto cached = pCache->packets.find(packetIndex);
+    if (cached == pCache->packets.end() || cached->second.refCount == 0 || --cached->second.refCount != 0) {
+        return;
+    }
+
+    pCache->lru.push_front(packetIndex);
+    cached->second.lruPosition = pCache->lru.begin();
+    pCache->unusedBytes += cached->second.pPacket->size;
+
+    // evict the least recently released packets once the unused ones exceed the cache size
+    while (pCache->unusedBytes > VKTRACEVIEWER_PACKET_CACHE_SIZE) {
+        auto evicted = pCache->packets.find(pCache->lru.back());
+        pCache->unusedBytes -= evicted->second.pPacket->size;
+        vktrace_free(evicted->second.pPacket);
+        pCache->packets.erase(evicted);
+        pCache->lru.pop_back();
+    }
 }
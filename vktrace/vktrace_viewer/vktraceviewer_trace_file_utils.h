@@ -29,19 +29,25 @@ extern "C" {
 }
 #include "vktraceviewer_output.h"
 
+class vktraceviewer_QController;
+struct vktraceviewer_trace_packet_cache;
+
+// Upper bound on the memory held by interpreted packets that are not currently in use.
+#define VKTRACEVIEWER_PACKET_CACHE_SIZE (256 * 1024 * 1024)
+
 struct vktraceviewer_trace_file_packet_offsets {
     // the file offset to this particular packet
-    unsigned int fileOffset;
+    uint64_t fileOffset;
 
-    // Pointer to the packet header if it's been read from disk
-    vktrace_trace_packet_header* pHeader;
+    // Copy of the packet header; pBody is not valid, use vktraceviewer_acquire_trace_packet() to read the body
+    vktrace_trace_packet_header header;
 };
 
 struct vktraceviewer_trace_file_info {
     // the trace file name & path
     char* filename;
 
-    // the trace file
+    // the trace file, kept open so packets can be read on demand
     FILE* pFile;
 
     // trace file header
@@ -53,8 +59,25 @@ struct vktraceviewer_trace_file_info {
 
     // array of packet offsets
     vktraceviewer_trace_file_packet_offsets* pPacketOffsets;
+
+    // mapping of the trace file and the interpreted packets read from it
+    vktraceviewer_trace_packet_cache* pPacketCache;
 };
 
-BOOL vktraceviewer_populate_trace_file_info(vktraceviewer_trace_file_info* pTraceFileInfo);
+// Reads the trace file header and the header of every packet; packet bodies are left on disk.
+BOOL vktraceviewer_populate_trace_file_info(vktraceviewer_trace_file_info* pTraceFileInfo, QString& errorMessage);
+
+// Frees everything populated above and closes the trace file. The filename is left to the caller.
+void vktraceviewer_free_trace_file_info(vktraceviewer_trace_file_info* pTraceFileInfo);
+
+// Sets the controller used to interpret API packets when they are read.
+void vktraceviewer_set_trace_packet_controller(vktraceviewer_trace_file_info* pTraceFileInfo,
+                                               vktraceviewer_QController* pController);
+
+// Returns the interpreted packet at packetIndex, or NULL if it can't be read or interpreted.
+// The packet stays valid until the matching vktraceviewer_release_trace_packet() call.
+vktrace_trace_packet_header* vktraceviewer_acquire_trace_packet(vktraceviewer_trace_file_info* pTraceFileInfo,
+                                                                uint64_t packetIndex);
+void vktraceviewer_release_trace_packet(vktraceviewer_trace_file_info* pTraceFileInfo, uint64_t packetIndex);
 
 #endif  // VKTRACEVIEWER_TRACE_FILE_UTILS_H_
@@ -85,6 +85,7 @@ bool vktraceviewer_vk_QController::LoadTraceFile(vktraceviewer_trace_file_info*
     assert(pView != NULL);
     setView(pView);
     m_pTraceFileInfo = pTraceFileInfo;
+    vktraceviewer_set_trace_packet_controller(pTraceFileInfo, this);
 
     assert(m_pReplayWidget == NULL);
     m_pReplayWidget = new vktraceviewer_QReplayWidget(&m_replayWorker);
@@ -284,6 +285,11 @@ void vktraceviewer_vk_QController::UpdateFromSettings(vktrace_SettingGroup* pGro
 }
 
 void vktraceviewer_vk_QController::UnloadTraceFile(void) {
+    if (m_pTraceFileInfo != NULL) {
+        vktraceviewer_set_trace_packet_controller(m_pTraceFileInfo, NULL);
+        m_pTraceFileInfo = NULL;
+    }
+
     if (m_pView != NULL) {
         m_pView->set_calltree_model(NULL, NULL);
         m_pView = NULL;